@@ -0,0 +1,54 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_BENCH_UTIL_H
+#define XARPD_BENCH_UTIL_H
+
+#include <time.h>
+
+// Seed of runs that do not pick one, keeps runs comparable across commits
+#define DEFAULT_SEED 0x9E3779B97F4A7C15ull
+
+/**
+ * Deterministic generator, xorshift64*
+ *
+ * @param state - generator state, never 0
+ *
+ * @return - next value
+ */
+static inline unsigned long long next_random(unsigned long long *state) {
+    unsigned long long x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+/**
+ * Monotonic time
+ *
+ * @return - nanoseconds since arbitrary point
+ */
+static inline unsigned long long now_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Current wall clock time, comparable with kernel receive timestamps
+ *
+ * @return - nanoseconds since epoch
+ */
+static inline unsigned long long wall_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#endif //XARPD_BENCH_UTIL_H
@@ -0,0 +1,202 @@
+//
+// Created by root on 18/10/26.
+//
+// Compares the blocking read() loop used by reader() against a multishot
+// io_uring receive with provided buffers. Frames travel over a datagram
+// socketpair so the benchmark runs without privileges or real interfaces.
+//
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <cstdlib>
+#include <errno.h>
+#include <chrono>
+#include "pthread.h"
+#include "../inc/uring.h"
+
+#define FRAME_SIZE 42
+#define BUFFER_SIZE 1024
+
+/*
+ * Benchmark context
+ */
+typedef struct _bench_ctx {
+    int fd;
+    unsigned long packets;
+} bench_ctx;
+
+/**
+ * Sender thread, blasts ARP sized frames into the socket
+ *
+ * @param ctx - benchmark context
+ *
+ * @return - void
+ */
+void *sender(void *ctx) {
+    auto *bc = (bench_ctx *) ctx;
+    char frame[FRAME_SIZE];
+
+    // Broadcast ARP request look-alike
+    memset(frame, 0xFF, 6);
+    memset(frame + 6, 0x02, 6);
+    frame[12] = 0x08;
+    frame[13] = 0x06;
+    memset(frame + 14, 0, FRAME_SIZE - 14);
+
+    for (unsigned long i = 0; i < bc->packets; ++i) {
+        if (send(bc->fd, frame, FRAME_SIZE, 0) < 0) {
+            perror("send()");
+            exit(errno);
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ * Starts sender on one end of a fresh socketpair
+ *
+ * @param packets - amount of frames to send
+ * @param ctx - context to fill
+ * @param thread - sender thread
+ *
+ * @return - receiving descriptor
+ */
+int start_sender(unsigned long packets, bench_ctx *ctx, pthread_t *thread) {
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) < 0) {
+        perror("socketpair()");
+        exit(errno);
+    }
+
+    ctx->fd = fds[0];
+    ctx->packets = packets;
+
+    if (pthread_create(thread, nullptr, sender, (void *) ctx)) {
+        perror("pthreads()");
+        exit(errno);
+    }
+
+    return fds[1];
+}
+
+/**
+ * Blocking read() per frame, as done by reader()
+ *
+ * @param fd - receiving descriptor
+ * @param packets - frames to receive
+ * @param syscalls - syscall counter
+ *
+ * @return - checksum of received data
+ */
+unsigned long run_read(int fd, unsigned long packets, unsigned long *syscalls) {
+    char buffer[BUFFER_SIZE + 1];
+    unsigned long sum = 0;
+
+    for (unsigned long i = 0; i < packets; ++i) {
+        long size = read(fd, buffer, BUFFER_SIZE);
+        (*syscalls)++;
+
+        if (size < 0) {
+            perror("read()");
+            exit(errno);
+        }
+
+        sum += (unsigned char) buffer[12] + size;
+    }
+
+    return sum;
+}
+
+/**
+ * Multishot receive with provided buffers, as done by uring_engine
+ *
+ * @param fd - receiving descriptor
+ * @param packets - frames to receive
+ * @param syscalls - syscall counter
+ *
+ * @return - checksum of received data
+ */
+unsigned long run_uring(int fd, unsigned long packets, unsigned long *syscalls) {
+    uring ring(256);
+    unsigned long sum = 0;
+    unsigned long received = 0;
+
+    if (!ring.setup_buffers(1, 512, 2048) || !ring.prep_recv_multishot(fd, URING_USER_DATA(URING_TAG_RECV, 0))) {
+        fprintf(stderr, "Could not arm receive\n");
+        exit(1);
+    }
+
+    while (received < packets) {
+        ring.submit(1);
+        (*syscalls)++;
+
+        io_uring_cqe *cqe;
+        while ((cqe = ring.peek_cqe()) != nullptr) {
+            int res = cqe->res;
+            unsigned int flags = cqe->flags;
+            ring.cqe_seen();
+
+            if (res > 0 && (flags & IORING_CQE_F_BUFFER)) {
+                unsigned int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+                sum += (unsigned char) ring.buffer(bid)[12] + res;
+                ring.recycle_buffer(bid);
+                received++;
+            } else if (res < 0 && res != -ENOBUFS) {
+                fprintf(stderr, "recv: %s\n", strerror(-res));
+                exit(1);
+            }
+
+            // Queue was just submitted, re-arming always finds room
+            if (!(flags & IORING_CQE_F_MORE)) {
+                ring.prep_recv_multishot(fd, URING_USER_DATA(URING_TAG_RECV, 0));
+            }
+        }
+    }
+
+    return sum;
+}
+
+/**
+ * Runs a single mode and prints a CSV row
+ *
+ * @param mode - mode name
+ * @param packets - frames to receive
+ * @param fn - receive loop
+ */
+void bench(const char *mode, unsigned long packets, unsigned long (*fn)(int, unsigned long, unsigned long *)) {
+    bench_ctx ctx{};
+    pthread_t thread;
+    unsigned long syscalls = 0;
+
+    int fd = start_sender(packets, &ctx, &thread);
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned long sum = fn(fd, packets, &syscalls);
+    auto end = std::chrono::steady_clock::now();
+
+    pthread_join(thread, nullptr);
+    close(fd);
+    close(ctx.fd);
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    printf("%s,%lu,%.6f,%.0f,%lu,%lu\n", mode, packets, seconds, packets / seconds, syscalls, sum);
+}
+
+int main(int argc, char **args) {
+    unsigned long packets = argc > 1 ? strtoul(args[1], nullptr, 10) : 1000000;
+
+    if (!uring::supported()) {
+        fprintf(stderr, "io_uring is not available\n");
+        return 1;
+    }
+
+    printf("mode,packets,seconds,pps,syscalls,checksum\n");
+    bench("read", packets, run_read);
+    bench("uring", packets, run_uring);
+
+    return 0;
+}
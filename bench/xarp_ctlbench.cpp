@@ -0,0 +1,405 @@
+//
+// Created by root on 18/10/26.
+//
+// Control protocol load tester. Opens concurrent connections to a running daemon, the same
+// way xarp does (XARPD_SOCKET or XARPD_TCP), and keeps a pipeline of requests in flight on
+// each one, drawn from a weighted command mix. Prints requests per second and latency
+// percentiles per command as CSV. Preloading a large table turns SHOW into a stress test
+// of the chunked table dump.
+//
+
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <cstdlib>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include "../inc/control_client.h"
+#include "../inc/protocol.h"
+#include "../inc/histogram.h"
+#include "../inc/utils.h"
+#include "bench_util.h"
+
+#define DEFAULT_CONNECTIONS 8
+#define DEFAULT_DEPTH 1
+#define DEFAULT_SECONDS 5
+#define DEFAULT_MIX "show=1,add=4,del=4,res=1"
+#define DEFAULT_BASE_IP "10.250.0.0"
+#define DEFAULT_KEYS 1000
+#define DEFAULT_TTL 300
+
+using namespace std;
+
+/*
+ * Commands in mix
+ */
+enum bench_command {
+    BENCH_SHOW,
+    BENCH_ADD,
+    BENCH_DEL,
+    BENCH_RES,
+    BENCH_QUERY,
+    BENCH_STATS,
+    BENCH_LATENCY,
+    BENCH_COMMANDS
+};
+
+static const char *bench_command_names[BENCH_COMMANDS] = {"show", "add", "del", "res", "query", "stats",
+                                                          "latency"};
+
+/*
+ * Load tester settings
+ */
+typedef struct _ctlbench_opts {
+    unsigned int connections;
+    unsigned int depth;         // Requests in flight per connection
+    unsigned int seconds;
+    unsigned int weights[BENCH_COMMANDS];
+    unsigned int weight_total;
+    unsigned int base_ip;
+    unsigned int keys;          // ADD, DEL and RES pick base_ip + [0, keys)
+    unsigned int preload;       // Entries added from base_ip on before the run
+    unsigned int show_limit;    // SHOW page size, 0 dumps whole table
+    unsigned int res_timeout;
+    bool keep;                  // Leave entries in table after the run
+    unsigned long long seed;
+} ctlbench_opts;
+
+/*
+ * Request awaiting its last response frame
+ */
+typedef struct _pending_request {
+    bench_command command;
+    unsigned long long start_ns;
+} pending_request;
+
+/*
+ * Connection thread context
+ */
+typedef struct _connection_ctx {
+    const ctlbench_opts *opts;
+    unsigned int index;
+    pthread_t thread;
+} connection_ctx;
+
+// Completed requests by command, and over all commands
+histogram *latency[BENCH_COMMANDS + 1];
+
+// Requests answered with DENIED or BAD_REQUEST
+atomic<unsigned long long> errors[BENCH_COMMANDS];
+
+// Entries received in SHOW responses
+atomic<unsigned long long> show_entries(0);
+
+// Set once run time is over, connections then drain their pipelines
+atomic<bool> stopping(false);
+
+/**
+ * MAC added for ip, recognizable in table dumps
+ *
+ * @param ip - ip address
+ * @param mac - MAC address
+ */
+static void key_mac(unsigned int ip, unsigned char mac[HW_ADDR_LEN]) {
+    mac[0] = 0x02;
+    mac[1] = 0xCB;
+    mac[2] = (unsigned char) (ip >> 24);
+    mac[3] = (unsigned char) (ip >> 16);
+    mac[4] = (unsigned char) (ip >> 8);
+    mac[5] = (unsigned char) ip;
+}
+
+/**
+ * Sends request of a command drawn from mix
+ *
+ * @param opts - settings
+ * @param client - connection
+ * @param state - generator state of connection
+ * @param command - set to drawn command
+ *
+ * @return - request id
+ */
+static unsigned int issue(const ctlbench_opts *opts, control_client *client, unsigned long long *state,
+                          bench_command *command) {
+    command_hdr cmd{};
+    unsigned int pick = (unsigned int) (next_random(state) % opts->weight_total);
+    unsigned int ip = opts->base_ip + (unsigned int) (next_random(state) % opts->keys);
+
+    int c = 0;
+    while (pick >= opts->weights[c]) pick -= opts->weights[c++];
+    *command = (bench_command) c;
+
+    if (c == BENCH_SHOW) {
+        cmd.type = COMMAND_SHOW;
+        cmd.limit = opts->show_limit;
+    } else if (c == BENCH_ADD) {
+        cmd.type = COMMAND_ADD;
+        cmd.ip = ip;
+        cmd.ttl = DEFAULT_TTL;
+        key_mac(ip, cmd.eth);
+    } else if (c == BENCH_DEL) {
+        cmd.type = COMMAND_DEL;
+        cmd.ip = ip;
+    } else if (c == BENCH_RES) {
+        cmd.type = COMMAND_RES;
+        cmd.ip = ip;
+        cmd.timeout = opts->res_timeout;
+    } else if (c == BENCH_QUERY) {
+        // Filter runs over whole table, matches only the key space
+        cmd.type = COMMAND_QUERY;
+        cmd.ip = opts->base_ip;
+        cmd.ip_prefix = 16;
+        cmd.ttl_max = ARP_TTL_PERMANENT;
+    } else if (c == BENCH_STATS) {
+        cmd.type = COMMAND_STATS;
+    } else {
+        cmd.type = COMMAND_LATENCY;
+    }
+
+    return client->request(&cmd);
+}
+
+/**
+ * Keeps depth requests in flight until stopped, then waits for the outstanding ones
+ *
+ * @param ctx - connection_ctx
+ */
+void *run_connection(void *ctx) {
+    auto *conn = (connection_ctx *) ctx;
+    const ctlbench_opts *opts = conn->opts;
+    unsigned long long state = opts->seed + conn->index * 0x9E3779B97F4A7C15ull;
+    unordered_map<unsigned int, pending_request> pending;
+    control_client client;
+    frame_hdr hdr{};
+    string payload;
+
+    if (state == 0) state = DEFAULT_SEED;
+
+    while (true) {
+        while (!stopping.load(memory_order_relaxed) && pending.size() < opts->depth) {
+            pending_request req{};
+            req.start_ns = now_ns();
+            unsigned int id = issue(opts, &client, &state, &req.command);
+            pending[id] = req;
+        }
+        if (pending.empty()) break;
+
+        if (!client.receive(&hdr, payload)) {
+            fprintf(stderr, "Connection %u closed by daemon\n", conn->index);
+            break;
+        }
+
+        auto it = pending.find(hdr.request_id);
+        if (it == pending.end()) continue;
+
+        bench_command command = it->second.command;
+        if (hdr.type == COMMAND_DENIED || hdr.type == COMMAND_BAD_REQUEST) {
+            errors[command].fetch_add(1, memory_order_relaxed);
+        } else if (command == BENCH_SHOW && payload.size() >= WIRE_SHOW_HDR_LEN) {
+            show_entries.fetch_add((payload.size() - WIRE_SHOW_HDR_LEN) / WIRE_ENTRY_LEN, memory_order_relaxed);
+        }
+
+        // Multi-frame responses complete with their last frame
+        if (hdr.flags & FRAME_FLAG_MORE) continue;
+
+        unsigned long long took = now_ns() - it->second.start_ns;
+        latency[command]->record(took);
+        latency[BENCH_COMMANDS]->record(took);
+        pending.erase(it);
+    }
+
+    return nullptr;
+}
+
+/**
+ * Adds or removes entries base_ip + [0, count) with pipelined batches
+ *
+ * @param opts - settings
+ * @param count - entries
+ * @param remove - delete instead of add
+ *
+ * @return - entries changed
+ */
+static unsigned long long batch_entries(const ctlbench_opts *opts, unsigned int count, bool remove) {
+    vector<unsigned char> batch(WIRE_COMMAND_MAX);
+    control_client client;
+    command_hdr cmd{};
+    frame_hdr hdr{};
+    string payload;
+    unsigned long long applied = 0;
+    unsigned int pending = 0;
+
+    cmd.type = remove ? COMMAND_DEL_BATCH : COMMAND_ADD_BATCH;
+    cmd.items = batch.data();
+
+    for (unsigned int i = 0; i < count; ++i) {
+        unsigned int ip = opts->base_ip + i;
+
+        if (remove) {
+            encode_batch_ip(batch.data() + WIRE_BATCH_IP_LEN * cmd.item_count, ip);
+        } else {
+            arp_table_entry ent{};
+            ent.ipAddress = ip;
+            ent.ttl = ARP_TTL_PERMANENT;
+            key_mac(ip, ent.ethAddress);
+            encode_entry(batch.data() + WIRE_ENTRY_LEN * cmd.item_count, &ent);
+        }
+        cmd.item_count++;
+
+        if (cmd.item_count == BATCH_MAX_ENTRIES || i + 1 == count) {
+            client.request(&cmd);
+            cmd.item_count = 0;
+            pending++;
+        }
+    }
+
+    while (pending > 0 && client.receive(&hdr, payload)) {
+        pending--;
+
+        if (hdr.type == cmd.type && payload.size() == WIRE_BATCH_DONE_LEN) {
+            applied += decode_batch_done((const unsigned char *) payload.data());
+        } else if (hdr.type == COMMAND_DENIED) {
+            fprintf(stderr, "Permission denied\n");
+            break;
+        }
+    }
+
+    return applied;
+}
+
+/**
+ * Parses command mix "name=weight,..."
+ *
+ * @param spec - mix
+ * @param opts - settings receiving weights
+ *
+ * @return - false on unknown command or all weights 0
+ */
+static bool parse_mix(const char *spec, ctlbench_opts *opts) {
+    memset(opts->weights, 0, sizeof(opts->weights));
+    opts->weight_total = 0;
+
+    while (*spec != '\0') {
+        const char *eq = strchr(spec, '=');
+        if (eq == nullptr) return false;
+
+        int c = 0;
+        while (c < BENCH_COMMANDS && (strlen(bench_command_names[c]) != (size_t) (eq - spec) ||
+                                      strncmp(spec, bench_command_names[c], eq - spec) != 0)) c++;
+        if (c == BENCH_COMMANDS) return false;
+
+        char *end;
+        opts->weights[c] = (unsigned int) strtoul(eq + 1, &end, 10);
+        opts->weight_total += opts->weights[c];
+        if (*end != ',' && *end != '\0') return false;
+        spec = *end == ',' ? end + 1 : end;
+    }
+
+    return opts->weight_total > 0;
+}
+
+int main(int argc, char **args) {
+    ctlbench_opts opts{};
+    opts.connections = DEFAULT_CONNECTIONS;
+    opts.depth = DEFAULT_DEPTH;
+    opts.seconds = DEFAULT_SECONDS;
+    opts.base_ip = parse_ip_addr(DEFAULT_BASE_IP);
+    opts.keys = DEFAULT_KEYS;
+    opts.seed = DEFAULT_SEED;
+    parse_mix(DEFAULT_MIX, &opts);
+
+    int opt;
+    while ((opt = getopt(argc, args, "c:q:d:m:t:n:P:l:T:kS:")) != -1) {
+        if (opt == 'c' && strtoul(optarg, nullptr, 10) > 0) {
+            opts.connections = (unsigned int) strtoul(optarg, nullptr, 10);
+        } else if (opt == 'q' && strtoul(optarg, nullptr, 10) > 0) {
+            opts.depth = (unsigned int) strtoul(optarg, nullptr, 10);
+        } else if (opt == 'd' && strtoul(optarg, nullptr, 10) > 0) {
+            opts.seconds = (unsigned int) strtoul(optarg, nullptr, 10);
+        } else if (opt == 'm' && parse_mix(optarg, &opts)) {
+            continue;
+        } else if (opt == 't' && parse_ip_addr(optarg) != 0) {
+            opts.base_ip = parse_ip_addr(optarg);
+        } else if (opt == 'n' && strtoul(optarg, nullptr, 10) > 0) {
+            opts.keys = (unsigned int) strtoul(optarg, nullptr, 10);
+        } else if (opt == 'P') {
+            opts.preload = (unsigned int) strtoul(optarg, nullptr, 10);
+        } else if (opt == 'l') {
+            opts.show_limit = (unsigned int) strtoul(optarg, nullptr, 10);
+        } else if (opt == 'T') {
+            opts.res_timeout = (unsigned int) strtoul(optarg, nullptr, 10);
+        } else if (opt == 'k') {
+            opts.keep = true;
+        } else if (opt == 'S' && strtoull(optarg, nullptr, 0) > 0) {
+            opts.seed = strtoull(optarg, nullptr, 0);
+        } else {
+            fprintf(stderr, "Usage: %s [-c connections] [-q depth] [-d seconds] [-m cmd=weight,...] "
+                            "[-t first_ip] [-n keys] [-P preload] [-l show_limit] [-T res_timeout_ms] [-k] "
+                            "[-S seed]\n"
+                            "Commands: show add del res query stats latency. "
+                            "Keys and preloaded entries start at first_ip and are removed afterwards "
+                            "unless -k is given.\n", args[0]);
+            return 1;
+        }
+    }
+
+    for (auto &h : latency) h = new histogram();
+    for (auto &e : errors) e.store(0, memory_order_relaxed);
+
+    // Large tables make SHOW stream many frames
+    if (opts.preload > 0) {
+        unsigned long long start = now_ns();
+        unsigned long long added = batch_entries(&opts, opts.preload, false);
+        fprintf(stderr, "Preloaded %llu entries in %.2f s\n", added, (double) (now_ns() - start) / 1e9);
+    }
+
+    vector<connection_ctx> conns(opts.connections);
+    unsigned long long start = now_ns();
+    for (unsigned int i = 0; i < opts.connections; ++i) {
+        conns[i].opts = &opts;
+        conns[i].index = i;
+        if (pthread_create(&conns[i].thread, nullptr, run_connection, &conns[i])) {
+            perror("pthreads()");
+            exit(errno);
+        }
+    }
+
+    sleep(opts.seconds);
+    stopping.store(true);
+    for (auto &conn : conns) pthread_join(conn.thread, nullptr);
+    double seconds = (double) (now_ns() - start) / 1e9;
+
+    // Latency columns are microseconds from request sent to last response frame
+    printf("command,requests,errors,rps,mean_us,p50_us,p90_us,p99_us,p999_us,max_us\n");
+    for (int c = 0; c <= BENCH_COMMANDS; ++c) {
+        latency_summary s{};
+        latency[c]->summarize(&s);
+        if (s.count == 0) continue;
+
+        unsigned long long errs = 0;
+        if (c < BENCH_COMMANDS) {
+            errs = errors[c].load();
+        } else {
+            for (auto &e : errors) errs += e.load();
+        }
+
+        printf("%s,%llu,%llu,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+               c < BENCH_COMMANDS ? bench_command_names[c] : "all", s.count, errs, s.count / seconds,
+               s.mean / 1e3, s.p50 / 1e3, s.p90 / 1e3, s.p99 / 1e3, s.p999 / 1e3, s.max / 1e3);
+    }
+    if (show_entries.load() > 0) {
+        printf("# show streamed %llu entries, %.0f entries/s\n", show_entries.load(), show_entries.load() / seconds);
+    }
+
+    if (!opts.keep) {
+        unsigned int span = opts.preload > opts.keys ? opts.preload : opts.keys;
+        batch_entries(&opts, span, true);
+    }
+
+    return 0;
+}
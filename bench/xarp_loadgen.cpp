@@ -0,0 +1,526 @@
+//
+// Created by root on 18/10/26.
+//
+// ARP request load generator. Sends request storms at a stepped target rate, either on a
+// live interface (e.g. one end of a veth pair whose other end xarpd serves) or into an
+// in-process worker through the memory backend, and matches replies to measure loss and
+// latency. The first rate the daemon cannot sustain is reported as saturation point.
+// Targets are synthesized with a uniform or Zipfian distribution, or replayed from a pcap.
+//
+
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <cstdlib>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <arpa/inet.h>
+#include "../inc/arp_table.h"
+#include "../inc/interface_worker.h"
+#include "../inc/utils.h"
+#include "../inc/logger.h"
+#include "../inc/histogram.h"
+#include "../inc/packet_io.h"
+#include "../inc/pcap_io.h"
+#include "../inc/memory_io.h"
+#include "bench_util.h"
+
+#define DEFAULT_TARGETS 1000
+#define DEFAULT_BASE_IP "10.0.0.1"
+#define DEFAULT_RATES "10000:100000:10000"
+#define DEFAULT_STEP_MS 2000
+#define DEFAULT_LOSS_PCT 1.0
+#define DEFAULT_WRITE_COUNT 1000000
+
+// Target indexes drawn before sending, cycled by sender
+#define TARGET_POOL (1 << 20)
+
+// Requests in flight that can be told apart, sequence travels in sender MAC
+#define SEQ_BITS 20
+#define SEQ_RING (1 << SEQ_BITS)
+
+// Time outstanding replies get after each step
+#define DRAIN_MS 200
+
+// Sender address of in-process worker and of synthesized requests there
+#define INPROC_SENDER_IP 0x0A0000FEu
+
+using namespace std;
+
+// Locally administered prefix of sender MACs, low three bytes carry the sequence
+static const unsigned char loadgen_oui[3] = {0x02, 0x58, 0x4C};
+
+/*
+ * Load generator settings
+ */
+typedef struct _loadgen_opts {
+    const char *ifname;         // Live interface, nullptr for in-process worker
+    const char *replay_path;    // Requests replayed instead of synthesized
+    const char *write_path;     // Requests written to pcap instead of sent
+    unsigned int base_ip;
+    unsigned int targets;
+    double zipf;                // Exponent, 0 for uniform
+    vector<unsigned long long> rates;
+    unsigned int step_ms;
+    double loss_pct;
+    unsigned long long write_count;
+    unsigned long long seed;
+} loadgen_opts;
+
+/*
+ * State shared by sender and reply matching
+ */
+typedef struct _loadgen_state {
+    unique_ptr<atomic<unsigned long long>[]> sent_ns;   // Send time by sequence, 0 once answered
+    atomic<unsigned long long> replies;
+    atomic<unsigned long long> unmatched;
+    atomic<histogram *> latency;
+    histogram *retired;                                 // Swapped out last step, receiver may still hold it
+    atomic<bool> done;
+    packet_io *live;
+    memory_io *inproc;
+} loadgen_state;
+
+/*
+ * Result of one rate step
+ */
+typedef struct _step_result {
+    unsigned long long offered;
+    unsigned long long sent;
+    unsigned long long replies;
+    double seconds;
+    latency_summary latency;
+} step_result;
+
+/**
+ * Draws target indexes, rank i of a Zipfian distribution is target i
+ *
+ * @param opts - settings
+ * @param pool - drawn indexes
+ */
+static void draw_targets(const loadgen_opts *opts, vector<unsigned int> *pool) {
+    unsigned long long state = opts->seed;
+    pool->resize(TARGET_POOL);
+
+    if (opts->zipf <= 0) {
+        for (auto &t : *pool) t = (unsigned int) (next_random(&state) % opts->targets);
+        return;
+    }
+
+    // Cumulative weights 1/(rank+1)^s, sampled by binary search
+    vector<double> cdf(opts->targets);
+    double total = 0;
+    for (unsigned int i = 0; i < opts->targets; ++i) {
+        total += 1.0 / pow((double) i + 1, opts->zipf);
+        cdf[i] = total;
+    }
+    for (auto &t : *pool) {
+        double u = (double) (next_random(&state) >> 11) / (double) (1ull << 53) * total;
+        t = (unsigned int) (lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+        if (t >= opts->targets) t = opts->targets - 1;
+    }
+}
+
+/**
+ * Loads ARP requests of a pcap file
+ *
+ * @param path - pcap file
+ * @param frames - requests, ARP_FRAME_LEN bytes each
+ *
+ * @return - false if file cannot be read or holds no request
+ */
+static bool load_requests(const char *path, vector<char> *frames) {
+    unsigned char mac[HW_ADDR_LEN] = {0};
+    pcap_replay_io replay(path, mac, 0, 0);
+    iface ifn{};
+    char buffer[PACKET_IO_FRAME_MAX];
+    unsigned long long rx_ns;
+    ssize_t length;
+
+    if (!replay.open("replay", &ifn)) return false;
+
+    while ((length = replay.receive(buffer, sizeof(buffer), &rx_ns)) > 0) {
+        arp_hdr arp{};
+        if (parse_arp_frame(buffer, (unsigned int) length, &arp) && ntohs(arp.opcode) == ARP_REQUEST) {
+            frames->insert(frames->end(), buffer, buffer + ARP_FRAME_LEN);
+        }
+    }
+
+    if (frames->empty()) fprintf(stderr, "%s: no ARP requests\n", path);
+    return !frames->empty();
+}
+
+/**
+ * Matches reply to its request by sequence in target MAC and records latency
+ *
+ * @param st - shared state
+ * @param frame - frame
+ * @param length - frame length
+ * @param rx_ns - receive time
+ */
+static void on_frame(loadgen_state *st, const char *frame, unsigned int length, unsigned long long rx_ns) {
+    arp_hdr arp{};
+
+    if (!parse_arp_frame(frame, length, &arp) || ntohs(arp.opcode) != ARP_REPLY) return;
+    if (memcmp(arp.destination_mac, loadgen_oui, sizeof(loadgen_oui)) != 0) return;
+
+    unsigned int seq = ((unsigned int) arp.destination_mac[3] << 16 | (unsigned int) arp.destination_mac[4] << 8 |
+                        arp.destination_mac[5]) & (SEQ_RING - 1);
+    unsigned long long sent = st->sent_ns[seq].exchange(0, memory_order_relaxed);
+    if (sent == 0) {
+        // Duplicate, or request overwritten after SEQ_RING newer ones
+        st->unmatched.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    st->replies.fetch_add(1, memory_order_relaxed);
+    st->latency.load(memory_order_acquire)->record(rx_ns > sent ? rx_ns - sent : 0);
+}
+
+/**
+ * Receives replies on live interface until done
+ *
+ * @param ctx - loadgen_state
+ */
+void *receive_replies(void *ctx) {
+    auto *st = (loadgen_state *) ctx;
+    char buffer[PACKET_IO_FRAME_MAX];
+    unsigned long long rx_ns;
+
+    while (!st->done.load(memory_order_relaxed)) {
+        ssize_t length = st->live->receive(buffer, sizeof(buffer), &rx_ns);
+        if (length <= 0) continue;
+
+        on_frame(st, buffer, (unsigned int) length, rx_ns != 0 ? rx_ns : wall_ns());
+    }
+
+    return nullptr;
+}
+
+/**
+ * Writes request with sequence and target into frame
+ *
+ * @param frame - ARP_FRAME_LEN bytes, replayed request or synthesized here
+ * @param replayed - keep target and sender IP of frame
+ * @param seq - sequence
+ * @param sender_ip - sender address, host order
+ * @param target_ip - target address, host order
+ */
+static void stamp_request(char *frame, bool replayed, unsigned long long seq, unsigned int sender_ip,
+                          unsigned int target_ip) {
+    unsigned char mac[HW_ADDR_LEN] = {loadgen_oui[0], loadgen_oui[1], loadgen_oui[2], (unsigned char) (seq >> 16),
+                                      (unsigned char) (seq >> 8), (unsigned char) seq};
+
+    if (replayed) {
+        // Ethernet source and sender MAC
+        memcpy(frame + 6, mac, HW_ADDR_LEN);
+        memcpy(frame + 22, mac, HW_ADDR_LEN);
+        return;
+    }
+
+    unsigned char broadcast[HW_ADDR_LEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    unsigned char zero[HW_ADDR_LEN] = {0};
+    encode_arp_frame(frame, ARP_REQUEST, broadcast, mac, sender_ip, zero, target_ip);
+}
+
+/**
+ * Sends requests at rate for one step and waits for late replies
+ *
+ * @param opts - settings
+ * @param st - shared state
+ * @param rate - requests per second, 0 sends as fast as backend takes them
+ * @param pool - target indexes
+ * @param replay - replayed requests, empty when synthesizing
+ * @param sender_ip - sender address, host order
+ * @param seq - sequence, continued across steps
+ * @param out - result
+ */
+static void run_step(const loadgen_opts *opts, loadgen_state *st, unsigned long long rate,
+                     const vector<unsigned int> &pool, const vector<char> &replay, unsigned int sender_ip,
+                     unsigned long long *seq, step_result *out) {
+    auto *latency = new histogram();
+    histogram *previous = st->latency.exchange(latency, memory_order_acq_rel);
+
+    // Receiver may have loaded previous just before the exchange, free the one retired a whole step ago
+    delete st->retired;
+    st->retired = previous;
+    unsigned long long replies_before = st->replies.load(memory_order_relaxed);
+    unsigned long long step_ns = (unsigned long long) opts->step_ms * 1000000ull;
+    size_t replay_count = replay.size() / ARP_FRAME_LEN;
+    char frame[ARP_FRAME_LEN];
+    unsigned long long sent = 0;
+
+    unsigned long long start = wall_ns();
+    unsigned long long now = start;
+    while (now - start < step_ns) {
+        // Next request is due at a fixed offset from start, so a late sender catches up
+        if (rate > 0) {
+            unsigned long long due = start + sent * 1000000000ull / rate;
+            while (now < due) {
+                if (due - now > 100000) usleep((useconds_t) ((due - now) / 2000));
+                now = wall_ns();
+            }
+        }
+
+        if (replay_count > 0) {
+            memcpy(frame, &replay[(sent % replay_count) * ARP_FRAME_LEN], ARP_FRAME_LEN);
+            stamp_request(frame, true, *seq, 0, 0);
+        } else {
+            stamp_request(frame, false, *seq, sender_ip, opts->base_ip + pool[*seq % pool.size()]);
+        }
+
+        now = wall_ns();
+        st->sent_ns[*seq & (SEQ_RING - 1)].store(now, memory_order_relaxed);
+        bool ok = st->live != nullptr ? st->live->send(frame, ARP_FRAME_LEN) : st->inproc->push(frame, ARP_FRAME_LEN);
+        if (ok) sent++;
+        (*seq)++;
+    }
+    out->seconds = (double) (wall_ns() - start) / 1e9;
+
+    // Late replies still count towards this step
+    if (st->inproc != nullptr) st->inproc->wait_idle();
+    usleep(DRAIN_MS * 1000);
+
+    out->offered = rate * opts->step_ms / 1000;
+    out->sent = sent;
+    out->replies = st->replies.load(memory_order_relaxed) - replies_before;
+    latency->summarize(&out->latency);
+}
+
+/**
+ * Writes synthesized or replayed requests to a pcap file, spaced at first rate
+ *
+ * @param opts - settings
+ * @param pool - target indexes
+ * @param replay - replayed requests, empty when synthesizing
+ * @param sender_ip - sender address, host order
+ *
+ * @return - exit status
+ */
+static int write_requests(const loadgen_opts *opts, const vector<unsigned int> &pool, const vector<char> &replay,
+                          unsigned int sender_ip) {
+    pcap_writer writer;
+    size_t replay_count = replay.size() / ARP_FRAME_LEN;
+    unsigned long long rate = opts->rates.front() > 0 ? opts->rates.front() : 1000000;
+    unsigned long long start = wall_ns();
+    char frame[ARP_FRAME_LEN];
+
+    if (!writer.open(opts->write_path)) return 1;
+
+    for (unsigned long long i = 0; i < opts->write_count; ++i) {
+        if (replay_count > 0) {
+            memcpy(frame, &replay[(i % replay_count) * ARP_FRAME_LEN], ARP_FRAME_LEN);
+            stamp_request(frame, true, i, 0, 0);
+        } else {
+            stamp_request(frame, false, i, sender_ip, opts->base_ip + pool[i % pool.size()]);
+        }
+        writer.write(frame, ARP_FRAME_LEN, start + i * 1000000000ull / rate);
+    }
+    writer.close();
+
+    printf("Wrote %llu requests to %s\n", opts->write_count, opts->write_path);
+    return 0;
+}
+
+/**
+ * Worker answering for every target through the memory backend
+ *
+ * @param opts - settings
+ * @param st - shared state, replies are matched in the worker's send path
+ */
+static void start_inproc(const loadgen_opts *opts, loadgen_state *st) {
+    static interface_worker *workers[1];
+    auto *table = new arp_table(false);
+    vector<arp_table_entry> entries(opts->targets);
+    unsigned char mac[HW_ADDR_LEN] = {0x02, 0, 0, 0, 0, 0x01};
+
+    for (unsigned int i = 0; i < opts->targets; ++i) {
+        entries[i].ipAddress = opts->base_ip + i;
+        entries[i].ttl = ARP_TTL_PERMANENT;
+        entries[i].ethAddress[0] = 0x02;
+        memcpy(entries[i].ethAddress + 2, &entries[i].ipAddress, 4);
+    }
+    table->add_batch(entries.data(), entries.size());
+
+    st->inproc = new memory_io(mac, INPROC_SENDER_IP, 0);
+    st->inproc->set_sink([st](const char *frame, unsigned int length) {
+        on_frame(st, frame, length, wall_ns());
+    });
+
+    workers[0] = new interface_worker(new string("loadgen"), table, workers, 1);
+    workers[0]->set_io(st->inproc);
+    workers[0]->bind();
+}
+
+/**
+ * Raw socket on interface, promiscuous since replies go to generated sender MACs
+ *
+ * @param ifname - interface
+ * @param st - shared state
+ * @param sender_ip - set to interface address
+ *
+ * @return - false if interface cannot be opened
+ */
+static bool start_live(const char *ifname, loadgen_state *st, unsigned int *sender_ip) {
+    auto *io = new raw_socket_io();
+    iface ifn{};
+
+    if (!io->open(ifname, &ifn)) return false;
+    *sender_ip = ifn.ip_addr;
+
+    packet_mreq mreq{};
+    mreq.mr_ifindex = ifn.index;
+    mreq.mr_type = PACKET_MR_PROMISC;
+    if (setsockopt(io->fd(), SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        perror("PACKET_ADD_MEMBERSHIP");
+    }
+
+    // Receiver wakes up to notice the end of the run
+    timeval timeout{0, 100000};
+    setsockopt(io->fd(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    st->live = io;
+    return true;
+}
+
+/**
+ * Parses rates as list "a,b,c" or range "from:to:step"
+ *
+ * @param spec - rates
+ * @param out - parsed rates
+ *
+ * @return - false on invalid rates
+ */
+static bool parse_rates(const char *spec, vector<unsigned long long> *out) {
+    unsigned long long from, to, step;
+    out->clear();
+
+    if (sscanf(spec, "%llu:%llu:%llu", &from, &to, &step) == 3) {
+        if (step == 0 || to < from) return false;
+        for (unsigned long long r = from; r <= to; r += step) out->push_back(r);
+        return true;
+    }
+
+    while (*spec != '\0') {
+        char *end;
+        out->push_back(strtoull(spec, &end, 10));
+        if (end == spec || (*end != ',' && *end != '\0')) return false;
+        spec = *end == ',' ? end + 1 : end;
+    }
+
+    return !out->empty();
+}
+
+int main(int argc, char **args) {
+    loadgen_opts opts{};
+    opts.base_ip = parse_ip_addr(DEFAULT_BASE_IP);
+    opts.targets = DEFAULT_TARGETS;
+    opts.step_ms = DEFAULT_STEP_MS;
+    opts.loss_pct = DEFAULT_LOSS_PCT;
+    opts.write_count = DEFAULT_WRITE_COUNT;
+    opts.seed = DEFAULT_SEED;
+    parse_rates(DEFAULT_RATES, &opts.rates);
+
+    int opt;
+    while ((opt = getopt(argc, args, "i:t:n:z:p:d:l:R:w:c:S:")) != -1) {
+        if (opt == 'i') {
+            opts.ifname = optarg;
+        } else if (opt == 't' && parse_ip_addr(optarg) != 0) {
+            opts.base_ip = parse_ip_addr(optarg);
+        } else if (opt == 'n' && strtoul(optarg, nullptr, 10) > 0) {
+            opts.targets = (unsigned int) strtoul(optarg, nullptr, 10);
+        } else if (opt == 'z' && strtod(optarg, nullptr) >= 0) {
+            opts.zipf = strtod(optarg, nullptr);
+        } else if (opt == 'p' && parse_rates(optarg, &opts.rates)) {
+            continue;
+        } else if (opt == 'd' && strtoul(optarg, nullptr, 10) > 0) {
+            opts.step_ms = (unsigned int) strtoul(optarg, nullptr, 10);
+        } else if (opt == 'l' && strtod(optarg, nullptr) >= 0) {
+            opts.loss_pct = strtod(optarg, nullptr);
+        } else if (opt == 'R') {
+            opts.replay_path = optarg;
+        } else if (opt == 'w') {
+            opts.write_path = optarg;
+        } else if (opt == 'c' && strtoull(optarg, nullptr, 10) > 0) {
+            opts.write_count = strtoull(optarg, nullptr, 10);
+        } else if (opt == 'S' && strtoull(optarg, nullptr, 0) > 0) {
+            opts.seed = strtoull(optarg, nullptr, 0);
+        } else {
+            fprintf(stderr, "Usage: %s [-i interface] [-t first_target] [-n targets] [-z zipf_exponent] "
+                            "[-p pps,...|from:to:step] [-d step_ms] [-l loss_pct] [-R requests.pcap] "
+                            "[-w out.pcap [-c count]] [-S seed]\n"
+                            "Without -i requests go to an in-process worker answering for every target. "
+                            "With -i the daemon on the other end must know the targets.\n", args[0]);
+            return 1;
+        }
+    }
+
+    // Worker logs table changes and sends at info level, which would be measured
+    log_set_level(LOG_LEVEL_ERROR);
+
+    vector<unsigned int> pool;
+    vector<char> replay;
+    draw_targets(&opts, &pool);
+    if (opts.replay_path != nullptr && !load_requests(opts.replay_path, &replay)) return 1;
+
+    if (opts.write_path != nullptr) return write_requests(&opts, pool, replay, INPROC_SENDER_IP);
+
+    loadgen_state st{};
+    st.sent_ns.reset(new atomic<unsigned long long>[SEQ_RING]);
+    for (unsigned int i = 0; i < SEQ_RING; ++i) st.sent_ns[i].store(0, memory_order_relaxed);
+    st.latency.store(new histogram(), memory_order_relaxed);
+
+    pthread_t receiver{};
+    unsigned int sender_ip = INPROC_SENDER_IP;
+    if (opts.ifname != nullptr) {
+        if (!start_live(opts.ifname, &st, &sender_ip)) return 1;
+        pthread_create(&receiver, nullptr, receive_replies, &st);
+    } else {
+        start_inproc(&opts, &st);
+    }
+
+    // Latency columns are microseconds from send to reply
+    printf("offered_pps,sent_pps,reply_pps,sent,replies,loss_pct,p50_us,p90_us,p99_us,p999_us,max_us\n");
+
+    unsigned long long seq = 0;
+    unsigned long long sustained = 0;
+    unsigned long long saturated = 0;
+    for (unsigned long long rate : opts.rates) {
+        step_result r{};
+        run_step(&opts, &st, rate, pool, replay, sender_ip, &seq, &r);
+
+        double loss = r.sent > 0 ? 100.0 * (double) (r.sent - min(r.sent, r.replies)) / (double) r.sent : 0;
+        printf("%llu,%.0f,%.0f,%llu,%llu,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f\n", rate, r.sent / r.seconds,
+               r.replies / r.seconds, r.sent, r.replies, loss, r.latency.p50 / 1e3, r.latency.p90 / 1e3,
+               r.latency.p99 / 1e3, r.latency.p999 / 1e3, r.latency.max / 1e3);
+        fflush(stdout);
+
+        // A step holds when sender kept pace and replies stayed within allowed loss
+        bool kept_pace = rate == 0 || (double) r.sent >= 0.99 * (double) r.offered;
+        if (kept_pace && loss <= opts.loss_pct) {
+            sustained = max(sustained, (unsigned long long) (r.replies / r.seconds));
+        } else if (saturated == 0) {
+            saturated = rate > 0 ? rate : (unsigned long long) (r.sent / r.seconds);
+        }
+    }
+
+    if (saturated > 0) {
+        printf("# saturated at %llu pps offered, highest sustained reply rate %llu pps\n", saturated, sustained);
+    } else {
+        printf("# not saturated, highest sustained reply rate %llu pps\n", sustained);
+    }
+    if (st.unmatched.load() > 0) printf("# %llu unmatched replies\n", st.unmatched.load());
+
+    st.done.store(true);
+    if (opts.ifname != nullptr) pthread_join(receiver, nullptr);
+
+    return 0;
+}
@@ -0,0 +1,537 @@
+//
+// Created by root on 18/10/26.
+//
+// Microbenchmarks of the ARP table, frame parsing and serialization and interface
+// routing, and end-to-end request handling through an in-memory backend. Keys come
+// from a fixed seed and every case is repeated, so runs on the same machine are
+// comparable across commits. Results are printed as CSV, one row per case
+// and table size. Numbers are only meaningful with -DCMAKE_BUILD_TYPE=Release.
+//
+
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <arpa/inet.h>
+#include "../inc/arp_table.h"
+#include "../inc/interface_worker.h"
+#include "../inc/utils.h"
+#include "../inc/logger.h"
+#include "../inc/memory_io.h"
+#include "bench_util.h"
+
+#define DEFAULT_SIZES "1000,10000,100000,1000000,10000000"
+#define DEFAULT_OPS 1000000
+#define DEFAULT_REPEATS 5
+
+// Distinct frames cycled through by parse and serialize cases
+#define FRAME_POOL 1024
+
+using namespace std;
+
+/*
+ * Benchmark settings
+ */
+typedef struct _bench_opts {
+    vector<size_t> sizes;
+    size_t ops;
+    unsigned int repeats;
+    unsigned long long seed;
+    const char *filter;
+} bench_opts;
+
+// Defeats dead code elimination of measured loops
+static volatile unsigned long long sink;
+
+/**
+ * IP of i-th key, a bijection so keys never collide and land all over the table
+ *
+ * @param i - key index
+ *
+ * @return - ip address
+ */
+static inline unsigned int key_ip(unsigned int i) {
+    return i * 2654435761u + 0x0A000000u;
+}
+
+/**
+ * Prints one CSV row from per repetition ns/op samples
+ *
+ * @param name - case name
+ * @param size - table size, 0 where it does not apply
+ * @param ops - operations per repetition
+ * @param samples - ns per operation of each repetition
+ */
+static void report(const char *name, size_t size, size_t ops, vector<double> &samples) {
+    sort(samples.begin(), samples.end());
+    double median = samples[samples.size() / 2];
+    if (samples.size() % 2 == 0) median = (samples[samples.size() / 2 - 1] + median) / 2;
+
+    printf("%s,%zu,%zu,%zu,%.2f,%.2f,%.2f,%.3f\n", name, size, ops, samples.size(), median, samples.front(),
+           samples.back(), 1000.0 / median);
+    fflush(stdout);
+}
+
+/**
+ * Checks case against -f filter
+ *
+ * @param opts - settings
+ * @param name - case name
+ *
+ * @return - true if case should run
+ */
+static bool selected(const bench_opts *opts, const char *name) {
+    return opts->filter == nullptr || strstr(name, opts->filter) != nullptr;
+}
+
+/**
+ * Builds table of size entries, keys 0..size-1, loaded sorted like a startup config
+ *
+ * @param size - entries
+ * @param ttl - ttl of every entry
+ *
+ * @return - table without timer thread
+ */
+static arp_table *build_table(size_t size, unsigned int ttl) {
+    auto *table = new arp_table(false);
+    vector<arp_table_entry> entries(size);
+
+    for (size_t i = 0; i < size; ++i) {
+        entries[i].ipAddress = key_ip((unsigned int) i);
+        entries[i].ttl = ttl;
+        memcpy(entries[i].ethAddress, &entries[i].ipAddress, 4);
+        entries[i].ethAddress[4] = 0x02;
+        entries[i].ethAddress[5] = 0x00;
+    }
+    sort(entries.begin(), entries.end(), [](const arp_table_entry &a, const arp_table_entry &b) {
+        return a.ipAddress < b.ipAddress;
+    });
+    table->add_batch(entries.data(), entries.size());
+
+    return table;
+}
+
+/**
+ * Lookups of present or absent keys in random order, as done for every ARP request
+ *
+ * @param opts - settings
+ * @param table - table with keys 0..size-1
+ * @param size - table size
+ * @param hit - look up present keys
+ */
+static void bench_lookup(const bench_opts *opts, arp_table *table, size_t size, bool hit) {
+    vector<unsigned int> ips(opts->ops);
+    unsigned long long state = opts->seed;
+    vector<double> samples;
+
+    for (auto &ip : ips) {
+        auto i = (unsigned int) (next_random(&state) % size);
+        ip = key_ip(hit ? i : (unsigned int) size + i);
+    }
+
+    for (unsigned int r = 0; r <= opts->repeats; ++r) {
+        unsigned long long found = 0;
+        arp_table_entry entry{};
+
+        unsigned long long start = now_ns();
+        for (auto ip : ips) found += table->copy_by_ip(ip, &entry);
+        unsigned long long took = now_ns() - start;
+
+        sink = found;
+        // First round warms caches and is discarded
+        if (r > 0) samples.push_back((double) took / ips.size());
+    }
+
+    report(hit ? "lookup_hit" : "lookup_miss", size, ips.size(), samples);
+}
+
+/**
+ * Inserts batches of fresh keys and deletes them again, table size stays within 10% of size
+ *
+ * @param opts - settings
+ * @param table - table with keys 0..size-1
+ * @param size - table size
+ */
+static void bench_insert_delete(const bench_opts *opts, arp_table *table, size_t size) {
+    size_t batch = max((size_t) 1, min(size / 10, opts->ops));
+    size_t rounds = (opts->ops + batch - 1) / batch;
+    vector<double> insert_samples;
+    vector<double> delete_samples;
+    unsigned char eth[6] = {0x02, 0, 0, 0, 0, 0};
+
+    for (unsigned int r = 0; r <= opts->repeats; ++r) {
+        unsigned long long insert_ns = 0;
+        unsigned long long delete_ns = 0;
+
+        for (size_t b = 0; b < rounds; ++b) {
+            auto first = (unsigned int) (size + b * batch);
+
+            unsigned long long start = now_ns();
+            for (size_t i = 0; i < batch; ++i) table->add(key_ip(first + (unsigned int) i), eth, 60);
+            unsigned long long mid = now_ns();
+            for (size_t i = 0; i < batch; ++i) table->remove(key_ip(first + (unsigned int) i));
+            unsigned long long end = now_ns();
+
+            insert_ns += mid - start;
+            delete_ns += end - mid;
+        }
+
+        if (r > 0) {
+            insert_samples.push_back((double) insert_ns / (rounds * batch));
+            delete_samples.push_back((double) delete_ns / (rounds * batch));
+        }
+    }
+
+    if (selected(opts, "insert")) report("insert", size, rounds * batch, insert_samples);
+    if (selected(opts, "delete")) report("delete", size, rounds * batch, delete_samples);
+}
+
+/**
+ * Mixed churn, 95% of operations are hits and the rest replace the oldest key with a new one
+ * through an insert and a delete, so size stays constant
+ *
+ * @param opts - settings
+ * @param table - table with keys 0..size-1
+ * @param size - table size
+ */
+static void bench_churn(const bench_opts *opts, arp_table *table, size_t size) {
+    unsigned long long state = opts->seed;
+    vector<unsigned char> kinds(opts->ops);
+    vector<unsigned int> picks(opts->ops);
+    vector<double> samples;
+    unsigned char eth[6] = {0x02, 0, 0, 0, 0, 1};
+
+    for (size_t i = 0; i < opts->ops; ++i) {
+        unsigned long long v = next_random(&state);
+        kinds[i] = (unsigned char) (v % 20);
+        picks[i] = (unsigned int) ((v >> 8) % size);
+    }
+
+    // Live keys are [oldest, oldest + size)
+    auto oldest = (unsigned int) 0;
+    for (unsigned int r = 0; r <= opts->repeats; ++r) {
+        arp_table_entry entry{};
+        unsigned long long found = 0;
+
+        unsigned long long start = now_ns();
+        for (size_t i = 0; i < opts->ops; ++i) {
+            if (kinds[i] == 0) {
+                table->add(key_ip(oldest + (unsigned int) size), eth, 60);
+                table->remove(key_ip(oldest));
+                oldest++;
+            } else {
+                found += table->copy_by_ip(key_ip(oldest + picks[i]), &entry);
+            }
+        }
+        unsigned long long took = now_ns() - start;
+
+        sink = found;
+        if (r > 0) samples.push_back((double) took / opts->ops);
+    }
+
+    report("churn", size, opts->ops, samples);
+
+    // Restore keys 0..size-1 for later cases
+    auto end = oldest + (unsigned int) size;
+    for (auto i = max(oldest, (unsigned int) size); i < end; ++i) table->remove(key_ip(i));
+    for (unsigned int i = 0; i < min(oldest, (unsigned int) size); ++i) table->add(key_ip(i), eth, ARP_TTL_PERMANENT);
+}
+
+/**
+ * Expiry sweeps: aging every entry without removals, then expiring whole table
+ *
+ * @param opts - settings
+ * @param size - table size
+ */
+static void bench_expiry(const bench_opts *opts, size_t size) {
+    vector<double> sweep_samples;
+    vector<double> expire_samples;
+
+    // Long TTL so repeated ticks only age entries
+    arp_table *table = build_table(size, 1000000);
+    unsigned int sweeps = (unsigned int) max((size_t) 1, opts->ops / size);
+    for (unsigned int r = 0; r <= opts->repeats && selected(opts, "expiry_sweep"); ++r) {
+        unsigned long long start = now_ns();
+        for (unsigned int s = 0; s < sweeps; ++s) table->tick();
+        unsigned long long took = now_ns() - start;
+
+        if (r > 0) sweep_samples.push_back((double) took / ((double) sweeps * size));
+    }
+    delete table;
+
+    for (unsigned int r = 0; r <= opts->repeats && selected(opts, "expiry_remove"); ++r) {
+        table = build_table(size, 1);
+
+        unsigned long long start = now_ns();
+        table->tick();
+        unsigned long long took = now_ns() - start;
+
+        sink = table->count();
+        delete table;
+        if (r > 0) expire_samples.push_back((double) took / size);
+    }
+
+    if (!sweep_samples.empty()) report("expiry_sweep", size, (size_t) sweeps * size, sweep_samples);
+    if (!expire_samples.empty()) report("expiry_remove", size, size, expire_samples);
+}
+
+/**
+ * Parse and serialize throughput of ARP frames
+ *
+ * @param opts - settings
+ */
+static void bench_frames(const bench_opts *opts) {
+    vector<char> pool(FRAME_POOL * ARP_FRAME_LEN);
+    unsigned long long state = opts->seed;
+    unsigned char broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    unsigned char zero[6] = {0, 0, 0, 0, 0, 0};
+    vector<double> parse_samples;
+    vector<double> encode_samples;
+
+    for (unsigned int i = 0; i < FRAME_POOL; ++i) {
+        unsigned char mac[6] = {0x02, 0, 0, 0, (unsigned char) (i >> 8), (unsigned char) i};
+        encode_arp_frame(&pool[i * ARP_FRAME_LEN], ARP_REQUEST, broadcast, mac, key_ip(i), zero,
+                         (unsigned int) next_random(&state));
+    }
+
+    for (unsigned int r = 0; r <= opts->repeats && selected(opts, "parse"); ++r) {
+        unsigned long long acc = 0;
+        arp_hdr arp{};
+
+        unsigned long long start = now_ns();
+        for (size_t i = 0; i < opts->ops; ++i) {
+            if (parse_arp_frame(&pool[(i % FRAME_POOL) * ARP_FRAME_LEN], ARP_FRAME_LEN, &arp)) {
+                acc += arp.destination_ip;
+            }
+        }
+        unsigned long long took = now_ns() - start;
+
+        sink = acc;
+        if (r > 0) parse_samples.push_back((double) took / opts->ops);
+    }
+
+    for (unsigned int r = 0; r <= opts->repeats && selected(opts, "serialize"); ++r) {
+        unsigned long long acc = 0;
+        char frame[ARP_FRAME_LEN];
+
+        unsigned long long start = now_ns();
+        for (size_t i = 0; i < opts->ops; ++i) {
+            const char *req = &pool[(i % FRAME_POOL) * ARP_FRAME_LEN];
+            acc += encode_arp_frame(frame, ARP_REPLY, (const unsigned char *) req + 22,
+                                    (const unsigned char *) req + 6, (unsigned int) i,
+                                    (const unsigned char *) req + 22, key_ip((unsigned int) i));
+            acc += (unsigned char) frame[41];
+        }
+        unsigned long long took = now_ns() - start;
+
+        sink = acc;
+        if (r > 0) encode_samples.push_back((double) took / opts->ops);
+    }
+
+    if (!parse_samples.empty()) report("parse", 0, opts->ops, parse_samples);
+    if (!encode_samples.empty()) report("serialize", 0, opts->ops, encode_samples);
+}
+
+/**
+ * Interface lookup by destination network, the last interface matches so every one is checked
+ *
+ * @param opts - settings
+ * @param count - interfaces
+ */
+static void bench_route(const bench_opts *opts, int count) {
+    auto **workers = new interface_worker *[count];
+    vector<double> samples;
+
+    for (int i = 0; i < count; ++i) {
+        workers[i] = new interface_worker(new string("bench" + to_string(i)), nullptr, workers, count);
+        workers[i]->iface_data->ip_addr = 0x0A000001u + ((unsigned int) i << 8);
+        workers[i]->iface_data->netmask = 0xFFFFFF00u;
+    }
+
+    unsigned int target = 0x0A000000u + ((unsigned int) (count - 1) << 8) + 77;
+    for (unsigned int r = 0; r <= opts->repeats; ++r) {
+        unsigned long long found = 0;
+
+        unsigned long long start = now_ns();
+        for (size_t i = 0; i < opts->ops; ++i) {
+            found += find_interface_worker(target + (unsigned int) (i & 0x7F), workers, count) != nullptr;
+        }
+        unsigned long long took = now_ns() - start;
+
+        sink = found;
+        if (r > 0) samples.push_back((double) took / opts->ops);
+    }
+
+    report("route", (size_t) count, opts->ops, samples);
+}
+
+/**
+ * Worker bound to an in-memory backend, its reader thread waits for pushed frames
+ *
+ * @param io - set to backend of worker
+ *
+ * @return - worker, table is set per case
+ */
+static interface_worker *e2e_worker(memory_io **io) {
+    static interface_worker *workers[1];
+    unsigned char mac[6] = {0x02, 0, 0, 0, 0, 0x01};
+
+    *io = new memory_io(mac, 0x0A000001u, 0, MEMORY_IO_CAPACITY);
+    workers[0] = new interface_worker(new string("bench-e2e"), nullptr, workers, 1);
+    workers[0]->set_io(*io);
+    workers[0]->bind();
+
+    return workers[0];
+}
+
+/**
+ * ARP requests for present keys through process_packet up to the reply handed to the backend,
+ * called inline and queued to the worker's reader thread
+ *
+ * @param opts - settings
+ * @param worker - worker of e2e_worker
+ * @param io - backend of worker
+ * @param table - table with keys 0..size-1
+ * @param size - table size
+ */
+static void bench_e2e(const bench_opts *opts, interface_worker *worker, memory_io *io, arp_table *table,
+                      size_t size) {
+    vector<char> pool(FRAME_POOL * ARP_FRAME_LEN);
+    unsigned long long state = opts->seed;
+    unsigned char broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    unsigned char zero[6] = {0, 0, 0, 0, 0, 0};
+    vector<double> direct_samples;
+    vector<double> queue_samples;
+
+    for (unsigned int i = 0; i < FRAME_POOL; ++i) {
+        unsigned char mac[6] = {0x02, 0, 0, 0x01, (unsigned char) (i >> 8), (unsigned char) i};
+        encode_arp_frame(&pool[i * ARP_FRAME_LEN], ARP_REQUEST, broadcast, mac, 0x0A000002u + i, zero,
+                         key_ip((unsigned int) (next_random(&state) % size)));
+    }
+    worker->set_table(table);
+
+    for (unsigned int r = 0; r <= opts->repeats && selected(opts, "e2e_direct"); ++r) {
+        unsigned long long before = io->sent();
+
+        unsigned long long start = now_ns();
+        for (size_t i = 0; i < opts->ops; ++i) {
+            worker->process_packet(&pool[(i % FRAME_POOL) * ARP_FRAME_LEN], ARP_FRAME_LEN);
+        }
+        unsigned long long took = now_ns() - start;
+
+        if (io->sent() - before != opts->ops) fprintf(stderr, "e2e_direct: replies missing\n");
+        if (r > 0) direct_samples.push_back((double) took / opts->ops);
+    }
+
+    for (unsigned int r = 0; r <= opts->repeats && selected(opts, "e2e_queue"); ++r) {
+        unsigned long long before = io->sent();
+
+        unsigned long long start = now_ns();
+        for (size_t i = 0; i < opts->ops; ++i) {
+            io->push(&pool[(i % FRAME_POOL) * ARP_FRAME_LEN], ARP_FRAME_LEN);
+        }
+        io->wait_idle();
+        unsigned long long took = now_ns() - start;
+
+        if (io->sent() - before != opts->ops) fprintf(stderr, "e2e_queue: replies missing\n");
+        if (r > 0) queue_samples.push_back((double) took / opts->ops);
+    }
+
+    if (!direct_samples.empty()) report("e2e_direct", size, opts->ops, direct_samples);
+    if (!queue_samples.empty()) report("e2e_queue", size, opts->ops, queue_samples);
+}
+
+/**
+ * Parses comma separated sizes
+ *
+ * @param list - sizes
+ * @param out - parsed sizes
+ *
+ * @return - false on invalid size
+ */
+static bool parse_sizes(const char *list, vector<size_t> *out) {
+    out->clear();
+
+    while (*list != '\0') {
+        char *end;
+        unsigned long long size = strtoull(list, &end, 10);
+        if (end == list || size == 0 || size > 0x7FFFFFFF) return false;
+
+        out->push_back((size_t) size);
+        list = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') return false;
+    }
+
+    return !out->empty();
+}
+
+int main(int argc, char **args) {
+    bench_opts opts{};
+    opts.ops = DEFAULT_OPS;
+    opts.repeats = DEFAULT_REPEATS;
+    opts.seed = DEFAULT_SEED;
+    opts.filter = nullptr;
+    parse_sizes(DEFAULT_SIZES, &opts.sizes);
+
+    int opt;
+    while ((opt = getopt(argc, args, "s:n:r:S:f:")) != -1) {
+        if (opt == 's' && parse_sizes(optarg, &opts.sizes)) {
+            continue;
+        } else if (opt == 'n' && strtoull(optarg, nullptr, 10) > 0) {
+            opts.ops = (size_t) strtoull(optarg, nullptr, 10);
+        } else if (opt == 'r' && strtoul(optarg, nullptr, 10) > 0) {
+            opts.repeats = (unsigned int) strtoul(optarg, nullptr, 10);
+        } else if (opt == 'S' && strtoull(optarg, nullptr, 0) > 0) {
+            opts.seed = strtoull(optarg, nullptr, 0);
+        } else if (opt == 'f') {
+            opts.filter = optarg;
+        } else {
+            fprintf(stderr, "Usage: %s [-s size,...] [-n ops] [-r repeats] [-S seed] [-f case]\n"
+                            "Cases: lookup_hit lookup_miss insert delete churn expiry_sweep expiry_remove "
+                            "parse serialize route e2e_direct e2e_queue\n", args[0]);
+            return 1;
+        }
+    }
+
+    // Table changes log at info level, which would measure the logger
+    log_set_level(LOG_LEVEL_ERROR);
+
+    // Worker prints its interface when bound, before results start
+    memory_io *e2e_io = nullptr;
+    interface_worker *e2e = nullptr;
+    bool e2e_cases = selected(&opts, "e2e_direct") || selected(&opts, "e2e_queue");
+    if (e2e_cases) e2e = e2e_worker(&e2e_io);
+
+    // Median, min and max are ns per operation over repetitions after a warm-up round
+    printf("case,size,ops,repeats,median_ns,min_ns,max_ns,mops\n");
+
+    if (selected(&opts, "parse") || selected(&opts, "serialize")) bench_frames(&opts);
+
+    if (selected(&opts, "route")) {
+        for (int count : {1, 4, 16}) bench_route(&opts, count);
+    }
+
+    for (size_t size : opts.sizes) {
+        bool table_cases = selected(&opts, "lookup_hit") || selected(&opts, "lookup_miss") ||
+                           selected(&opts, "insert") || selected(&opts, "delete") || selected(&opts, "churn") ||
+                           e2e_cases;
+        if (table_cases) {
+            arp_table *table = build_table(size, ARP_TTL_PERMANENT);
+
+            if (selected(&opts, "lookup_hit")) bench_lookup(&opts, table, size, true);
+            if (selected(&opts, "lookup_miss")) bench_lookup(&opts, table, size, false);
+            if (selected(&opts, "insert") || selected(&opts, "delete")) bench_insert_delete(&opts, table, size);
+            if (selected(&opts, "churn")) bench_churn(&opts, table, size);
+            if (e2e_cases) bench_e2e(&opts, e2e, e2e_io, table, size);
+
+            delete table;
+        }
+
+        if (selected(&opts, "expiry_sweep") || selected(&opts, "expiry_remove")) bench_expiry(&opts, size);
+    }
+
+    return 0;
+}
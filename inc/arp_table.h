@@ -5,37 +5,121 @@
 #ifndef XARPD_ARPTABLE_H
 #define XARPD_ARPTABLE_H
 
+#include <map>
+#include <atomic>
+#include <utility>
 #include <vector>
 #include <string.h>
 #include "types.h"
 #include "pthread.h"
 
+// Entries examined per query call, bounds read lock hold time when few entries match
+#define ARP_QUERY_SCAN_BUDGET 4096
+
 using namespace std;
 
+/**
+ * Called for each entry while table read lock is held
+ */
+typedef void (*entry_visitor)(const arp_table_entry *entry, void *ctx);
+
+/**
+ * Called for every change while table write lock is held, must not block
+ */
+typedef void (*change_listener)(unsigned char event, const arp_table_entry *entry, void *ctx);
+
+/**
+ * Called once write lock is released after changes were reported, may wake other threads
+ */
+typedef void (*flush_listener)(void *ctx);
+
+// Flush listeners a table accepts, kept in a fixed array so it can be read without lock
+#define ARP_FLUSH_LISTENERS_MAX 4
+
+/**
+ * Query predicates, ranges are inclusive
+ */
+typedef struct _arp_query {
+    unsigned int ip_lo;
+    unsigned int ip_hi;
+    unsigned long long eth_lo;
+    unsigned long long eth_hi;
+    unsigned int ttl_min;
+    unsigned int ttl_max;
+    unsigned char kinds;
+    bool by_eth;    // Walk MAC index, picked when MAC range is narrower than IP range
+} arp_query;
+
+/**
+ * Where a query resumes, position in the index it walks
+ */
+typedef struct _arp_query_cursor {
+    unsigned long long eth;
+    unsigned int ip;
+    bool done;
+} arp_query_cursor;
+
 class arp_table {
 private:
-    vector<arp_table_entry*> *table;
+    // Ordered by IP so readers can resume from a cursor
+    map<unsigned int, arp_table_entry *> *table;
+    // Ordered by MAC then IP for MAC and OUI lookups
+    map<pair<unsigned long long, unsigned int>, arp_table_entry *> *eth_index;
+    pthread_rwlock_t lock;
     pthread_t *timer_thread;
 
     void dispatch_timer_thread(arp_table *ctx);
 
+    arp_table_entry *find_by_ip(unsigned int ip);
+    void erase(map<unsigned int, arp_table_entry *>::iterator it, unsigned char event);
+    unsigned char store(map<unsigned int, arp_table_entry *>::iterator *hint, unsigned int ip_address,
+                        const unsigned char eth_address[], unsigned int ttl, unsigned char kind);
+
+    // Registered change listeners, called in registration order
+    vector<pair<change_listener, void *>> listeners;
+
+    void notify(unsigned char event, const arp_table_entry *entry);
+    void unlock_write();
+
+    // Run after unlocking, slots are filled under write lock before count is published
+    pair<flush_listener, void *> flushers[ARP_FLUSH_LISTENERS_MAX];
+    atomic<unsigned int> flusher_count;
+
+    // Changes were reported since write lock was taken
+    bool changed;
+
+    // Kept by notify so monitoring reads them without the table lock
+    atomic<unsigned long long> entries;
+    atomic<unsigned long long> changes[ARP_EVENT_EXPIRE + 1];
+
     unsigned int defaultTtl;
 
 public:
-    arp_table();
+    explicit arp_table(bool start_timer = true);
+    ~arp_table();
 
-    arp_table_entry *get(unsigned int index);
-    arp_table_entry *find_by_ip(unsigned int ip);
     arp_table_entry *find_by_eth(unsigned char eth[]);
+    bool copy_by_ip(unsigned int ip, arp_table_entry *out);
+    size_t visit_page(unsigned int cursor, size_t max, entry_visitor visit, void *ctx, bool *exhausted);
+    size_t query(const arp_query *q, arp_query_cursor *cursor, size_t max, entry_visitor visit, void *ctx);
 
-    void add(unsigned int ip_address, unsigned char eth_address[], unsigned int ttl);
+    void add(unsigned int ip_address, unsigned char eth_address[], unsigned int ttl,
+             unsigned char kind = ARP_ENTRY_STATIC);
     void add(unsigned int ip_address, unsigned char eth_address[]);
+    size_t add_batch(const arp_table_entry *entries, size_t count);
+    size_t remove_batch(const unsigned int *ips, size_t count);
 
     bool remove(unsigned int ip);
 
+    void tick();
+
     void setTtl(unsigned int ttl);
 
     unsigned long count();
+    void read_counters(table_counters *out);
+    void add_listener(change_listener fn, void *ctx, bool replay = false, flush_listener flush = nullptr);
+
+    static unsigned long long eth_key(const unsigned char eth[]);
 };
 
 #endif //XARPD_ARPTABLE_H
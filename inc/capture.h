@@ -0,0 +1,63 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_CAPTURE_H
+#define XARPD_CAPTURE_H
+
+#include <stddef.h>
+#include "types.h"
+
+// Frames kept by capture ring, a power of two
+#define CAPTURE_SLOTS 8192
+
+// Bytes kept of each frame, padded ARP fits
+#define CAPTURE_SNAPLEN 64
+
+// Direction of captured frame
+#define CAPTURE_RX 0
+#define CAPTURE_TX 1
+
+/**
+ * Captured frame
+ */
+typedef struct _capture_record {
+    unsigned long long ts_ns;       // Wall clock time
+    unsigned short length;          // Frame length
+    unsigned char caplen;           // Bytes kept of frame
+    unsigned char direction;        // CAPTURE_RX or CAPTURE_TX
+    char ifname[MAX_IFNAME_LEN];
+    unsigned char data[CAPTURE_SNAPLEN];
+} capture_record;
+
+/*
+ * Frames received and sent by workers go to a fixed ring while capture is on. Writers claim
+ * a slot with one atomic add and never wait, a reader skips slots being written or already
+ * overwritten. The ring is allocated the first time capture starts.
+ */
+
+extern bool capture_on;
+
+void capture_start();
+void capture_stop();
+bool capture_active();
+unsigned long long capture_written();
+void capture_write(const char *ifname, unsigned char direction, const char *frame, unsigned int length);
+unsigned long long capture_oldest();
+size_t capture_read(unsigned long long *cursor, unsigned long long end, capture_record *out, size_t max);
+
+/**
+ * Captures frame if capture is on, otherwise costs one load and a predicted branch
+ *
+ * @param ifname - interface name
+ * @param direction - CAPTURE_RX or CAPTURE_TX
+ * @param frame - frame
+ * @param length - frame length
+ */
+inline void capture_frame(const char *ifname, unsigned char direction, const char *frame, unsigned int length) {
+    if (__builtin_expect(__atomic_load_n(&capture_on, __ATOMIC_RELAXED), 0)) {
+        capture_write(ifname, direction, frame, length);
+    }
+}
+
+#endif //XARPD_CAPTURE_H
@@ -0,0 +1,35 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_CONFIG_H
+#define XARPD_CONFIG_H
+
+#include <vector>
+#include "types.h"
+
+// Smallest part of config file given to a parser thread
+#define CONFIG_CHUNK_MIN (1024 * 1024)
+#define CONFIG_MAX_THREADS 16
+
+using namespace std;
+
+/*
+ * Startup config, one directive per line, # starts a comment:
+ *
+ *   ttl <seconds>                                      default TTL of learned entries
+ *   interface <name> [address <ip>/<len>] [mtu <n>]    serve interface, overriding kernel values
+ *   static <ip> <mac> [<ttl>|permanent]                entry loaded before readers start
+ *
+ * Static entries without TTL are permanent.
+ */
+typedef struct _daemon_config {
+    vector<arp_table_entry> statics;
+    vector<iface_settings> interfaces;
+    unsigned int ttl;
+    bool has_ttl;
+} daemon_config;
+
+bool load_config(const char *path, daemon_config *config);
+
+#endif //XARPD_CONFIG_H
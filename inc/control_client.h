@@ -0,0 +1,34 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_CONTROL_CLIENT_H
+#define XARPD_CONTROL_CLIENT_H
+
+#include <string>
+#include "types.h"
+#include "protocol.h"
+
+using namespace std;
+
+int control_connect();
+
+/**
+ * Persistent framed connection to daemon, requests may be pipelined
+ */
+class control_client {
+private:
+    int fd;
+    unsigned int next_id;
+    string in;
+
+public:
+    control_client();
+    ~control_client();
+
+    unsigned int request(const command_hdr *cmd, const config_hdr *config = nullptr);
+    bool receive(frame_hdr *hdr, string &payload);
+    void finish();
+};
+
+#endif //XARPD_CONTROL_CLIENT_H
@@ -0,0 +1,169 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_CONTROL_SERVER_H
+#define XARPD_CONTROL_SERVER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <sys/types.h>
+#include "pthread.h"
+#include "types.h"
+#include "protocol.h"
+
+#define CONTROL_MAX_EVENTS 64
+
+// Queued response bytes above which reading from connection pauses
+#define CONTROL_OUT_MAX (1024 * 1024)
+
+// Pooled output blocks, a frame never spans two blocks
+#define CONTROL_BLOCK_SIZE (16 * 1024)
+#define CONTROL_POOL_MAX 256
+#define CONTROL_PAYLOAD_MAX (CONTROL_BLOCK_SIZE - FRAME_HDR_LEN)
+
+// Blocks per sendmsg, keeps each SEQPACKET record within CONTROL_RECORD_MAX
+#define CONTROL_IOV_MAX (CONTROL_RECORD_MAX / CONTROL_BLOCK_SIZE)
+
+// Largest payload that may be answered from outside the loop thread
+#define CONTROL_INLINE_MAX 64
+
+using namespace std;
+
+class control_server;
+
+/**
+ * Peer credentials, only available on Unix socket connections
+ */
+typedef struct _control_peer {
+    bool has_creds;
+    pid_t pid;
+    uid_t uid;
+    gid_t gid;
+} control_peer;
+
+/**
+ * Called for every decoded request, response is delivered through control_server::respond
+ */
+typedef void (*request_handler)(control_server *server, unsigned long long con, const control_peer *peer,
+                                request_msg *req);
+
+/**
+ * Emits next chunk of a streamed response through control_server::reserve/commit,
+ * returns false once the final frame was sent. A producer with nothing to send yet
+ * calls control_server::idle and is run again after control_server::resume.
+ */
+typedef function<bool(control_server *server, unsigned long long con)> stream_producer;
+
+/**
+ * Reusable output buffer, frames are encoded in place and sent with sendmsg
+ */
+typedef struct _control_block {
+    struct _control_block *next;
+    size_t used;
+    size_t sent;
+    unsigned char data[CONTROL_BLOCK_SIZE];
+} control_block;
+
+/**
+ * Control connection state
+ */
+typedef struct _control_connection {
+    unsigned long long id;
+    int fd;
+    control_peer peer;
+    string in;                  // Partial frame carried between reads
+    control_block *out_head;
+    control_block *out_tail;
+    size_t out_pending;         // Queued bytes not sent yet
+    unsigned int outstanding;   // Requests dispatched but not answered yet
+    bool read_closed;           // Peer will not send more requests
+    bool dispatching;           // Frames are being handed to handler
+    deque<stream_producer> streams;
+    bool pumping;               // Stream producer is running
+    bool stream_idle;           // Front producer waits for resume
+    unsigned int events;        // Epoll interest currently registered
+} control_connection;
+
+/**
+ * Response produced outside the loop thread, payload is carried inline
+ */
+typedef struct _control_completion {
+    unsigned long long con;
+    unsigned int request_id;
+    unsigned short type;
+    unsigned char flags;
+    unsigned short length;
+    unsigned char payload[CONTROL_INLINE_MAX];
+} control_completion;
+
+class control_server {
+private:
+    vector<int> listen_fds;
+    int epoll_fd;
+    int wake_fd;
+    request_handler handler;
+
+    unordered_map<unsigned long long, control_connection *> connections;
+    unsigned long long next_id;
+
+    // Free output blocks, only touched by loop thread
+    control_block *free_blocks;
+    size_t free_count;
+
+    // Work handed over by other threads, swapped with the spare lists to keep their capacity
+    mutex completion_lock;
+    vector<control_completion> completions;
+    vector<control_completion> completions_spare;
+    vector<int> adopted;
+    vector<int> adopted_spare;
+    vector<unsigned long long> resumed;
+    vector<unsigned long long> resumed_spare;
+
+    pthread_t *loop_thread;
+
+    void accept_all(int listen_fd);
+    void add_connection(int fd);
+    void close_connection(control_connection *c);
+    void handle_read(control_connection *c);
+    void handle_write(control_connection *c);
+    bool dispatch_frames(control_connection *c, const unsigned char *data, size_t available, size_t *consumed);
+    bool flush(control_connection *c);
+    void settle(control_connection *c);
+    void pump(control_connection *c);
+    bool finished(control_connection *c);
+    void update_events(control_connection *c);
+    void drain_completions();
+    void wake();
+
+    control_block *alloc_block();
+    void release_block(control_block *b);
+    unsigned char *reserve_on(control_connection *c, size_t room);
+    void commit_on(control_connection *c, unsigned int request_id, unsigned short type, size_t length,
+                   unsigned char flags);
+
+public:
+    explicit control_server(request_handler handler);
+
+    void add_listener(int listen_fd);
+
+    void start();
+    void run();
+
+    unsigned char *reserve(unsigned long long con, size_t room);
+    void commit(unsigned long long con, unsigned int request_id, unsigned short type, size_t length,
+                unsigned char flags = 0);
+
+    void respond(unsigned long long con, unsigned int request_id, unsigned short type, const void *payload,
+                 size_t length, unsigned char flags = 0);
+    void stream(unsigned long long con, stream_producer producer);
+    void idle(unsigned long long con);
+    void resume(unsigned long long con);
+    void adopt(int fd);
+};
+
+#endif //XARPD_CONTROL_SERVER_H
@@ -0,0 +1,45 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_HISTOGRAM_H
+#define XARPD_HISTOGRAM_H
+
+#include <atomic>
+#include "types.h"
+
+// Linear sub-buckets per power of two, values are kept within 1/16 of their magnitude
+#define HIST_SUB_BITS 4
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+
+// Largest recorded value is 2^40 ns, about 18 minutes
+#define HIST_MAX_BITS 40
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+using namespace std;
+
+/**
+ * Log-bucketed latency histogram in nanoseconds. Recording is a few relaxed atomic
+ * operations so any thread may record without a lock.
+ */
+class histogram {
+private:
+    atomic<unsigned long long> buckets[HIST_BUCKETS];
+    atomic<unsigned long long> count;
+    atomic<unsigned long long> sum;
+    atomic<unsigned long long> min;
+    atomic<unsigned long long> max;
+
+    static unsigned int bucket_of(unsigned long long value);
+    static unsigned long long bucket_high(unsigned int bucket);
+
+public:
+    histogram();
+
+    void record(unsigned long long ns);
+    void summarize(latency_summary *out);
+    unsigned long long below_powers(unsigned int first_bits, unsigned int n, unsigned long long *below,
+                                    unsigned long long *sum);
+};
+
+#endif //XARPD_HISTOGRAM_H
@@ -9,12 +9,19 @@
 #include "types.h"
 #include "pthread.h"
 #include "arp_table.h"
+#include "histogram.h"
+#include "packet_io.h"
 #include <string>
+#include <mutex>
+#include <linux/if_packet.h>
 
 
 
 using namespace std;
 
+class uring_engine;
+class resolver;
+
 class interface_worker {
 private:
     string *iface_name;
@@ -22,25 +29,40 @@ private:
     interface_worker** workers;
     int worker_count;
 
-    int rawsockfd;
+    uring_engine *engine;
+    resolver *resolv;
+    const iface_settings *settings;
+
+    // Backend counters reset on every read, totals are kept here
+    mutex kernel_lock;
+    unsigned long long kernel_packets;
+    unsigned long long kernel_drops;
 
-    int bind_iface_name(int fd, char *iface_name);
-    void get_iface_info(int sockfd, char *ifname, iface *ifn);
+    void send_frame(const char *frame, unsigned int length);
 public:
     iface *iface_data;
+    packet_io *io;
     pthread_t *readerThread;
+    unsigned int stats_slot;
+    histogram latency[LATENCY_COUNT];
 
     interface_worker(string *iface_name, arp_table *main, interface_worker **pWorker, int i);
+    ~interface_worker();
 
     void set_table(arp_table *table);
-    void bind();
-    void process_packet(const char *data, unsigned int length);
+    void set_engine(uring_engine *engine);
+    void set_resolver(resolver *resolv);
+    void set_settings(const iface_settings *settings);
+    void set_io(packet_io *io);
+    bool open();
+    void start();
+    bool bind();
+    void process_packet(const char *data, unsigned int length, unsigned long long rx_ns = 0);
+    void read_stats(unsigned long long out[STAT_COUNT]);
 
     void reply_arp(arp_hdr *arp, arp_table_entry *pEntry);
     void arp_request(unsigned int ip);
 
-    void resolve_ip(unsigned int i);
-
 };
 
 
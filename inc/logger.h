@@ -0,0 +1,181 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_LOGGER_H
+#define XARPD_LOGGER_H
+
+#include <stdint.h>
+#include <atomic>
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+// Records buffered per thread, further ones are dropped until the formatter catches up
+#define LOG_RING_SIZE 1024
+#define LOG_MAX_ARGS 4
+
+// Formatter pause when every ring is empty
+#define LOG_FLUSH_US 10000
+
+using namespace std;
+
+enum log_arg_type : unsigned char {
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_STR,    // Must outlive the record: literals, interface names
+    LOG_ARG_IP,
+    LOG_ARG_MAC,
+    LOG_ARG_ERRNO
+};
+
+/**
+ * Argument captured by value, rendered by formatter thread
+ */
+typedef struct _log_arg {
+    log_arg_type type;
+    union {
+        long long i;
+        unsigned long long u;
+        const char *s;
+        unsigned char mac[6];
+    };
+} log_arg;
+
+/**
+ * Binary record, format string is a literal and only read when the record is printed.
+ * Each conversion of format consumes one argument, IP, MAC and errno arguments print
+ * themselves whatever the conversion is.
+ */
+typedef struct _log_record {
+    unsigned long long time_ns;
+    const char *fmt;
+    unsigned char level;
+    unsigned char argc;
+    log_arg args[LOG_MAX_ARGS];
+} log_record;
+
+extern int log_level;
+
+void log_set_level(int level);
+int log_parse_level(const char *name);
+unsigned long long log_dropped();
+void log_flush();
+void log_push(log_record *rec);
+
+/*
+ * Argument capture
+ */
+inline log_arg log_capture(int v) {
+    log_arg a;
+    a.type = LOG_ARG_INT;
+    a.i = v;
+    return a;
+}
+
+inline log_arg log_capture(long v) {
+    log_arg a;
+    a.type = LOG_ARG_INT;
+    a.i = v;
+    return a;
+}
+
+inline log_arg log_capture(unsigned int v) {
+    log_arg a;
+    a.type = LOG_ARG_UINT;
+    a.u = v;
+    return a;
+}
+
+inline log_arg log_capture(unsigned long v) {
+    log_arg a;
+    a.type = LOG_ARG_UINT;
+    a.u = v;
+    return a;
+}
+
+inline log_arg log_capture(unsigned long long v) {
+    log_arg a;
+    a.type = LOG_ARG_UINT;
+    a.u = v;
+    return a;
+}
+
+inline log_arg log_capture(const char *v) {
+    log_arg a;
+    a.type = LOG_ARG_STR;
+    a.s = v;
+    return a;
+}
+
+inline log_arg log_capture(log_arg v) {
+    return v;
+}
+
+/**
+ * IP in host order, printed dotted
+ */
+inline log_arg log_ip(unsigned int ip) {
+    log_arg a;
+    a.type = LOG_ARG_IP;
+    a.u = ip;
+    return a;
+}
+
+inline log_arg log_mac(const unsigned char eth[]) {
+    log_arg a;
+    a.type = LOG_ARG_MAC;
+    for (int i = 0; i < 6; ++i) a.mac[i] = eth[i];
+    return a;
+}
+
+/**
+ * Error number, text is looked up by formatter
+ */
+inline log_arg log_errno(int err) {
+    log_arg a;
+    a.type = LOG_ARG_ERRNO;
+    a.i = err;
+    return a;
+}
+
+inline void log_fill(log_record * /*rec*/) {
+}
+
+template<typename T, typename... Rest>
+inline void log_fill(log_record *rec, T first, Rest... rest) {
+    static_assert(sizeof...(Rest) < LOG_MAX_ARGS, "too many log arguments");
+    rec->args[rec->argc++] = log_capture(first);
+    log_fill(rec, rest...);
+}
+
+/**
+ * Queues record on calling thread's ring, never blocks
+ *
+ * @param level - LOG_LEVEL_*
+ * @param fmt - literal format
+ * @param args - arguments
+ */
+template<typename... Args>
+void log_write(int level, const char *fmt, Args... args) {
+    log_record rec;
+    rec.fmt = fmt;
+    rec.level = (unsigned char) level;
+    rec.argc = 0;
+    log_fill(&rec, args...);
+    log_push(&rec);
+}
+
+// Level test is one relaxed load, arguments are not evaluated below the level
+#define log_at(level, ...) do { \
+        if ((level) <= __atomic_load_n(&log_level, __ATOMIC_RELAXED)) log_write((level), __VA_ARGS__); \
+    } while (0)
+
+#define log_error(...) log_at(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define log_warn(...) log_at(LOG_LEVEL_WARN, __VA_ARGS__)
+#define log_info(...) log_at(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_debug(...) log_at(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif //XARPD_LOGGER_H
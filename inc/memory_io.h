@@ -0,0 +1,69 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_MEMORY_IO_H
+#define XARPD_MEMORY_IO_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include "packet_io.h"
+
+// Frames queued towards worker before push blocks
+#define MEMORY_IO_CAPACITY 4096
+
+/**
+ * Frames sent by worker, called on the sending thread
+ */
+typedef function<void(const char *frame, unsigned int length)> frame_sink;
+
+/**
+ * Queued frame
+ */
+typedef struct _memory_frame {
+    unsigned int length;
+    char data[PACKET_IO_FRAME_MAX];
+} memory_frame;
+
+/**
+ * In-process backend: frames pushed by caller are received by worker, frames worker sends go
+ * to a sink. Needs no privileges, for tests, benchmarks and embedders feeding their own frames.
+ */
+class memory_io : public packet_io {
+private:
+    unsigned char mac[HW_ADDR_LEN];
+    unsigned int ip;
+    unsigned int netmask;
+
+    // Bounded queue towards worker
+    vector<memory_frame> slots;
+    size_t head;                // Next slot received
+    size_t tail;                // Next slot pushed
+    bool closed;
+    bool waiting;               // Worker blocks on empty queue
+    mutex lock;
+    condition_variable not_empty;
+    condition_variable not_full;
+    condition_variable idle;
+
+    frame_sink sink;
+    atomic<unsigned long long> sent_frames;
+
+public:
+    memory_io(const unsigned char mac[], unsigned int ip, unsigned int netmask, size_t capacity = MEMORY_IO_CAPACITY);
+
+    bool open(const char *ifname, iface *out) override;
+    ssize_t receive(char *buffer, size_t size, unsigned long long *rx_ns) override;
+    bool send(const char *frame, unsigned int length) override;
+
+    void set_sink(frame_sink sink);
+    bool push(const char *frame, unsigned int length);
+    void wait_idle();
+    void close();
+    unsigned long long sent();
+};
+
+#endif //XARPD_MEMORY_IO_H
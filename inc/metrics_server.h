@@ -0,0 +1,54 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_METRICS_SERVER_H
+#define XARPD_METRICS_SERVER_H
+
+#include <string>
+#include "pthread.h"
+
+// Largest request head read before answering
+#define METRICS_REQUEST_MAX 4096
+
+// Time a scraper gets to send its request or read the response
+#define METRICS_IO_TIMEOUT_MS 2000
+
+// Default scrape port
+#define XARPD_METRICS_PORT 9466
+
+using namespace std;
+
+/**
+ * Appends every metric family to out, must only read values that need no packet path lock.
+ * Families are written with metrics_family and metrics_sample so both formats come out right.
+ */
+typedef void (*metrics_renderer)(string &out, bool openmetrics, void *ctx);
+
+/**
+ * Minimal HTTP listener answering GET /metrics in Prometheus text or OpenMetrics format.
+ * Scrapes are served one at a time on a thread of their own.
+ */
+class metrics_server {
+private:
+    int listen_fd;
+    metrics_renderer render;
+    void *ctx;
+    pthread_t *thread;
+
+    void serve(int fd);
+
+public:
+    metrics_server(metrics_renderer render, void *ctx);
+
+    bool listen(const char *address);
+    void start();
+    void run();
+};
+
+void metrics_family(string &out, bool openmetrics, const char *name, const char *type, const char *help);
+void metrics_label(string &labels, const char *key, const char *value);
+void metrics_sample(string &out, const char *name, const string &labels, unsigned long long value);
+void metrics_sample(string &out, const char *name, const string &labels, double value);
+
+#endif //XARPD_METRICS_SERVER_H
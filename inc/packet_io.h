@@ -0,0 +1,98 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_PACKET_IO_H
+#define XARPD_PACKET_IO_H
+
+#include <string>
+#include <sys/types.h>
+#include "types.h"
+
+// Largest frame a backend hands to a worker, longer ones are truncated and ARP always fits
+#define PACKET_IO_FRAME_MAX 1024
+
+using namespace std;
+
+/**
+ * Where an interface worker receives frames from and sends them to. receive is only called
+ * from the worker's reader thread, send may be called from any thread.
+ */
+class packet_io {
+public:
+    virtual ~packet_io() = default;
+
+    /**
+     * Attaches to interface and fills its identity: name, MAC, address, netmask, MTU and index
+     *
+     * @param ifname - interface name
+     * @param out - interface data
+     *
+     * @return - false if interface cannot be used, reason is already printed
+     */
+    virtual bool open(const char *ifname, iface *out) = 0;
+
+    /**
+     * Waits for next frame
+     *
+     * @param buffer - frame buffer
+     * @param size - buffer size
+     * @param rx_ns - receive time on CLOCK_REALTIME, 0 if backend has none
+     *
+     * @return - frame length, 0 once source is exhausted, -1 on error with errno set
+     */
+    virtual ssize_t receive(char *buffer, size_t size, unsigned long long *rx_ns) = 0;
+
+    /**
+     * Sends frame, destination is taken from its Ethernet header
+     *
+     * @param frame - frame
+     * @param length - frame length
+     *
+     * @return - false if frame could not be sent
+     */
+    virtual bool send(const char *frame, unsigned int length) = 0;
+
+    /**
+     * Socket an io_uring engine may service instead of receive and send
+     *
+     * @return - descriptor, -1 if backend has none
+     */
+    virtual int fd() { return -1; }
+
+    /**
+     * Adds frames seen and dropped below backend since last call
+     *
+     * @param packets - frames seen
+     * @param drops - frames dropped
+     */
+    virtual void read_drops(unsigned long long * /*packets*/, unsigned long long * /*drops*/) { }
+};
+
+/**
+ * Creates backend of an interface, lets embedders and benchmarks replace raw sockets
+ */
+typedef packet_io *(*packet_io_factory)(const string &ifname, void *ctx);
+
+/**
+ * AF_PACKET socket bound to interface, identity comes from kernel. Needs CAP_NET_RAW.
+ */
+class raw_socket_io : public packet_io {
+private:
+    int sockfd;
+    int ifindex;
+
+    bool query(const char *ifname, iface *out);
+
+public:
+    raw_socket_io();
+    ~raw_socket_io() override;
+
+    bool open(const char *ifname, iface *out) override;
+    ssize_t receive(char *buffer, size_t size, unsigned long long *rx_ns) override;
+    bool send(const char *frame, unsigned int length) override;
+    int fd() override;
+    void read_drops(unsigned long long *packets, unsigned long long *drops) override;
+};
+
+#endif //XARPD_PACKET_IO_H
@@ -0,0 +1,90 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_PCAP_IO_H
+#define XARPD_PCAP_IO_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <atomic>
+#include "packet_io.h"
+
+// Classic pcap magic numbers, written in file byte order
+#define PCAP_MAGIC_USEC 0xA1B2C3D4
+#define PCAP_MAGIC_NSEC 0xA1B23C4D
+#define PCAP_LINKTYPE_ETHERNET 1
+
+/**
+ * Classic pcap file header
+ */
+typedef struct _pcap_file_header {
+    unsigned int magic;
+    unsigned short version_major;
+    unsigned short version_minor;
+    int thiszone;
+    unsigned int sigfigs;
+    unsigned int snaplen;
+    unsigned int linktype;
+} pcap_file_header;
+
+/**
+ * Classic pcap record header
+ */
+typedef struct _pcap_record_header {
+    unsigned int ts_sec;
+    unsigned int ts_frac;       // Microseconds or nanoseconds, see magic
+    unsigned int incl_len;
+    unsigned int orig_len;
+} pcap_record_header;
+
+/**
+ * Writes Ethernet frames to a nanosecond pcap file, safe to call from several threads
+ */
+class pcap_writer {
+private:
+    FILE *file;
+    pthread_mutex_t lock;
+
+public:
+    pcap_writer();
+    ~pcap_writer();
+
+    bool open(const char *path);
+    void write(const char *frame, unsigned int length, unsigned long long ts_ns);
+    void flush();
+    void close();
+};
+
+/**
+ * Replays Ethernet frames of a pcap file to a worker, sent frames are written to another pcap
+ * file or only counted. Identity is given, so no privileges and no interface are needed.
+ */
+class pcap_replay_io : public packet_io {
+private:
+    string in_path;
+    string out_path;
+    unsigned int loops;
+    unsigned char mac[HW_ADDR_LEN];
+    unsigned int ip;
+    unsigned int netmask;
+
+    FILE *in;
+    bool swapped;               // File written on host of other byte order
+    long first_record;          // Offset of first record, for looping
+    pcap_writer out;
+    atomic<unsigned long long> sent_frames;
+
+public:
+    pcap_replay_io(const string &in_path, const unsigned char mac[], unsigned int ip, unsigned int netmask,
+                   const string &out_path = "", unsigned int loops = 1);
+    ~pcap_replay_io() override;
+
+    bool open(const char *ifname, iface *out) override;
+    ssize_t receive(char *buffer, size_t size, unsigned long long *rx_ns) override;
+    bool send(const char *frame, unsigned int length) override;
+
+    unsigned long long sent();
+};
+
+#endif //XARPD_PCAP_IO_H
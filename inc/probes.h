@@ -0,0 +1,65 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_PROBES_H
+#define XARPD_PROBES_H
+
+/*
+ * USDT tracepoints under provider "xarpd". Each probe has a semaphore that tracers raise while
+ * attached, a probe site is a load of it and a branch that is not taken until then, so its
+ * arguments are only computed while traced. Without <sys/sdt.h> or with XARPD_NO_USDT every
+ * probe compiles to nothing.
+ *
+ *   frame__received     (ifname, length)
+ *   frame__malformed    (ifname, length)
+ *   arp__classified     (ifname, opcode, sender_ip, target_ip)
+ *   table__hit          (ifname, ip)
+ *   table__miss         (ifname, ip)
+ *   reply__sent         (ifname, ip, latency_ns)
+ *   entry__learned      (ip, mac, ttl, kind, event)     mac packed by arp_table::eth_key
+ *   entry__removed      (ip, mac, event)                ARP_EVENT_DELETE or ARP_EVENT_EXPIRE
+ *   resolve__started    (ifname, ip)
+ *   resolve__completed  (ifname, ip, found, latency_ns)
+ *   command__dispatched (type, request_id, uid)         uid is -1 without peer credentials
+ *
+ * Addresses are host order, tools/ has bpftrace examples.
+ */
+
+#if !defined(XARPD_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define XARPD_USDT 1
+#endif
+#endif
+
+#define XARPD_PROBE_LIST(X) X(frame__received) X(frame__malformed) X(arp__classified) X(table__hit) \
+    X(table__miss) X(reply__sent) X(entry__learned) X(entry__removed) X(resolve__started) \
+    X(resolve__completed) X(command__dispatched)
+
+#ifdef XARPD_USDT
+// Defined in probes.cpp, probe notes refer to them by their unmangled name
+#define XARPD_SEMAPHORE_DECLARE(name) extern volatile unsigned short xarpd_##name##_semaphore;
+extern "C" {
+XARPD_PROBE_LIST(XARPD_SEMAPHORE_DECLARE)
+}
+
+#define XARPD_PROBE_ENABLED(name) __builtin_expect(xarpd_##name##_semaphore != 0, 0)
+#define XARPD_PROBE2(name, a, b) \
+    do { if (XARPD_PROBE_ENABLED(name)) DTRACE_PROBE2(xarpd, name, a, b); } while (0)
+#define XARPD_PROBE3(name, a, b, c) \
+    do { if (XARPD_PROBE_ENABLED(name)) DTRACE_PROBE3(xarpd, name, a, b, c); } while (0)
+#define XARPD_PROBE4(name, a, b, c, d) \
+    do { if (XARPD_PROBE_ENABLED(name)) DTRACE_PROBE4(xarpd, name, a, b, c, d); } while (0)
+#define XARPD_PROBE5(name, a, b, c, d, e) \
+    do { if (XARPD_PROBE_ENABLED(name)) DTRACE_PROBE5(xarpd, name, a, b, c, d, e); } while (0)
+#else
+#define XARPD_PROBE_ENABLED(name) false
+#define XARPD_PROBE2(name, a, b) do { } while (0)
+#define XARPD_PROBE3(name, a, b, c) do { } while (0)
+#define XARPD_PROBE4(name, a, b, c, d) do { } while (0)
+#define XARPD_PROBE5(name, a, b, c, d, e) do { } while (0)
+#endif
+
+#endif //XARPD_PROBES_H
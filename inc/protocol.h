@@ -0,0 +1,171 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_PROTOCOL_H
+#define XARPD_PROTOCOL_H
+
+#include <stddef.h>
+#include "types.h"
+#include "capture.h"
+
+/*
+ * Control protocol v2
+ *
+ * Every message is a frame, all integers are big-endian and fields are packed:
+ *
+ *   u32 length       bytes following this field (header rest + payload)
+ *   u8  version      PROTOCOL_VERSION
+ *   u8  flags        FRAME_FLAG_*
+ *   u16 type         command or response type
+ *   u32 request_id   chosen by client, echoed in response
+ *   ... payload
+ *
+ * Requests may be pipelined on one connection, responses arrive as they complete
+ * and are matched by request_id. A response may span several frames, every frame
+ * but the last one carries FRAME_FLAG_MORE.
+ *
+ * SHOW takes an optional cursor (first IP) and limit, each response frame starts
+ * with the cursor to resume from and whether the table was exhausted.
+ *
+ * QUERY filters the table in the daemon by IP prefix, MAC prefix, TTL range and
+ * entry kind, its response frames carry matching entries only and may be empty.
+ *
+ * WATCH never completes, every response frame starts with the amount of events the
+ * daemon dropped after the ones in the frame because the subscriber fell behind,
+ * followed by table change events. The first frame acknowledges the subscription.
+ *
+ * SCAN resolves every host of a list of IP ranges with paced requests, each host
+ * that answers is sent as its own frame and the last frame counts probed and
+ * answered hosts.
+ *
+ * ADD_BATCH and DEL_BATCH carry many entries or IPs, they are applied to the table
+ * under one lock and answered with the amount of entries that changed.
+ *
+ * STATS answers with one record per interface: its name followed by STAT_COUNT
+ * 64-bit counters in iface_stat order.
+ *
+ * LATENCY answers with one record per interface: its name followed by a digest of
+ * each histogram in iface_latency order, every digest being count, min, max, mean,
+ * p50, p90, p99 and p99.9 as 64-bit nanoseconds.
+ *
+ * CAPTURE starts, stops or reports the frame capture ring, each answered with whether
+ * capture is on and frames captured so far. Its DUMP operation streams the frames the
+ * ring holds instead, oldest first, CAPTURE_CHUNK_RECORDS per frame.
+ */
+#define PROTOCOL_VERSION 2
+#define FRAME_HDR_LEN 12
+#define FRAME_MAX_LEN (1024 * 1024)
+
+// More frames follow for the same request
+#define FRAME_FLAG_MORE 0x01
+
+// Largest single send/recv, keeps SEQPACKET records from being truncated
+#define CONTROL_RECORD_MAX (64 * 1024)
+
+// Wire sizes of payload items
+#define WIRE_IFNAME_LEN MAX_IFNAME_LEN
+#define WIRE_ENTRY_LEN 14
+#define WIRE_IFACE_LEN 84
+#define WIRE_SCAN_RANGE_LEN 5
+#define WIRE_SCAN_DONE_LEN 8
+#define WIRE_BATCH_IP_LEN 4
+#define WIRE_BATCH_DONE_LEN 4
+#define WIRE_SHOW_HDR_LEN 5
+#define WIRE_QUERY_LEN 21
+#define WIRE_WATCH_HDR_LEN 4
+#define WIRE_EVENT_LEN (1 + WIRE_ENTRY_LEN)
+#define WIRE_STATS_LEN (WIRE_IFNAME_LEN + 8 * STAT_COUNT)
+#define WIRE_SUMMARY_LEN 64
+#define WIRE_LATENCY_LEN (WIRE_IFNAME_LEN + WIRE_SUMMARY_LEN * LATENCY_COUNT)
+#define WIRE_CAPTURE_STATUS_LEN 9
+#define WIRE_CAPTURE_LEN (12 + WIRE_IFNAME_LEN + CAPTURE_SNAPLEN)
+
+// CAPTURE operations
+#define CAPTURE_OP_STATUS 0
+#define CAPTURE_OP_START 1
+#define CAPTURE_OP_STOP 2
+#define CAPTURE_OP_DUMP 3
+
+// Captured frames per CAPTURE dump frame, a chunk fits one output block
+#define CAPTURE_CHUNK_RECORDS 128
+
+// SCAN limits, a range is a network and its prefix length
+#define SCAN_MAX_RANGES 256
+#define SCAN_MAX_HOSTS 65536
+
+// Items per batch frame, a full ADD_BATCH still fits one SEQPACKET record
+#define BATCH_MAX_ENTRIES 4096
+
+// Largest command payload, a full ADD_BATCH
+#define WIRE_COMMAND_MAX (WIRE_ENTRY_LEN * BATCH_MAX_ENTRIES)
+
+// Entries per SHOW frame
+#define SHOW_CHUNK_ENTRIES 256
+
+/**
+ * Decoded frame header, host byte order
+ */
+typedef struct _frame_hdr {
+    unsigned int length;
+    unsigned char version;
+    unsigned char flags;
+    unsigned short type;
+    unsigned int request_id;
+} frame_hdr;
+
+/**
+ * Decoded request, config is only used by interface commands
+ */
+typedef struct _request_msg {
+    unsigned int id;
+    command_hdr cmd;
+    config_hdr config;
+} request_msg;
+
+size_t encode_frame_hdr(unsigned char *out, unsigned short type, unsigned int request_id, size_t payload_len,
+                        unsigned char flags = 0);
+bool decode_frame_hdr(const unsigned char *in, frame_hdr *hdr);
+size_t frame_size(const unsigned char *in, size_t available);
+
+size_t encode_command(unsigned char *out, const command_hdr *cmd, const config_hdr *config);
+bool decode_command(unsigned short type, const unsigned char *in, size_t len, command_hdr *cmd, config_hdr *config);
+
+size_t encode_scan_range(unsigned char *out, unsigned int ip, unsigned char prefix);
+void decode_scan_range(const unsigned char *in, unsigned int *ip, unsigned char *prefix);
+size_t encode_scan_done(unsigned char *out, unsigned int probed, unsigned int answered);
+void decode_scan_done(const unsigned char *in, unsigned int *probed, unsigned int *answered);
+
+size_t encode_batch_ip(unsigned char *out, unsigned int ip);
+unsigned int decode_batch_ip(const unsigned char *in);
+size_t encode_batch_done(unsigned char *out, unsigned int applied);
+unsigned int decode_batch_done(const unsigned char *in);
+
+size_t encode_show_hdr(unsigned char *out, unsigned int next_cursor, bool end);
+void decode_show_hdr(const unsigned char *in, unsigned int *next_cursor, bool *end);
+
+size_t encode_entry(unsigned char *out, const arp_table_entry *entry);
+void decode_entry(const unsigned char *in, arp_table_entry *entry);
+
+size_t encode_watch_hdr(unsigned char *out, unsigned int dropped);
+unsigned int decode_watch_hdr(const unsigned char *in);
+
+size_t encode_event(unsigned char *out, unsigned char event, const arp_table_entry *entry);
+unsigned char decode_event(const unsigned char *in, arp_table_entry *entry);
+
+size_t encode_iface(unsigned char *out, const iface *ifc);
+void decode_iface(const unsigned char *in, iface *ifc);
+
+size_t encode_stats(unsigned char *out, const char *ifname, const unsigned long long values[STAT_COUNT]);
+void decode_stats(const unsigned char *in, char *ifname, unsigned long long values[STAT_COUNT]);
+
+size_t encode_latency(unsigned char *out, const char *ifname, const latency_summary summaries[LATENCY_COUNT]);
+void decode_latency(const unsigned char *in, char *ifname, latency_summary summaries[LATENCY_COUNT]);
+
+size_t encode_capture_status(unsigned char *out, bool active, unsigned long long written);
+void decode_capture_status(const unsigned char *in, bool *active, unsigned long long *written);
+
+size_t encode_capture(unsigned char *out, const capture_record *rec);
+void decode_capture(const unsigned char *in, capture_record *rec);
+
+#endif //XARPD_PROTOCOL_H
@@ -0,0 +1,108 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_RESOLVER_H
+#define XARPD_RESOLVER_H
+
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include "pthread.h"
+#include "types.h"
+#include "arp_table.h"
+#include "interface_worker.h"
+
+#define RESOLVE_TIMEOUT_MS 3000
+#define RESOLVE_RETRY_MS 250
+#define RESOLVE_RETRY_MAX_MS 1000
+#define RESOLVE_BACKOFF 2
+
+// Paced first requests per second on each interface
+#define RESOLVE_PROBE_RATE 200
+
+using namespace std;
+
+typedef chrono::steady_clock::time_point resolve_time;
+
+/**
+ * Completion callback, entry is nullptr when resolution timed out
+ */
+typedef function<void(bool found, arp_table_entry *entry)> resolve_callback;
+
+/**
+ * Request attached to a resolution
+ */
+typedef struct _resolve_waiter {
+    resolve_time deadline;      // Not set before first request went out
+    unsigned int timeout_ms;
+    resolve_callback callback;
+} resolve_waiter;
+
+/**
+ * In-flight resolution shared by every request for the same IP
+ */
+typedef struct _pending_resolution {
+    unsigned int ip;
+    interface_worker *worker;
+    unsigned int attempts;
+    unsigned int interval_ms;
+    resolve_time next_retry;
+    resolve_time sent_at;       // First request, resolve latency is measured from it
+    bool sent;                  // Paced resolutions wait in their interface queue first
+    vector<resolve_waiter> waiters;
+} pending_resolution;
+
+/**
+ * Request picked under lock and sent once it is released
+ */
+typedef pair<interface_worker *, unsigned int> resolve_send;
+
+/**
+ * First requests of paced resolutions waiting for their slot on one interface
+ */
+typedef struct _probe_pacer {
+    deque<unsigned int> queue;
+    resolve_time next_send;
+} probe_pacer;
+
+class resolver {
+private:
+    arp_table *table;
+    interface_worker **workers;
+    int worker_count;
+
+    unordered_map<unsigned int, pending_resolution *> pending;
+    unordered_map<interface_worker *, probe_pacer> pacers;
+    mutex lock;
+    condition_variable scheduler_wake;
+
+    pthread_t *scheduler_thread;
+
+    unsigned int retry_ms;
+    unsigned int retry_max_ms;
+    unsigned int backoff;
+    unsigned int probe_rate;
+
+    void dispatch_scheduler_thread(resolver *ctx);
+    void mark_sent(pending_resolution *p, resolve_time now);
+    void pace(resolve_time now, resolve_time *next, vector<resolve_send> *sends);
+
+public:
+    resolver(arp_table *table, interface_worker **workers, int worker_count);
+
+    void set_backoff(unsigned int retry_ms, unsigned int retry_max_ms, unsigned int backoff);
+    void set_probe_rate(unsigned int rate);
+
+    void resolve_async(unsigned int ip, unsigned int timeout_ms, resolve_callback callback, bool paced = false);
+    bool resolve(unsigned int ip, unsigned int timeout_ms, arp_table_entry *out);
+    void learned(unsigned int ip, unsigned char eth_address[]);
+
+    void schedule();
+};
+
+#endif //XARPD_RESOLVER_H
@@ -0,0 +1,110 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_SHM_TABLE_H
+#define XARPD_SHM_TABLE_H
+
+#include <stddef.h>
+#include "types.h"
+
+/*
+ * Shared memory table export
+ *
+ * xarpd mirrors the ARP table into a POSIX shared memory segment so local processes can look
+ * up entries without a syscall. The segment is a header followed by an open addressing hash
+ * table with linear probing, keyed by IP. Deletions shift later entries back, so there are
+ * no tombstones.
+ *
+ * The daemon is the only writer. It makes seq odd before it touches any slot and even again
+ * afterwards. A reader that sees an odd seq, or a different seq after probing, retries. When
+ * the table gets too full to hold another entry, overflow is set and a missed lookup is not
+ * authoritative anymore until the daemon restarts.
+ *
+ * TTLs are as of the last change of an entry, they are not aged in the segment.
+ */
+#define SHM_TABLE_NAME "/xarpd.table"
+#define SHM_TABLE_MAGIC 0x58415250
+#define SHM_TABLE_VERSION 1
+
+// Default slot count as a power of two, entries stop being added past 3/4 of it
+#define SHM_TABLE_BITS 18
+#define SHM_TABLE_MAX_BITS 26
+
+// Read attempts before a lookup gives up on a busy writer
+#define SHM_READ_RETRIES 1024
+
+// Slot word 3 layout: mac[4], mac[5], kind, flags
+#define SHM_SLOT_USED 0x01
+
+// Lookup results
+#define SHM_LOOKUP_FOUND 1
+#define SHM_LOOKUP_MISSING 0
+#define SHM_LOOKUP_UNKNOWN (-1)
+
+typedef struct _shm_table_hdr {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int slot_bits;
+    unsigned int overflow;          // Some entries were not exported
+    unsigned int seq;               // Odd while writer is changing slots
+    unsigned int count;
+    unsigned long long generation;  // Bumped by every change
+    unsigned char pad[32];
+} shm_table_hdr;
+
+/**
+ * Entry packed into words so readers copy it with word sized loads
+ */
+typedef struct _shm_slot {
+    unsigned int words[4];
+} shm_slot;
+
+/**
+ * Writer side, owned by the daemon
+ */
+class shm_table_writer {
+private:
+    char name[64];
+    shm_table_hdr *hdr;
+    shm_slot *slots;
+    unsigned int mask;
+    size_t size;
+
+    void begin();
+    void end();
+    void store(unsigned int index, const shm_slot *slot);
+    long find(unsigned int ip);
+
+public:
+    shm_table_writer(const char *name, unsigned int slot_bits);
+    ~shm_table_writer();
+
+    void put(const arp_table_entry *entry);
+    void erase(unsigned int ip);
+};
+
+/**
+ * Reader side, lookups take no locks and make no syscalls
+ */
+class shm_table_reader {
+private:
+    const shm_table_hdr *hdr;
+    const shm_slot *slots;
+    unsigned int mask;
+    size_t size;
+
+public:
+    shm_table_reader();
+    ~shm_table_reader();
+
+    bool open(const char *name = SHM_TABLE_NAME);
+    int lookup(unsigned int ip, arp_table_entry *out) const;
+    unsigned long long generation() const;
+};
+
+unsigned int shm_slot_hash(unsigned int ip, unsigned int mask);
+
+void shm_table_changed(unsigned char event, const arp_table_entry *entry, void *ctx);
+
+#endif //XARPD_SHM_TABLE_H
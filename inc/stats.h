@@ -0,0 +1,43 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_STATS_H
+#define XARPD_STATS_H
+
+#include "types.h"
+
+// Interfaces with their own counters
+#define STATS_MAX_IFACES 64
+
+/**
+ * Counters written by one thread, each counter has a single writer so increments need no
+ * atomic read-modify-write. Readers sum every block.
+ */
+typedef struct _stats_block {
+    unsigned long long values[STATS_MAX_IFACES][STAT_COUNT];
+    struct _stats_block *next;
+} stats_block;
+
+extern thread_local stats_block *stats_local;
+
+stats_block *stats_attach();
+unsigned int stats_register();
+void stats_unregister(unsigned int slot);
+void stats_read(unsigned int slot, unsigned long long out[STAT_COUNT]);
+
+/**
+ * Adds to counter of interface on calling thread's block
+ *
+ * @param slot - interface slot from stats_register
+ * @param counter - STAT_*
+ * @param n - amount
+ */
+inline void stats_add(unsigned int slot, unsigned int counter, unsigned long long n = 1) {
+    stats_block *block = stats_local != nullptr ? stats_local : stats_attach();
+    unsigned long long *v = &block->values[slot][counter];
+
+    __atomic_store_n(v, *v + n, __ATOMIC_RELAXED);
+}
+
+#endif //XARPD_STATS_H
@@ -10,20 +10,69 @@
 #define ARP_REQUEST 1
 #define ARP_REPLY 2
 
+#define XARPD_SOCKET_PATH "/var/run/xarpd.sock"
+#define XARPD_TCP_PORT 5050
+
 struct iface {
     int sockfd;
     int mtu;
     char ifname[MAX_IFNAME_LEN];
     unsigned char mac_addr[HW_ADDR_LEN];
     unsigned int ip_addr;
-    unsigned int rx_pkts;
-    unsigned int rx_bytes;
-    unsigned int tx_pkts;
-    unsigned int tx_bytes;
+    unsigned long long rx_pkts;     // Counters are only filled in when interface is reported
+    unsigned long long rx_bytes;
+    unsigned long long tx_pkts;
+    unsigned long long tx_bytes;
+    unsigned long long rx_dropped;  // Frames kernel dropped before reader got them
     int index;
     unsigned int netmask;
 };
 
+// Interface counters
+enum iface_stat {
+    STAT_RX_FRAMES,
+    STAT_RX_BYTES,
+    STAT_TX_FRAMES,
+    STAT_TX_BYTES,
+    STAT_ARP_REQUESTS,
+    STAT_ARP_REPLIES,
+    STAT_PARSE_ERRORS,
+    STAT_TABLE_HITS,
+    STAT_TABLE_MISSES,
+    STAT_REPLIES_SENT,
+    STAT_KERNEL_PACKETS,
+    STAT_KERNEL_DROPS,
+    STAT_COUNT
+};
+
+// Interface latency histograms
+enum iface_latency {
+    LATENCY_REPLY,      // Request received to reply sent
+    LATENCY_RESOLVE,    // First request sent to reply learned
+    LATENCY_COUNT
+};
+
+// Latency histogram digest, nanoseconds
+typedef struct _latency_summary {
+    unsigned long long count;
+    unsigned long long min;
+    unsigned long long max;
+    unsigned long long mean;
+    unsigned long long p50;
+    unsigned long long p90;
+    unsigned long long p99;
+    unsigned long long p999;
+} latency_summary;
+
+// Interface settings from config file, applied when worker binds
+typedef struct _iface_settings {
+    char ifname[MAX_IFNAME_LEN];
+    unsigned int ip_addr;
+    unsigned int netmask;
+    int mtu;                // 0 keeps MTU reported by kernel
+    bool has_addr;
+} iface_settings;
+
 typedef struct _ether_hdr {
     unsigned char ether_dhost[HW_ADDR_LEN];     // Destination address
     unsigned char ether_shost[HW_ADDR_LEN];     // Source address
@@ -51,19 +100,34 @@ static unsigned short COMMAND_DEL_NOT_FOUND = 6;
 static unsigned short COMMAND_IF_SHOW = 7;
 static unsigned short COMMAND_IF_CONFIG = 8;
 static unsigned short COMMAND_IF_MTU = 9;
+static unsigned short COMMAND_DENIED = 10;
+static unsigned short COMMAND_BAD_REQUEST = 11;
+static unsigned short COMMAND_QUERY = 12;
+static unsigned short COMMAND_WATCH = 13;
+static unsigned short COMMAND_SCAN = 14;
+static unsigned short COMMAND_ADD_BATCH = 15;
+static unsigned short COMMAND_DEL_BATCH = 16;
+static unsigned short COMMAND_STATS = 17;
+static unsigned short COMMAND_LATENCY = 18;
+static unsigned short COMMAND_CAPTURE = 19;
 
 typedef struct _command_hdr {
     unsigned short type;
     unsigned int ip;
     unsigned char eth[8];
     unsigned int ttl;
+    unsigned int timeout;   // RES timeout in ms, 0 for default
+    unsigned int cursor;    // SHOW first IP to list
+    unsigned int limit;     // SHOW max entries, 0 for whole table
+    unsigned char ip_prefix;    // QUERY network length of ip, 0 matches any IP
+    unsigned char eth_prefix;   // QUERY bits of eth to match, 0 matches any MAC
+    unsigned char kinds;        // QUERY ARP_ENTRY_* mask, 0 matches any kind
+    unsigned int ttl_max;       // QUERY TTL range is [ttl, ttl_max]
+    unsigned int op;            // CAPTURE_OP_*
+    const unsigned char *items;     // SCAN ranges or batch entries as encoded, only valid while request is handled
+    unsigned int item_count;
 } command_hdr;
 
-typedef struct _response_hdr {
-    unsigned short type;
-    unsigned short len;
-} response_hdr;
-
 typedef struct _config_hdr {
     unsigned int ip;
     unsigned int mask;
@@ -71,10 +135,35 @@ typedef struct _config_hdr {
     char eth[MAX_IFNAME_LEN + 1];
 } config_hdr;
 
+// TTL of entries that never expire
+#define ARP_TTL_PERMANENT ((unsigned int) -1)
+
+// How an entry got into the table
+#define ARP_ENTRY_STATIC 0x01
+#define ARP_ENTRY_DYNAMIC 0x02
+
+// Table change events
+#define ARP_EVENT_ADD 1
+#define ARP_EVENT_UPDATE 2
+#define ARP_EVENT_DELETE 3
+#define ARP_EVENT_EXPIRE 4
+
+/**
+ * Table size and changes since start, read without table lock
+ */
+typedef struct _table_counters {
+    unsigned long long entries;
+    unsigned long long added;
+    unsigned long long updated;
+    unsigned long long deleted;
+    unsigned long long expired;
+} table_counters;
+
 typedef struct _arpTableEntry{
     unsigned int ipAddress;
     unsigned int ttl;
     unsigned char ethAddress[6];
+    unsigned char kind;
 } arp_table_entry;
 
 #endif //XARPD_TYPES_H
\ No newline at end of file
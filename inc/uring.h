@@ -0,0 +1,82 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_URING_H
+#define XARPD_URING_H
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+
+/*
+ * User data tags, stored in the upper byte of each SQE user_data
+ */
+#define URING_TAG_RECV 1
+#define URING_TAG_SEND 2
+#define URING_TAG_ACCEPT 3
+#define URING_TAG_WAKE 4
+
+#define URING_USER_DATA(tag, value) (((unsigned long long) (tag) << 56) | (unsigned long long) (value))
+#define URING_TAG(user_data) ((unsigned int) ((user_data) >> 56))
+#define URING_VALUE(user_data) ((unsigned int) ((user_data) & 0xFFFFFFFF))
+
+/**
+ * Minimal io_uring wrapper built on raw syscalls (no liburing dependency)
+ */
+class uring {
+private:
+    int ring_fd;
+
+    // Submission queue
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int sq_entries;
+    unsigned int sq_local_tail;
+    unsigned int sq_submitted;
+    io_uring_sqe *sqes;
+
+    // Completion queue
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    io_uring_cqe *cqes;
+
+    // Mappings
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+
+    // Provided buffer ring
+    io_uring_buf_ring *buf_ring;
+    char *buf_base;
+    unsigned int buf_count;
+    unsigned int buf_size;
+    unsigned short buf_group;
+
+public:
+    explicit uring(unsigned int entries);
+    ~uring();
+
+    static bool supported();
+
+    io_uring_sqe *get_sqe();
+    int submit(unsigned int wait_nr);
+
+    io_uring_cqe *peek_cqe();
+    void cqe_seen();
+
+    bool setup_buffers(unsigned short group, unsigned int count, unsigned int size);
+    char *buffer(unsigned int id);
+    void recycle_buffer(unsigned int id);
+
+    bool prep_recv_multishot(int fd, unsigned long long user_data);
+    bool prep_accept_multishot(int fd, unsigned long long user_data);
+    bool prep_sendmsg(int fd, msghdr *msg, unsigned long long user_data);
+    bool prep_read(int fd, void *buf, unsigned int len, unsigned long long user_data);
+};
+
+#endif //XARPD_URING_H
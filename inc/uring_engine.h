@@ -0,0 +1,74 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_URING_ENGINE_H
+#define XARPD_URING_ENGINE_H
+
+#include <linux/if_packet.h>
+#include <sys/uio.h>
+#include <vector>
+#include <mutex>
+#include "pthread.h"
+#include "uring.h"
+
+#define URING_ENTRIES 256
+#define URING_BUFFER_GROUP 1
+#define URING_BUFFER_COUNT 512
+#define URING_BUFFER_SIZE 2048
+#define URING_SEND_SLOTS 128
+#define URING_FRAME_SIZE 64
+
+using namespace std;
+
+class interface_worker;
+
+/**
+ * Pre-allocated outgoing frame, lives until its send completes
+ */
+typedef struct _send_slot {
+    char frame[URING_FRAME_SIZE];
+    sockaddr_ll sa;
+    iovec iov;
+    msghdr msg;
+    int fd;
+} send_slot;
+
+class uring_engine {
+private:
+    uring *ring;
+    interface_worker **workers;
+    int worker_count;
+
+    // Wake-up for sends queued from other threads
+    int wake_fd;
+    unsigned long long wake_value;
+    bool wake_armed;
+
+    // Receives that found submission queue full
+    vector<int> unarmed;
+
+    // Send slot pool
+    send_slot *slots;
+    vector<unsigned int> free_slots;
+    vector<unsigned int> pending_slots;
+    mutex send_lock;
+
+    pthread_t *engine_thread;
+
+    void arm_recv(int index);
+    void arm_wake();
+    void rearm();
+    void flush_sends();
+    void handle_completion(io_uring_cqe *cqe);
+
+public:
+    uring_engine(interface_worker **workers, int worker_count);
+
+    void start();
+    void run();
+
+    bool queue_send(int fd, const char *frame, unsigned int length, sockaddr_ll *sa);
+};
+
+#endif //XARPD_URING_ENGINE_H
@@ -8,9 +8,21 @@
 #include "types.h"
 #include "interface_worker.h"
 
-unsigned char *parse_eth_addr(char *addr);
+// Ethernet/IPv4 ARP payload without padding
+#define ARP_WIRE_LEN 28
 
-unsigned int parse_ip_addr(char *filter);
+// Ethernet header followed by ARP payload
+#define ARP_FRAME_LEN (14 + ARP_WIRE_LEN)
+
+bool scan_uint(const char **cursor, const char *end, unsigned int *value);
+
+bool scan_ip_addr(const char **cursor, const char *end, unsigned int *ip);
+
+bool scan_eth_addr(const char **cursor, const char *end, unsigned char eth[]);
+
+bool parse_eth_addr(const char *addr, unsigned char eth[]);
+
+unsigned int parse_ip_addr(const char *filter);
 
 void print_eth_address(char *s, unsigned char eth_addr[]);
 
@@ -24,6 +36,12 @@ bool eth_address_eq(unsigned char *eth_a, unsigned char *eth_b);
 
 void build_arp_header(const char *data, arp_hdr *hdr);
 
+bool parse_arp_frame(const char *data, unsigned int length, arp_hdr *arp);
+
+unsigned int encode_arp_frame(char *out, unsigned short opcode, const unsigned char eth_dst[],
+                              const unsigned char sender_mac[], unsigned int sender_ip,
+                              const unsigned char target_mac[], unsigned int target_ip);
+
 interface_worker *find_interface_worker(unsigned int ip, interface_worker **workers, int worker_count);
 
 interface_worker *find_interface_worker_by_name(char eth[23], interface_worker **workers, int worker_count);
@@ -0,0 +1,74 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_WATCH_HUB_H
+#define XARPD_WATCH_HUB_H
+
+#include <atomic>
+#include "types.h"
+#include "arp_table.h"
+#include "control_server.h"
+
+// Events queued per subscriber before further ones are dropped, a power of two
+#define WATCH_QUEUE_MAX 4096
+
+// Events per WATCH frame
+#define WATCH_CHUNK_EVENTS 512
+
+// Connections watching at once, each one holds a ring of WATCH_QUEUE_MAX events
+#define WATCH_SUBSCRIBERS_MAX 64
+
+using namespace std;
+
+/**
+ * Table change as queued for subscribers
+ */
+typedef struct _watch_event {
+    unsigned char type;
+    arp_table_entry entry;
+} watch_event;
+
+/**
+ * Connection watching the table. Its ring has one producer, publishers are serialized by the
+ * table write lock, and one consumer, the control loop.
+ */
+typedef struct _watch_subscriber {
+    unsigned long long con;
+    watch_event *ring;
+    atomic<size_t> head;            // Next event to drain, written by loop
+    atomic<size_t> tail;            // Next event to fill, written by publisher
+    atomic<unsigned int> dropped;   // Events lost to a full ring since last drain
+    atomic<bool> waiting;           // Stream is parked until next event
+    atomic<bool> wake;              // Parked stream must be resumed once table lock is released
+} watch_subscriber;
+
+class watch_hub {
+private:
+    control_server *server;
+
+    // Subscribers by slot, publish and flush only read them
+    atomic<watch_subscriber *> slots[WATCH_SUBSCRIBERS_MAX];
+    atomic<unsigned int> subscribed;
+
+    // Publishes and flushes running, a subscriber is freed only when none may still see it
+    atomic<unsigned int> active;
+
+    // Some stream is due a wake-up
+    atomic<bool> wake_pending;
+
+public:
+    explicit watch_hub(control_server *server);
+
+    watch_subscriber *subscribe(unsigned long long con);
+    void unsubscribe(watch_subscriber *sub);
+
+    void publish(unsigned char type, const arp_table_entry *entry);
+    void flush();
+    size_t drain(watch_subscriber *sub, unsigned char *out, size_t max, unsigned int *dropped);
+};
+
+void watch_table_changed(unsigned char event, const arp_table_entry *entry, void *ctx);
+void watch_table_flushed(void *ctx);
+
+#endif //XARPD_WATCH_HUB_H
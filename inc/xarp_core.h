@@ -0,0 +1,74 @@
+//
+// Created by root on 18/10/26.
+//
+
+#ifndef XARPD_XARP_CORE_H
+#define XARPD_XARP_CORE_H
+
+#include <future>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "arp_table.h"
+#include "interface_worker.h"
+#include "resolver.h"
+#include "packet_io.h"
+
+using namespace std;
+
+class uring_engine;
+
+/**
+ * Tunables applied when core starts
+ */
+typedef struct _core_options {
+    unsigned int retry_ms;
+    unsigned int retry_max_ms;
+    unsigned int backoff;
+    unsigned int probe_rate;
+    bool use_uring;             // Falls back to blocking I/O when io_uring is unavailable
+    packet_io_factory io_factory;   // Backend per interface, nullptr for raw sockets
+    void *io_ctx;                   // Passed to io_factory
+} core_options;
+
+/**
+ * Outcome of a resolution awaited through a future
+ */
+typedef struct _resolve_result {
+    bool found;
+    arp_table_entry entry;
+} resolve_result;
+
+/**
+ * ARP engine embeddable in any process: table, one worker per interface and the resolver.
+ * Packet sockets need CAP_NET_RAW unless options give another backend. Started workers run for
+ * the rest of the process.
+ */
+class xarp_core {
+private:
+    arp_table *table;
+    interface_worker **workers;
+    int worker_count;
+    resolver *resolv;
+    uring_engine *engine;
+    vector<iface_settings> settings;
+
+public:
+    xarp_core();
+
+    arp_table *get_table();
+    resolver *get_resolver();
+    interface_worker **get_workers();
+    int get_worker_count();
+    bool uses_uring();
+
+    bool start(const vector<string> &ifnames, const vector<iface_settings> &settings, const core_options *opts);
+
+    bool lookup(unsigned int ip, arp_table_entry *out);
+    void resolve(unsigned int ip, unsigned int timeout_ms, resolve_callback callback, bool paced = false);
+    future<resolve_result> resolve(unsigned int ip, unsigned int timeout_ms);
+};
+
+void core_default_options(core_options *opts);
+
+#endif //XARPD_XARP_CORE_H
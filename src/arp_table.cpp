@@ -6,16 +6,43 @@
 #include <unistd.h>
 #include "../inc/arp_table.h"
 #include "../inc/utils.h"
+#include "../inc/logger.h"
+#include "../inc/probes.h"
 
 /**
  * ARP table constructor
+ *
+ * @param start_timer - age entries every second on a timer thread, otherwise owner calls tick
  */
-arp_table::arp_table() {
+arp_table::arp_table(bool start_timer) {
     this->defaultTtl = 60;
-    this->table = new vector<arp_table_entry *>();
-    this->dispatch_timer_thread(this);
+    this->table = new map<unsigned int, arp_table_entry *>();
+    this->eth_index = new map<pair<unsigned long long, unsigned int>, arp_table_entry *>();
+    this->entries.store(0, memory_order_relaxed);
+    for (auto &c : this->changes) c.store(0, memory_order_relaxed);
+    this->flusher_count.store(0, memory_order_relaxed);
+    this->changed = false;
+    pthread_rwlock_init(&this->lock, nullptr);
+    this->timer_thread = nullptr;
+    if (start_timer) this->dispatch_timer_thread(this);
 };
 
+/**
+ * ARP table destructor, listeners are not told about entries going away
+ */
+arp_table::~arp_table() {
+    if (this->timer_thread != nullptr) {
+        pthread_cancel(*this->timer_thread);
+        pthread_join(*this->timer_thread, nullptr);
+        delete this->timer_thread;
+    }
+
+    for (auto &it : *this->table) delete it.second;
+    delete this->table;
+    delete this->eth_index;
+    pthread_rwlock_destroy(&this->lock);
+}
+
 /**
  * Timer thread
  *
@@ -26,26 +53,13 @@ arp_table::arp_table() {
 void *timer(void *ctx) {
     // Cast context variable
     auto *at = (arp_table *) ctx;
-    arp_table_entry *ent;
 
     while (true) {
-        // Iterate over each entry
-        for (int i = 0; i < at->count(); ++i) {
-            // Check if we have a nullptr or permanent entry
-            if (ent == nullptr || ent->ttl == -1) continue;
-
-            // Update TTL
-            ent = at->get(i);
-            ent->ttl--;
-
-            // If entry expired, remove it
-            if (ent->ttl == 0) {
-                at->remove(ent->ipAddress);
-            }
+        // Sleep for 1 second
+        usleep(1 * 1000 * 1000);
 
-            // Sleep for 1 second
-            usleep(1 * 1000 * 1000);
-        }
+        // Age every entry by one second
+        at->tick();
     }
 }
 
@@ -57,7 +71,6 @@ void *timer(void *ctx) {
 void arp_table::dispatch_timer_thread(arp_table *ctx) {
     // Build thread information
     ctx->timer_thread = new pthread_t();
-    auto *attributes = new pthread_attr_t();
 
     // Dispatch thread with context
     if (pthread_create(ctx->timer_thread, nullptr, timer, (void *) ctx)) {
@@ -67,34 +80,214 @@ void arp_table::dispatch_timer_thread(arp_table *ctx) {
 }
 
 /**
- * Get ARP entry by index
+ * Decrements TTL of every entry and removes expired ones
+ */
+void arp_table::tick() {
+    pthread_rwlock_wrlock(&this->lock);
+
+    for (auto it = this->table->begin(); it != this->table->end();) {
+        arp_table_entry *ent = it->second;
+
+        // Permanent entries never expire
+        if (ent->ttl == ARP_TTL_PERMANENT) {
+            ++it;
+            continue;
+        }
+
+        // Remove expired entry
+        if (ent->ttl <= 1) {
+            log_info("Expired ARP entry: %s", log_ip(ent->ipAddress));
+            this->erase(it++, ARP_EVENT_EXPIRE);
+            continue;
+        }
+
+        ent->ttl--;
+        ++it;
+    }
+
+    this->unlock_write();
+}
+
+/**
+ * Get ARP entry by IP, caller must hold lock
  *
- * @param index - index
+ * @param ip - ip to find
  *
  * @return - nullptr if not found, arp_table_entry* if found
  */
-arp_table_entry *arp_table::get(unsigned int index) {
-    return this->table->at(index);
+arp_table_entry *arp_table::find_by_ip(unsigned int ip) {
+    auto it = this->table->find(ip);
+
+    if (it == this->table->end()) return nullptr;
+
+    return it->second;
 }
 
 /**
- * Get ARP entry by IP
+ * Unlink entry from both indexes and free it, caller must hold write lock
+ *
+ * @param it - table position of entry
+ * @param event - ARP_EVENT_DELETE or ARP_EVENT_EXPIRE
+ */
+void arp_table::erase(map<unsigned int, arp_table_entry *>::iterator it, unsigned char event) {
+    arp_table_entry *ent = it->second;
+
+    XARPD_PROBE3(entry__removed, ent->ipAddress, eth_key(ent->ethAddress), event);
+    this->notify(event, ent);
+
+    this->eth_index->erase(make_pair(eth_key(ent->ethAddress), ent->ipAddress));
+    this->table->erase(it);
+    delete ent;
+}
+
+/**
+ * Pack Ethernet address into integer ordered like its bytes
+ *
+ * @param eth - ethernet address
+ *
+ * @return - 48 bit key
+ */
+unsigned long long arp_table::eth_key(const unsigned char eth[]) {
+    unsigned long long key = 0;
+
+    for (int i = 0; i < HW_ADDR_LEN; ++i) {
+        key = (key << 8) | eth[i];
+    }
+
+    return key;
+}
+
+/**
+ * Copy ARP entry by IP
  *
  * @param ip - ip to find
+ * @param out - entry copy
  *
- * @return - nullptr if not found, arp_table_entry* if found
+ * @return - true if entry was found
  */
-arp_table_entry *arp_table::find_by_ip(unsigned int ip) {
-    // Iterate over each entry in table
-    for (int i = 0; i < this->count(); ++i) {
-        // Check if entry matched target IP address
-        arp_table_entry *en = this->table->at(i);
-        if (en->ipAddress == ip) {
-            return this->table->at(i);
+bool arp_table::copy_by_ip(unsigned int ip, arp_table_entry *out) {
+    pthread_rwlock_rdlock(&this->lock);
+
+    arp_table_entry *en = this->find_by_ip(ip);
+    if (en != nullptr) {
+        memcpy(out, en, sizeof(arp_table_entry));
+    }
+
+    pthread_rwlock_unlock(&this->lock);
+
+    return en != nullptr;
+}
+
+/**
+ * Visit entries in IP order starting at cursor, lets callers serialize without an intermediate copy
+ *
+ * @param cursor - first IP to include
+ * @param max - max entries to visit
+ * @param visit - visitor
+ * @param ctx - visitor context
+ * @param exhausted - set to true if no entry follows the visited ones
+ *
+ * @return - amount of entries visited, less than max once table is exhausted
+ */
+size_t arp_table::visit_page(unsigned int cursor, size_t max, entry_visitor visit, void *ctx, bool *exhausted) {
+    size_t visited = 0;
+
+    pthread_rwlock_rdlock(&this->lock);
+
+    auto it = this->table->lower_bound(cursor);
+    for (; it != this->table->end() && visited < max; ++it) {
+        visit(it->second, ctx);
+        visited++;
+    }
+    *exhausted = it == this->table->end();
+
+    pthread_rwlock_unlock(&this->lock);
+
+    return visited;
+}
+
+/**
+ * Check entry against query predicates
+ *
+ * @param q - query
+ * @param ent - entry
+ *
+ * @return - true if every predicate matches
+ */
+static bool query_match(const arp_query *q, const arp_table_entry *ent) {
+    if (ent->ipAddress < q->ip_lo || ent->ipAddress > q->ip_hi) return false;
+    if (ent->ttl < q->ttl_min || ent->ttl > q->ttl_max) return false;
+    if (q->kinds != 0 && !(ent->kind & q->kinds)) return false;
+
+    unsigned long long eth = arp_table::eth_key(ent->ethAddress);
+
+    return eth >= q->eth_lo && eth <= q->eth_hi;
+}
+
+/**
+ * Visit entries matching query, walking IP index or MAC index depending on q->by_eth.
+ * Each call examines at most ARP_QUERY_SCAN_BUDGET entries so sparse matches do not hold
+ * the read lock over the whole table, callers repeat until cursor is done.
+ *
+ * @param q - query
+ * @param cursor - resume position, zeroed for first call, updated on return
+ * @param max - max entries to visit
+ * @param visit - visitor
+ * @param ctx - visitor context
+ *
+ * @return - amount of entries visited
+ */
+size_t arp_table::query(const arp_query *q, arp_query_cursor *cursor, size_t max, entry_visitor visit, void *ctx) {
+    size_t visited = 0;
+    size_t scanned = 0;
+
+    if (cursor->done) return 0;
+
+    pthread_rwlock_rdlock(&this->lock);
+
+    if (q->by_eth) {
+        // Resume inside MAC range, IP breaks ties between entries sharing a MAC
+        auto start = std::max(make_pair(cursor->eth, cursor->ip), make_pair(q->eth_lo, 0u));
+
+        auto it = this->eth_index->lower_bound(start);
+        for (; it != this->eth_index->end() && it->first.first <= q->eth_hi; ++it) {
+            if (visited == max || scanned == ARP_QUERY_SCAN_BUDGET) break;
+            scanned++;
+
+            if (query_match(q, it->second)) {
+                visit(it->second, ctx);
+                visited++;
+            }
+        }
+
+        if (it == this->eth_index->end() || it->first.first > q->eth_hi) {
+            cursor->done = true;
+        } else {
+            cursor->eth = it->first.first;
+            cursor->ip = it->first.second;
+        }
+    } else {
+        auto it = this->table->lower_bound(std::max(cursor->ip, q->ip_lo));
+        for (; it != this->table->end() && it->first <= q->ip_hi; ++it) {
+            if (visited == max || scanned == ARP_QUERY_SCAN_BUDGET) break;
+            scanned++;
+
+            if (query_match(q, it->second)) {
+                visit(it->second, ctx);
+                visited++;
+            }
+        }
+
+        if (it == this->table->end() || it->first > q->ip_hi) {
+            cursor->done = true;
+        } else {
+            cursor->ip = it->first;
         }
     }
 
-    return nullptr;
+    pthread_rwlock_unlock(&this->lock);
+
+    return visited;
 }
 
 /**
@@ -105,48 +298,142 @@ arp_table_entry *arp_table::find_by_ip(unsigned int ip) {
  * @return - nullptr if not found, arp_table_entry* if found
  */
 arp_table_entry *arp_table::find_by_eth(unsigned char eth[]) {
-    // Iterate over each entry in table
-    for (int i = 0; i < this->table->size(); ++i) {
-        // Check if entry matched target Ethernet address
-        if (eth_address_eq(eth, this->table->at(i)->ethAddress)) {
-            return this->table->at(i);
-        }
+    arp_table_entry *found = nullptr;
+
+    pthread_rwlock_rdlock(&this->lock);
+
+    // Lowest IP using this address
+    auto it = this->eth_index->lower_bound(make_pair(eth_key(eth), 0u));
+    if (it != this->eth_index->end() && it->first.first == eth_key(eth)) {
+        found = it->second;
     }
 
-    return nullptr;
+    pthread_rwlock_unlock(&this->lock);
+
+    return found;
 }
 
 /**
- * Build arp_table_entry and pushes to table
+ * Insert entry or refresh existing one in both indexes, caller must hold write lock
  *
+ * @param hint - table position to insert before, moved past stored entry
  * @param ip_address - ip address
  * @param eth_address - ethernet address
  * @param ttl - ttl
+ * @param kind - ARP_ENTRY_STATIC if configured, ARP_ENTRY_DYNAMIC if learned
+ *
+ * @return - ARP_EVENT_ADD or ARP_EVENT_UPDATE, 0 if a learned address would replace a static one
  */
-void arp_table::add(unsigned int ip_address, unsigned char eth_address[], unsigned int ttl) {
-    // Debugging
-    print_ip_addr((char *) "Adding ARP entry from: ", ip_address);
-    printf("\n");
+unsigned char arp_table::store(map<unsigned int, arp_table_entry *>::iterator *hint, unsigned int ip_address,
+                               const unsigned char eth_address[], unsigned int ttl, unsigned char kind) {
+    // Sorted input lands right at hint, anything else falls back to a lookup
+    auto it = this->table->emplace_hint(*hint, ip_address, nullptr);
+    *hint = next(it);
 
-    // Check if entry already exists
-    if (this->find_by_ip(ip_address) != nullptr) {
-        printf("Entry already exists, aborting...\n");
-        return;
+    arp_table_entry *entry = it->second;
+    unsigned char event = ARP_EVENT_UPDATE;
+
+    if (entry == nullptr) {
+        entry = new arp_table_entry();
+        entry->ipAddress = ip_address;
+        it->second = entry;
+        event = ARP_EVENT_ADD;
+    } else if (entry->kind == ARP_ENTRY_STATIC && kind == ARP_ENTRY_DYNAMIC) {
+        return 0;
+    } else {
+        // Reindex under new address
+        this->eth_index->erase(make_pair(eth_key(entry->ethAddress), ip_address));
     }
 
-    // Build ARP table entry
-    auto entry = new arp_table_entry();
-    entry->ipAddress = ip_address;
-    entry->ttl = ttl;
     memcpy(entry->ethAddress, eth_address, sizeof(char) * 6);
+    entry->ttl = ttl;
+    entry->kind = kind;
+    (*this->eth_index)[make_pair(eth_key(entry->ethAddress), ip_address)] = entry;
+
+    XARPD_PROBE5(entry__learned, ip_address, eth_key(entry->ethAddress), ttl, kind, event);
+    this->notify(event, entry);
+
+    return event;
+}
 
-    // Add to vector
-    this->table->push_back(entry);
+/**
+ * Build arp_table_entry and pushes to table, an existing entry is refreshed unless
+ * a learned address would replace a static one
+ *
+ * @param ip_address - ip address
+ * @param eth_address - ethernet address
+ * @param ttl - ttl
+ * @param kind - ARP_ENTRY_STATIC if configured, ARP_ENTRY_DYNAMIC if learned
+ */
+void arp_table::add(unsigned int ip_address, unsigned char eth_address[], unsigned int ttl, unsigned char kind) {
+    log_debug("Adding ARP entry from: %s", log_ip(ip_address));
+
+    pthread_rwlock_wrlock(&this->lock);
+
+    auto hint = this->table->end();
+    unsigned char event = this->store(&hint, ip_address, eth_address, ttl, kind);
+    arp_table_entry added{};
+    if (event != 0) added = *prev(hint)->second;
 
-    // Debug to console
-    printf("Added: ");
-    print_arp_table_entry(entry);
-    printf("\n");
+    this->unlock_write();
+
+    if (event == 0) {
+        log_info("Static entry already exists, aborting...");
+    } else {
+        log_info("%s(%s, %s, %u)", event == ARP_EVENT_ADD ? "Added: " : "Updated: ", log_ip(added.ipAddress),
+                 log_mac(added.ethAddress), added.ttl);
+    }
+}
+
+/**
+ * Add or refresh many static entries under one lock, cheapest when sorted by IP
+ *
+ * @param entries - entries to store, kind is ignored
+ * @param count - amount of entries
+ *
+ * @return - amount of entries added or updated
+ */
+size_t arp_table::add_batch(const arp_table_entry *entries, size_t count) {
+    size_t applied = 0;
+
+    pthread_rwlock_wrlock(&this->lock);
+
+    auto hint = this->table->end();
+    for (size_t i = 0; i < count; ++i) {
+        if (this->store(&hint, entries[i].ipAddress, entries[i].ethAddress, entries[i].ttl, ARP_ENTRY_STATIC)) {
+            applied++;
+        }
+    }
+
+    this->unlock_write();
+
+    return applied;
+}
+
+/**
+ * Remove many entries under one lock
+ *
+ * @param ips - ips to remove
+ * @param count - amount of ips
+ *
+ * @return - amount of entries removed
+ */
+size_t arp_table::remove_batch(const unsigned int *ips, size_t count) {
+    size_t removed = 0;
+
+    pthread_rwlock_wrlock(&this->lock);
+
+    for (size_t i = 0; i < count; ++i) {
+        auto it = this->table->find(ips[i]);
+        if (it == this->table->end()) continue;
+
+        this->erase(it, ARP_EVENT_DELETE);
+        removed++;
+    }
+
+    this->unlock_write();
+
+    return removed;
 }
 
 /**
@@ -155,17 +442,34 @@ void arp_table::add(unsigned int ip_address, unsigned char eth_address[], unsign
  * @return - entry count
  */
 unsigned long arp_table::count() {
-    return this->table->size();
+    pthread_rwlock_rdlock(&this->lock);
+    unsigned long size = this->table->size();
+    pthread_rwlock_unlock(&this->lock);
+
+    return size;
 }
 
 /**
- * Add ARP entry with default TTL
+ * Reads size and change counts without taking table lock, values may lag a concurrent change
+ *
+ * @param out - counters
+ */
+void arp_table::read_counters(table_counters *out) {
+    out->entries = this->entries.load(memory_order_relaxed);
+    out->added = this->changes[ARP_EVENT_ADD].load(memory_order_relaxed);
+    out->updated = this->changes[ARP_EVENT_UPDATE].load(memory_order_relaxed);
+    out->deleted = this->changes[ARP_EVENT_DELETE].load(memory_order_relaxed);
+    out->expired = this->changes[ARP_EVENT_EXPIRE].load(memory_order_relaxed);
+}
+
+/**
+ * Add learned ARP entry with default TTL
  *
  * @param ip_address - ip address
  * @param eth_address - ethernet address
  */
 void arp_table::add(unsigned int ip_address, unsigned char *eth_address) {
-    this->add(ip_address, eth_address, defaultTtl);
+    this->add(ip_address, eth_address, defaultTtl, ARP_ENTRY_DYNAMIC);
 }
 
 /**
@@ -176,30 +480,96 @@ void arp_table::add(unsigned int ip_address, unsigned char *eth_address) {
  * @return - if an entry got removed
  */
 bool arp_table::remove(unsigned int ip) {
-    arp_table_entry *x;
-    bool removed = false;
-
-    // Iterate over each entry in table
-    for (unsigned long i = 0; i < this->table->size(); ++i) {
-        x = this->table->at(i);
-
-        // Mark 'removed' if something got removed
-        if (x->ipAddress == ip) {
-            this->table->erase(this->table->begin() + i);
-            // Vector element was removed and shifted others
-            i--;
-            removed =  true;
-        }
+    pthread_rwlock_wrlock(&this->lock);
+
+    auto it = this->table->find(ip);
+    bool removed = it != this->table->end();
+
+    if (removed) {
+        this->erase(it, ARP_EVENT_DELETE);
     }
 
+    this->unlock_write();
+
     return removed;
 }
 
+/**
+ * Register listener for table changes
+ *
+ * @param fn - listener
+ * @param ctx - listener context
+ * @param replay - report every current entry as added first, so listener misses nothing
+ * @param flush - called with ctx once write lock is released after changes, nullptr for none
+ */
+void arp_table::add_listener(change_listener fn, void *ctx, bool replay, flush_listener flush) {
+    pthread_rwlock_wrlock(&this->lock);
+
+    if (replay) {
+        for (auto &it : *this->table) {
+            fn(ARP_EVENT_ADD, it.second, ctx);
+        }
+        this->changed = this->changed || !this->table->empty();
+    }
+    this->listeners.emplace_back(fn, ctx);
+
+    // Writers read flushers after unlocking, a slot is complete before count covers it
+    if (flush != nullptr) {
+        unsigned int n = this->flusher_count.load(memory_order_relaxed);
+        if (n == ARP_FLUSH_LISTENERS_MAX) {
+            fprintf(stderr, "More than %d flush listeners\n", ARP_FLUSH_LISTENERS_MAX);
+            exit(EXIT_FAILURE);
+        }
+        this->flushers[n] = make_pair(flush, ctx);
+        this->flusher_count.store(n + 1, memory_order_release);
+    }
+
+    this->unlock_write();
+}
+
+/**
+ * Releases write lock, then lets flush listeners act on changes made under it
+ */
+void arp_table::unlock_write() {
+    bool flush = this->changed;
+    this->changed = false;
+
+    pthread_rwlock_unlock(&this->lock);
+
+    if (!flush) return;
+
+    unsigned int n = this->flusher_count.load(memory_order_acquire);
+    for (unsigned int i = 0; i < n; ++i) {
+        this->flushers[i].first(this->flushers[i].second);
+    }
+}
+
+/**
+ * Report change to every listener, caller must hold write lock
+ *
+ * @param event - ARP_EVENT_* type
+ * @param entry - changed entry
+ */
+void arp_table::notify(unsigned char event, const arp_table_entry *entry) {
+    // Single writer under lock, relaxed stores are enough for readers
+    this->changes[event].store(this->changes[event].load(memory_order_relaxed) + 1, memory_order_relaxed);
+    if (event == ARP_EVENT_ADD) {
+        this->entries.store(this->entries.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    } else if (event == ARP_EVENT_DELETE || event == ARP_EVENT_EXPIRE) {
+        this->entries.store(this->entries.load(memory_order_relaxed) - 1, memory_order_relaxed);
+    }
+
+    for (auto &listener : this->listeners) {
+        listener.first(event, entry, listener.second);
+    }
+    this->changed = true;
+}
+
 /**
  * Set default TTL
  *
  * @param ttl - new default ttl
  */
 void arp_table::setTtl(unsigned int ttl) {
-    this->defaultTtl = ttl < 0 ? -1 : ttl;
+    this->defaultTtl = ttl;
 }
@@ -0,0 +1,146 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include <string.h>
+#include <time.h>
+#include "../inc/capture.h"
+
+/*
+ * Ring slot, seq is 2 * position + 1 while written and 2 * position + 2 once complete
+ */
+typedef struct _capture_slot {
+    unsigned long long seq;
+    capture_record record;
+} capture_slot;
+
+bool capture_on = false;
+
+// Never freed, writers that saw capture on just before it stopped still own a slot
+static capture_slot *ring = nullptr;
+
+// Frames written since start of process, next position to claim
+static unsigned long long head = 0;
+
+/**
+ * Turns capture on, allocating ring on first use. Only called from control thread.
+ */
+void capture_start() {
+    if (__atomic_load_n(&ring, __ATOMIC_RELAXED) == nullptr) {
+        auto *slots = new capture_slot[CAPTURE_SLOTS];
+        memset(slots, 0, sizeof(capture_slot) * CAPTURE_SLOTS);
+        __atomic_store_n(&ring, slots, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&capture_on, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Turns capture off, ring keeps what it holds for later reads
+ */
+void capture_stop() {
+    __atomic_store_n(&capture_on, false, __ATOMIC_RELAXED);
+}
+
+/**
+ * If frames are captured
+ *
+ * @return - true while on
+ */
+bool capture_active() {
+    return __atomic_load_n(&capture_on, __ATOMIC_RELAXED);
+}
+
+/**
+ * Frames captured since process start, including overwritten ones
+ *
+ * @return - count
+ */
+unsigned long long capture_written() {
+    return __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Writes frame to next slot, overwriting the oldest one
+ *
+ * @param ifname - interface name
+ * @param direction - CAPTURE_RX or CAPTURE_TX
+ * @param frame - frame
+ * @param length - frame length
+ */
+void capture_write(const char *ifname, unsigned char direction, const char *frame, unsigned int length) {
+    capture_slot *slots = __atomic_load_n(&ring, __ATOMIC_ACQUIRE);
+    if (slots == nullptr) return;
+
+    unsigned long long pos = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+    capture_slot *slot = &slots[pos & (CAPTURE_SLOTS - 1)];
+    timespec ts{};
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    // Readers see an odd seq before any byte of the record changes
+    __atomic_store_n(&slot->seq, 2 * pos + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    capture_record *rec = &slot->record;
+    rec->ts_ns = (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    rec->length = (unsigned short) (length < 0xFFFF ? length : 0xFFFF);
+    rec->caplen = (unsigned char) (length < CAPTURE_SNAPLEN ? length : CAPTURE_SNAPLEN);
+    rec->direction = direction;
+    strncpy(rec->ifname, ifname, MAX_IFNAME_LEN - 1);
+    rec->ifname[MAX_IFNAME_LEN - 1] = '\0';
+    memcpy(rec->data, frame, rec->caplen);
+
+    __atomic_store_n(&slot->seq, 2 * pos + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * Position of oldest frame ring may still hold
+ *
+ * @return - position
+ */
+unsigned long long capture_oldest() {
+    unsigned long long written = capture_written();
+
+    return written > CAPTURE_SLOTS ? written - CAPTURE_SLOTS : 0;
+}
+
+/**
+ * Copies complete frames from cursor on, frames overwritten or still being written are skipped
+ *
+ * @param cursor - position to read from, advanced past what was read or skipped
+ * @param end - position to stop at
+ * @param out - records
+ * @param max - max records
+ *
+ * @return - records copied
+ */
+size_t capture_read(unsigned long long *cursor, unsigned long long end, capture_record *out, size_t max) {
+    capture_slot *slots = __atomic_load_n(&ring, __ATOMIC_ACQUIRE);
+    size_t count = 0;
+
+    if (slots == nullptr) {
+        *cursor = end;
+        return 0;
+    }
+
+    // Older frames are gone
+    if (*cursor < capture_oldest()) *cursor = capture_oldest();
+
+    while (*cursor < end && count < max) {
+        capture_slot *slot = &slots[*cursor & (CAPTURE_SLOTS - 1)];
+        unsigned long long expected = 2 * *cursor + 2;
+        (*cursor)++;
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != expected) continue;
+        memcpy(&out[count], &slot->record, sizeof(capture_record));
+
+        // Record was overwritten while copied
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != expected) continue;
+
+        count++;
+    }
+
+    return count;
+}
@@ -0,0 +1,284 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pthread.h"
+#include "../inc/config.h"
+#include "../inc/utils.h"
+
+/**
+ * Part of config file parsed by one thread, results are merged in file order
+ */
+typedef struct _config_chunk {
+    const char *begin;
+    const char *end;
+    unsigned int lines;
+    unsigned int first_error;   // Line in chunk of first malformed directive, 0 if none
+    const char *error;
+    daemon_config parsed;
+} config_chunk;
+
+/**
+ * Skips spaces and tabs
+ *
+ * @param p - position
+ * @param end - end of line
+ *
+ * @return - first other character or end
+ */
+static const char *skip_blank(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+
+    return p;
+}
+
+/**
+ * Checks that a token ended where a blank, a comment or end of line follows
+ *
+ * @param p - position after token
+ * @param end - end of line
+ *
+ * @return - true if token is complete
+ */
+static bool at_separator(const char *p, const char *end) {
+    return p == end || *p == ' ' || *p == '\t' || *p == '\r' || *p == '#';
+}
+
+/**
+ * Consumes keyword when it is the next word
+ *
+ * @param cursor - position, moved past keyword and following blanks
+ * @param end - end of line
+ * @param word - keyword
+ *
+ * @return - true if keyword matched
+ */
+static bool scan_word(const char **cursor, const char *end, const char *word) {
+    size_t len = strlen(word);
+    const char *p = *cursor;
+
+    if ((size_t) (end - p) < len || memcmp(p, word, len) != 0) return false;
+    if (!at_separator(p + len, end)) return false;
+
+    *cursor = skip_blank(p + len, end);
+
+    return true;
+}
+
+/**
+ * Parses one directive
+ *
+ * @param p - start of line
+ * @param end - end of line, without newline
+ * @param out - where directive is stored
+ *
+ * @return - error message, nullptr if line was valid
+ */
+static const char *parse_line(const char *p, const char *end, daemon_config *out) {
+    p = skip_blank(p, end);
+
+    // Blank line or comment
+    if (p == end || *p == '#') return nullptr;
+
+    if (scan_word(&p, end, "static")) {
+        arp_table_entry ent{};
+        ent.ttl = ARP_TTL_PERMANENT;
+        ent.kind = ARP_ENTRY_STATIC;
+
+        if (!scan_ip_addr(&p, end, &ent.ipAddress) || !at_separator(p, end)) return "expected IP address";
+        p = skip_blank(p, end);
+        if (!scan_eth_addr(&p, end, ent.ethAddress) || !at_separator(p, end)) return "expected MAC address";
+        p = skip_blank(p, end);
+
+        if (!scan_word(&p, end, "permanent") && p < end && *p != '#') {
+            if (!scan_uint(&p, end, &ent.ttl) || !at_separator(p, end)) return "expected TTL";
+            p = skip_blank(p, end);
+        }
+
+        out->statics.push_back(ent);
+    } else if (scan_word(&p, end, "ttl")) {
+        if (!scan_uint(&p, end, &out->ttl) || !at_separator(p, end)) return "expected TTL";
+        out->has_ttl = true;
+        p = skip_blank(p, end);
+    } else if (scan_word(&p, end, "interface")) {
+        iface_settings ifs{};
+
+        // Name ends at first blank
+        const char *name = p;
+        while (!at_separator(p, end)) p++;
+        if (p == name || p - name >= MAX_IFNAME_LEN) return "expected interface name";
+        memcpy(ifs.ifname, name, (size_t) (p - name));
+        p = skip_blank(p, end);
+
+        while (p < end && *p != '#') {
+            if (scan_word(&p, end, "mtu")) {
+                unsigned int mtu;
+                if (!scan_uint(&p, end, &mtu) || !at_separator(p, end) || mtu == 0 || mtu > 65535) {
+                    return "expected MTU";
+                }
+                ifs.mtu = (int) mtu;
+            } else if (scan_word(&p, end, "address")) {
+                unsigned int len = 32;
+                if (!scan_ip_addr(&p, end, &ifs.ip_addr) || (!at_separator(p, end) && *p != '/')) {
+                    return "expected interface address";
+                }
+                if (p < end && *p == '/') {
+                    p++;
+                    if (!scan_uint(&p, end, &len) || !at_separator(p, end) || len > 32) {
+                        return "expected prefix length";
+                    }
+                }
+                ifs.netmask = len == 0 ? 0 : UINT32_MAX << (32 - len);
+                ifs.has_addr = true;
+            } else {
+                return "unknown interface setting";
+            }
+            p = skip_blank(p, end);
+        }
+
+        out->interfaces.push_back(ifs);
+    } else {
+        return "unknown directive";
+    }
+
+    // Only a comment may follow
+    if (p < end && *p != '#') return "unexpected text after directive";
+
+    return nullptr;
+}
+
+/**
+ * Parser thread, handles every line of its chunk
+ *
+ * @param ctx - config chunk
+ *
+ * @return - void
+ */
+void *parse_chunk(void *ctx) {
+    auto *chunk = (config_chunk *) ctx;
+    const char *p = chunk->begin;
+
+    while (p < chunk->end) {
+        auto *nl = (const char *) memchr(p, '\n', (size_t) (chunk->end - p));
+        const char *line_end = nl != nullptr ? nl : chunk->end;
+        chunk->lines++;
+
+        const char *error = parse_line(p, line_end, &chunk->parsed);
+        if (error != nullptr && chunk->first_error == 0) {
+            chunk->first_error = chunk->lines;
+            chunk->error = error;
+        }
+
+        p = line_end + 1;
+    }
+
+    return nullptr;
+}
+
+/**
+ * Loads config file. Large files are split at line boundaries and parsed by several threads,
+ * parsing never allocates besides growing the result vectors.
+ *
+ * @param path - config file
+ * @param config - parsed config
+ *
+ * @return - false if file could not be read or has a malformed line
+ */
+bool load_config(const char *path, daemon_config *config) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open config %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0) {
+        perror("fstat()");
+        close(fd);
+        return false;
+    }
+
+    config->has_ttl = false;
+    auto size = (size_t) st.st_size;
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap()");
+        return false;
+    }
+
+    const char *data = (const char *) map;
+    const char *end = data + size;
+
+    // One thread per CONFIG_CHUNK_MIN bytes, bounded by online CPUs
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = size / CONFIG_CHUNK_MIN + 1;
+    if (threads > (size_t) (cpus > 0 ? cpus : 1)) threads = (size_t) (cpus > 0 ? cpus : 1);
+    if (threads > CONFIG_MAX_THREADS) threads = CONFIG_MAX_THREADS;
+
+    // Chunks end right after a newline
+    vector<config_chunk> chunks(threads);
+    const char *p = data;
+    for (size_t i = 0; i < threads; ++i) {
+        const char *stop = i + 1 == threads ? end : data + size / threads * (i + 1);
+        if (stop < p) stop = p;
+        auto *nl = (const char *) memchr(stop, '\n', (size_t) (end - stop));
+        stop = nl != nullptr && i + 1 < threads ? nl + 1 : end;
+
+        chunks[i].begin = p;
+        chunks[i].end = stop;
+        chunks[i].lines = 0;
+        chunks[i].first_error = 0;
+        chunks[i].error = nullptr;
+        chunks[i].parsed.has_ttl = false;
+        p = stop;
+    }
+
+    vector<pthread_t> tids(threads);
+    for (size_t i = 1; i < threads; ++i) {
+        if (pthread_create(&tids[i], nullptr, parse_chunk, &chunks[i])) {
+            perror("pthreads()");
+            exit(errno);
+        }
+    }
+    parse_chunk(&chunks[0]);
+    for (size_t i = 1; i < threads; ++i) {
+        pthread_join(tids[i], nullptr);
+    }
+
+    munmap(map, size);
+
+    // Merge in file order so later directives win
+    bool valid = true;
+    unsigned int line_base = 0;
+    for (auto &chunk : chunks) {
+        if (chunk.first_error != 0 && valid) {
+            fprintf(stderr, "%s:%u: %s\n", path, line_base + chunk.first_error, chunk.error);
+            valid = false;
+        }
+
+        config->statics.insert(config->statics.end(), chunk.parsed.statics.begin(), chunk.parsed.statics.end());
+        config->interfaces.insert(config->interfaces.end(), chunk.parsed.interfaces.begin(),
+                                  chunk.parsed.interfaces.end());
+        if (chunk.parsed.has_ttl) {
+            config->ttl = chunk.parsed.ttl;
+            config->has_ttl = true;
+        }
+
+        line_base += chunk.lines;
+    }
+
+    return valid;
+}
@@ -0,0 +1,153 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <cstdlib>
+#include "../inc/control_client.h"
+#include "../inc/types.h"
+
+/**
+ * Connect to daemon over its Unix socket (XARPD_SOCKET overrides the path),
+ * or over TCP when XARPD_TCP is set to "<ip>[:<port>]"
+ *
+ * @return - connected descriptor
+ */
+int control_connect() {
+    int fd;
+    const char *tcp = getenv("XARPD_TCP");
+
+    if (tcp != nullptr) {
+        sockaddr_in addr{};
+        char host[INET_ADDRSTRLEN];
+
+        // Split optional port
+        strncpy(host, tcp, sizeof(host) - 1);
+        host[sizeof(host) - 1] = '\0';
+        char *colon = strchr(host, ':');
+        unsigned short port = XARPD_TCP_PORT;
+        if (colon != nullptr) {
+            *colon = '\0';
+            port = (unsigned short) strtol(colon + 1, nullptr, 10);
+        }
+
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = inet_addr(host);
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_in)) < 0) {
+            perror("ERROR connecting to socket");
+            exit(errno);
+        }
+
+        return fd;
+    }
+
+    sockaddr_un addr{};
+    const char *path = getenv("XARPD_SOCKET");
+    if (path == nullptr) path = XARPD_SOCKET_PATH;
+
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    // Message boundaries come from the socket type
+    fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(sockaddr_un)) < 0) {
+        perror("ERROR connecting to socket");
+        exit(errno);
+    }
+
+    return fd;
+}
+
+/**
+ * Connects to daemon
+ */
+control_client::control_client() {
+    this->fd = control_connect();
+    this->next_id = 1;
+}
+
+/**
+ * Closes connection
+ */
+control_client::~control_client() {
+    close(this->fd);
+}
+
+/**
+ * Sends request frame without waiting for its response
+ *
+ * @param cmd - command
+ * @param config - interface config, only used by interface commands
+ *
+ * @return - request id echoed in response
+ */
+unsigned int control_client::request(const command_hdr *cmd, const config_hdr *config) {
+    unsigned char frame[FRAME_HDR_LEN + WIRE_COMMAND_MAX];
+    config_hdr empty{};
+    unsigned int id = this->next_id++;
+
+    size_t length = encode_command(frame + FRAME_HDR_LEN, cmd, config != nullptr ? config : &empty);
+    encode_frame_hdr(frame, cmd->type, id, length);
+
+    if (send(this->fd, frame, FRAME_HDR_LEN + length, MSG_NOSIGNAL) < 0) {
+        perror("send()");
+        exit(errno);
+    }
+
+    return id;
+}
+
+/**
+ * Blocks until next response frame arrives, responses may come in any order
+ *
+ * @param hdr - decoded frame header
+ * @param payload - frame payload
+ *
+ * @return - false if daemon closed connection or sent malformed frame
+ */
+bool control_client::receive(frame_hdr *hdr, string &payload) {
+    char buffer[CONTROL_RECORD_MAX];
+
+    while (true) {
+        size_t size = frame_size((const unsigned char *) this->in.data(), this->in.size());
+
+        if (size > FRAME_MAX_LEN) {
+            fprintf(stderr, "Daemon sent oversized frame\n");
+            return false;
+        }
+
+        if (size > 0 && this->in.size() >= size) {
+            if (!decode_frame_hdr((const unsigned char *) this->in.data(), hdr)) {
+                fprintf(stderr, "Daemon speaks an unsupported protocol version\n");
+                return false;
+            }
+
+            payload.assign(this->in, FRAME_HDR_LEN, size - FRAME_HDR_LEN);
+            this->in.erase(0, size);
+            return true;
+        }
+
+        long n = recv(this->fd, buffer, CONTROL_RECORD_MAX, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+
+        this->in.append(buffer, (size_t) n);
+    }
+}
+
+/**
+ * Tells daemon no more requests follow, connection closes once responses are flushed
+ */
+void control_client::finish() {
+    shutdown(this->fd, SHUT_WR);
+}
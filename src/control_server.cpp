@@ -0,0 +1,804 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include "../inc/control_server.h"
+#include "../inc/logger.h"
+#include <sys/epoll.h>      // epoll_*
+#include <sys/eventfd.h>    // eventfd
+#include <sys/socket.h>     // accept4, sendmsg, getsockopt
+#include <sys/uio.h>        // iovec
+#include <unistd.h>         // read, close
+#include <fcntl.h>          // fcntl
+#include <string.h>         // strerror, memset
+#include <errno.h>          // errno
+#include <stdio.h>          // printf
+#include <cstdlib>          // exit
+
+/*
+ * Epoll tags, listeners are tagged with their index and connection ids start after them
+ */
+#define CONTROL_TAG_WAKE 0
+#define CONTROL_TAG_LISTEN 1
+#define CONTROL_MAX_LISTENERS 8
+#define CONTROL_FIRST_ID (CONTROL_TAG_LISTEN + CONTROL_MAX_LISTENERS)
+
+// Marks the thread running the event loop
+static thread_local bool on_loop_thread = false;
+
+/**
+ * Control loop thread
+ *
+ * @param ctx - server context
+ *
+ * @return - void
+ */
+void *control_loop(void *ctx) {
+    auto *srv = (control_server *) ctx;
+
+    srv->run();
+
+    return nullptr;
+}
+
+/**
+ * Constructor
+ *
+ * @param handler - request handler
+ */
+control_server::control_server(request_handler handler) {
+    this->handler = handler;
+    this->next_id = CONTROL_FIRST_ID;
+    this->loop_thread = nullptr;
+    this->free_blocks = nullptr;
+    this->free_count = 0;
+
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epoll_fd < 0) {
+        perror("epoll_create1()");
+        exit(errno);
+    }
+
+    // Wake-up for completions from resolver and adopted connections
+    this->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->wake_fd < 0) {
+        perror("eventfd()");
+        exit(errno);
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = CONTROL_TAG_WAKE;
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->wake_fd, &ev);
+}
+
+/**
+ * Serve connections from listening socket, drained by non-blocking accepts
+ *
+ * @param listen_fd - listening socket
+ */
+void control_server::add_listener(int listen_fd) {
+    if (this->listen_fds.size() >= CONTROL_MAX_LISTENERS) {
+        fprintf(stderr, "Too many control listeners\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = CONTROL_TAG_LISTEN + this->listen_fds.size();
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        perror("epoll_ctl()");
+        exit(errno);
+    }
+
+    this->listen_fds.push_back(listen_fd);
+}
+
+/**
+ * Dispatch event loop on its own thread
+ */
+void control_server::start() {
+    this->loop_thread = new pthread_t();
+
+    if (pthread_create(this->loop_thread, nullptr, control_loop, (void *) this)) {
+        perror("pthreads()");
+        exit(errno);
+    }
+}
+
+/**
+ * Event loop
+ */
+void control_server::run() {
+    epoll_event events[CONTROL_MAX_EVENTS];
+
+    on_loop_thread = true;
+
+    while (true) {
+        int n = epoll_wait(this->epoll_fd, events, CONTROL_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait()");
+            exit(errno);
+        }
+
+        for (int i = 0; i < n; ++i) {
+            unsigned long long tag = events[i].data.u64;
+
+            if (tag == CONTROL_TAG_WAKE) {
+                this->drain_completions();
+                continue;
+            }
+
+            if (tag < CONTROL_FIRST_ID) {
+                this->accept_all(this->listen_fds[tag - CONTROL_TAG_LISTEN]);
+                continue;
+            }
+
+            // Connection may have been closed by an earlier event in this batch
+            auto it = this->connections.find(tag);
+            if (it == this->connections.end()) continue;
+            control_connection *c = it->second;
+
+            if (events[i].events & EPOLLERR) {
+                this->close_connection(c);
+                continue;
+            }
+
+            // Peer is gone, requests it already sent are still applied
+            if (events[i].events & EPOLLHUP) {
+                if (!c->read_closed) this->handle_read(c);
+
+                auto left = this->connections.find(tag);
+                if (left != this->connections.end()) this->close_connection(left->second);
+                continue;
+            }
+
+            if (events[i].events & EPOLLOUT) {
+                this->handle_write(c);
+
+                // Write may have closed connection
+                if (this->connections.find(tag) == this->connections.end()) continue;
+            }
+
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                this->handle_read(c);
+            }
+        }
+    }
+}
+
+/**
+ * Accepts every pending connection
+ *
+ * @param listen_fd - listening socket
+ */
+void control_server::accept_all(int listen_fd) {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("Accept()");
+            }
+            return;
+        }
+
+        this->add_connection(fd);
+    }
+}
+
+/**
+ * Registers new connection in loop
+ *
+ * @param fd - connection descriptor
+ */
+void control_server::add_connection(int fd) {
+    auto *c = new control_connection();
+    c->id = this->next_id++;
+    c->fd = fd;
+    c->out_head = nullptr;
+    c->out_tail = nullptr;
+    c->out_pending = 0;
+    c->outstanding = 0;
+    c->read_closed = false;
+    c->dispatching = false;
+    c->pumping = false;
+    c->stream_idle = false;
+    c->events = EPOLLIN | EPOLLRDHUP;
+
+    // Credentials of peer process, TCP connections have none
+    ucred cred{};
+    socklen_t cred_len = sizeof(cred);
+    c->peer.has_creds = getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0 && cred.pid > 0;
+    c->peer.pid = cred.pid;
+    c->peer.uid = cred.uid;
+    c->peer.gid = cred.gid;
+
+    epoll_event ev{};
+    ev.events = c->events;
+    ev.data.u64 = c->id;
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("epoll_ctl()");
+        close(fd);
+        delete c;
+        return;
+    }
+
+    this->connections[c->id] = c;
+}
+
+/**
+ * Closes connection and forgets it, late responses are discarded
+ *
+ * @param c - connection
+ */
+void control_server::close_connection(control_connection *c) {
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, c->fd, nullptr);
+    close(c->fd);
+
+    // Return unsent blocks to pool
+    while (c->out_head != nullptr) {
+        control_block *b = c->out_head;
+        c->out_head = b->next;
+        this->release_block(b);
+    }
+
+    this->connections.erase(c->id);
+    delete c;
+}
+
+/**
+ * Takes output block from pool
+ *
+ * @return - empty block
+ */
+control_block *control_server::alloc_block() {
+    control_block *b = this->free_blocks;
+
+    if (b != nullptr) {
+        this->free_blocks = b->next;
+        this->free_count--;
+    } else {
+        b = new control_block;
+    }
+
+    b->next = nullptr;
+    b->used = 0;
+    b->sent = 0;
+
+    return b;
+}
+
+/**
+ * Returns output block to pool, pool is capped so idle memory stays bounded
+ *
+ * @param b - block
+ */
+void control_server::release_block(control_block *b) {
+    if (this->free_count >= CONTROL_POOL_MAX) {
+        delete b;
+        return;
+    }
+
+    b->next = this->free_blocks;
+    this->free_blocks = b;
+    this->free_count++;
+}
+
+/**
+ * Checks if connection has nothing left to do: peer stopped sending and every response was flushed
+ *
+ * @param c - connection
+ *
+ * @return - true if connection can be closed
+ */
+bool control_server::finished(control_connection *c) {
+    return c->read_closed && !c->dispatching && c->outstanding == 0 && c->streams.empty() && c->out_pending == 0;
+}
+
+/**
+ * Polls for what connection is waiting on, reading pauses while too many responses are queued
+ *
+ * @param c - connection
+ */
+void control_server::update_events(control_connection *c) {
+    unsigned int events = 0;
+
+    if (!c->read_closed && c->out_pending < CONTROL_OUT_MAX) events |= EPOLLIN | EPOLLRDHUP;
+    if (c->out_pending > 0) events |= EPOLLOUT;
+
+    if (events == c->events) return;
+    c->events = events;
+
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.u64 = c->id;
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/**
+ * Reads available bytes and dispatches every complete frame. Frames are decoded straight from
+ * the read buffer, only a trailing partial frame is kept on the connection.
+ *
+ * @param c - connection
+ */
+void control_server::handle_read(control_connection *c) {
+    unsigned char buffer[CONTROL_RECORD_MAX];
+    size_t consumed;
+
+    while (c->out_pending < CONTROL_OUT_MAX) {
+        long n = read(c->fd, buffer, CONTROL_RECORD_MAX);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        // Peer is done sending, pending responses are still flushed
+        if (n == 0) {
+            c->read_closed = true;
+            break;
+        }
+
+        if (n < 0) {
+            this->close_connection(c);
+            return;
+        }
+
+        if (c->in.empty()) {
+            if (!this->dispatch_frames(c, buffer, (size_t) n, &consumed)) return;
+            c->in.append((const char *) buffer + consumed, (size_t) n - consumed);
+        } else {
+            // Complete frame carried over from previous read
+            c->in.append((const char *) buffer, (size_t) n);
+            if (!this->dispatch_frames(c, (const unsigned char *) c->in.data(), c->in.size(), &consumed)) return;
+            c->in.erase(0, consumed);
+        }
+
+        // Responses of this batch leave in one sendmsg
+        if (!this->flush(c)) return;
+    }
+
+    this->settle(c);
+}
+
+/**
+ * Decodes complete frames and hands them to handler, malformed payloads are answered with BAD_REQUEST
+ *
+ * @param c - connection
+ * @param data - received bytes
+ * @param available - amount of received bytes
+ * @param consumed - bytes of complete frames
+ *
+ * @return - false if connection was closed
+ */
+bool control_server::dispatch_frames(control_connection *c, const unsigned char *data, size_t available,
+                                     size_t *consumed) {
+    unsigned long long id = c->id;
+    size_t offset = 0;
+
+    c->dispatching = true;
+
+    while (true) {
+        size_t size = frame_size(data + offset, available - offset);
+
+        if (size == 0) break;
+
+        // Stream cannot be resynchronized after a bad length, checked before waiting for the rest so
+        // a peer cannot make the partial frame buffer grow past one frame
+        if (size < FRAME_HDR_LEN || size > FRAME_MAX_LEN) {
+            log_warn("Dropping connection with malformed frame");
+            this->close_connection(c);
+            return false;
+        }
+
+        if (available - offset < size) break;
+
+        frame_hdr hdr{};
+        request_msg req{};
+        bool valid = decode_frame_hdr(data + offset, &hdr) &&
+                     decode_command(hdr.type, data + offset + FRAME_HDR_LEN, size - FRAME_HDR_LEN, &req.cmd,
+                                    &req.config);
+        offset += size;
+        c->outstanding++;
+
+        if (valid) {
+            req.id = hdr.request_id;
+            this->handler(this, id, &c->peer, &req);
+
+            // Handler may have closed connection
+            auto it = this->connections.find(id);
+            if (it == this->connections.end()) return false;
+            c = it->second;
+        } else {
+            this->reserve_on(c, 0);
+            this->commit_on(c, hdr.request_id, COMMAND_BAD_REQUEST, 0, 0);
+        }
+    }
+
+    c->dispatching = false;
+    *consumed = offset;
+
+    return true;
+}
+
+/**
+ * Sends queued blocks with scatter-gather writes until socket is full
+ *
+ * @param c - connection
+ *
+ * @return - false if connection was closed
+ */
+bool control_server::flush(control_connection *c) {
+    while (c->out_pending > 0) {
+        iovec iov[CONTROL_IOV_MAX];
+        int count = 0;
+
+        for (control_block *b = c->out_head; b != nullptr && count < CONTROL_IOV_MAX; b = b->next) {
+            if (b->used == b->sent) continue;
+            iov[count].iov_base = b->data + b->sent;
+            iov[count].iov_len = b->used - b->sent;
+            count++;
+        }
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t) count;
+
+        long n = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+
+            // Wait until socket is writable again
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+
+            this->close_connection(c);
+            return false;
+        }
+
+        // Release fully sent blocks
+        auto left = (size_t) n;
+        c->out_pending -= left;
+        while (left > 0) {
+            control_block *b = c->out_head;
+            size_t chunk = b->used - b->sent;
+
+            if (left < chunk) {
+                b->sent += left;
+                break;
+            }
+
+            left -= chunk;
+            b->sent = b->used;
+
+            // Tail stays in place while it still has room for more frames
+            if (b == c->out_tail) break;
+            c->out_head = b->next;
+            this->release_block(b);
+        }
+    }
+
+    // Everything was sent, tail can be reused from the start
+    if (c->out_tail != nullptr) {
+        this->release_block(c->out_tail);
+        c->out_head = nullptr;
+        c->out_tail = nullptr;
+    }
+
+    return true;
+}
+
+/**
+ * Decides what connection waits on after a flush: more stream chunks, closing or polling
+ *
+ * @param c - connection
+ */
+void control_server::settle(control_connection *c) {
+    // Socket has room, produce next chunk of streamed responses
+    if (!c->pumping && !c->dispatching && c->out_pending == 0 && !c->streams.empty() && !c->stream_idle) {
+        this->pump(c);
+        return;
+    }
+
+    if (this->finished(c)) {
+        this->close_connection(c);
+        return;
+    }
+
+    this->update_events(c);
+}
+
+/**
+ * Flushes queued responses once socket is writable again
+ *
+ * @param c - connection
+ */
+void control_server::handle_write(control_connection *c) {
+    if (!this->flush(c)) return;
+
+    this->settle(c);
+}
+
+/**
+ * Runs stream producers while socket keeps up, only one chunk is queued at a time
+ *
+ * @param c - connection
+ */
+void control_server::pump(control_connection *c) {
+    unsigned long long id = c->id;
+
+    c->pumping = true;
+
+    while (!c->streams.empty() && c->out_pending == 0 && !c->stream_idle) {
+        bool more = c->streams.front()(this, id);
+
+        // Producer may have closed connection
+        auto it = this->connections.find(id);
+        if (it == this->connections.end()) return;
+        c = it->second;
+
+        if (!more) c->streams.pop_front();
+
+        if (!this->flush(c)) return;
+    }
+
+    c->pumping = false;
+
+    if (this->finished(c)) {
+        this->close_connection(c);
+        return;
+    }
+
+    this->update_events(c);
+}
+
+/**
+ * Reserves zeroed room for one frame at the end of output queue
+ *
+ * @param c - connection
+ * @param room - payload bytes needed, at most CONTROL_PAYLOAD_MAX
+ *
+ * @return - where payload should be encoded
+ */
+unsigned char *control_server::reserve_on(control_connection *c, size_t room) {
+    control_block *b = c->out_tail;
+
+    // Frames never span blocks
+    if (b == nullptr || CONTROL_BLOCK_SIZE - b->used < FRAME_HDR_LEN + room) {
+        b = this->alloc_block();
+
+        if (c->out_tail != nullptr) {
+            c->out_tail->next = b;
+        } else {
+            c->out_head = b;
+        }
+        c->out_tail = b;
+    }
+
+    // Pooled blocks keep bytes of earlier responses, encoders skipping a padding byte must not leak them
+    unsigned char *payload = b->data + b->used + FRAME_HDR_LEN;
+    memset(payload, 0, room);
+
+    return payload;
+}
+
+/**
+ * Completes frame whose payload was encoded in reserved room and queues it
+ *
+ * @param c - connection
+ * @param request_id - request being answered
+ * @param type - response type
+ * @param length - payload length
+ * @param flags - FRAME_FLAG_MORE if more frames follow for this request
+ */
+void control_server::commit_on(control_connection *c, unsigned int request_id, unsigned short type, size_t length,
+                               unsigned char flags) {
+    control_block *b = c->out_tail;
+
+    encode_frame_hdr(b->data + b->used, type, request_id, length, flags);
+    b->used += FRAME_HDR_LEN + length;
+    c->out_pending += FRAME_HDR_LEN + length;
+
+    // Request is answered once its last frame is queued
+    if (!(flags & FRAME_FLAG_MORE) && c->outstanding > 0) c->outstanding--;
+
+    // Batched responses are flushed by whoever is dispatching or pumping
+    if (c->dispatching || c->pumping) return;
+
+    if (!this->flush(c)) return;
+    this->settle(c);
+}
+
+/**
+ * Reserves room for a response payload, must run on loop thread.
+ * Reservation is valid until commit or next reserve on the same connection.
+ *
+ * @param con - connection id
+ * @param room - payload bytes needed, at most CONTROL_PAYLOAD_MAX
+ *
+ * @return - where payload should be encoded, nullptr if connection is gone
+ */
+unsigned char *control_server::reserve(unsigned long long con, size_t room) {
+    auto it = this->connections.find(con);
+    if (it == this->connections.end()) return nullptr;
+
+    return this->reserve_on(it->second, room);
+}
+
+/**
+ * Queues reserved frame, must run on loop thread
+ *
+ * @param con - connection id
+ * @param request_id - request being answered
+ * @param type - response type
+ * @param length - payload length
+ * @param flags - FRAME_FLAG_MORE if more frames follow for this request
+ */
+void control_server::commit(unsigned long long con, unsigned int request_id, unsigned short type, size_t length,
+                            unsigned char flags) {
+    auto it = this->connections.find(con);
+    if (it == this->connections.end()) return;
+
+    this->commit_on(it->second, request_id, type, length, flags);
+}
+
+/**
+ * Attaches producer for a response too large to build at once, must run on loop thread.
+ * Producer is called whenever connection has flushed what was queued before.
+ *
+ * @param con - connection id
+ * @param producer - chunk producer
+ */
+void control_server::stream(unsigned long long con, stream_producer producer) {
+    auto it = this->connections.find(con);
+    if (it == this->connections.end()) return;
+
+    control_connection *c = it->second;
+    c->streams.push_back(producer);
+
+    if (!c->pumping && !c->dispatching && c->out_pending == 0 && !c->stream_idle) {
+        this->pump(c);
+    }
+}
+
+/**
+ * Parks front stream producer of connection until resume, must be called by that producer.
+ * Streams queued behind it wait as well.
+ *
+ * @param con - connection id
+ */
+void control_server::idle(unsigned long long con) {
+    auto it = this->connections.find(con);
+    if (it == this->connections.end()) return;
+
+    it->second->stream_idle = true;
+}
+
+/**
+ * Runs parked stream producer again, safe to call from any thread
+ *
+ * @param con - connection id
+ */
+void control_server::resume(unsigned long long con) {
+    {
+        lock_guard<mutex> guard(this->completion_lock);
+        this->resumed.push_back(con);
+    }
+
+    this->wake();
+}
+
+/**
+ * Sends response frame to connection, safe to call from any thread.
+ * Outside the loop thread payload must fit CONTROL_INLINE_MAX.
+ *
+ * @param con - connection id
+ * @param request_id - request being answered
+ * @param type - response type
+ * @param payload - encoded payload
+ * @param length - payload length
+ * @param flags - FRAME_FLAG_MORE if more frames follow for this request
+ */
+void control_server::respond(unsigned long long con, unsigned int request_id, unsigned short type,
+                             const void *payload, size_t length, unsigned char flags) {
+    if (on_loop_thread) {
+        unsigned char *data = this->reserve(con, length);
+        if (data == nullptr) return;
+
+        if (length > 0) memcpy(data, payload, length);
+        this->commit(con, request_id, type, length, flags);
+        return;
+    }
+
+    if (length > CONTROL_INLINE_MAX) {
+        fprintf(stderr, "Response of %zu bytes is too large to hand over, answering BAD_REQUEST\n", length);
+        type = COMMAND_BAD_REQUEST;
+        length = 0;
+        flags = 0;
+    }
+
+    {
+        lock_guard<mutex> guard(this->completion_lock);
+        this->completions.emplace_back();
+
+        control_completion &completion = this->completions.back();
+        completion.con = con;
+        completion.request_id = request_id;
+        completion.type = type;
+        completion.flags = flags;
+        completion.length = (unsigned short) length;
+        if (length > 0) memcpy(completion.payload, payload, length);
+    }
+
+    this->wake();
+}
+
+/**
+ * Hands an already accepted connection to the loop, safe to call from any thread
+ *
+ * @param fd - connection descriptor
+ */
+void control_server::adopt(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    {
+        lock_guard<mutex> guard(this->completion_lock);
+        this->adopted.push_back(fd);
+    }
+
+    this->wake();
+}
+
+/**
+ * Wakes loop thread
+ */
+void control_server::wake() {
+    unsigned long long one = 1;
+
+    if (write(this->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("write(eventfd)");
+    }
+}
+
+/**
+ * Picks up work handed over by other threads
+ */
+void control_server::drain_completions() {
+    unsigned long long value;
+
+    // Reset wake-up counter
+    if (read(this->wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        perror("read(eventfd)");
+    }
+
+    {
+        lock_guard<mutex> guard(this->completion_lock);
+        this->completions_spare.swap(this->completions);
+        this->adopted_spare.swap(this->adopted);
+        this->resumed_spare.swap(this->resumed);
+    }
+
+    for (int fd : this->adopted_spare) {
+        this->add_connection(fd);
+    }
+
+    for (auto &completion : this->completions_spare) {
+        this->respond(completion.con, completion.request_id, completion.type, completion.payload,
+                      completion.length, completion.flags);
+    }
+
+    for (unsigned long long con : this->resumed_spare) {
+        auto it = this->connections.find(con);
+        if (it == this->connections.end() || !it->second->stream_idle) continue;
+
+        control_connection *c = it->second;
+        c->stream_idle = false;
+        if (!c->pumping && !c->dispatching && c->out_pending == 0) this->pump(c);
+    }
+
+    this->adopted_spare.clear();
+    this->completions_spare.clear();
+    this->resumed_spare.clear();
+}
@@ -0,0 +1,129 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include "../inc/histogram.h"
+
+histogram::histogram() {
+    for (auto &bucket : this->buckets) bucket.store(0, memory_order_relaxed);
+    this->count.store(0, memory_order_relaxed);
+    this->sum.store(0, memory_order_relaxed);
+    this->min.store(~0ull, memory_order_relaxed);
+    this->max.store(0, memory_order_relaxed);
+}
+
+/**
+ * Bucket of value, small values get one bucket each and larger ones share a bucket
+ * with values of the same magnitude and top HIST_SUB_BITS bits
+ *
+ * @param value - value
+ *
+ * @return - bucket index
+ */
+unsigned int histogram::bucket_of(unsigned long long value) {
+    if (value >= (1ull << HIST_MAX_BITS)) value = (1ull << HIST_MAX_BITS) - 1;
+    if (value < HIST_SUB_COUNT) return (unsigned int) value;
+
+    unsigned int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+
+    return (shift + 1) * HIST_SUB_COUNT + (unsigned int) ((value >> shift) - HIST_SUB_COUNT);
+}
+
+/**
+ * Largest value falling in bucket
+ *
+ * @param bucket - bucket index
+ *
+ * @return - value
+ */
+unsigned long long histogram::bucket_high(unsigned int bucket) {
+    if (bucket < HIST_SUB_COUNT) return bucket;
+
+    unsigned int shift = bucket / HIST_SUB_COUNT - 1;
+    unsigned long long mantissa = bucket % HIST_SUB_COUNT + HIST_SUB_COUNT;
+
+    return ((mantissa + 1) << shift) - 1;
+}
+
+/**
+ * Adds sample
+ *
+ * @param ns - latency in nanoseconds
+ */
+void histogram::record(unsigned long long ns) {
+    this->buckets[bucket_of(ns)].fetch_add(1, memory_order_relaxed);
+    this->count.fetch_add(1, memory_order_relaxed);
+    this->sum.fetch_add(ns, memory_order_relaxed);
+
+    unsigned long long seen = this->min.load(memory_order_relaxed);
+    while (ns < seen && !this->min.compare_exchange_weak(seen, ns, memory_order_relaxed));
+
+    seen = this->max.load(memory_order_relaxed);
+    while (ns > seen && !this->max.compare_exchange_weak(seen, ns, memory_order_relaxed));
+}
+
+/**
+ * Computes count, extremes, mean and percentiles. Samples recorded meanwhile may be
+ * partly included, percentiles are upper bounds of their bucket.
+ *
+ * @param out - summary
+ */
+void histogram::summarize(latency_summary *out) {
+    static const unsigned int permille[] = {500, 900, 990, 999};
+    unsigned long long *targets[] = {&out->p50, &out->p90, &out->p99, &out->p999};
+    unsigned long long counts[HIST_BUCKETS];
+    unsigned long long total = 0;
+
+    // Bucket snapshot decides percentiles so they agree with each other
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        counts[i] = this->buckets[i].load(memory_order_relaxed);
+        total += counts[i];
+    }
+
+    out->count = total;
+    out->min = total == 0 ? 0 : this->min.load(memory_order_relaxed);
+    out->max = this->max.load(memory_order_relaxed);
+    unsigned long long n = this->count.load(memory_order_relaxed);
+    out->mean = n == 0 ? 0 : this->sum.load(memory_order_relaxed) / n;
+
+    unsigned long long seen = 0;
+    unsigned int bucket = 0;
+    for (int p = 0; p < 4; ++p) {
+        // Smallest bucket holding the wanted rank
+        unsigned long long rank = (total * permille[p] + 999) / 1000;
+        while (bucket < HIST_BUCKETS && (seen + counts[bucket] < rank || counts[bucket] == 0)) {
+            seen += counts[bucket];
+            bucket++;
+        }
+
+        unsigned long long value = bucket < HIST_BUCKETS ? bucket_high(bucket) : out->max;
+        *targets[p] = total == 0 ? 0 : (value < out->max ? value : out->max);
+    }
+}
+
+/**
+ * Counts samples below consecutive powers of two, bucket edges fall on them so counts are exact
+ *
+ * @param first_bits - first power, at least HIST_SUB_BITS
+ * @param n - powers to count, first_bits + n - 1 at most HIST_MAX_BITS
+ * @param below - output, below[i] is samples under 2^(first_bits + i) ns
+ * @param sum - output, sum of samples in ns
+ *
+ * @return - samples in snapshot
+ */
+unsigned long long histogram::below_powers(unsigned int first_bits, unsigned int n, unsigned long long *below,
+                                           unsigned long long *sum) {
+    unsigned long long total = 0;
+    unsigned int next = 0;
+
+    for (unsigned int i = 0; i < HIST_BUCKETS; ++i) {
+        // 2^b starts bucket (b - HIST_SUB_BITS + 1) * HIST_SUB_COUNT
+        while (next < n && i == (first_bits + next - HIST_SUB_BITS + 1) * HIST_SUB_COUNT) below[next++] = total;
+        total += this->buckets[i].load(memory_order_relaxed);
+    }
+    while (next < n) below[next++] = total;
+
+    *sum = this->sum.load(memory_order_relaxed);
+
+    return total;
+}
@@ -5,13 +5,17 @@
 #include "../inc/utils.h"
 #include "../inc/interface_worker.h"
 #include "../inc/arp_table.h"
-#include <net/if.h>         // ifreq
-#include <net/ethernet.h>   // ETH_P_ALL
+#include "../inc/resolver.h"
+#include "../inc/logger.h"
+#include "../inc/stats.h"
+#include "../inc/probes.h"
+#include "../inc/capture.h"
+#ifdef XARPD_IO_URING
+#include "../inc/uring_engine.h"
+#endif
+#include <net/ethernet.h>   // ETH_P_ARP
 #include <linux/if_packet.h>// sockaddr_ll
-#include <linux/if_arp.h>   // ARPHRD_ETHER
-#include <sys/ioctl.h>      // SIOCGIFHWADDR
-#include <sys/socket.h>     // socket()
-#include <sys/types.h>      // socket()
+#include <time.h>           // clock_gettime
 #include <arpa/inet.h>      // htons
 #include <string.h>         // strerror
 #include <errno.h>          // errno
@@ -19,9 +23,6 @@
 #include <mutex>
 #include "pthread.h"
 
-#define ETH_ADDR_LEN 6
-#define BUFFER_SIZE 1024
-#define DEFAULT_MTU 1500
 
 /**
  * Interface reader thread
@@ -33,98 +34,140 @@
 void *reader(void *ctx) {
     auto *ir = (interface_worker *) ctx;
 
+    // Prepare buffer, frames longer than buffer are truncated and ARP always fits
+    char buffer[PACKET_IO_FRAME_MAX];
+
     while (true) {
-        // Prepare buffers
-        char buffer[BUFFER_SIZE + 1];
-        auto data = new std::string();
-        unsigned int data_size = 0;
-        memset(buffer, '\0', BUFFER_SIZE);
-
-        // Keep reading until the end
-        long segment_size = BUFFER_SIZE;
-        while (segment_size == BUFFER_SIZE && data_size < BUFFER_SIZE) {
-            // Read data to buffer
-            segment_size = (unsigned long) read(ir->iface_data->sockfd, buffer, BUFFER_SIZE);
-
-            // Check for errors
-            if (segment_size < 0) {
-                printf("ERROR: %s\n", strerror(errno));
-
-                return nullptr;
-            } else if (segment_size > BUFFER_SIZE) {
-                // This should only happen with read() ignores max buffer size
-                printf("Reading buffer overflow\n");
-                exit(1);
-            } else {
-                // Push data to string buffer
-                data_size += segment_size;
-                data->append(buffer, (unsigned long) segment_size);
-            }
+        unsigned long long rx_ns = 0;
+        ssize_t size = ir->io->receive(buffer, PACKET_IO_FRAME_MAX, &rx_ns);
+
+        // Check for errors
+        if (size < 0) {
+            log_error("receive(): %s", log_errno(errno));
+
+            return nullptr;
+        }
+
+        // Replayed sources end
+        if (size == 0) {
+            log_info("No more frames on %s", ir->iface_data->ifname);
+
+            return nullptr;
         }
 
         // Count statistics
-        ir->iface_data->rx_bytes += data->size();
-        ir->iface_data->rx_pkts++;
+        stats_add(ir->stats_slot, STAT_RX_FRAMES);
+        stats_add(ir->stats_slot, STAT_RX_BYTES, (unsigned long long) size);
 
         // Process received packet
-        ir->process_packet(data->c_str(), data_size);
+        ir->process_packet(buffer, (unsigned int) size, rx_ns);
     }
 }
 
+/**
+ * Wall clock time, same clock as socket receive timestamps
+ *
+ * @return - nanoseconds since epoch
+ */
+static unsigned long long wall_ns() {
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (unsigned long long) now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
 /**
  * Process raw packet data
  *
  * @param data - raw data
  * @param length - total data length
+ * @param rx_ns - kernel receive timestamp, 0 when socket has none
  */
-void interface_worker::process_packet(const char *data, unsigned int length) {
+void interface_worker::process_packet(const char *data, unsigned int length, unsigned long long rx_ns) {
     // Ethernet data
     auto *eth = (eth_hdr *) data;
-    unsigned int eth_data_length = length - sizeof(eth_hdr);
 
-    // If frame is directed to this interface
-    bool me = eth_address_eq(this->iface_data->mac_addr, eth->ether_dhost);
+    XARPD_PROBE2(frame__received, (const char *) this->iface_data->ifname, length);
 
     // Processing should only continue if packet is ARP
-    if (ntohs(eth->ether_type) == ETH_P_ARP) {
-        // Copy data from Ethernet frame to form ARP packet
-        char *arp_data = new char[eth_data_length];
-        memcpy(arp_data, data + sizeof(eth_hdr), eth_data_length);
-        auto *arp = (arp_hdr *) arp_data;
-        printf("Received ARP packet: %d\n", ntohs(arp->opcode));
-
-        // Fix variable length fields
-        build_arp_header(data, arp);
+    if (length >= sizeof(eth_hdr) && ntohs(eth->ether_type) == ETH_P_ARP) {
+        // Malformed frames are captured too, they are what debugging is after
+        capture_frame(this->iface_data->ifname, CAPTURE_RX, data, length);
+
+        // Only Ethernet/IPv4 ARP is understood
+        arp_hdr parsed{};
+        auto *arp = &parsed;
+        if (!parse_arp_frame(data, length, arp)) {
+            stats_add(this->stats_slot, STAT_PARSE_ERRORS);
+            XARPD_PROBE2(frame__malformed, (const char *) this->iface_data->ifname, length);
+            return;
+        }
+        log_debug("Received ARP packet: %d", ntohs(arp->opcode));
+        XARPD_PROBE4(arp__classified, (const char *) this->iface_data->ifname, ntohs(arp->opcode),
+                     ntohl(arp->sender_ip), ntohl(arp->destination_ip));
 
         // Check what kind of ARP operation we received
         if (ntohs(arp->opcode) == ARP_REQUEST) {
-            // Debug
-            print_ip_addr((char *) "Received ARP request for: ", ntohl(arp->destination_ip));
-            printf("\n");
+            stats_add(this->stats_slot, STAT_ARP_REQUESTS);
+
+            // Without a kernel timestamp latency starts once frame reached us
+            if (rx_ns == 0) rx_ns = wall_ns();
+            log_debug("Received ARP request for: %s", log_ip(ntohl(arp->destination_ip)));
 
             // Check if we can reply this request
-            arp_table_entry *entry = this->table->find_by_ip(ntohl(arp->destination_ip));
+            arp_table_entry entry{};
 
             // Reply request if we have an entry
-            if (entry != nullptr) {
-                printf("Found entry in ARP table\n");
+            if (this->table->copy_by_ip(ntohl(arp->destination_ip), &entry)) {
+                stats_add(this->stats_slot, STAT_TABLE_HITS);
+                XARPD_PROBE2(table__hit, (const char *) this->iface_data->ifname, entry.ipAddress);
+                log_debug("Found entry in ARP table");
                 // Reply request if entry exists
-                this->reply_arp(arp, entry);
+                this->reply_arp(arp, &entry);
+
+                unsigned long long sent_ns = wall_ns();
+                unsigned long long took = sent_ns > rx_ns ? sent_ns - rx_ns : 0;
+                this->latency[LATENCY_REPLY].record(took);
+                XARPD_PROBE3(reply__sent, (const char *) this->iface_data->ifname, entry.ipAddress, took);
             } else {
-                printf("No entry found in ARP table\n");
+                stats_add(this->stats_slot, STAT_TABLE_MISSES);
+                XARPD_PROBE2(table__miss, (const char *) this->iface_data->ifname,
+                             ntohl(arp->destination_ip));
+                log_debug("No entry found in ARP table");
             }
         } else if (ntohs(arp->opcode) == ARP_REPLY) {
-            // Debug
-            print_ip_addr((char *) "Received ARP reply from: ", ntohl(arp->sender_ip));
-            printf("\n");
+            stats_add(this->stats_slot, STAT_ARP_REPLIES);
+            log_debug("Received ARP reply from: %s", log_ip(ntohl(arp->sender_ip)));
 
             // Learn new entry from reply
             this->table->add(ntohl(arp->sender_ip), arp->sender_mac);
+
+            // Wake requests waiting on this IP
+            if (this->resolv != nullptr) {
+                this->resolv->learned(ntohl(arp->sender_ip), arp->sender_mac);
+            }
         }
 
     }
 }
 
+/**
+ * Sums counters of every thread and folds in backend receive statistics, which are reset
+ * each time they are read
+ *
+ * @param out - totals indexed by STAT_*
+ */
+void interface_worker::read_stats(unsigned long long out[STAT_COUNT]) {
+    stats_read(this->stats_slot, out);
+
+    lock_guard<mutex> guard(this->kernel_lock);
+
+    this->io->read_drops(&this->kernel_packets, &this->kernel_drops);
+
+    out[STAT_KERNEL_PACKETS] = this->kernel_packets;
+    out[STAT_KERNEL_DROPS] = this->kernel_drops;
+}
+
 /**
  * Dispatch interface worker thread
  *
@@ -150,126 +193,87 @@ void dispatch_reader(interface_worker *ctx) {
  */
 interface_worker::interface_worker(string *iface_name, arp_table *main, interface_worker **workers, int worker_count) {
     this->iface_name = iface_name;
-    this->iface_data = new iface;
+    this->iface_data = new iface();
+    this->stats_slot = stats_register();
+    this->kernel_packets = 0;
+    this->kernel_drops = 0;
     this->workers = workers;
     this->worker_count = worker_count;
+    this->engine = nullptr;
+    this->resolv = nullptr;
+    this->settings = nullptr;
+    this->io = nullptr;
     this->set_table(main);
 }
 
 /**
- * Bind worker to interface
+ * Closes backend of a worker that was never started
  */
-void interface_worker::bind() {
-    // Create socket
-    this->rawsockfd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+interface_worker::~interface_worker() {
+    delete this->io;
+    delete this->iface_data;
+    delete this->iface_name;
+    stats_unregister(this->stats_slot);
+}
 
-    // Check for errors
-    if (rawsockfd < 0) {
-        fprintf(stderr, "ERROR: %s\n", strerror(errno));
-        exit(errno);
+/**
+ * Attach worker to interface through its backend, a raw socket unless set_io gave another one
+ *
+ * @return - false if interface cannot be used, reason is already printed
+ */
+bool interface_worker::open() {
+    if (this->io == nullptr) {
+        this->io = new raw_socket_io();
     }
 
-    // Bind socket to interface
-    if (bind_iface_name(rawsockfd, (char *) this->iface_name->c_str()) < 0) {
-        perror("Server-setsockopt() error for SO_BINDTODEVICE");
-        printf("%s\n", strerror(errno));
-        close(this->rawsockfd);
-        exit(errno);
+    // Attach and query interface information
+    if (!this->io->open(this->iface_name->c_str(), this->iface_data)) {
+        fprintf(stderr, "Could not open %s\n", this->iface_name->c_str());
+        return false;
     }
 
-    // Query interface information
-    this->get_iface_info(rawsockfd, (char *) this->iface_name->c_str(), this->iface_data);
+    // Configured values replace what backend reported
+    if (this->settings != nullptr) {
+        if (this->settings->has_addr) {
+            this->iface_data->ip_addr = this->settings->ip_addr;
+            this->iface_data->netmask = this->settings->netmask;
+        }
+        if (this->settings->mtu > 0) {
+            this->iface_data->mtu = this->settings->mtu;
+        }
+    }
 
     // Debug iface data
     print_iface(this->iface_data);
 
     // Print current interface Ethernet address
     print_eth_address(iface_data->ifname, iface_data->mac_addr);
+    printf("\n");
 
-    // Dispatch reader thread
-    dispatch_reader(this);
+    return true;
 }
 
 /**
- * Bind interface by name
- *
- * @param fd - socket file descriptor
- * @param iface_name - interface name
- *
- * @return - return value of setsockopt function
+ * Start receiving on opened interface
  */
-int interface_worker::bind_iface_name(int fd, char *iface_name) {
-    return setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, iface_name, (socklen_t) strlen(iface_name));
+void interface_worker::start() {
+    // Dispatch reader thread unless an io_uring engine services this socket
+    if (this->engine == nullptr) {
+        dispatch_reader(this);
+    }
 }
 
 /**
- * Queries interface information
+ * Open interface and start receiving
  *
- * @param sockfd - socket file descriptor for interface
- * @param ifname - interface name
- * @param ifn  - interface information object
+ * @return - false if interface cannot be used, nothing is started then
  */
-void interface_worker::get_iface_info(int sockfd, char *ifname, iface *ifn) {
-    /*
-     * Structure allocations
-     */
-    struct ifreq s{};
-    struct ifreq if_idx{};
-    struct ifreq netmask{};
-    struct ifreq ipaddr{};
-
-    ifn->mtu = DEFAULT_MTU;
+bool interface_worker::bind() {
+    if (!this->open()) return false;
 
-    /*
-     * Network Mask
-     */
-    strcpy(netmask.ifr_name, ifname);
-    if (0 == ioctl(sockfd, SIOCGIFNETMASK, &netmask)) {
-        for (int i = 0; i < 4; ++i) {
-            ifn->netmask += (unsigned char) netmask.ifr_netmask.sa_data[i + 2] << (24 - (i * 8));
-        }
-        printf("NetMask: %08X\n", ifn->netmask);
-    } else {
-        perror("Error getting NetMask");
-        exit(errno);
-    }
+    this->start();
 
-    /*
-     * IP Address
-     */
-    strcpy(ipaddr.ifr_name, ifname);
-    if (0 == ioctl(sockfd, SIOCGIFADDR, &ipaddr)) {
-        for (int i = 0; i < 4; ++i) {
-            ifn->ip_addr += (unsigned char) ipaddr.ifr_addr.sa_data[i + 2] << (24 - (i * 8));
-        }
-    } else {
-        perror("Error getting IP Address");
-        exit(errno);
-    }
-
-    /*
-     * MAC Address
-     */
-    strcpy(s.ifr_name, ifname);
-    if (0 == ioctl(sockfd, SIOCGIFHWADDR, &s)) {
-        memcpy(&ifn->mac_addr, &s.ifr_addr.sa_data, ETH_ADDR_LEN);
-        ifn->sockfd = sockfd;
-        strcpy(ifn->ifname, ifname);
-    } else {
-        perror("Error getting MAC address");
-        exit(errno);
-    }
-
-    /*
-     * Interface index
-     */
-    strncpy(if_idx.ifr_name, ifname, IFNAMSIZ - 1);
-    if (ioctl(sockfd, SIOCGIFINDEX, &if_idx) < 0) {
-        perror("SIOCGIFINDEX");
-        exit(errno);
-    }
-    printf("IF is running at %d==%d\n", if_idx.ifr_ifindex, s.ifr_ifru.ifru_ivalue);
-    ifn->index = if_idx.ifr_ifindex;
+    return true;
 }
 
 /**
@@ -282,109 +286,92 @@ void interface_worker::set_table(arp_table *table) {
 }
 
 /**
- * Build reply ARP header
+ * Set io_uring engine used for packet I/O, must be called before start()
  *
- * @param arp - arp header to build
- * @param entry - arp entry to respond
+ * @param engine - engine pointer, nullptr for blocking reader thread
  */
-void interface_worker::reply_arp(arp_hdr *arp, arp_table_entry *entry) {
-    auto *p = new arp_hdr;
-    auto *sa = new sockaddr_ll;
-    char *pck = new char[14 + sizeof(arp_hdr)]; // 14 = Ethernet header size
-
-    /*
-     * Socket address
-     */
-    sa->sll_ifindex = this->iface_data->index;
-    sa->sll_family = PF_PACKET;
-    sa->sll_halen = ETH_ALEN;
-    memcpy(sa->sll_addr, arp->sender_mac, sizeof(char) * 6);
-
-    /*
-     * ARP header placeholder
-     */
-    p->hardware_type = htons(1);
-    p->protocol_type = htons(ETH_P_IP);
-    memcpy(p->sender_mac, entry->ethAddress, sizeof(char) * 6);
-    memcpy(p->destination_mac, arp->sender_mac, sizeof(char) * 6);
-    p->sender_ip = htonl(entry->ipAddress);
-    p->destination_ip = htonl(arp->sender_ip);
-    p->opcode = htons(ARP_REPLY);
-    p->hardware_length = HW_ADDR_LEN;
-    p->protocol_length = sizeof(this->iface_data->ip_addr);
-
-    /*
-     * Build Ethernet header
-     */
-    memcpy(pck, arp->sender_mac, sizeof(char) * 6);
-    memcpy(pck + 6, entry->ethAddress, sizeof(char) * 6);
-    pck[12] = ETH_P_ARP / 256;
-    pck[13] = ETH_P_ARP % 256;
-
-    // Point to end of Ethernet header
-    char *pt = pck + 14;
-
-    /*
-     * Build ARP header
-     */
-    memcpy(pt, &p->hardware_type, sizeof(short));
-    pt += sizeof(short);
-
-    memcpy(pt, &p->protocol_type, sizeof(short));
-    pt += sizeof(short);
-
-    memcpy(pt, &p->hardware_length, sizeof(char));
-    pt += sizeof(char);
-
-    memcpy(pt, &p->protocol_length, sizeof(char));
-    pt += sizeof(char);
-
-    memcpy(pt, &p->opcode, sizeof(short));
-    pt += sizeof(short);
+void interface_worker::set_engine(uring_engine *engine) {
+    this->engine = engine;
+}
 
-    memcpy(pt, p->sender_mac, sizeof(char) * 6);
-    pt += sizeof(char) * 6;
+/**
+ * Set resolver notified when replies are learned
+ *
+ * @param resolv - resolver pointer
+ */
+void interface_worker::set_resolver(resolver *resolv) {
+    this->resolv = resolv;
+}
 
-    memcpy(pt, &p->sender_ip, sizeof(int));
-    pt += sizeof(int);
+/**
+ * Set packet backend, must be called before open
+ *
+ * @param io - backend, nullptr for a raw socket
+ */
+void interface_worker::set_io(packet_io *io) {
+    this->io = io;
+}
 
-    memcpy(pt, p->destination_mac, sizeof(char) * 6);
-    pt += sizeof(char) * 6;
+/**
+ * Set configured interface settings, must be called before open
+ *
+ * @param settings - settings, nullptr keeps kernel values
+ */
+void interface_worker::set_settings(const iface_settings *settings) {
+    this->settings = settings;
+}
 
-    memcpy(pt, &p->destination_ip, sizeof(int));
-    pt += sizeof(int);
+/**
+ * Send raw frame, batching through io_uring engine when available
+ *
+ * @param frame - raw frame, destination is its Ethernet destination
+ * @param length - frame length
+ */
+void interface_worker::send_frame(const char *frame, unsigned int length) {
+    stats_add(this->stats_slot, STAT_TX_FRAMES);
+    stats_add(this->stats_slot, STAT_TX_BYTES, length);
+    capture_frame(this->iface_data->ifname, CAPTURE_TX, frame, length);
+
+#ifdef XARPD_IO_URING
+    if (this->engine != nullptr) {
+        sockaddr_ll sa{};
+        sa.sll_ifindex = this->iface_data->index;
+        sa.sll_family = PF_PACKET;
+        sa.sll_halen = ETH_ALEN;
+        memcpy(sa.sll_addr, frame, ETH_ALEN);
+
+        if (this->engine->queue_send(this->io->fd(), frame, length, &sa)) return;
+    }
+#endif
 
-    /*
-     * Send raw frame
-     */
-    if (sendto(rawsockfd, pck, sizeof(arp_hdr) + 14, 0, (struct sockaddr *) sa, sizeof(struct sockaddr_ll)) < 0) {
+    if (!this->io->send(frame, length)) {
         perror("sendto");
         exit(errno);
     }
-
-    printf("Sent!\n");
 }
 
 /**
- * Resolve Ethernet address of given IP
+ * Build reply ARP header
  *
- * @param ip - ip to solve
+ * @param arp - arp header to build
+ * @param entry - arp entry to respond
  */
-void interface_worker::resolve_ip(unsigned int ip) {
-    print_ip_addr((char *) "Resolving: ", ip);
-    printf("\n");
+void interface_worker::reply_arp(arp_hdr *arp, arp_table_entry *entry) {
+    char frame[ARP_FRAME_LEN];
 
-    // Find interface that handles the network for IP
-    auto w = find_interface_worker(ip, this->workers, this->worker_count);
+    /*
+     * Entry answers requester directly
+     */
+    unsigned int length = encode_arp_frame(frame, ARP_REPLY, arp->sender_mac, entry->ethAddress, entry->ipAddress,
+                                           arp->sender_mac, ntohl(arp->sender_ip));
 
-    // Send ARP request if Interface Worker was found
-    if(w != nullptr) {
-        w->arp_request(ip);
-    } else {
-        printf("Could not find interface worker for IP: ");
-        print_ip_addr((char*)"", ip);
-        printf("\n");
-    }
+    /*
+     * Send raw frame
+     */
+    this->send_frame(frame, length);
+    stats_add(this->stats_slot, STAT_REPLIES_SENT);
+
+    log_debug("Sent!");
 }
 
 /**
@@ -393,9 +380,7 @@ void interface_worker::resolve_ip(unsigned int ip) {
  * @param ip - ip address to arp request
  */
 void interface_worker::arp_request(unsigned int ip) {
-    auto *p = new arp_hdr;
-    auto *sa = new sockaddr_ll;
-    char *pck = new char[14 + sizeof(arp_hdr)]; // 14 = Ethernet header size
+    char frame[ARP_FRAME_LEN];
 
     /*
      * Build fixed Ethernet addresses
@@ -408,78 +393,15 @@ void interface_worker::arp_request(unsigned int ip) {
     }
 
     /*
-     * Socket address
+     * Broadcast request from interface address
      */
-    sa->sll_ifindex = this->iface_data->index;
-    sa->sll_family = PF_PACKET;
-    sa->sll_halen = ETH_ALEN;
-    memcpy(sa->sll_addr, this->iface_data->mac_addr, sizeof(char) * 6);
-
-    /*
-     * Build ARP header placeholder
-     */
-    p->hardware_type = htons(1);
-    p->protocol_type = htons(ETH_P_IP);
-    memcpy(p->sender_mac, this->iface_data->mac_addr, sizeof(char) * 6);
-    memcpy(p->destination_mac, request_mac, sizeof(char) * 6);
-    p->sender_ip = htonl(this->iface_data->ip_addr);
-    p->destination_ip = htonl(ip);
-    p->opcode = htons(ARP_REQUEST);
-    p->hardware_length = HW_ADDR_LEN;
-    p->protocol_length = sizeof(this->iface_data->ip_addr);
-
-    /*
-     * Build Ethernet header
-     */
-    memcpy(pck, broadcast_mac, sizeof(char) * 6);
-    memcpy(pck + 6, this->iface_data->mac_addr, sizeof(char) * 6);
-    pck[12] = ETH_P_ARP / 256;
-    pck[13] = ETH_P_ARP % 256;
-
-    // Point to end of Ethernet header
-    char *pt = pck + 14;
-
-    /*
-     * Build actual ARP header
-     */
-    memcpy(pt, &p->hardware_type, sizeof(short));
-    pt += sizeof(short);
-
-    memcpy(pt, &p->protocol_type, sizeof(short));
-    pt += sizeof(short);
-
-    memcpy(pt, &p->hardware_length, sizeof(char));
-    pt += sizeof(char);
-
-    memcpy(pt, &p->protocol_length, sizeof(char));
-    pt += sizeof(char);
-
-    memcpy(pt, &p->opcode, sizeof(short));
-    pt += sizeof(short);
-
-    memcpy(pt, p->sender_mac, sizeof(char) * 6);
-    pt += sizeof(char) * 6;
-
-    memcpy(pt, &p->sender_ip, sizeof(int));
-    pt += sizeof(int);
-
-    memcpy(pt, p->destination_mac, sizeof(char) * 6);
-    pt += sizeof(char) * 6;
-
-    memcpy(pt, &p->destination_ip, sizeof(int));
-    pt += sizeof(int);
-
-    // Count statistics
-    this->iface_data->tx_bytes += sizeof(arp_hdr);
-    this->iface_data->tx_pkts++;
+    unsigned int length = encode_arp_frame(frame, ARP_REQUEST, broadcast_mac, this->iface_data->mac_addr,
+                                           this->iface_data->ip_addr, request_mac, ip);
 
     /*
      * Send raw frame
      */
-    if (sendto(rawsockfd, pck, sizeof(arp_hdr) + 14, 0, (struct sockaddr *) sa, sizeof(struct sockaddr_ll)) < 0) {
-        perror("sendto");
-        exit(errno);
-    }
+    this->send_frame(frame, length);
 
-    printf("Sent!\n");
+    log_debug("Sent!");
 }
@@ -0,0 +1,336 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <mutex>
+#include <vector>
+#include "pthread.h"
+#include "../inc/logger.h"
+
+// Longest line produced by formatter
+#define LOG_LINE_MAX 512
+
+/**
+ * Single producer single consumer ring owned by one thread at a time
+ */
+typedef struct _log_ring {
+    log_record records[LOG_RING_SIZE];
+    atomic<unsigned int> head;          // Next record written by owner
+    atomic<unsigned int> tail;          // Next record printed by formatter
+    atomic<unsigned long long> dropped;
+    atomic<bool> owned;                 // Owner exited, ring may be reused once empty
+} log_ring;
+
+/**
+ * Releases ring when its thread exits
+ */
+class log_ring_owner {
+public:
+    log_ring *ring = nullptr;
+
+    ~log_ring_owner() {
+        if (this->ring != nullptr) this->ring->owned.store(false, memory_order_release);
+    }
+};
+
+int log_level = LOG_LEVEL_INFO;
+
+static mutex registry_lock;
+static vector<log_ring *> rings;
+
+// Only one thread formats at a time, exit flush may race the formatter thread
+static mutex drain_lock;
+static unsigned long long dropped_total = 0;
+
+static pthread_once_t formatter_once = PTHREAD_ONCE_INIT;
+static thread_local log_ring_owner ring_owner;
+
+/**
+ * Sets level, records above it are skipped before arguments are evaluated
+ *
+ * @param level - LOG_LEVEL_*
+ */
+void log_set_level(int level) {
+    __atomic_store_n(&log_level, level, __ATOMIC_RELAXED);
+}
+
+/**
+ * Parses level name or number
+ *
+ * @param name - error, warn, info, debug or 0-3
+ *
+ * @return - level, -1 if unknown
+ */
+int log_parse_level(const char *name) {
+    static const char *names[] = {"error", "warn", "info", "debug"};
+
+    for (int i = LOG_LEVEL_ERROR; i <= LOG_LEVEL_DEBUG; ++i) {
+        if (strcmp(name, names[i]) == 0) return i;
+    }
+    if (name[0] >= '0' && name[0] <= '3' && name[1] == '\0') return name[0] - '0';
+
+    return -1;
+}
+
+/**
+ * Records lost to full rings, including ones not reported yet
+ *
+ * @return - dropped records
+ */
+unsigned long long log_dropped() {
+    lock_guard<mutex> registry(registry_lock);
+    unsigned long long total = __atomic_load_n(&dropped_total, __ATOMIC_RELAXED);
+
+    for (auto ring : rings) total += ring->dropped.load(memory_order_relaxed);
+
+    return total;
+}
+
+/**
+ * Appends argument to line, conversion spec is reused for numbers and strings
+ *
+ * @param line - line buffer
+ * @param len - used length
+ * @param spec - conversion including '%', length modifiers removed
+ * @param spec_len - spec length
+ * @param arg - argument
+ *
+ * @return - new length
+ */
+static size_t render_arg(char *line, size_t len, const char *spec, size_t spec_len, const log_arg *arg) {
+    char fmt[32];
+    size_t room = LOG_LINE_MAX - len;
+    int n = 0;
+
+    if (spec_len + 3 > sizeof(fmt)) spec_len = sizeof(fmt) - 3;
+    char conv = spec[spec_len - 1];
+
+    switch (arg->type) {
+        case LOG_ARG_INT:
+        case LOG_ARG_UINT:
+            // Widen conversion to long long
+            memcpy(fmt, spec, spec_len - 1);
+            fmt[spec_len - 1] = 'l';
+            fmt[spec_len] = 'l';
+            fmt[spec_len + 1] = strchr("diouxX", conv) == nullptr ? (arg->type == LOG_ARG_INT ? 'd' : 'u') : conv;
+            fmt[spec_len + 2] = '\0';
+            n = arg->type == LOG_ARG_INT ? snprintf(line + len, room, fmt, arg->i) : snprintf(line + len, room, fmt, arg->u);
+            break;
+        case LOG_ARG_STR:
+            memcpy(fmt, spec, spec_len - 1);
+            fmt[spec_len - 1] = 's';
+            fmt[spec_len] = '\0';
+            n = snprintf(line + len, room, fmt, arg->s != nullptr ? arg->s : "(null)");
+            break;
+        case LOG_ARG_IP:
+            n = snprintf(line + len, room, "%u.%u.%u.%u", (unsigned int) (arg->u >> 24) & 0xFF,
+                         (unsigned int) (arg->u >> 16) & 0xFF, (unsigned int) (arg->u >> 8) & 0xFF,
+                         (unsigned int) arg->u & 0xFF);
+            break;
+        case LOG_ARG_MAC:
+            n = snprintf(line + len, room, "%02X:%02X:%02X:%02X:%02X:%02X", arg->mac[0], arg->mac[1], arg->mac[2],
+                         arg->mac[3], arg->mac[4], arg->mac[5]);
+            break;
+        case LOG_ARG_ERRNO:
+            n = snprintf(line + len, room, "%s", strerror((int) arg->i));
+            break;
+    }
+
+    if (n < 0) return len;
+
+    return (size_t) n >= room ? LOG_LINE_MAX - 1 : len + n;
+}
+
+/**
+ * Formats record into line
+ *
+ * @param rec - record
+ * @param line - buffer of LOG_LINE_MAX bytes
+ *
+ * @return - line length including newline
+ */
+static size_t format_record(const log_record *rec, char *line) {
+    static const char *prefixes[] = {"ERROR: ", "WARN: ", "", ""};
+    size_t len = strlen(prefixes[rec->level & 3]);
+    unsigned int next = 0;
+
+    memcpy(line, prefixes[rec->level & 3], len);
+
+    for (const char *p = rec->fmt; *p != '\0' && len < LOG_LINE_MAX - 2; ++p) {
+        if (*p != '%') {
+            line[len++] = *p;
+            continue;
+        }
+        if (p[1] == '%') {
+            line[len++] = '%';
+            p++;
+            continue;
+        }
+
+        // Copy flags and width, drop length modifiers, stop at conversion
+        char spec[16];
+        size_t spec_len = 0;
+        spec[spec_len++] = '%';
+        const char *q = p + 1;
+        while (*q != '\0' && strchr("diouxXscp", *q) == nullptr) {
+            if (strchr("hlzjt", *q) == nullptr && spec_len < sizeof(spec) - 1) spec[spec_len++] = *q;
+            q++;
+        }
+        if (*q == '\0') break;
+        spec[spec_len++] = *q;
+        p = q;
+
+        if (next < rec->argc) len = render_arg(line, len, spec, spec_len, &rec->args[next++]);
+    }
+
+    line[len++] = '\n';
+
+    return len;
+}
+
+/**
+ * Prints every queued record in time order across rings
+ */
+static void drain() {
+    char line[LOG_LINE_MAX];
+    vector<log_ring *> current;
+    bool wrote = false;
+
+    {
+        lock_guard<mutex> registry(registry_lock);
+        current = rings;
+    }
+
+    while (true) {
+        // Oldest head among non-empty rings
+        log_ring *oldest = nullptr;
+        unsigned long long oldest_time = 0;
+        for (auto ring : current) {
+            unsigned int tail = ring->tail.load(memory_order_relaxed);
+            if (tail == ring->head.load(memory_order_acquire)) continue;
+
+            unsigned long long t = ring->records[tail % LOG_RING_SIZE].time_ns;
+            if (oldest == nullptr || t < oldest_time) {
+                oldest = ring;
+                oldest_time = t;
+            }
+        }
+        if (oldest == nullptr) break;
+
+        unsigned int tail = oldest->tail.load(memory_order_relaxed);
+        size_t len = format_record(&oldest->records[tail % LOG_RING_SIZE], line);
+        oldest->tail.store(tail + 1, memory_order_release);
+
+        fwrite(line, 1, len, stdout);
+        wrote = true;
+    }
+
+    // Report losses after what made it through
+    for (auto ring : current) {
+        unsigned long long dropped = ring->dropped.exchange(0, memory_order_relaxed);
+        if (dropped == 0) continue;
+
+        __atomic_fetch_add(&dropped_total, dropped, __ATOMIC_RELAXED);
+        fprintf(stdout, "WARN: Dropped %llu log records\n", dropped);
+        wrote = true;
+    }
+
+    if (wrote) fflush(stdout);
+}
+
+/**
+ * Prints queued records, called at exit so messages before it are not lost
+ */
+void log_flush() {
+    lock_guard<mutex> guard(drain_lock);
+
+    drain();
+}
+
+/**
+ * Formatter thread
+ *
+ * @param ctx - unused
+ *
+ * @return - void
+ */
+void *formatter(void * /*ctx*/) {
+    while (true) {
+        log_flush();
+        usleep(LOG_FLUSH_US);
+    }
+}
+
+/**
+ * Starts formatter on first use
+ */
+static void start_formatter() {
+    pthread_t tid;
+
+    if (pthread_create(&tid, nullptr, formatter, nullptr)) {
+        perror("pthreads()");
+        exit(errno);
+    }
+    pthread_detach(tid);
+
+    atexit(log_flush);
+}
+
+/**
+ * Ring of calling thread, reuses a drained ring of an exited thread
+ *
+ * @return - ring
+ */
+static log_ring *thread_ring() {
+    if (ring_owner.ring != nullptr) return ring_owner.ring;
+
+    pthread_once(&formatter_once, start_formatter);
+
+    lock_guard<mutex> registry(registry_lock);
+    for (auto ring : rings) {
+        if (ring->owned.load(memory_order_acquire)) continue;
+        if (ring->tail.load(memory_order_acquire) != ring->head.load(memory_order_relaxed)) continue;
+
+        ring->owned.store(true, memory_order_relaxed);
+        ring_owner.ring = ring;
+        return ring;
+    }
+
+    auto *ring = new log_ring();
+    ring->head.store(0, memory_order_relaxed);
+    ring->tail.store(0, memory_order_relaxed);
+    ring->dropped.store(0, memory_order_relaxed);
+    ring->owned.store(true, memory_order_relaxed);
+    rings.push_back(ring);
+    ring_owner.ring = ring;
+
+    return ring;
+}
+
+/**
+ * Copies record into calling thread's ring, counts it as dropped when ring is full
+ *
+ * @param rec - record, time is set here
+ */
+void log_push(log_record *rec) {
+    log_ring *ring = thread_ring();
+    unsigned int head = ring->head.load(memory_order_relaxed);
+
+    if (head - ring->tail.load(memory_order_acquire) >= LOG_RING_SIZE) {
+        ring->dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    rec->time_ns = (unsigned long long) now.tv_sec * 1000000000ull + now.tv_nsec;
+
+    ring->records[head % LOG_RING_SIZE] = *rec;
+    ring->head.store(head + 1, memory_order_release);
+}
@@ -0,0 +1,171 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include <string.h>
+#include "../inc/memory_io.h"
+
+/**
+ * Constructor
+ *
+ * @param mac - interface hardware address
+ * @param ip - interface address, host order
+ * @param netmask - interface netmask, host order
+ * @param capacity - frames queued before push blocks
+ */
+memory_io::memory_io(const unsigned char mac[], unsigned int ip, unsigned int netmask, size_t capacity) {
+    memcpy(this->mac, mac, HW_ADDR_LEN);
+    this->ip = ip;
+    this->netmask = netmask;
+    this->slots.resize(capacity > 0 ? capacity : 1);
+    this->head = 0;
+    this->tail = 0;
+    this->closed = false;
+    this->waiting = false;
+    this->sink = nullptr;
+    this->sent_frames.store(0, memory_order_relaxed);
+}
+
+/**
+ * Reports identity given at construction
+ *
+ * @param ifname - interface name
+ * @param out - interface data
+ *
+ * @return - always true
+ */
+bool memory_io::open(const char *ifname, iface *out) {
+    strncpy(out->ifname, ifname, MAX_IFNAME_LEN - 1);
+    memcpy(out->mac_addr, this->mac, HW_ADDR_LEN);
+    out->ip_addr = this->ip;
+    out->netmask = this->netmask;
+    out->mtu = 1500;
+    out->index = 0;
+    out->sockfd = -1;
+
+    return true;
+}
+
+/**
+ * Waits for a pushed frame
+ *
+ * @param buffer - frame buffer
+ * @param size - buffer size
+ * @param rx_ns - set to 0, latency is measured from processing
+ *
+ * @return - frame length, 0 once closed and drained
+ */
+ssize_t memory_io::receive(char *buffer, size_t size, unsigned long long *rx_ns) {
+    unique_lock<mutex> guard(this->lock);
+
+    while (this->head == this->tail && !this->closed) {
+        // Previous frame is processed once worker comes back for the next one
+        this->waiting = true;
+        this->idle.notify_all();
+        this->not_empty.wait(guard);
+    }
+    this->waiting = false;
+
+    if (this->head == this->tail) {
+        // Closed and drained, worker is done for good
+        this->idle.notify_all();
+        return 0;
+    }
+
+    memory_frame *f = &this->slots[this->head % this->slots.size()];
+    size_t length = f->length < size ? f->length : size;
+    memcpy(buffer, f->data, length);
+
+    // Pusher only waits when queue was full
+    bool was_full = this->tail - this->head == this->slots.size();
+    this->head++;
+    if (was_full) this->not_full.notify_one();
+
+    *rx_ns = 0;
+
+    return (ssize_t) length;
+}
+
+/**
+ * Hands frame to sink
+ *
+ * @param frame - frame
+ * @param length - frame length
+ *
+ * @return - always true
+ */
+bool memory_io::send(const char *frame, unsigned int length) {
+    this->sent_frames.fetch_add(1, memory_order_relaxed);
+    if (this->sink) this->sink(frame, length);
+
+    return true;
+}
+
+/**
+ * Sets where sent frames go, must be called before worker sends
+ *
+ * @param sink - sink, nullptr only counts frames
+ */
+void memory_io::set_sink(frame_sink sink) {
+    this->sink = move(sink);
+}
+
+/**
+ * Queues frame for worker, blocks while queue is full
+ *
+ * @param frame - frame, truncated to PACKET_IO_FRAME_MAX
+ * @param length - frame length
+ *
+ * @return - false once closed
+ */
+bool memory_io::push(const char *frame, unsigned int length) {
+    unique_lock<mutex> guard(this->lock);
+
+    while (this->tail - this->head == this->slots.size() && !this->closed) {
+        this->not_full.wait(guard);
+    }
+    if (this->closed) return false;
+
+    memory_frame *f = &this->slots[this->tail % this->slots.size()];
+    f->length = length < PACKET_IO_FRAME_MAX ? length : PACKET_IO_FRAME_MAX;
+    memcpy(f->data, frame, f->length);
+
+    // Worker only waits when queue was empty
+    bool was_empty = this->head == this->tail;
+    this->tail++;
+    if (was_empty) this->not_empty.notify_one();
+
+    return true;
+}
+
+/**
+ * Waits until worker processed every pushed frame and waits for more, or input is closed and drained
+ */
+void memory_io::wait_idle() {
+    unique_lock<mutex> guard(this->lock);
+
+    while (this->head != this->tail || (!this->waiting && !this->closed)) {
+        this->idle.wait(guard);
+    }
+}
+
+/**
+ * Ends input, worker receives what is queued and then sees end of frames
+ */
+void memory_io::close() {
+    lock_guard<mutex> guard(this->lock);
+
+    this->closed = true;
+    this->not_empty.notify_all();
+    this->not_full.notify_all();
+    this->idle.notify_all();
+}
+
+/**
+ * Frames sent by worker so far
+ *
+ * @return - frame count
+ */
+unsigned long long memory_io::sent() {
+    return this->sent_frames.load(memory_order_relaxed);
+}
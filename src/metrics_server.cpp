@@ -0,0 +1,309 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include "../inc/metrics_server.h"
+#include "../inc/logger.h"
+#include <sys/socket.h>     // socket, accept4, send
+#include <sys/time.h>       // timeval
+#include <netinet/in.h>     // sockaddr_in
+#include <arpa/inet.h>      // inet_pton
+#include <unistd.h>         // read, close
+#include <strings.h>        // strncasecmp
+#include <string.h>         // strchr
+#include <errno.h>          // errno
+#include <stdio.h>          // printf, snprintf
+#include <cstdlib>          // exit, strtol
+
+/**
+ * Metrics thread
+ *
+ * @param ctx - server context
+ *
+ * @return - void
+ */
+void *metrics_loop(void *ctx) {
+    auto *srv = (metrics_server *) ctx;
+
+    srv->run();
+
+    return nullptr;
+}
+
+/**
+ * Constructor
+ *
+ * @param render - writes metric families on every scrape
+ * @param ctx - renderer context
+ */
+metrics_server::metrics_server(metrics_renderer render, void *ctx) {
+    this->listen_fd = -1;
+    this->render = render;
+    this->ctx = ctx;
+    this->thread = nullptr;
+}
+
+/**
+ * Opens listening socket
+ *
+ * @param address - [ip:]port, ip defaults to loopback so metrics are not exposed by accident
+ *
+ * @return - false if address is invalid or taken
+ */
+bool metrics_server::listen(const char *address) {
+    sockaddr_in sa{};
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    const char *colon = strrchr(address, ':');
+    const char *port_str = address;
+    if (colon != nullptr) {
+        string host(address, colon - address);
+        if (inet_pton(AF_INET, host.c_str(), &sa.sin_addr) != 1) {
+            fprintf(stderr, "Invalid metrics address: %s\n", address);
+            return false;
+        }
+        port_str = colon + 1;
+    }
+
+    char *end;
+    long port = strtol(port_str, &end, 10);
+    if (*port_str == '\0' || *end != '\0' || port <= 0 || port > 65535) {
+        fprintf(stderr, "Invalid metrics port: %s\n", address);
+        return false;
+    }
+    sa.sin_port = htons((unsigned short) port);
+
+    this->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (this->listen_fd < 0) {
+        perror("socket()");
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(this->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (bind(this->listen_fd, (struct sockaddr *) &sa, sizeof(sa)) == -1 || ::listen(this->listen_fd, 16) == -1) {
+        perror("metrics bind()");
+        close(this->listen_fd);
+        this->listen_fd = -1;
+        return false;
+    }
+
+    printf("Serving metrics on %s:%ld\n", inet_ntoa(sa.sin_addr), port);
+
+    return true;
+}
+
+/**
+ * Serves scrapes on a thread of their own
+ */
+void metrics_server::start() {
+    this->thread = new pthread_t();
+
+    if (pthread_create(this->thread, nullptr, metrics_loop, (void *) this)) {
+        perror("pthreads()");
+        exit(errno);
+    }
+}
+
+/**
+ * Accepts and answers scrapes forever
+ */
+void metrics_server::run() {
+    while (true) {
+        int fd = accept4(this->listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) log_warn("Metrics accept(): %s", log_errno(errno));
+            continue;
+        }
+
+        this->serve(fd);
+        close(fd);
+    }
+}
+
+/**
+ * Sends whole buffer, gives up on timeout or error
+ *
+ * @param fd - connection
+ * @param data - bytes
+ * @param length - byte count
+ *
+ * @return - true if everything was sent
+ */
+static bool send_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+
+        data += n;
+        length -= n;
+    }
+
+    return true;
+}
+
+/**
+ * Answers one request, connection is closed afterwards
+ *
+ * @param fd - connection
+ */
+void metrics_server::serve(int fd) {
+    timeval tv{};
+    tv.tv_sec = METRICS_IO_TIMEOUT_MS / 1000;
+    tv.tv_usec = (METRICS_IO_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // Read request head, body is never expected
+    char request[METRICS_REQUEST_MAX + 1];
+    size_t used = 0;
+    while (used < METRICS_REQUEST_MAX) {
+        ssize_t n = read(fd, request + used, METRICS_REQUEST_MAX - used);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+
+        used += n;
+        request[used] = '\0';
+        if (strstr(request, "\r\n\r\n") != nullptr || strstr(request, "\n\n") != nullptr) break;
+    }
+    request[used] = '\0';
+
+    const char *status = "200 OK";
+    string body;
+    bool openmetrics = false;
+    bool head = strncmp(request, "HEAD ", 5) == 0;
+
+    if (strncmp(request, "GET ", 4) != 0 && !head) {
+        status = "405 Method Not Allowed";
+        body = "Only GET is supported\n";
+    } else {
+        const char *path = request + (head ? 5 : 4);
+        size_t path_len = strcspn(path, " ?\r\n");
+        if (!(path_len == 8 && strncmp(path, "/metrics", 8) == 0) && !(path_len == 1 && *path == '/')) {
+            status = "404 Not Found";
+            body = "Metrics are served on /metrics\n";
+        } else {
+            // Scrapers that ask for OpenMetrics get it, everyone else gets Prometheus text
+            for (const char *line = strchr(request, '\n'); line != nullptr; line = strchr(line + 1, '\n')) {
+                if (strncasecmp(line + 1, "Accept:", 7) != 0) continue;
+
+                const char *eol = strchr(line + 1, '\n');
+                string accept(line + 8, eol != nullptr ? eol - line - 8 : strlen(line + 8));
+                openmetrics = accept.find("application/openmetrics-text") != string::npos;
+                break;
+            }
+
+            body.reserve(16 * 1024);
+            this->render(body, openmetrics, this->ctx);
+            if (openmetrics) body += "# EOF\n";
+        }
+    }
+
+    const char *content_type = openmetrics ? "application/openmetrics-text; version=1.0.0; charset=utf-8"
+                                           : "text/plain; version=0.0.4; charset=utf-8";
+    char header[256];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                              status, content_type, body.size());
+
+    if (!send_all(fd, header, (size_t) header_len)) return;
+    if (!head) send_all(fd, body.data(), body.size());
+}
+
+/**
+ * Writes HELP and TYPE lines, counter families are named without _total in OpenMetrics
+ *
+ * @param out - exposition
+ * @param openmetrics - OpenMetrics instead of Prometheus text
+ * @param name - family name, counters without _total
+ * @param type - counter, gauge or histogram
+ * @param help - description
+ */
+void metrics_family(string &out, bool openmetrics, const char *name, const char *type, const char *help) {
+    const char *suffix = !openmetrics && strcmp(type, "counter") == 0 ? "_total" : "";
+
+    out += "# HELP ";
+    out += name;
+    out += suffix;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += suffix;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+/**
+ * Appends key="value" to label set, escaping value
+ *
+ * @param labels - labels without braces, comma separated
+ * @param key - label name
+ * @param value - label value
+ */
+void metrics_label(string &labels, const char *key, const char *value) {
+    if (!labels.empty()) labels += ',';
+    labels += key;
+    labels += "=\"";
+    for (const char *p = value; *p != '\0'; ++p) {
+        if (*p == '\\' || *p == '"') {
+            labels += '\\';
+            labels += *p;
+        } else if (*p == '\n') {
+            labels += "\\n";
+        } else {
+            labels += *p;
+        }
+    }
+    labels += '"';
+}
+
+/**
+ * Writes integer sample
+ *
+ * @param out - exposition
+ * @param name - sample name
+ * @param labels - labels from metrics_label, may be empty
+ * @param value - value
+ */
+void metrics_sample(string &out, const char *name, const string &labels, unsigned long long value) {
+    char number[24];
+    snprintf(number, sizeof(number), "%llu", value);
+
+    out += name;
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+    out += number;
+    out += '\n';
+}
+
+/**
+ * Writes floating point sample
+ *
+ * @param out - exposition
+ * @param name - sample name
+ * @param labels - labels from metrics_label, may be empty
+ * @param value - value
+ */
+void metrics_sample(string &out, const char *name, const string &labels, double value) {
+    char number[32];
+    snprintf(number, sizeof(number), "%.9g", value);
+
+    out += name;
+    if (!labels.empty()) {
+        out += '{';
+        out += labels;
+        out += '}';
+    }
+    out += ' ';
+    out += number;
+    out += '\n';
+}
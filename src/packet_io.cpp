@@ -0,0 +1,220 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include "../inc/packet_io.h"
+#include "../inc/logger.h"
+#include <net/if.h>         // ifreq
+#include <net/ethernet.h>   // ETH_P_ALL
+#include <linux/if_packet.h>// sockaddr_ll, tpacket_stats
+#include <sys/ioctl.h>      // SIOCGIFHWADDR
+#include <sys/socket.h>     // socket, recvmsg, sendto
+#include <arpa/inet.h>      // htons
+#include <time.h>           // timespec
+#include <string.h>         // strerror
+#include <errno.h>          // errno
+#include <unistd.h>         // close
+#include <stdio.h>          // perror
+
+#define DEFAULT_MTU 1500
+
+/**
+ * Constructor
+ */
+raw_socket_io::raw_socket_io() {
+    this->sockfd = -1;
+    this->ifindex = 0;
+}
+
+/**
+ * Destructor
+ */
+raw_socket_io::~raw_socket_io() {
+    if (this->sockfd >= 0) close(this->sockfd);
+}
+
+/**
+ * Opens packet socket bound to interface and queries interface information
+ *
+ * @param ifname - interface name
+ * @param out - interface data
+ *
+ * @return - false if socket cannot be opened or interface is unknown
+ */
+bool raw_socket_io::open(const char *ifname, iface *out) {
+    // Create socket
+    this->sockfd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+
+    // Check for errors
+    if (this->sockfd < 0) {
+        fprintf(stderr, "ERROR: %s\n", strerror(errno));
+        return false;
+    }
+
+    // Bind socket to interface
+    if (setsockopt(this->sockfd, SOL_SOCKET, SO_BINDTODEVICE, ifname, (socklen_t) strlen(ifname)) < 0) {
+        perror("Server-setsockopt() error for SO_BINDTODEVICE");
+        close(this->sockfd);
+        this->sockfd = -1;
+        return false;
+    }
+
+    // Kernel timestamps received frames, reply latency then includes time spent queued
+    int on = 1;
+    if (setsockopt(this->sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+        log_warn("No receive timestamps on %s: %s", ifname, log_errno(errno));
+    }
+
+    return this->query(ifname, out);
+}
+
+/**
+ * Queries interface information
+ *
+ * @param ifname - interface name
+ * @param ifn - interface information object
+ *
+ * @return - false if kernel does not know interface
+ */
+bool raw_socket_io::query(const char *ifname, iface *ifn) {
+    /*
+     * Structure allocations
+     */
+    struct ifreq s{};
+    struct ifreq if_idx{};
+    struct ifreq netmask{};
+    struct ifreq ipaddr{};
+
+    ifn->mtu = DEFAULT_MTU;
+
+    /*
+     * Network Mask
+     */
+    strncpy(netmask.ifr_name, ifname, IFNAMSIZ - 1);
+    if (0 == ioctl(this->sockfd, SIOCGIFNETMASK, &netmask)) {
+        for (int i = 0; i < 4; ++i) {
+            ifn->netmask += (unsigned char) netmask.ifr_netmask.sa_data[i + 2] << (24 - (i * 8));
+        }
+        printf("NetMask: %08X\n", ifn->netmask);
+    } else {
+        perror("Error getting NetMask");
+        return false;
+    }
+
+    /*
+     * IP Address
+     */
+    strncpy(ipaddr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (0 == ioctl(this->sockfd, SIOCGIFADDR, &ipaddr)) {
+        for (int i = 0; i < 4; ++i) {
+            ifn->ip_addr += (unsigned char) ipaddr.ifr_addr.sa_data[i + 2] << (24 - (i * 8));
+        }
+    } else {
+        perror("Error getting IP Address");
+        return false;
+    }
+
+    /*
+     * MAC Address
+     */
+    strncpy(s.ifr_name, ifname, IFNAMSIZ - 1);
+    if (0 == ioctl(this->sockfd, SIOCGIFHWADDR, &s)) {
+        memcpy(&ifn->mac_addr, &s.ifr_addr.sa_data, HW_ADDR_LEN);
+        ifn->sockfd = this->sockfd;
+        strncpy(ifn->ifname, ifname, MAX_IFNAME_LEN - 1);
+    } else {
+        perror("Error getting MAC address");
+        return false;
+    }
+
+    /*
+     * Interface index
+     */
+    strncpy(if_idx.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(this->sockfd, SIOCGIFINDEX, &if_idx) < 0) {
+        perror("SIOCGIFINDEX");
+        return false;
+    }
+    printf("IF is running at %d==%d\n", if_idx.ifr_ifindex, s.ifr_ifru.ifru_ivalue);
+    ifn->index = if_idx.ifr_ifindex;
+    this->ifindex = if_idx.ifr_ifindex;
+
+    return true;
+}
+
+/**
+ * Receives next frame with its kernel timestamp
+ *
+ * @param buffer - frame buffer
+ * @param size - buffer size
+ * @param rx_ns - kernel receive time, 0 when socket has no timestamps
+ *
+ * @return - frame length, -1 on error
+ */
+ssize_t raw_socket_io::receive(char *buffer, size_t size, unsigned long long *rx_ns) {
+    char control[CMSG_SPACE(sizeof(timespec))];
+    iovec iov{buffer, size};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t length = recvmsg(this->sockfd, &msg, 0);
+    if (length < 0) return -1;
+
+    // Kernel receive time when socket timestamps are on
+    *rx_ns = 0;
+    for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec ts{};
+            memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            *rx_ns = (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        }
+    }
+
+    return length;
+}
+
+/**
+ * Sends frame to hardware address in its Ethernet header
+ *
+ * @param frame - frame
+ * @param length - frame length
+ *
+ * @return - false if kernel refused frame
+ */
+bool raw_socket_io::send(const char *frame, unsigned int length) {
+    sockaddr_ll sa{};
+    sa.sll_ifindex = this->ifindex;
+    sa.sll_family = PF_PACKET;
+    sa.sll_halen = ETH_ALEN;
+    memcpy(sa.sll_addr, frame, ETH_ALEN);
+
+    return sendto(this->sockfd, frame, length, 0, (struct sockaddr *) &sa, sizeof(struct sockaddr_ll)) >= 0;
+}
+
+/**
+ * Packet socket, serviced by io_uring engine when one is used
+ *
+ * @return - descriptor
+ */
+int raw_socket_io::fd() {
+    return this->sockfd;
+}
+
+/**
+ * Adds kernel receive statistics, which the kernel resets each time they are read
+ *
+ * @param packets - frames seen by socket
+ * @param drops - frames dropped before being read
+ */
+void raw_socket_io::read_drops(unsigned long long *packets, unsigned long long *drops) {
+    tpacket_stats st{};
+    socklen_t len = sizeof(st);
+
+    if (getsockopt(this->sockfd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) {
+        *packets += st.tp_packets;
+        *drops += st.tp_drops;
+    }
+}
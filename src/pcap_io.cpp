@@ -0,0 +1,263 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include "../inc/pcap_io.h"
+#include <string.h>         // memcpy
+#include <time.h>           // clock_gettime
+#include <errno.h>          // errno
+
+// Larger stdio buffers, replay is a sequential read of small records
+#define PCAP_IO_BUFFER (1 << 20)
+
+/**
+ * Current wall clock time
+ *
+ * @return - nanoseconds since epoch
+ */
+static unsigned long long pcap_now_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Constructor
+ */
+pcap_writer::pcap_writer() {
+    this->file = nullptr;
+    pthread_mutex_init(&this->lock, nullptr);
+}
+
+/**
+ * Destructor
+ */
+pcap_writer::~pcap_writer() {
+    this->close();
+    pthread_mutex_destroy(&this->lock);
+}
+
+/**
+ * Creates file and writes its header
+ *
+ * @param path - file path, truncated if it exists
+ *
+ * @return - false if file cannot be written
+ */
+bool pcap_writer::open(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f == nullptr) {
+        perror(path);
+        return false;
+    }
+    setvbuf(f, nullptr, _IOFBF, PCAP_IO_BUFFER);
+
+    pcap_file_header header{};
+    header.magic = PCAP_MAGIC_NSEC;
+    header.version_major = 2;
+    header.version_minor = 4;
+    header.snaplen = 65535;
+    header.linktype = PCAP_LINKTYPE_ETHERNET;
+
+    if (fwrite(&header, sizeof(header), 1, f) != 1) {
+        perror(path);
+        fclose(f);
+        return false;
+    }
+
+    pthread_mutex_lock(&this->lock);
+    this->file = f;
+    pthread_mutex_unlock(&this->lock);
+
+    return true;
+}
+
+/**
+ * Appends frame
+ *
+ * @param frame - frame
+ * @param length - frame length
+ * @param ts_ns - capture time, nanoseconds since epoch
+ */
+void pcap_writer::write(const char *frame, unsigned int length, unsigned long long ts_ns) {
+    pcap_record_header record{};
+    record.ts_sec = (unsigned int) (ts_ns / 1000000000ull);
+    record.ts_frac = (unsigned int) (ts_ns % 1000000000ull);
+    record.incl_len = length;
+    record.orig_len = length;
+
+    pthread_mutex_lock(&this->lock);
+    if (this->file != nullptr) {
+        fwrite(&record, sizeof(record), 1, this->file);
+        fwrite(frame, 1, length, this->file);
+    }
+    pthread_mutex_unlock(&this->lock);
+}
+
+/**
+ * Pushes buffered records to file
+ */
+void pcap_writer::flush() {
+    pthread_mutex_lock(&this->lock);
+    if (this->file != nullptr) fflush(this->file);
+    pthread_mutex_unlock(&this->lock);
+}
+
+/**
+ * Flushes and closes file, later writes are dropped
+ */
+void pcap_writer::close() {
+    pthread_mutex_lock(&this->lock);
+    if (this->file != nullptr) {
+        fclose(this->file);
+        this->file = nullptr;
+    }
+    pthread_mutex_unlock(&this->lock);
+}
+
+/**
+ * Constructor
+ *
+ * @param in_path - pcap file replayed
+ * @param mac - interface hardware address
+ * @param ip - interface address, host order
+ * @param netmask - interface netmask, host order
+ * @param out_path - pcap file receiving sent frames, empty to only count them
+ * @param loops - times file is replayed, 0 replays forever
+ */
+pcap_replay_io::pcap_replay_io(const string &in_path, const unsigned char mac[], unsigned int ip,
+                               unsigned int netmask, const string &out_path, unsigned int loops) {
+    this->in_path = in_path;
+    this->out_path = out_path;
+    this->loops = loops;
+    memcpy(this->mac, mac, HW_ADDR_LEN);
+    this->ip = ip;
+    this->netmask = netmask;
+    this->in = nullptr;
+    this->swapped = false;
+    this->first_record = 0;
+    this->sent_frames.store(0, memory_order_relaxed);
+}
+
+/**
+ * Destructor
+ */
+pcap_replay_io::~pcap_replay_io() {
+    if (this->in != nullptr) fclose(this->in);
+    this->out.close();
+}
+
+/**
+ * Opens both files and reports identity given at construction
+ *
+ * @param ifname - interface name
+ * @param out - interface data
+ *
+ * @return - false if input is not an Ethernet pcap or output cannot be written
+ */
+bool pcap_replay_io::open(const char *ifname, iface *out) {
+    this->in = fopen(this->in_path.c_str(), "rb");
+    if (this->in == nullptr) {
+        perror(this->in_path.c_str());
+        return false;
+    }
+    setvbuf(this->in, nullptr, _IOFBF, PCAP_IO_BUFFER);
+
+    pcap_file_header header{};
+    if (fread(&header, sizeof(header), 1, this->in) != 1) {
+        fprintf(stderr, "%s: no pcap header\n", this->in_path.c_str());
+        return false;
+    }
+
+    if (header.magic == PCAP_MAGIC_USEC || header.magic == PCAP_MAGIC_NSEC) {
+        this->swapped = false;
+    } else if (__builtin_bswap32(header.magic) == PCAP_MAGIC_USEC ||
+               __builtin_bswap32(header.magic) == PCAP_MAGIC_NSEC) {
+        this->swapped = true;
+        header.linktype = __builtin_bswap32(header.linktype);
+    } else {
+        fprintf(stderr, "%s: not a pcap file, pcapng is not supported\n", this->in_path.c_str());
+        return false;
+    }
+
+    if (header.linktype != PCAP_LINKTYPE_ETHERNET) {
+        fprintf(stderr, "%s: link type %u is not Ethernet\n", this->in_path.c_str(), header.linktype);
+        return false;
+    }
+    this->first_record = ftell(this->in);
+
+    if (!this->out_path.empty() && !this->out.open(this->out_path.c_str())) return false;
+
+    strncpy(out->ifname, ifname, MAX_IFNAME_LEN - 1);
+    memcpy(out->mac_addr, this->mac, HW_ADDR_LEN);
+    out->ip_addr = this->ip;
+    out->netmask = this->netmask;
+    out->mtu = 1500;
+    out->index = 0;
+    out->sockfd = -1;
+
+    return true;
+}
+
+/**
+ * Reads next record, rewinding while loops remain
+ *
+ * @param buffer - frame buffer
+ * @param size - buffer size, longer frames are truncated
+ * @param rx_ns - set to 0, capture times are not replayed
+ *
+ * @return - frame length, 0 at end of replay or on a file without records, -1 on a truncated file
+ */
+ssize_t pcap_replay_io::receive(char *buffer, size_t size, unsigned long long *rx_ns) {
+    pcap_record_header record{};
+    bool rewound = false;
+    *rx_ns = 0;
+
+    while (fread(&record, sizeof(record), 1, this->in) != 1) {
+        // A full pass without a record would rewind forever
+        if (this->loops == 1 || rewound) {
+            // Sent frames are complete once replay ends
+            this->out.flush();
+            return 0;
+        }
+        if (this->loops > 1) this->loops--;
+        fseek(this->in, this->first_record, SEEK_SET);
+        rewound = true;
+    }
+
+    unsigned int length = this->swapped ? __builtin_bswap32(record.incl_len) : record.incl_len;
+    size_t kept = length < size ? length : size;
+
+    if (fread(buffer, 1, kept, this->in) != kept ||
+        (kept < length && fseek(this->in, (long) (length - kept), SEEK_CUR) != 0)) {
+        errno = EIO;
+        return -1;
+    }
+
+    return (ssize_t) kept;
+}
+
+/**
+ * Writes frame to output file
+ *
+ * @param frame - frame
+ * @param length - frame length
+ *
+ * @return - always true
+ */
+bool pcap_replay_io::send(const char *frame, unsigned int length) {
+    this->sent_frames.fetch_add(1, memory_order_relaxed);
+    this->out.write(frame, length, pcap_now_ns());
+
+    return true;
+}
+
+/**
+ * Frames sent by worker so far
+ *
+ * @return - frame count
+ */
+unsigned long long pcap_replay_io::sent() {
+    return this->sent_frames.load(memory_order_relaxed);
+}
@@ -0,0 +1,14 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include "../inc/probes.h"
+
+#ifdef XARPD_USDT
+// Raised by tracers through the address in each probe note, the section is where they look for it
+#define XARPD_SEMAPHORE_DEFINE(name) \
+    volatile unsigned short xarpd_##name##_semaphore __attribute__((section(".probes"))) = 0;
+extern "C" {
+XARPD_PROBE_LIST(XARPD_SEMAPHORE_DEFINE)
+}
+#endif
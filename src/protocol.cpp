@@ -0,0 +1,696 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include <string.h>
+#include "../inc/protocol.h"
+
+/*
+ * Big-endian field helpers
+ */
+
+static void put_u16(unsigned char *p, unsigned short v) {
+    p[0] = (unsigned char) (v >> 8);
+    p[1] = (unsigned char) v;
+}
+
+static void put_u32(unsigned char *p, unsigned int v) {
+    p[0] = (unsigned char) (v >> 24);
+    p[1] = (unsigned char) (v >> 16);
+    p[2] = (unsigned char) (v >> 8);
+    p[3] = (unsigned char) v;
+}
+
+static void put_u64(unsigned char *p, unsigned long long v) {
+    put_u32(p, (unsigned int) (v >> 32));
+    put_u32(p + 4, (unsigned int) v);
+}
+
+static unsigned short get_u16(const unsigned char *p) {
+    return (unsigned short) ((p[0] << 8) | p[1]);
+}
+
+static unsigned int get_u32(const unsigned char *p) {
+    return ((unsigned int) p[0] << 24) | ((unsigned int) p[1] << 16) | ((unsigned int) p[2] << 8) | p[3];
+}
+
+static unsigned long long get_u64(const unsigned char *p) {
+    return ((unsigned long long) get_u32(p) << 32) | get_u32(p + 4);
+}
+
+/**
+ * Write interface name as fixed size, zero padded field
+ *
+ * @param p - output
+ * @param name - interface name
+ */
+static void put_ifname(unsigned char *p, const char *name) {
+    memset(p, 0, WIRE_IFNAME_LEN);
+    strncpy((char *) p, name, WIRE_IFNAME_LEN - 1);
+}
+
+/**
+ * Read interface name field, always terminated
+ *
+ * @param p - input
+ * @param name - output with room for WIRE_IFNAME_LEN bytes
+ */
+static void get_ifname(const unsigned char *p, char *name) {
+    memcpy(name, p, WIRE_IFNAME_LEN);
+    name[WIRE_IFNAME_LEN - 1] = '\0';
+}
+
+/**
+ * Encode frame header
+ *
+ * @param out - output, at least FRAME_HDR_LEN bytes
+ * @param type - command or response type
+ * @param request_id - request id
+ * @param payload_len - length of payload following header
+ * @param flags - FRAME_FLAG_* bits
+ *
+ * @return - bytes written
+ */
+size_t encode_frame_hdr(unsigned char *out, unsigned short type, unsigned int request_id, size_t payload_len,
+                        unsigned char flags) {
+    put_u32(out, (unsigned int) (FRAME_HDR_LEN - 4 + payload_len));
+    out[4] = PROTOCOL_VERSION;
+    out[5] = flags;
+    put_u16(out + 6, type);
+    put_u32(out + 8, request_id);
+
+    return FRAME_HDR_LEN;
+}
+
+/**
+ * Decode frame header
+ *
+ * @param in - input, at least FRAME_HDR_LEN bytes
+ * @param hdr - decoded header
+ *
+ * @return - false if frame is malformed or version is not supported
+ */
+bool decode_frame_hdr(const unsigned char *in, frame_hdr *hdr) {
+    hdr->length = get_u32(in);
+    hdr->version = in[4];
+    hdr->flags = in[5];
+    hdr->type = get_u16(in + 6);
+    hdr->request_id = get_u32(in + 8);
+
+    return hdr->length >= FRAME_HDR_LEN - 4 && hdr->version == PROTOCOL_VERSION;
+}
+
+/**
+ * Size of frame starting at input, from its length prefix
+ *
+ * @param in - input
+ * @param available - bytes available
+ *
+ * @return - full frame size, 0 if length prefix was not received yet
+ */
+size_t frame_size(const unsigned char *in, size_t available) {
+    if (available < 4) return 0;
+
+    return 4 + (size_t) get_u32(in);
+}
+
+/**
+ * Encode command payload
+ *
+ * @param out - output, at least WIRE_COMMAND_MAX bytes
+ * @param cmd - command
+ * @param config - interface config, only used by interface commands
+ *
+ * @return - payload length
+ */
+size_t encode_command(unsigned char *out, const command_hdr *cmd, const config_hdr *config) {
+    if (cmd->type == COMMAND_SHOW) {
+        put_u32(out, cmd->cursor);
+        put_u32(out + 4, cmd->limit);
+        return 8;
+    } else if (cmd->type == COMMAND_RES) {
+        put_u32(out, cmd->ip);
+        put_u32(out + 4, cmd->timeout);
+        return 8;
+    } else if (cmd->type == COMMAND_ADD) {
+        put_u32(out, cmd->ip);
+        memcpy(out + 4, cmd->eth, HW_ADDR_LEN);
+        put_u32(out + 10, cmd->ttl);
+        return 14;
+    } else if (cmd->type == COMMAND_DEL) {
+        put_u32(out, cmd->ip);
+        return 4;
+    } else if (cmd->type == COMMAND_TTL) {
+        put_u32(out, cmd->ttl);
+        return 4;
+    } else if (cmd->type == COMMAND_QUERY) {
+        put_u32(out, cmd->ip);
+        out[4] = cmd->ip_prefix;
+        memcpy(out + 5, cmd->eth, HW_ADDR_LEN);
+        out[11] = cmd->eth_prefix;
+        put_u32(out + 12, cmd->ttl);
+        put_u32(out + 16, cmd->ttl_max);
+        out[20] = cmd->kinds;
+        return WIRE_QUERY_LEN;
+    } else if (cmd->type == COMMAND_SCAN) {
+        // Ranges were encoded by caller
+        put_u32(out, cmd->timeout);
+        memcpy(out + 4, cmd->items, WIRE_SCAN_RANGE_LEN * cmd->item_count);
+        return 4 + WIRE_SCAN_RANGE_LEN * cmd->item_count;
+    } else if (cmd->type == COMMAND_ADD_BATCH) {
+        memcpy(out, cmd->items, WIRE_ENTRY_LEN * cmd->item_count);
+        return WIRE_ENTRY_LEN * cmd->item_count;
+    } else if (cmd->type == COMMAND_DEL_BATCH) {
+        memcpy(out, cmd->items, WIRE_BATCH_IP_LEN * cmd->item_count);
+        return WIRE_BATCH_IP_LEN * cmd->item_count;
+    } else if (cmd->type == COMMAND_CAPTURE) {
+        put_u32(out, cmd->op);
+        return 4;
+    } else if (cmd->type == COMMAND_IF_CONFIG) {
+        put_ifname(out, config->eth);
+        put_u32(out + WIRE_IFNAME_LEN, config->ip);
+        put_u32(out + WIRE_IFNAME_LEN + 4, config->mask);
+        return WIRE_IFNAME_LEN + 8;
+    } else if (cmd->type == COMMAND_IF_MTU) {
+        put_ifname(out, config->eth);
+        put_u32(out + WIRE_IFNAME_LEN, config->ip);
+        return WIRE_IFNAME_LEN + 4;
+    }
+
+    // IF_SHOW, WATCH, STATS and LATENCY carry no payload
+    return 0;
+}
+
+/**
+ * Decode command payload
+ *
+ * @param type - command type from frame header
+ * @param in - payload
+ * @param len - payload length
+ * @param cmd - decoded command
+ * @param config - decoded interface config
+ *
+ * @return - false if type is unknown or payload has the wrong size
+ */
+bool decode_command(unsigned short type, const unsigned char *in, size_t len, command_hdr *cmd, config_hdr *config) {
+    memset(cmd, 0, sizeof(command_hdr));
+    memset(config, 0, sizeof(config_hdr));
+    cmd->type = type;
+
+    if (type == COMMAND_IF_SHOW || type == COMMAND_WATCH || type == COMMAND_STATS || type == COMMAND_LATENCY) {
+        return len == 0;
+    } else if (type == COMMAND_SHOW) {
+        // Empty payload lists whole table
+        if (len == 0) return true;
+        if (len != 8) return false;
+        cmd->cursor = get_u32(in);
+        cmd->limit = get_u32(in + 4);
+    } else if (type == COMMAND_RES) {
+        if (len != 8) return false;
+        cmd->ip = get_u32(in);
+        cmd->timeout = get_u32(in + 4);
+    } else if (type == COMMAND_ADD) {
+        if (len != 14) return false;
+        cmd->ip = get_u32(in);
+        memcpy(cmd->eth, in + 4, HW_ADDR_LEN);
+        cmd->ttl = get_u32(in + 10);
+    } else if (type == COMMAND_DEL) {
+        if (len != 4) return false;
+        cmd->ip = get_u32(in);
+    } else if (type == COMMAND_TTL) {
+        if (len != 4) return false;
+        cmd->ttl = get_u32(in);
+    } else if (type == COMMAND_QUERY) {
+        if (len != WIRE_QUERY_LEN) return false;
+        cmd->ip = get_u32(in);
+        cmd->ip_prefix = in[4];
+        memcpy(cmd->eth, in + 5, HW_ADDR_LEN);
+        cmd->eth_prefix = in[11];
+        cmd->ttl = get_u32(in + 12);
+        cmd->ttl_max = get_u32(in + 16);
+        cmd->kinds = in[20];
+
+        // Prefix lengths past address size are malformed
+        if (cmd->ip_prefix > 32 || cmd->eth_prefix > HW_ADDR_LEN * 8) return false;
+    } else if (type == COMMAND_SCAN) {
+        if (len < 4 + WIRE_SCAN_RANGE_LEN || (len - 4) % WIRE_SCAN_RANGE_LEN != 0) return false;
+        cmd->timeout = get_u32(in);
+        cmd->items = in + 4;
+        cmd->item_count = (unsigned int) ((len - 4) / WIRE_SCAN_RANGE_LEN);
+        if (cmd->item_count > SCAN_MAX_RANGES) return false;
+
+        // Whole sweep must stay within host limit
+        unsigned long long hosts = 0;
+        for (unsigned int i = 0; i < cmd->item_count; ++i) {
+            unsigned char prefix = cmd->items[WIRE_SCAN_RANGE_LEN * i + 4];
+            if (prefix > 32) return false;
+            hosts += 1ULL << (32 - prefix);
+        }
+        if (hosts > SCAN_MAX_HOSTS) return false;
+    } else if (type == COMMAND_ADD_BATCH) {
+        // Entries are decoded by handler straight from payload
+        if (len == 0 || len % WIRE_ENTRY_LEN != 0 || len > WIRE_ENTRY_LEN * BATCH_MAX_ENTRIES) return false;
+        cmd->items = in;
+        cmd->item_count = (unsigned int) (len / WIRE_ENTRY_LEN);
+    } else if (type == COMMAND_DEL_BATCH) {
+        if (len == 0 || len % WIRE_BATCH_IP_LEN != 0 || len > WIRE_BATCH_IP_LEN * BATCH_MAX_ENTRIES) return false;
+        cmd->items = in;
+        cmd->item_count = (unsigned int) (len / WIRE_BATCH_IP_LEN);
+    } else if (type == COMMAND_CAPTURE) {
+        if (len != 4) return false;
+        cmd->op = get_u32(in);
+        if (cmd->op > CAPTURE_OP_DUMP) return false;
+    } else if (type == COMMAND_IF_CONFIG) {
+        if (len != WIRE_IFNAME_LEN + 8) return false;
+        get_ifname(in, config->eth);
+        config->ip = get_u32(in + WIRE_IFNAME_LEN);
+        config->mask = get_u32(in + WIRE_IFNAME_LEN + 4);
+    } else if (type == COMMAND_IF_MTU) {
+        if (len != WIRE_IFNAME_LEN + 4) return false;
+        get_ifname(in, config->eth);
+        config->ip = get_u32(in + WIRE_IFNAME_LEN);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Encode SCAN range
+ *
+ * @param out - output, at least WIRE_SCAN_RANGE_LEN bytes
+ * @param ip - network
+ * @param prefix - network length, 32 for a single host
+ *
+ * @return - bytes written
+ */
+size_t encode_scan_range(unsigned char *out, unsigned int ip, unsigned char prefix) {
+    put_u32(out, ip);
+    out[4] = prefix;
+
+    return WIRE_SCAN_RANGE_LEN;
+}
+
+/**
+ * Decode SCAN range
+ *
+ * @param in - input, at least WIRE_SCAN_RANGE_LEN bytes
+ * @param ip - network
+ * @param prefix - network length
+ */
+void decode_scan_range(const unsigned char *in, unsigned int *ip, unsigned char *prefix) {
+    *ip = get_u32(in);
+    *prefix = in[4];
+}
+
+/**
+ * Encode final SCAN frame
+ *
+ * @param out - output, at least WIRE_SCAN_DONE_LEN bytes
+ * @param probed - hosts resolved
+ * @param answered - hosts that answered
+ *
+ * @return - bytes written
+ */
+size_t encode_scan_done(unsigned char *out, unsigned int probed, unsigned int answered) {
+    put_u32(out, probed);
+    put_u32(out + 4, answered);
+
+    return WIRE_SCAN_DONE_LEN;
+}
+
+/**
+ * Decode final SCAN frame
+ *
+ * @param in - input, at least WIRE_SCAN_DONE_LEN bytes
+ * @param probed - hosts resolved
+ * @param answered - hosts that answered
+ */
+void decode_scan_done(const unsigned char *in, unsigned int *probed, unsigned int *answered) {
+    *probed = get_u32(in);
+    *answered = get_u32(in + 4);
+}
+
+/**
+ * Encode IP of DEL_BATCH
+ *
+ * @param out - output, at least WIRE_BATCH_IP_LEN bytes
+ * @param ip - ip to delete
+ *
+ * @return - bytes written
+ */
+size_t encode_batch_ip(unsigned char *out, unsigned int ip) {
+    put_u32(out, ip);
+
+    return WIRE_BATCH_IP_LEN;
+}
+
+/**
+ * Decode IP of DEL_BATCH
+ *
+ * @param in - input, at least WIRE_BATCH_IP_LEN bytes
+ *
+ * @return - ip to delete
+ */
+unsigned int decode_batch_ip(const unsigned char *in) {
+    return get_u32(in);
+}
+
+/**
+ * Encode batch response
+ *
+ * @param out - output, at least WIRE_BATCH_DONE_LEN bytes
+ * @param applied - entries added, updated or removed
+ *
+ * @return - bytes written
+ */
+size_t encode_batch_done(unsigned char *out, unsigned int applied) {
+    put_u32(out, applied);
+
+    return WIRE_BATCH_DONE_LEN;
+}
+
+/**
+ * Decode batch response
+ *
+ * @param in - input, at least WIRE_BATCH_DONE_LEN bytes
+ *
+ * @return - entries added, updated or removed
+ */
+unsigned int decode_batch_done(const unsigned char *in) {
+    return get_u32(in);
+}
+
+/**
+ * Encode SHOW frame header preceding its entries
+ *
+ * @param out - output, at least WIRE_SHOW_HDR_LEN bytes
+ * @param next_cursor - IP to resume listing from
+ * @param end - true if table has no entries past this frame
+ *
+ * @return - bytes written
+ */
+size_t encode_show_hdr(unsigned char *out, unsigned int next_cursor, bool end) {
+    put_u32(out, next_cursor);
+    out[4] = (unsigned char) (end ? 1 : 0);
+
+    return WIRE_SHOW_HDR_LEN;
+}
+
+/**
+ * Decode SHOW frame header
+ *
+ * @param in - input, at least WIRE_SHOW_HDR_LEN bytes
+ * @param next_cursor - IP to resume listing from
+ * @param end - true if table has no entries past this frame
+ */
+void decode_show_hdr(const unsigned char *in, unsigned int *next_cursor, bool *end) {
+    *next_cursor = get_u32(in);
+    *end = in[4] != 0;
+}
+
+/**
+ * Encode ARP table entry
+ *
+ * @param out - output, at least WIRE_ENTRY_LEN bytes
+ * @param entry - entry
+ *
+ * @return - bytes written
+ */
+size_t encode_entry(unsigned char *out, const arp_table_entry *entry) {
+    put_u32(out, entry->ipAddress);
+    put_u32(out + 4, entry->ttl);
+    memcpy(out + 8, entry->ethAddress, HW_ADDR_LEN);
+
+    return WIRE_ENTRY_LEN;
+}
+
+/**
+ * Decode ARP table entry
+ *
+ * @param in - input, at least WIRE_ENTRY_LEN bytes
+ * @param entry - decoded entry
+ */
+void decode_entry(const unsigned char *in, arp_table_entry *entry) {
+    entry->ipAddress = get_u32(in);
+    entry->ttl = get_u32(in + 4);
+    memcpy(entry->ethAddress, in + 8, HW_ADDR_LEN);
+}
+
+/**
+ * Encode WATCH frame header preceding its events
+ *
+ * @param out - output, at least WIRE_WATCH_HDR_LEN bytes
+ * @param dropped - events lost since previous frame
+ *
+ * @return - bytes written
+ */
+size_t encode_watch_hdr(unsigned char *out, unsigned int dropped) {
+    put_u32(out, dropped);
+
+    return WIRE_WATCH_HDR_LEN;
+}
+
+/**
+ * Decode WATCH frame header
+ *
+ * @param in - input, at least WIRE_WATCH_HDR_LEN bytes
+ *
+ * @return - events lost since previous frame
+ */
+unsigned int decode_watch_hdr(const unsigned char *in) {
+    return get_u32(in);
+}
+
+/**
+ * Encode table change event
+ *
+ * @param out - output, at least WIRE_EVENT_LEN bytes
+ * @param event - ARP_EVENT_* type
+ * @param entry - entry after the change, or as it was when removed
+ *
+ * @return - bytes written
+ */
+size_t encode_event(unsigned char *out, unsigned char event, const arp_table_entry *entry) {
+    out[0] = event;
+
+    return 1 + encode_entry(out + 1, entry);
+}
+
+/**
+ * Decode table change event
+ *
+ * @param in - input, at least WIRE_EVENT_LEN bytes
+ * @param entry - decoded entry
+ *
+ * @return - ARP_EVENT_* type
+ */
+unsigned char decode_event(const unsigned char *in, arp_table_entry *entry) {
+    decode_entry(in + 1, entry);
+
+    return in[0];
+}
+
+/**
+ * Encode interface, socket descriptor is local to the daemon and not sent
+ *
+ * @param out - output, at least WIRE_IFACE_LEN bytes
+ * @param ifc - interface
+ *
+ * @return - bytes written
+ */
+size_t encode_iface(unsigned char *out, const iface *ifc) {
+    unsigned char *p = out;
+
+    put_ifname(p, ifc->ifname);
+    p += WIRE_IFNAME_LEN;
+    memcpy(p, ifc->mac_addr, HW_ADDR_LEN);
+    p += HW_ADDR_LEN;
+
+    put_u32(p, ifc->ip_addr);
+    put_u32(p + 4, ifc->netmask);
+    put_u32(p + 8, (unsigned int) ifc->mtu);
+    put_u32(p + 12, (unsigned int) ifc->index);
+    put_u64(p + 16, ifc->rx_pkts);
+    put_u64(p + 24, ifc->rx_bytes);
+    put_u64(p + 32, ifc->tx_pkts);
+    put_u64(p + 40, ifc->tx_bytes);
+    put_u64(p + 48, ifc->rx_dropped);
+
+    return WIRE_IFACE_LEN;
+}
+
+/**
+ * Decode interface
+ *
+ * @param in - input, at least WIRE_IFACE_LEN bytes
+ * @param ifc - decoded interface
+ */
+void decode_iface(const unsigned char *in, iface *ifc) {
+    const unsigned char *p = in;
+
+    memset(ifc, 0, sizeof(iface));
+    get_ifname(p, ifc->ifname);
+    p += WIRE_IFNAME_LEN;
+    memcpy(ifc->mac_addr, p, HW_ADDR_LEN);
+    p += HW_ADDR_LEN;
+
+    ifc->sockfd = -1;
+    ifc->ip_addr = get_u32(p);
+    ifc->netmask = get_u32(p + 4);
+    ifc->mtu = (int) get_u32(p + 8);
+    ifc->index = (int) get_u32(p + 12);
+    ifc->rx_pkts = get_u64(p + 16);
+    ifc->rx_bytes = get_u64(p + 24);
+    ifc->tx_pkts = get_u64(p + 32);
+    ifc->tx_bytes = get_u64(p + 40);
+    ifc->rx_dropped = get_u64(p + 48);
+}
+
+/**
+ * Encode counters of one interface
+ *
+ * @param out - output, at least WIRE_STATS_LEN bytes
+ * @param ifname - interface name
+ * @param values - counters indexed by STAT_*
+ *
+ * @return - bytes written
+ */
+size_t encode_stats(unsigned char *out, const char *ifname, const unsigned long long values[STAT_COUNT]) {
+    put_ifname(out, ifname);
+    for (int i = 0; i < STAT_COUNT; ++i) {
+        put_u64(out + WIRE_IFNAME_LEN + 8 * i, values[i]);
+    }
+
+    return WIRE_STATS_LEN;
+}
+
+/**
+ * Decode counters of one interface
+ *
+ * @param in - input, at least WIRE_STATS_LEN bytes
+ * @param ifname - output with room for WIRE_IFNAME_LEN bytes
+ * @param values - counters indexed by STAT_*
+ */
+void decode_stats(const unsigned char *in, char *ifname, unsigned long long values[STAT_COUNT]) {
+    get_ifname(in, ifname);
+    for (int i = 0; i < STAT_COUNT; ++i) {
+        values[i] = get_u64(in + WIRE_IFNAME_LEN + 8 * i);
+    }
+}
+
+/**
+ * Encode latency digests of one interface
+ *
+ * @param out - output, at least WIRE_LATENCY_LEN bytes
+ * @param ifname - interface name
+ * @param summaries - digests indexed by LATENCY_*
+ *
+ * @return - bytes written
+ */
+size_t encode_latency(unsigned char *out, const char *ifname, const latency_summary summaries[LATENCY_COUNT]) {
+    put_ifname(out, ifname);
+    for (int i = 0; i < LATENCY_COUNT; ++i) {
+        const latency_summary *s = &summaries[i];
+        unsigned char *p = out + WIRE_IFNAME_LEN + WIRE_SUMMARY_LEN * i;
+
+        put_u64(p, s->count);
+        put_u64(p + 8, s->min);
+        put_u64(p + 16, s->max);
+        put_u64(p + 24, s->mean);
+        put_u64(p + 32, s->p50);
+        put_u64(p + 40, s->p90);
+        put_u64(p + 48, s->p99);
+        put_u64(p + 56, s->p999);
+    }
+
+    return WIRE_LATENCY_LEN;
+}
+
+/**
+ * Decode latency digests of one interface
+ *
+ * @param in - input, at least WIRE_LATENCY_LEN bytes
+ * @param ifname - output with room for WIRE_IFNAME_LEN bytes
+ * @param summaries - digests indexed by LATENCY_*
+ */
+void decode_latency(const unsigned char *in, char *ifname, latency_summary summaries[LATENCY_COUNT]) {
+    get_ifname(in, ifname);
+    for (int i = 0; i < LATENCY_COUNT; ++i) {
+        latency_summary *s = &summaries[i];
+        const unsigned char *p = in + WIRE_IFNAME_LEN + WIRE_SUMMARY_LEN * i;
+
+        s->count = get_u64(p);
+        s->min = get_u64(p + 8);
+        s->max = get_u64(p + 16);
+        s->mean = get_u64(p + 24);
+        s->p50 = get_u64(p + 32);
+        s->p90 = get_u64(p + 40);
+        s->p99 = get_u64(p + 48);
+        s->p999 = get_u64(p + 56);
+    }
+}
+
+/**
+ * Encode capture state
+ *
+ * @param out - output, at least WIRE_CAPTURE_STATUS_LEN bytes
+ * @param active - if capture is on
+ * @param written - frames captured so far
+ *
+ * @return - bytes written
+ */
+size_t encode_capture_status(unsigned char *out, bool active, unsigned long long written) {
+    out[0] = (unsigned char) active;
+    put_u64(out + 1, written);
+
+    return WIRE_CAPTURE_STATUS_LEN;
+}
+
+/**
+ * Decode capture state
+ *
+ * @param in - input, at least WIRE_CAPTURE_STATUS_LEN bytes
+ * @param active - if capture is on
+ * @param written - frames captured so far
+ */
+void decode_capture_status(const unsigned char *in, bool *active, unsigned long long *written) {
+    *active = in[0] != 0;
+    *written = get_u64(in + 1);
+}
+
+/**
+ * Encode captured frame, unused data bytes are zeroed
+ *
+ * @param out - output, at least WIRE_CAPTURE_LEN bytes
+ * @param rec - captured frame
+ *
+ * @return - bytes written
+ */
+size_t encode_capture(unsigned char *out, const capture_record *rec) {
+    put_u64(out, rec->ts_ns);
+    put_u16(out + 8, rec->length);
+    out[10] = rec->caplen;
+    out[11] = rec->direction;
+    put_ifname(out + 12, rec->ifname);
+    memset(out + 12 + WIRE_IFNAME_LEN, 0, CAPTURE_SNAPLEN);
+    memcpy(out + 12 + WIRE_IFNAME_LEN, rec->data, rec->caplen);
+
+    return WIRE_CAPTURE_LEN;
+}
+
+/**
+ * Decode captured frame
+ *
+ * @param in - input, at least WIRE_CAPTURE_LEN bytes
+ * @param rec - captured frame
+ */
+void decode_capture(const unsigned char *in, capture_record *rec) {
+    rec->ts_ns = get_u64(in);
+    rec->length = get_u16(in + 8);
+    rec->caplen = in[10] < CAPTURE_SNAPLEN ? in[10] : CAPTURE_SNAPLEN;
+    rec->direction = in[11];
+    get_ifname(in + 12, rec->ifname);
+    memcpy(rec->data, in + 12 + WIRE_IFNAME_LEN, CAPTURE_SNAPLEN);
+}
@@ -0,0 +1,373 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include <vector>
+#include <unistd.h>
+#include "../inc/resolver.h"
+#include "../inc/utils.h"
+#include "../inc/logger.h"
+#include "../inc/probes.h"
+
+/**
+ * Resolver constructor
+ *
+ * @param table - table where replies are learned
+ * @param workers - interface workers used to send requests
+ * @param worker_count - amount of workers
+ */
+resolver::resolver(arp_table *table, interface_worker **workers, int worker_count) {
+    this->table = table;
+    this->workers = workers;
+    this->worker_count = worker_count;
+    this->retry_ms = RESOLVE_RETRY_MS;
+    this->retry_max_ms = RESOLVE_RETRY_MAX_MS;
+    this->backoff = RESOLVE_BACKOFF;
+    this->probe_rate = RESOLVE_PROBE_RATE;
+    this->dispatch_scheduler_thread(this);
+}
+
+/**
+ * Scheduler thread
+ *
+ * @param ctx - resolver context
+ *
+ * @return - void
+ */
+void *scheduler(void *ctx) {
+    auto *r = (resolver *) ctx;
+
+    while (true) {
+        r->schedule();
+    }
+}
+
+/**
+ * Dispatch scheduler thread with context
+ *
+ * @param ctx - resolver object context
+ */
+void resolver::dispatch_scheduler_thread(resolver *ctx) {
+    ctx->scheduler_thread = new pthread_t();
+
+    if (pthread_create(ctx->scheduler_thread, nullptr, scheduler, (void *) ctx)) {
+        perror("pthreads()");
+        exit(errno);
+    }
+}
+
+/**
+ * Configure retransmission backoff
+ *
+ * @param retry_ms - interval before first retransmission
+ * @param retry_max_ms - interval cap
+ * @param backoff - interval multiplier applied after each retransmission
+ */
+void resolver::set_backoff(unsigned int retry_ms, unsigned int retry_max_ms, unsigned int backoff) {
+    lock_guard<mutex> guard(this->lock);
+
+    this->retry_ms = retry_ms;
+    this->retry_max_ms = retry_max_ms < retry_ms ? retry_ms : retry_max_ms;
+    this->backoff = backoff < 1 ? 1 : backoff;
+}
+
+/**
+ * Configure how fast paced resolutions send their first request
+ *
+ * @param rate - requests per second on each interface
+ */
+void resolver::set_probe_rate(unsigned int rate) {
+    lock_guard<mutex> guard(this->lock);
+
+    this->probe_rate = rate < 1 ? 1 : rate;
+}
+
+/**
+ * Starts waiter deadlines and retransmission timer once first request of resolution goes out,
+ * caller must hold lock
+ *
+ * @param p - resolution
+ * @param now - send time
+ */
+void resolver::mark_sent(pending_resolution *p, resolve_time now) {
+    p->sent = true;
+    p->sent_at = now;
+    XARPD_PROBE2(resolve__started, (const char *) p->worker->iface_data->ifname, p->ip);
+    p->next_retry = now + chrono::milliseconds(p->interval_ms);
+
+    for (auto &waiter : p->waiters) {
+        waiter.deadline = now + chrono::milliseconds(waiter.timeout_ms);
+    }
+}
+
+/**
+ * Resolve IP asynchronously, attaching to an in-flight resolution if one exists.
+ * Callback runs exactly once, possibly before this function returns.
+ * Paced resolutions queue their first request behind others on the same interface so sweeps
+ * do not flood the link, their timeout starts once the request is sent.
+ *
+ * @param ip - ip to resolve
+ * @param timeout_ms - how long caller is willing to wait
+ * @param callback - completion callback
+ * @param paced - send first request at the interface probe rate
+ */
+void resolver::resolve_async(unsigned int ip, unsigned int timeout_ms, resolve_callback callback, bool paced) {
+    // Entry is already known, nothing to send
+    arp_table_entry known{};
+    if (this->table->copy_by_ip(ip, &known)) {
+        callback(true, &known);
+        return;
+    }
+
+    resolve_time now = chrono::steady_clock::now();
+    resolve_waiter waiter;
+    waiter.deadline = resolve_time::max();
+    waiter.timeout_ms = timeout_ms;
+    waiter.callback = callback;
+
+    unique_lock<mutex> guard(this->lock);
+
+    auto it = this->pending.find(ip);
+    if (it != this->pending.end()) {
+        // Coalesce with resolution already in flight
+        pending_resolution *p = it->second;
+        if (p->sent) waiter.deadline = now + chrono::milliseconds(timeout_ms);
+        p->waiters.push_back(waiter);
+
+        // Unpaced caller does not wait for a queued sweep to reach this IP
+        bool jump = !p->sent && !paced;
+        if (jump) this->mark_sent(p, now);
+        this->scheduler_wake.notify_one();
+
+        if (jump) {
+            // Resolution may complete and be freed once unlocked
+            interface_worker *w = p->worker;
+            guard.unlock();
+            w->arp_request(ip);
+        }
+        return;
+    }
+
+    // Find interface that handles the network for IP
+    interface_worker *w = find_interface_worker(ip, this->workers, this->worker_count);
+    if (w == nullptr) {
+        guard.unlock();
+        log_warn("Could not find interface worker for IP: %s", log_ip(ip));
+        callback(false, nullptr);
+        return;
+    }
+
+    // Reply may have been learned since the first lookup
+    if (this->table->copy_by_ip(ip, &known)) {
+        guard.unlock();
+        callback(true, &known);
+        return;
+    }
+
+    auto *p = new pending_resolution();
+    p->ip = ip;
+    p->worker = w;
+    p->attempts = 1;
+    p->interval_ms = this->retry_ms;
+    p->sent = false;
+    p->waiters.push_back(waiter);
+    this->pending[ip] = p;
+
+    // Scheduler sends it once interface has a free slot
+    if (paced) {
+        this->pacers[w].queue.push_back(ip);
+        this->scheduler_wake.notify_one();
+        return;
+    }
+
+    this->mark_sent(p, now);
+    this->scheduler_wake.notify_one();
+
+    // First request goes out without holding the lock
+    guard.unlock();
+    log_info("Resolving: %s", log_ip(ip));
+    w->arp_request(ip);
+}
+
+/**
+ * Resolve IP, blocking until reply is learned or timeout passes
+ *
+ * @param ip - ip to resolve
+ * @param timeout_ms - how long caller is willing to wait
+ * @param out - entry filled on success
+ *
+ * @return - true if IP was resolved
+ */
+bool resolver::resolve(unsigned int ip, unsigned int timeout_ms, arp_table_entry *out) {
+    mutex done_lock;
+    condition_variable done_cond;
+    bool done = false;
+    bool found = false;
+
+    this->resolve_async(ip, timeout_ms, [&](bool ok, arp_table_entry *entry) {
+        lock_guard<mutex> guard(done_lock);
+        if (ok) memcpy(out, entry, sizeof(arp_table_entry));
+        found = ok;
+        done = true;
+        done_cond.notify_one();
+    });
+
+    unique_lock<mutex> guard(done_lock);
+    done_cond.wait(guard, [&] { return done; });
+
+    return found;
+}
+
+/**
+ * Called by interface workers when a reply is learned, completes matching resolution
+ *
+ * @param ip - ip address from reply
+ * @param eth_address - ethernet address from reply
+ */
+void resolver::learned(unsigned int ip, unsigned char eth_address[]) {
+    pending_resolution *p;
+
+    {
+        lock_guard<mutex> guard(this->lock);
+
+        auto it = this->pending.find(ip);
+        if (it == this->pending.end()) return;
+
+        p = it->second;
+        this->pending.erase(it);
+    }
+
+    // Replies to requests still waiting for their pacing slot say nothing about the wire
+    if (p->sent) {
+        auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - p->sent_at);
+        p->worker->latency[LATENCY_RESOLVE].record((unsigned long long) elapsed.count());
+        XARPD_PROBE4(resolve__completed, (const char *) p->worker->iface_data->ifname, ip, 1,
+                     (unsigned long long) elapsed.count());
+    }
+
+    // Prefer table entry so TTL matches what SHOW reports
+    arp_table_entry entry{};
+    if (!this->table->copy_by_ip(ip, &entry)) {
+        entry.ipAddress = ip;
+        entry.ttl = 0;
+        memcpy(entry.ethAddress, eth_address, sizeof(char) * 6);
+    }
+
+    // Wake every waiter together
+    for (auto &waiter : p->waiters) {
+        waiter.callback(true, &entry);
+    }
+
+    delete p;
+}
+
+/**
+ * Picks queued first requests whose slot came, one interface does not delay another.
+ * Caller must hold lock and send them once it is released.
+ *
+ * @param now - current time
+ * @param next - lowered to next slot of a non-empty queue
+ * @param sends - requests to send
+ */
+void resolver::pace(resolve_time now, resolve_time *next, vector<resolve_send> *sends) {
+    auto interval = chrono::microseconds(1000000 / this->probe_rate);
+
+    for (auto &it : this->pacers) {
+        probe_pacer &pacer = it.second;
+
+        // Idle interface does not build up credit for a burst
+        if (pacer.next_send < now - interval) pacer.next_send = now;
+
+        while (!pacer.queue.empty() && now >= pacer.next_send) {
+            unsigned int ip = pacer.queue.front();
+            pacer.queue.pop_front();
+
+            // Resolution may have completed, expired or been sent by an unpaced caller meanwhile
+            auto p = this->pending.find(ip);
+            if (p == this->pending.end() || p->second->sent) continue;
+
+            this->mark_sent(p->second, now);
+            sends->emplace_back(it.first, ip);
+            pacer.next_send += interval;
+
+            if (p->second->next_retry < *next) *next = p->second->next_retry;
+        }
+
+        if (!pacer.queue.empty() && pacer.next_send < *next) *next = pacer.next_send;
+    }
+}
+
+/**
+ * Scheduler step: expires waiters, retransmits due requests and sleeps until next event.
+ * Requests go out after the lock is released so learned() on packet threads never waits on a send.
+ */
+void resolver::schedule() {
+    vector<resolve_callback> expired;
+    vector<resolve_send> sends;
+
+    {
+        unique_lock<mutex> guard(this->lock);
+        resolve_time now = chrono::steady_clock::now();
+        resolve_time next = now + chrono::milliseconds(RESOLVE_TIMEOUT_MS);
+
+        for (auto it = this->pending.begin(); it != this->pending.end();) {
+            pending_resolution *p = it->second;
+
+            // Drop waiters whose deadline passed
+            auto &waiters = p->waiters;
+            for (auto w = waiters.begin(); w != waiters.end();) {
+                if (now >= w->deadline) {
+                    expired.push_back(w->callback);
+                    w = waiters.erase(w);
+                } else {
+                    if (w->deadline < next) next = w->deadline;
+                    ++w;
+                }
+            }
+
+            // Nobody is waiting anymore, stop retransmitting
+            if (waiters.empty()) {
+                if (p->sent && XARPD_PROBE_ENABLED(resolve__completed)) {
+                    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(now - p->sent_at);
+                    XARPD_PROBE4(resolve__completed, (const char *) p->worker->iface_data->ifname, p->ip, 0,
+                                 (unsigned long long) elapsed.count());
+                }
+                it = this->pending.erase(it);
+                delete p;
+                continue;
+            }
+            ++it;
+
+            // Still queued for its first request
+            if (!p->sent) continue;
+
+            if (now >= p->next_retry) {
+                // Retransmit with backoff
+                p->attempts++;
+                p->interval_ms *= this->backoff;
+                if (p->interval_ms > this->retry_max_ms) p->interval_ms = this->retry_max_ms;
+                p->next_retry = now + chrono::milliseconds(p->interval_ms);
+
+                log_debug("Retransmitting request for: %s (attempt %u)", log_ip(p->ip), p->attempts);
+                sends.emplace_back(p->worker, p->ip);
+            }
+
+            if (p->next_retry < next) next = p->next_retry;
+        }
+
+        this->pace(now, &next, &sends);
+
+        // Sleep until next retransmission, deadline or new resolution, next step sleeps after sending
+        if (expired.empty() && sends.empty()) {
+            this->scheduler_wake.wait_until(guard, next);
+        }
+    }
+
+    for (auto &send : sends) {
+        send.first->arp_request(send.second);
+    }
+
+    for (auto &callback : expired) {
+        callback(false, nullptr);
+    }
+}
@@ -0,0 +1,140 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../inc/shm_table.h"
+
+/**
+ * Home slot of IP
+ *
+ * @param ip - ip
+ * @param mask - slot count minus one
+ *
+ * @return - slot index
+ */
+unsigned int shm_slot_hash(unsigned int ip, unsigned int mask) {
+    return (ip * 0x9E3779B1u) & mask;
+}
+
+shm_table_reader::shm_table_reader() {
+    this->hdr = nullptr;
+    this->slots = nullptr;
+    this->mask = 0;
+    this->size = 0;
+}
+
+shm_table_reader::~shm_table_reader() {
+    if (this->hdr != nullptr) munmap((void *) this->hdr, this->size);
+}
+
+/**
+ * Maps segment exported by xarpd read only
+ *
+ * @param name - shared memory object name
+ *
+ * @return - false if segment does not exist or has another layout
+ */
+bool shm_table_reader::open(const char *name) {
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) return false;
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(shm_table_hdr)) {
+        close(fd);
+        return false;
+    }
+
+    auto size = (size_t) st.st_size;
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    auto *header = (const shm_table_hdr *) map;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_TABLE_MAGIC || header->version != SHM_TABLE_VERSION ||
+        header->slot_bits > SHM_TABLE_MAX_BITS ||
+        size < sizeof(shm_table_hdr) + sizeof(shm_slot) * ((size_t) 1 << header->slot_bits)) {
+        munmap(map, size);
+        return false;
+    }
+
+    if (this->hdr != nullptr) munmap((void *) this->hdr, this->size);
+    this->hdr = header;
+    this->slots = (const shm_slot *) (header + 1);
+    this->mask = (1u << header->slot_bits) - 1;
+    this->size = size;
+
+    return true;
+}
+
+/**
+ * Looks up IP, retries while writer changes the table
+ *
+ * @param ip - ip
+ * @param out - found entry
+ *
+ * @return - SHM_LOOKUP_FOUND, SHM_LOOKUP_MISSING or SHM_LOOKUP_UNKNOWN if table is not mapped,
+ *           writer kept it busy or a missing entry may not have been exported
+ */
+int shm_table_reader::lookup(unsigned int ip, arp_table_entry *out) const {
+    if (this->hdr == nullptr) return SHM_LOOKUP_UNKNOWN;
+
+    for (int attempt = 0; attempt < SHM_READ_RETRIES; ++attempt) {
+        unsigned int seq = __atomic_load_n(&this->hdr->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+
+        // Probe run is bounded even if a torn read shows no free slot
+        unsigned int words[4] = {0, 0, 0, 0};
+        bool found = false;
+        unsigned int i = shm_slot_hash(ip, this->mask);
+        for (unsigned int n = 0; n <= this->mask; ++n) {
+            const unsigned int *slot = this->slots[i].words;
+            words[3] = __atomic_load_n(&slot[3], __ATOMIC_RELAXED);
+            if (!(words[3] & SHM_SLOT_USED)) break;
+
+            words[0] = __atomic_load_n(&slot[0], __ATOMIC_RELAXED);
+            if (words[0] == ip) {
+                words[1] = __atomic_load_n(&slot[1], __ATOMIC_RELAXED);
+                words[2] = __atomic_load_n(&slot[2], __ATOMIC_RELAXED);
+                found = true;
+                break;
+            }
+            i = (i + 1) & this->mask;
+        }
+        unsigned int overflow = __atomic_load_n(&this->hdr->overflow, __ATOMIC_RELAXED);
+
+        // Copy is consistent only if no change started meanwhile
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&this->hdr->seq, __ATOMIC_RELAXED) != seq) continue;
+
+        if (!found) return overflow ? SHM_LOOKUP_UNKNOWN : SHM_LOOKUP_MISSING;
+
+        out->ipAddress = words[0];
+        out->ttl = words[1];
+        out->ethAddress[0] = (unsigned char) (words[2] >> 24);
+        out->ethAddress[1] = (unsigned char) (words[2] >> 16);
+        out->ethAddress[2] = (unsigned char) (words[2] >> 8);
+        out->ethAddress[3] = (unsigned char) words[2];
+        out->ethAddress[4] = (unsigned char) (words[3] >> 24);
+        out->ethAddress[5] = (unsigned char) (words[3] >> 16);
+        out->kind = (unsigned char) (words[3] >> 8);
+
+        return SHM_LOOKUP_FOUND;
+    }
+
+    return SHM_LOOKUP_UNKNOWN;
+}
+
+/**
+ * Change counter, differs whenever table content may have changed
+ *
+ * @return - generation, 0 if table is not mapped
+ */
+unsigned long long shm_table_reader::generation() const {
+    if (this->hdr == nullptr) return 0;
+
+    return __atomic_load_n(&this->hdr->generation, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,206 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../inc/shm_table.h"
+
+/**
+ * Pack entry into slot words
+ *
+ * @param entry - entry
+ * @param slot - packed slot
+ */
+static void pack_slot(const arp_table_entry *entry, shm_slot *slot) {
+    const unsigned char *m = entry->ethAddress;
+
+    slot->words[0] = entry->ipAddress;
+    slot->words[1] = entry->ttl;
+    slot->words[2] = ((unsigned int) m[0] << 24) | ((unsigned int) m[1] << 16) | ((unsigned int) m[2] << 8) | m[3];
+    slot->words[3] = ((unsigned int) m[4] << 24) | ((unsigned int) m[5] << 16) | ((unsigned int) entry->kind << 8) |
+                     SHM_SLOT_USED;
+}
+
+/**
+ * Creates segment and maps it, an existing segment of a previous run is replaced
+ *
+ * @param name - shared memory object name
+ * @param slot_bits - slot count as a power of two
+ */
+shm_table_writer::shm_table_writer(const char *name, unsigned int slot_bits) {
+    if (slot_bits > SHM_TABLE_MAX_BITS) slot_bits = SHM_TABLE_MAX_BITS;
+
+    strncpy(this->name, name, sizeof(this->name) - 1);
+    this->name[sizeof(this->name) - 1] = '\0';
+    this->mask = (1u << slot_bits) - 1;
+    this->size = sizeof(shm_table_hdr) + sizeof(shm_slot) * ((size_t) this->mask + 1);
+
+    // Readers of a previous run keep their mapping of the old segment
+    shm_unlink(this->name);
+    int fd = shm_open(this->name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("shm_open()");
+        exit(errno);
+    }
+
+    if (ftruncate(fd, (off_t) this->size) < 0) {
+        perror("ftruncate()");
+        exit(errno);
+    }
+
+    void *map = mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap()");
+        exit(errno);
+    }
+
+    // Fresh segment is zeroed, magic is written last so readers never see a partial header
+    this->hdr = (shm_table_hdr *) map;
+    this->slots = (shm_slot *) (this->hdr + 1);
+    this->hdr->version = SHM_TABLE_VERSION;
+    this->hdr->slot_bits = slot_bits;
+    __atomic_store_n(&this->hdr->magic, SHM_TABLE_MAGIC, __ATOMIC_RELEASE);
+}
+
+/**
+ * Removes segment, mapped readers keep their copy until they close it
+ */
+shm_table_writer::~shm_table_writer() {
+    munmap(this->hdr, this->size);
+    shm_unlink(this->name);
+}
+
+/**
+ * Marks start of a change
+ */
+void shm_table_writer::begin() {
+    __atomic_store_n(&this->hdr->seq, this->hdr->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * Publishes change
+ */
+void shm_table_writer::end() {
+    __atomic_store_n(&this->hdr->generation, this->hdr->generation + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&this->hdr->seq, this->hdr->seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Writes slot words, readers may be copying them concurrently
+ *
+ * @param index - slot index
+ * @param slot - new content
+ */
+void shm_table_writer::store(unsigned int index, const shm_slot *slot) {
+    for (int i = 0; i < 4; ++i) {
+        __atomic_store_n(&this->slots[index].words[i], slot->words[i], __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Finds slot of IP, only writer calls this so plain loads are fine
+ *
+ * @param ip - ip
+ *
+ * @return - slot index, -1 if IP is not exported
+ */
+long shm_table_writer::find(unsigned int ip) {
+    unsigned int i = shm_slot_hash(ip, this->mask);
+
+    while (this->slots[i].words[3] & SHM_SLOT_USED) {
+        if (this->slots[i].words[0] == ip) return i;
+        i = (i + 1) & this->mask;
+    }
+
+    return -1;
+}
+
+/**
+ * Inserts or replaces entry
+ *
+ * @param entry - entry
+ */
+void shm_table_writer::put(const arp_table_entry *entry) {
+    shm_slot slot{};
+    pack_slot(entry, &slot);
+
+    long found = this->find(entry->ipAddress);
+    if (found < 0 && this->hdr->count >= (this->mask + 1) / 4 * 3) {
+        // Table must keep free slots to end probes
+        if (!this->hdr->overflow) {
+            fprintf(stderr, "Shared table %s is full, lookups of missing entries are no longer authoritative\n",
+                    this->name);
+        }
+        __atomic_store_n(&this->hdr->overflow, 1u, __ATOMIC_RELAXED);
+        return;
+    }
+
+    unsigned int index = (unsigned int) found;
+    if (found < 0) {
+        index = shm_slot_hash(entry->ipAddress, this->mask);
+        while (this->slots[index].words[3] & SHM_SLOT_USED) index = (index + 1) & this->mask;
+    }
+
+    this->begin();
+    this->store(index, &slot);
+    if (found < 0) this->hdr->count++;
+    this->end();
+}
+
+/**
+ * Removes entry, later entries of its probe run are shifted back into the gap
+ *
+ * @param ip - ip
+ */
+void shm_table_writer::erase(unsigned int ip) {
+    long found = this->find(ip);
+    if (found < 0) return;
+
+    shm_slot empty{};
+    auto gap = (unsigned int) found;
+    unsigned int i = gap;
+
+    this->begin();
+
+    while (true) {
+        i = (i + 1) & this->mask;
+        if (!(this->slots[i].words[3] & SHM_SLOT_USED)) break;
+
+        // Entry may move into gap only if its home slot is not between gap and its position
+        unsigned int home = shm_slot_hash(this->slots[i].words[0], this->mask);
+        if (((i - home) & this->mask) >= ((i - gap) & this->mask)) {
+            shm_slot moved = this->slots[i];
+            this->store(gap, &moved);
+            gap = i;
+        }
+    }
+
+    this->store(gap, &empty);
+    this->hdr->count--;
+    this->end();
+}
+
+/**
+ * Table listener mirroring changes into segment, runs under table write lock
+ *
+ * @param event - ARP_EVENT_* type
+ * @param entry - changed entry
+ * @param ctx - shared table writer
+ */
+void shm_table_changed(unsigned char event, const arp_table_entry *entry, void *ctx) {
+    auto *writer = (shm_table_writer *) ctx;
+
+    if (event == ARP_EVENT_ADD || event == ARP_EVENT_UPDATE) {
+        writer->put(entry);
+    } else {
+        writer->erase(entry->ipAddress);
+    }
+}
@@ -0,0 +1,76 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <cstdlib>
+#include "../inc/stats.h"
+
+thread_local stats_block *stats_local = nullptr;
+
+// Blocks outlive their threads so counts of exited threads stay in the totals. The list
+// only grows at its head, so readers walk it without a lock the packet path could hold.
+static stats_block *blocks = nullptr;
+
+static unsigned int slots_used = 0;
+
+/**
+ * Creates block of calling thread on its first count
+ *
+ * @return - block
+ */
+stats_block *stats_attach() {
+    auto *block = new stats_block();
+    memset(block, 0, sizeof(stats_block));
+
+    block->next = __atomic_load_n(&blocks, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&blocks, &block->next, block, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    stats_local = block;
+
+    return block;
+}
+
+/**
+ * Reserves counters of one interface
+ *
+ * @return - slot
+ */
+unsigned int stats_register() {
+    unsigned int slot = __atomic_fetch_add(&slots_used, 1, __ATOMIC_RELAXED);
+
+    if (slot >= STATS_MAX_IFACES) {
+        fprintf(stderr, "More than %d interfaces\n", STATS_MAX_IFACES);
+        exit(EXIT_FAILURE);
+    }
+
+    return slot;
+}
+
+/**
+ * Returns counters of an interface that never counted anything. Only the latest slot can be
+ * returned, so slots are released in reverse order of registration.
+ *
+ * @param slot - slot from stats_register
+ */
+void stats_unregister(unsigned int slot) {
+    unsigned int expected = slot + 1;
+
+    __atomic_compare_exchange_n(&slots_used, &expected, slot, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sums counters of interface over every thread
+ *
+ * @param slot - interface slot
+ * @param out - totals indexed by STAT_*
+ */
+void stats_read(unsigned int slot, unsigned long long out[STAT_COUNT]) {
+    memset(out, 0, sizeof(unsigned long long) * STAT_COUNT);
+
+    for (stats_block *block = __atomic_load_n(&blocks, __ATOMIC_ACQUIRE); block != nullptr; block = block->next) {
+        for (int i = 0; i < STAT_COUNT; ++i) {
+            out[i] += __atomic_load_n(&block->values[slot][i], __ATOMIC_RELAXED);
+        }
+    }
+}
@@ -0,0 +1,407 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include "../inc/uring.h"
+#include <sys/mman.h>       // mmap
+#include <sys/syscall.h>    // __NR_io_uring_*
+#include <unistd.h>         // syscall, close
+#include <signal.h>         // _NSIG
+#include <string.h>         // memset
+#include <errno.h>          // errno
+#include <stdio.h>          // perror
+#include <cstdlib>          // exit, calloc
+
+/*
+ * Raw syscall wrappers
+ */
+static int sys_io_uring_setup(unsigned int entries, io_uring_params *p) {
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, _NSIG / 8);
+}
+
+static int sys_io_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * Creates ring and maps submission and completion queues
+ *
+ * @param entries - submission queue size
+ */
+uring::uring(unsigned int entries) {
+    io_uring_params p{};
+
+    this->buf_ring = nullptr;
+    this->buf_base = nullptr;
+    this->buf_count = 0;
+    this->buf_size = 0;
+    this->buf_group = 0;
+
+    // Create ring
+    this->ring_fd = sys_io_uring_setup(entries, &p);
+    if (this->ring_fd < 0) {
+        perror("io_uring_setup()");
+        exit(errno);
+    }
+
+    // Both queues are mapped together when kernel supports it
+    this->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    this->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (this->cq_size > this->sq_size) this->sq_size = this->cq_size;
+        this->cq_size = this->sq_size;
+    }
+
+    this->sq_ptr = mmap(nullptr, this->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        this->ring_fd, IORING_OFF_SQ_RING);
+    if (this->sq_ptr == MAP_FAILED) {
+        perror("mmap(IORING_OFF_SQ_RING)");
+        exit(errno);
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        this->cq_ptr = this->sq_ptr;
+    } else {
+        this->cq_ptr = mmap(nullptr, this->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            this->ring_fd, IORING_OFF_CQ_RING);
+        if (this->cq_ptr == MAP_FAILED) {
+            perror("mmap(IORING_OFF_CQ_RING)");
+            exit(errno);
+        }
+    }
+
+    // Map submission queue entries
+    this->sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    this->sqes = (io_uring_sqe *) mmap(nullptr, this->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                       this->ring_fd, IORING_OFF_SQES);
+    if (this->sqes == MAP_FAILED) {
+        perror("mmap(IORING_OFF_SQES)");
+        exit(errno);
+    }
+
+    /*
+     * Submission queue pointers
+     */
+    auto *sq = (char *) this->sq_ptr;
+    this->sq_head = (unsigned int *) (sq + p.sq_off.head);
+    this->sq_tail = (unsigned int *) (sq + p.sq_off.tail);
+    this->sq_mask = (unsigned int *) (sq + p.sq_off.ring_mask);
+    this->sq_array = (unsigned int *) (sq + p.sq_off.array);
+    this->sq_entries = p.sq_entries;
+    this->sq_local_tail = *this->sq_tail;
+    this->sq_submitted = this->sq_local_tail;
+
+    /*
+     * Completion queue pointers
+     */
+    auto *cq = (char *) this->cq_ptr;
+    this->cq_head = (unsigned int *) (cq + p.cq_off.head);
+    this->cq_tail = (unsigned int *) (cq + p.cq_off.tail);
+    this->cq_mask = (unsigned int *) (cq + p.cq_off.ring_mask);
+    this->cqes = (io_uring_cqe *) (cq + p.cq_off.cqes);
+}
+
+/**
+ * Unmaps queues and closes ring
+ */
+uring::~uring() {
+    if (this->buf_ring != nullptr) {
+        munmap(this->buf_ring, this->buf_count * sizeof(io_uring_buf));
+        delete[] this->buf_base;
+    }
+
+    munmap(this->sqes, this->sqes_size);
+    if (this->cq_ptr != this->sq_ptr) munmap(this->cq_ptr, this->cq_size);
+    munmap(this->sq_ptr, this->sq_size);
+    close(this->ring_fd);
+}
+
+/**
+ * Checks if ring knows every opcode used by engine and control loop
+ *
+ * @param fd - ring descriptor
+ *
+ * @return - true if all opcodes are supported
+ */
+static bool probe_opcodes(int fd) {
+    static const unsigned char needed[] = {IORING_OP_RECV, IORING_OP_ACCEPT, IORING_OP_SENDMSG, IORING_OP_READ};
+    size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    auto *probe = (io_uring_probe *) calloc(1, size);
+    bool ok = probe != nullptr && sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+
+    for (unsigned int i = 0; ok && i < sizeof(needed); ++i) {
+        auto *ops = (io_uring_probe_op *) (probe + 1);
+        ok = needed[i] <= probe->last_op && (ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    free(probe);
+
+    return ok;
+}
+
+/**
+ * Checks if running kernel allows everything engine relies on: the opcodes, provided
+ * buffer rings (5.19) and multishot receive (6.0). Older kernels must use blocking I/O
+ * instead, setting up a ring there would fail once the daemon runs.
+ *
+ * @return - true if a multishot receive into provided buffers worked on a trial ring
+ */
+bool uring::supported() {
+    io_uring_params p{};
+
+    int fd = sys_io_uring_setup(4, &p);
+    if (fd < 0) return false;
+
+    bool ok = probe_opcodes(fd);
+    close(fd);
+    if (!ok) return false;
+
+    // Trial ring, registering provided buffers fails before 5.19
+    uring ring(4);
+    if (!ring.setup_buffers(1, 2, 64)) return false;
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, sv) < 0) return false;
+
+    // Multishot receive stays armed after first datagram, older kernels reject it
+    if (ring.prep_recv_multishot(sv[0], 0) && send(sv[1], "x", 1, 0) == 1 && ring.submit(1) >= 0) {
+        io_uring_cqe *cqe = ring.peek_cqe();
+        ok = cqe != nullptr && cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE);
+    } else {
+        ok = false;
+    }
+
+    close(sv[0]);
+    close(sv[1]);
+
+    return ok;
+}
+
+/**
+ * Grabs next free submission entry, flushing queue if it is full
+ *
+ * @return - zeroed submission entry, nullptr if kernel did not take queued entries
+ */
+io_uring_sqe *uring::get_sqe() {
+    unsigned int head = __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+
+    // Queue is full, push pending entries to kernel
+    if (this->sq_local_tail - head >= this->sq_entries) {
+        this->submit(0);
+        head = __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+        if (this->sq_local_tail - head >= this->sq_entries) return nullptr;
+    }
+
+    unsigned int index = this->sq_local_tail & *this->sq_mask;
+    io_uring_sqe *sqe = &this->sqes[index];
+    this->sq_array[index] = index;
+    this->sq_local_tail++;
+
+    memset(sqe, 0, sizeof(io_uring_sqe));
+
+    return sqe;
+}
+
+/**
+ * Submits pending entries and optionally waits for completions
+ *
+ * @param wait_nr - minimum amount of completions to wait for
+ *
+ * @return - amount of submitted entries or negative errno
+ */
+int uring::submit(unsigned int wait_nr) {
+    unsigned int to_submit = this->sq_local_tail - this->sq_submitted;
+
+    // Publish new tail to kernel
+    __atomic_store_n(this->sq_tail, this->sq_local_tail, __ATOMIC_RELEASE);
+    this->sq_submitted = this->sq_local_tail;
+
+    if (to_submit == 0 && wait_nr == 0) return 0;
+
+    int ret;
+    do {
+        ret = sys_io_uring_enter(this->ring_fd, to_submit, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret < 0 ? -errno : ret;
+}
+
+/**
+ * Peeks next completion without consuming it
+ *
+ * @return - nullptr if queue is empty, completion entry otherwise
+ */
+io_uring_cqe *uring::peek_cqe() {
+    unsigned int head = *this->cq_head;
+
+    if (head == __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE)) return nullptr;
+
+    return &this->cqes[head & *this->cq_mask];
+}
+
+/**
+ * Marks last peeked completion as consumed
+ */
+void uring::cqe_seen() {
+    __atomic_store_n(this->cq_head, *this->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Registers a provided buffer ring used by multishot receives
+ *
+ * @param group - buffer group id
+ * @param count - amount of buffers (power of 2)
+ * @param size - size of each buffer
+ *
+ * @return - false if kernel has no provided buffer rings
+ */
+bool uring::setup_buffers(unsigned short group, unsigned int count, unsigned int size) {
+    io_uring_buf_reg reg{};
+
+    // Ring memory must be page aligned
+    void *ring = mmap(nullptr, count * sizeof(io_uring_buf), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+                      -1, 0);
+    if (ring == MAP_FAILED) return false;
+
+    reg.ring_addr = (unsigned long long) ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (sys_io_uring_register(this->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(ring, count * sizeof(io_uring_buf));
+        return false;
+    }
+
+    this->buf_ring = (io_uring_buf_ring *) ring;
+    this->buf_group = group;
+    this->buf_count = count;
+    this->buf_size = size;
+    this->buf_base = new char[(size_t) count * size];
+
+    // Hand every buffer to the kernel
+    this->buf_ring->tail = 0;
+    for (unsigned int i = 0; i < count; ++i) {
+        this->recycle_buffer(i);
+    }
+
+    return true;
+}
+
+/**
+ * Get provided buffer by id
+ *
+ * @param id - buffer id from completion flags
+ *
+ * @return - buffer address
+ */
+char *uring::buffer(unsigned int id) {
+    return this->buf_base + (size_t) id * this->buf_size;
+}
+
+/**
+ * Gives buffer back to kernel after its data was consumed
+ *
+ * @param id - buffer id
+ */
+void uring::recycle_buffer(unsigned int id) {
+    unsigned short tail = this->buf_ring->tail;
+    // Index ring memory directly, in C++ the flex array member is not at offset zero
+    auto *bufs = (io_uring_buf *) this->buf_ring;
+    io_uring_buf *buf = &bufs[tail & (this->buf_count - 1)];
+
+    buf->addr = (unsigned long long) this->buffer(id);
+    buf->len = this->buf_size;
+    buf->bid = (unsigned short) id;
+
+    __atomic_store_n(&this->buf_ring->tail, (unsigned short) (tail + 1), __ATOMIC_RELEASE);
+}
+
+/**
+ * Queues a multishot receive using provided buffers
+ *
+ * @param fd - socket to receive from
+ * @param user_data - completion tag
+ *
+ * @return - false if submission queue stayed full
+ */
+bool uring::prep_recv_multishot(int fd, unsigned long long user_data) {
+    io_uring_sqe *sqe = this->get_sqe();
+    if (sqe == nullptr) return false;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = this->buf_group;
+    sqe->user_data = user_data;
+
+    return true;
+}
+
+/**
+ * Queues a multishot accept
+ *
+ * @param fd - listening socket
+ * @param user_data - completion tag
+ *
+ * @return - false if submission queue stayed full
+ */
+bool uring::prep_accept_multishot(int fd, unsigned long long user_data) {
+    io_uring_sqe *sqe = this->get_sqe();
+    if (sqe == nullptr) return false;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data;
+
+    return true;
+}
+
+/**
+ * Queues a sendmsg, message must stay valid until completion
+ *
+ * @param fd - socket to send on
+ * @param msg - message header
+ * @param user_data - completion tag
+ *
+ * @return - false if submission queue stayed full
+ */
+bool uring::prep_sendmsg(int fd, msghdr *msg, unsigned long long user_data) {
+    io_uring_sqe *sqe = this->get_sqe();
+    if (sqe == nullptr) return false;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long) msg;
+    sqe->len = 1;
+    sqe->user_data = user_data;
+
+    return true;
+}
+
+/**
+ * Queues a plain read
+ *
+ * @param fd - descriptor to read
+ * @param buf - destination buffer
+ * @param len - buffer length
+ * @param user_data - completion tag
+ *
+ * @return - false if submission queue stayed full
+ */
+bool uring::prep_read(int fd, void *buf, unsigned int len, unsigned long long user_data) {
+    io_uring_sqe *sqe = this->get_sqe();
+    if (sqe == nullptr) return false;
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long) buf;
+    sqe->len = len;
+    sqe->user_data = user_data;
+
+    return true;
+}
@@ -0,0 +1,252 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include "../inc/uring_engine.h"
+#include "../inc/interface_worker.h"
+#include "../inc/logger.h"
+#include "../inc/stats.h"
+#include <sys/eventfd.h>    // eventfd
+#include <unistd.h>         // write
+#include <string.h>         // memcpy, strerror
+#include <errno.h>          // errno
+#include <stdio.h>          // printf
+#include <cstdlib>          // exit
+
+// Marks the thread running the completion loop
+static thread_local bool on_engine_thread = false;
+
+/**
+ * Engine thread
+ *
+ * @param ctx - engine context
+ *
+ * @return - void
+ */
+void *engine_loop(void *ctx) {
+    auto *e = (uring_engine *) ctx;
+
+    e->run();
+
+    return nullptr;
+}
+
+/**
+ * Constructor
+ *
+ * @param workers - interface workers whose sockets are serviced by the ring
+ * @param worker_count - amount of workers
+ */
+uring_engine::uring_engine(interface_worker **workers, int worker_count) {
+    this->workers = workers;
+    this->worker_count = worker_count;
+    this->engine_thread = nullptr;
+
+    // Ring with provided buffers for multishot receives
+    this->ring = new uring(URING_ENTRIES);
+    if (!this->ring->setup_buffers(URING_BUFFER_GROUP, URING_BUFFER_COUNT, URING_BUFFER_SIZE)) {
+        perror("io_uring_register(IORING_REGISTER_PBUF_RING)");
+        exit(errno);
+    }
+    this->wake_armed = false;
+
+    // Event used to wake ring when other threads queue frames
+    this->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (this->wake_fd < 0) {
+        perror("eventfd()");
+        exit(errno);
+    }
+
+    // Build send slot pool
+    this->slots = new send_slot[URING_SEND_SLOTS];
+    for (unsigned int i = 0; i < URING_SEND_SLOTS; ++i) {
+        this->free_slots.push_back(i);
+    }
+    this->pending_slots.reserve(URING_SEND_SLOTS);
+}
+
+/**
+ * Dispatch engine thread
+ */
+void uring_engine::start() {
+    this->engine_thread = new pthread_t();
+
+    if (pthread_create(this->engine_thread, nullptr, engine_loop, (void *) this)) {
+        perror("pthreads()");
+        exit(errno);
+    }
+}
+
+/**
+ * Arms multishot receive on worker socket, retried on next loop if submission queue is full
+ *
+ * @param index - worker index
+ */
+void uring_engine::arm_recv(int index) {
+    if (!this->ring->prep_recv_multishot(this->workers[index]->iface_data->sockfd,
+                                         URING_USER_DATA(URING_TAG_RECV, index))) {
+        this->unarmed.push_back(index);
+    }
+}
+
+/**
+ * Arms read on wake-up event, retried on next loop if submission queue is full
+ */
+void uring_engine::arm_wake() {
+    this->wake_armed = this->ring->prep_read(this->wake_fd, &this->wake_value, sizeof(this->wake_value),
+                                             URING_USER_DATA(URING_TAG_WAKE, 0));
+}
+
+/**
+ * Retries arming receives and wake-up that found submission queue full
+ */
+void uring_engine::rearm() {
+    vector<int> pending;
+    pending.swap(this->unarmed);
+
+    for (int index : pending) {
+        this->arm_recv(index);
+    }
+    if (!this->wake_armed) this->arm_wake();
+}
+
+/**
+ * Queues frame to be sent on next ring submission
+ *
+ * @param fd - packet socket
+ * @param frame - raw frame
+ * @param length - frame length
+ * @param sa - destination address
+ *
+ * @return - false if frame could not be queued and must be sent directly
+ */
+bool uring_engine::queue_send(int fd, const char *frame, unsigned int length, sockaddr_ll *sa) {
+    if (length > URING_FRAME_SIZE) return false;
+
+    {
+        lock_guard<mutex> guard(this->send_lock);
+
+        if (this->free_slots.empty()) return false;
+
+        unsigned int id = this->free_slots.back();
+        this->free_slots.pop_back();
+
+        // Fill slot
+        send_slot *slot = &this->slots[id];
+        memcpy(slot->frame, frame, length);
+        memcpy(&slot->sa, sa, sizeof(sockaddr_ll));
+        slot->fd = fd;
+        slot->iov.iov_base = slot->frame;
+        slot->iov.iov_len = length;
+        memset(&slot->msg, 0, sizeof(msghdr));
+        slot->msg.msg_name = &slot->sa;
+        slot->msg.msg_namelen = sizeof(sockaddr_ll);
+        slot->msg.msg_iov = &slot->iov;
+        slot->msg.msg_iovlen = 1;
+
+        this->pending_slots.push_back(id);
+    }
+
+    // Frames queued while processing completions go out with the next submission
+    if (!on_engine_thread) {
+        unsigned long long one = 1;
+        if (write(this->wake_fd, &one, sizeof(one)) < 0) {
+            perror("write(eventfd)");
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Moves queued frames into submission queue, frames that do not fit wait for next loop
+ */
+void uring_engine::flush_sends() {
+    lock_guard<mutex> guard(this->send_lock);
+    size_t queued = 0;
+
+    for (unsigned int id : this->pending_slots) {
+        send_slot *slot = &this->slots[id];
+        if (!this->ring->prep_sendmsg(slot->fd, &slot->msg, URING_USER_DATA(URING_TAG_SEND, id))) break;
+        queued++;
+    }
+
+    this->pending_slots.erase(this->pending_slots.begin(), this->pending_slots.begin() + queued);
+}
+
+/**
+ * Handles a single completion
+ *
+ * @param cqe - completion entry
+ */
+void uring_engine::handle_completion(io_uring_cqe *cqe) {
+    unsigned int tag = URING_TAG(cqe->user_data);
+    unsigned int value = URING_VALUE(cqe->user_data);
+
+    if (tag == URING_TAG_RECV) {
+        interface_worker *ir = this->workers[value];
+
+        if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+            unsigned int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+            // Count statistics
+            stats_add(ir->stats_slot, STAT_RX_FRAMES);
+            stats_add(ir->stats_slot, STAT_RX_BYTES, (unsigned long long) cqe->res);
+
+            // Process received packet straight from provided buffer
+            ir->process_packet(this->ring->buffer(bid), (unsigned int) cqe->res);
+            this->ring->recycle_buffer(bid);
+        } else if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+            log_error("recvmsg: %s", log_errno(-cqe->res));
+        }
+
+        // Kernel stopped the multishot, re-arm it
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            this->arm_recv((int) value);
+        }
+    } else if (tag == URING_TAG_SEND) {
+        if (cqe->res < 0) {
+            log_error("sendmsg: %s", log_errno(-cqe->res));
+        }
+
+        lock_guard<mutex> guard(this->send_lock);
+        this->free_slots.push_back(value);
+    } else if (tag == URING_TAG_WAKE) {
+        this->arm_wake();
+    }
+}
+
+/**
+ * Completion loop
+ */
+void uring_engine::run() {
+    on_engine_thread = true;
+
+    // Arm receives for every interface
+    for (int i = 0; i < this->worker_count; ++i) {
+        this->arm_recv(i);
+    }
+    this->arm_wake();
+
+    while (true) {
+        // Batch every frame produced since last submission
+        this->rearm();
+        this->flush_sends();
+
+        int ret = this->ring->submit(1);
+        if (ret < 0 && ret != -EBUSY) {
+            // No reader threads exist, a stopped ring would leave every interface silently dead
+            fprintf(stderr, "io_uring_enter(): %s\n", strerror(-ret));
+            exit(-ret);
+        }
+
+        // Drain all available completions
+        io_uring_cqe *cqe;
+        while ((cqe = this->ring->peek_cqe()) != nullptr) {
+            io_uring_cqe copy = *cqe;
+            this->ring->cqe_seen();
+
+            this->handle_completion(&copy);
+        }
+    }
+}
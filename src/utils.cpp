@@ -1,72 +1,144 @@
 #include <stdio.h>
 #include <string.h>
 #include <cstdlib>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
 #include "../inc/utils.h"
 #include "../inc/types.h"
 #include "../inc/interface_worker.h"
+#include "../inc/logger.h"
 
 /**
- * Parses Ethernet address to 6 bytes
+ * Reads unsigned decimal number, never allocates
  *
- * @param addr - ethernet address in string form
+ * @param cursor - position in text, moved past number
+ * @param end - end of text
+ * @param value - parsed number
  *
- * @return - ethernet address in byte form
+ * @return - false if no digit was found or number overflows
  */
-unsigned char *parse_eth_addr(char *addr) {
-    // 6 bytes used by an Ethernet Address
-    auto *ether = new unsigned char[(sizeof(unsigned char) * 6)];
-
-    // Copy string to use in strtok
-    auto *copy = new char[(sizeof(char) * (strlen(addr) + 1))];
-    strcpy(copy, addr);
-
-    // Parse text value to byte
-    ether[0] = (unsigned char) strtol(strtok(copy, ":"), nullptr, 16);
-    for (int j = 1; j < 6; ++j) {
-        ether[j] = (unsigned char) strtol(strtok(nullptr, ":"), nullptr, 16);
+bool scan_uint(const char **cursor, const char *end, unsigned int *value) {
+    const char *p = *cursor;
+    unsigned long long v = 0;
+
+    if (p == end || *p < '0' || *p > '9') return false;
+
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (unsigned) (*p - '0');
+        if (v > UINT32_MAX) return false;
+        p++;
     }
 
-    return ether;
+    *value = (unsigned int) v;
+    *cursor = p;
+
+    return true;
 }
 
 /**
- * Parses IP address to int form
+ * Reads dotted IP address, never allocates
  *
- * @param filter - ip address in string form
+ * @param cursor - position in text, moved past address
+ * @param end - end of text
+ * @param ip - parsed address
  *
- * @return - ip address in int form
+ * @return - false if text is not a dotted IPv4 address
  */
-unsigned int parse_ip_addr(char *filter) {
-    // Resulting int IP
-    int unsigned result = 0;
-
-    // Parsed IP segments
-    int *ipp = new int[(sizeof(int) * 4)];
+bool scan_ip_addr(const char **cursor, const char *end, unsigned int *ip) {
+    const char *p = *cursor;
+    unsigned int result = 0;
 
-    // 4 IP address segments
-    char **ip = new char *[(sizeof(char *) * 4)];
+    for (int i = 0; i < 4; ++i) {
+        unsigned int octet;
 
-    // Copy string to use in strtok
-    char *copy = new char[(sizeof(char) * (strlen(filter) + 1))];
-    strcpy(copy, filter);
+        if (i > 0) {
+            if (p == end || *p != '.') return false;
+            p++;
+        }
 
-    // Split IP String
-    ip[0] = strtok(copy, ".");
-    for (int i = 1; i < 4; ++i) {
-        ip[i] = strtok(nullptr, ".");
+        if (!scan_uint(&p, end, &octet) || octet > 255) return false;
+        result = (result << 8) | octet;
     }
 
-    // Parse to int
-    for (int i = 0; i < 4; ++i) {
-        ipp[i] = (int) strtol(ip[i], nullptr, 10);
-    }
+    *ip = result;
+    *cursor = p;
 
-    for (int i = 0; i < 4; ++i) {
-        result += ipp[i] << ((3 - i) * 8);
+    return true;
+}
+
+/**
+ * Reads colon separated Ethernet address, never allocates
+ *
+ * @param cursor - position in text, moved past address
+ * @param end - end of text
+ * @param eth - parsed address, 6 bytes
+ *
+ * @return - false if text is not an Ethernet address
+ */
+bool scan_eth_addr(const char **cursor, const char *end, unsigned char eth[]) {
+    const char *p = *cursor;
+
+    for (int i = 0; i < 6; ++i) {
+        unsigned int octet = 0;
+        int digits = 0;
+
+        if (i > 0) {
+            if (p == end || *p != ':') return false;
+            p++;
+        }
+
+        // One or two hex digits per octet
+        while (p < end && digits < 2) {
+            char c = *p;
+            unsigned int d;
+            if (c >= '0' && c <= '9') d = (unsigned) (c - '0');
+            else if (c >= 'a' && c <= 'f') d = (unsigned) (c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') d = (unsigned) (c - 'A' + 10);
+            else break;
+
+            octet = (octet << 4) | d;
+            digits++;
+            p++;
+        }
+
+        if (digits == 0) return false;
+        eth[i] = (unsigned char) octet;
     }
 
-    // Return IP number array
-    return result;
+    *cursor = p;
+
+    return true;
+}
+
+/**
+ * Parses Ethernet address to 6 bytes
+ *
+ * @param addr - ethernet address in string form
+ * @param eth - ethernet address in byte form
+ *
+ * @return - false if address is malformed
+ */
+bool parse_eth_addr(const char *addr, unsigned char eth[]) {
+    const char *end = addr + strlen(addr);
+
+    return scan_eth_addr(&addr, end, eth) && addr == end;
+}
+
+/**
+ * Parses IP address to int form
+ *
+ * @param filter - ip address in string form
+ *
+ * @return - ip address in int form, 0 if malformed
+ */
+unsigned int parse_ip_addr(const char *filter) {
+    const char *end = filter + strlen(filter);
+    unsigned int ip;
+
+    if (!scan_ip_addr(&filter, end, &ip) || filter != end) return 0;
+
+    return ip;
 }
 
 /**
@@ -124,8 +196,9 @@ void print_iface(iface *iff) {
     print_ip_addr((char*) "=>\tNetmask: ", iff->netmask);
     printf("\n");
     printf("=>\tUP MTU: %d\n", iff->mtu);
-    printf("=>\tRX packets: %d TX packets: %d\n", iff->rx_pkts, iff->tx_pkts);
-    printf("=>\tRX bytes: %d TX bytes: %d\n", iff->rx_bytes, iff->tx_bytes);
+    printf("=>\tRX packets: %llu TX packets: %llu\n", iff->rx_pkts, iff->tx_pkts);
+    printf("=>\tRX bytes: %llu TX bytes: %llu\n", iff->rx_bytes, iff->tx_bytes);
+    printf("=>\tRX dropped: %llu\n", iff->rx_dropped);
     printf("=>\n======== %s ========\n\n",iff->ifname);
 }
 
@@ -165,6 +238,71 @@ void build_arp_header(const char *data, arp_hdr *hdr) {
     memcpy(&hdr->destination_ip, data + off + hl + pl + hl, pl);
 }
 
+/**
+ * Decodes ARP payload of a frame already known to carry ARP, only Ethernet/IPv4 ARP is
+ * understood and variable length fields must fit in frame
+ *
+ * @param data - frame starting at Ethernet header
+ * @param length - frame length
+ * @param arp - decoded header, fields stay in network order
+ *
+ * @return - false if payload is truncated or not Ethernet/IPv4
+ */
+bool parse_arp_frame(const char *data, unsigned int length, arp_hdr *arp) {
+    if (length < sizeof(eth_hdr) + ARP_WIRE_LEN) return false;
+
+    // Fixed part lines up with arp_hdr
+    memcpy(arp, data + sizeof(eth_hdr), 8);
+    if (arp->hardware_length != HW_ADDR_LEN || arp->protocol_length != sizeof(unsigned int)) return false;
+
+    build_arp_header(data, arp);
+
+    return true;
+}
+
+/**
+ * Writes Ethernet/IPv4 ARP frame
+ *
+ * @param out - output, at least ARP_FRAME_LEN bytes
+ * @param opcode - ARP_REQUEST or ARP_REPLY
+ * @param eth_dst - Ethernet destination
+ * @param sender_mac - sender hardware address, also Ethernet source
+ * @param sender_ip - sender ip, host order
+ * @param target_mac - target hardware address
+ * @param target_ip - target ip, host order
+ *
+ * @return - frame length
+ */
+unsigned int encode_arp_frame(char *out, unsigned short opcode, const unsigned char eth_dst[],
+                              const unsigned char sender_mac[], unsigned int sender_ip,
+                              const unsigned char target_mac[], unsigned int target_ip) {
+    unsigned short hardware_type = htons(1);
+    unsigned short protocol_type = htons(ETH_P_IP);
+    unsigned short op = htons(opcode);
+    unsigned int sip = htonl(sender_ip);
+    unsigned int tip = htonl(target_ip);
+
+    // Ethernet header
+    memcpy(out, eth_dst, HW_ADDR_LEN);
+    memcpy(out + 6, sender_mac, HW_ADDR_LEN);
+    out[12] = ETH_P_ARP / 256;
+    out[13] = ETH_P_ARP % 256;
+
+    // ARP payload
+    char *pt = out + 14;
+    memcpy(pt, &hardware_type, 2);
+    memcpy(pt + 2, &protocol_type, 2);
+    pt[4] = HW_ADDR_LEN;
+    pt[5] = sizeof(unsigned int);
+    memcpy(pt + 6, &op, 2);
+    memcpy(pt + 8, sender_mac, HW_ADDR_LEN);
+    memcpy(pt + 14, &sip, 4);
+    memcpy(pt + 18, target_mac, HW_ADDR_LEN);
+    memcpy(pt + 24, &tip, 4);
+
+    return ARP_FRAME_LEN;
+}
+
 /**
  * Finds Interface Worker object that contains handles network for given IP
  *
@@ -183,12 +321,7 @@ interface_worker *find_interface_worker(unsigned int ip, interface_worker **work
         unsigned int net_if = mask & ifw->iface_data->ip_addr;
         unsigned int net_ip = mask & ip;
 
-        // Debug
-        printf("Attempting to solve: ");
-        print_ip_addr((char*) "", net_if);
-        printf(" == ");
-        print_ip_addr((char*) "", net_ip);
-        printf("\n");
+        log_debug("Attempting to solve: %s == %s", log_ip(net_if), log_ip(net_ip));
 
         // Check if interface and ip are on the same network
         if(net_if == net_ip) {
@@ -0,0 +1,182 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include <algorithm>
+#include <sched.h>
+#include "../inc/watch_hub.h"
+#include "../inc/protocol.h"
+
+/**
+ * Constructor
+ *
+ * @param server - control server delivering events
+ */
+watch_hub::watch_hub(control_server *server) {
+    this->server = server;
+    for (auto &slot : this->slots) slot.store(nullptr, memory_order_relaxed);
+    this->subscribed.store(0, memory_order_relaxed);
+    this->active.store(0, memory_order_relaxed);
+    this->wake_pending.store(false, memory_order_relaxed);
+}
+
+/**
+ * Registers connection as subscriber, its stream starts parked. Only called from control loop.
+ *
+ * @param con - connection id
+ *
+ * @return - subscriber, released with unsubscribe, nullptr if every slot is taken
+ */
+watch_subscriber *watch_hub::subscribe(unsigned long long con) {
+    for (auto &slot : this->slots) {
+        if (slot.load(memory_order_relaxed) != nullptr) continue;
+
+        auto *sub = new watch_subscriber();
+        sub->con = con;
+        sub->ring = new watch_event[WATCH_QUEUE_MAX];
+        sub->head.store(0, memory_order_relaxed);
+        sub->tail.store(0, memory_order_relaxed);
+        sub->dropped.store(0, memory_order_relaxed);
+        sub->waiting.store(false, memory_order_relaxed);
+        sub->wake.store(false, memory_order_relaxed);
+
+        slot.store(sub, memory_order_release);
+        this->subscribed.fetch_add(1, memory_order_relaxed);
+
+        return sub;
+    }
+
+    return nullptr;
+}
+
+/**
+ * Removes subscriber and frees it once no publish or flush can still reach it.
+ * Only called from control loop.
+ *
+ * @param sub - subscriber
+ */
+void watch_hub::unsubscribe(watch_subscriber *sub) {
+    for (auto &slot : this->slots) {
+        if (slot.load(memory_order_relaxed) == sub) slot.store(nullptr, memory_order_seq_cst);
+    }
+    this->subscribed.fetch_sub(1, memory_order_relaxed);
+
+    // Publishes and flushes are short, later ones no longer find the slot
+    while (this->active.load(memory_order_seq_cst) != 0) {
+        sched_yield();
+    }
+
+    delete[] sub->ring;
+    delete sub;
+}
+
+/**
+ * Queues event for every subscriber. Runs on packet and timer threads under the table write
+ * lock, so it takes no lock and makes no call: a full ring only counts the event as dropped
+ * and parked streams are resumed by flush once the table lock is released.
+ *
+ * @param type - ARP_EVENT_* type
+ * @param entry - changed entry
+ */
+void watch_hub::publish(unsigned char type, const arp_table_entry *entry) {
+    if (this->subscribed.load(memory_order_relaxed) == 0) return;
+
+    bool wake = false;
+    this->active.fetch_add(1, memory_order_seq_cst);
+
+    for (auto &slot : this->slots) {
+        watch_subscriber *sub = slot.load(memory_order_seq_cst);
+        if (sub == nullptr) continue;
+
+        size_t tail = sub->tail.load(memory_order_relaxed);
+        if (tail - sub->head.load(memory_order_acquire) == WATCH_QUEUE_MAX) {
+            sub->dropped.fetch_add(1, memory_order_relaxed);
+            continue;
+        }
+
+        watch_event &ev = sub->ring[tail & (WATCH_QUEUE_MAX - 1)];
+        ev.type = type;
+        ev.entry = *entry;
+        sub->tail.store(tail + 1, memory_order_seq_cst);
+
+        // One wake-up per parked stream, later events are picked up by the same drain
+        if (sub->waiting.load(memory_order_seq_cst) && sub->waiting.exchange(false, memory_order_seq_cst)) {
+            sub->wake.store(true, memory_order_release);
+            wake = true;
+        }
+    }
+
+    if (wake) this->wake_pending.store(true, memory_order_release);
+    this->active.fetch_sub(1, memory_order_release);
+}
+
+/**
+ * Resumes streams woken by publish, runs after table write lock is released
+ */
+void watch_hub::flush() {
+    if (!this->wake_pending.load(memory_order_relaxed) || !this->wake_pending.exchange(false)) return;
+
+    this->active.fetch_add(1, memory_order_seq_cst);
+
+    for (auto &slot : this->slots) {
+        watch_subscriber *sub = slot.load(memory_order_seq_cst);
+        if (sub != nullptr && sub->wake.exchange(false, memory_order_acquire)) {
+            this->server->resume(sub->con);
+        }
+    }
+
+    this->active.fetch_sub(1, memory_order_release);
+}
+
+/**
+ * Encodes queued events of subscriber, marks it waiting when there is nothing to send
+ *
+ * @param sub - subscriber
+ * @param out - output, room for max events of WIRE_EVENT_LEN
+ * @param max - max events
+ * @param dropped - events dropped since previous drain
+ *
+ * @return - amount of events encoded
+ */
+size_t watch_hub::drain(watch_subscriber *sub, unsigned char *out, size_t max, unsigned int *dropped) {
+    while (true) {
+        size_t head = sub->head.load(memory_order_relaxed);
+        size_t count = min(max, sub->tail.load(memory_order_acquire) - head);
+
+        for (size_t i = 0; i < count; ++i) {
+            watch_event &ev = sub->ring[(head + i) & (WATCH_QUEUE_MAX - 1)];
+            out += encode_event(out, ev.type, &ev.entry);
+        }
+        sub->head.store(head + count, memory_order_release);
+
+        *dropped = sub->dropped.exchange(0, memory_order_relaxed);
+        if (count > 0 || *dropped > 0) return count;
+
+        // Park, then look again so an event published in between is not left waiting
+        sub->waiting.store(true, memory_order_seq_cst);
+        if (sub->tail.load(memory_order_seq_cst) == head && sub->dropped.load(memory_order_relaxed) == 0) {
+            return 0;
+        }
+        sub->waiting.store(false, memory_order_relaxed);
+    }
+}
+
+/**
+ * Table listener forwarding changes to hub
+ *
+ * @param event - ARP_EVENT_* type
+ * @param entry - changed entry
+ * @param ctx - watch hub
+ */
+void watch_table_changed(unsigned char event, const arp_table_entry *entry, void *ctx) {
+    ((watch_hub *) ctx)->publish(event, entry);
+}
+
+/**
+ * Table flush listener waking streams once table lock is released
+ *
+ * @param ctx - watch hub
+ */
+void watch_table_flushed(void *ctx) {
+    ((watch_hub *) ctx)->flush();
+}
@@ -1,19 +1,15 @@
 #include <iostream>
+#include <unordered_map>
 #include <sys/socket.h>
 #include <sys/types.h>
-#include <netinet/in.h>
 #include <string.h>
+#include <ctype.h>
 #include <unistd.h>
-#include <arpa/inet.h>
 #include "../inc/types.h"
 #include "../inc/utils.h"
-
-/*
- * Socket
- */
-void build_socket();
-
-void connect();
+#include "../inc/control_client.h"
+#include "../inc/shm_table.h"
+#include "../inc/pcap_io.h"
 
 /*
  * Commands
@@ -21,9 +17,7 @@ void connect();
 
 void print_usage();
 
-void send_command(command_hdr *cmd);
-
-void send_if_show();
+void send_show(unsigned int cursor, unsigned int limit);
 
 void send_set_ttl(int ttl);
 
@@ -31,40 +25,65 @@ void send_del(unsigned int ip);
 
 void send_add(unsigned int ip, unsigned char mac[], unsigned int ttl);
 
-void send_res(unsigned int ip);
+void send_res(unsigned int ips[], int count, unsigned int timeout);
+
+void send_query(command_hdr *cmd);
+
+void send_watch();
+
+void send_scan(char **targets, int count, unsigned int timeout);
+
+void send_import(const char *path, bool remove);
+
+void send_export(const char *path);
+
+void send_stats();
+
+void send_latency();
+
+void send_capture(unsigned int op);
+
+void send_capture_dump(const char *path);
+
+int shm_lookup(char **targets, int count);
 
 /*
  * Utils
  */
-command_hdr *get_fresh_cmd();
+unsigned short await_response(const command_hdr *cmd, string &payload);
+
+bool parse_query(int argc, char **args, command_hdr *cmd);
 
 /*
  * Variables
  */
-int listenFd;
-sockaddr_in addr{};
-unsigned short port = 5050;
-unsigned int buffer_size = 1024 * 64;
-unsigned int received_bytes;
-unsigned char *buffer;
+control_client *client;
 
 int main(int argc, char **args) {
-    /*
-     * Prepare socket
-     */
-    build_socket();
-    connect();
+    if (argc < 2) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    // Shared memory lookups never talk to the daemon socket
+    if (strcmp(args[1], "lookup") == 0 && argc >= 3) {
+        return shm_lookup(args + 2, argc - 2);
+    }
 
     /*
-     * Boot
+     * Connect to daemon
      */
-    buffer = new unsigned char[buffer_size];
+    client = new control_client();
 
     /**
      * Call function according to arguments
      */
-    if (strcmp(args[1], "show") == 0 && argc == 2) {
-        send_if_show();
+    if (strcmp(args[1], "show") == 0 && argc <= 4) {
+        // Optional page: first IP and entry count
+        unsigned int cursor = argc >= 3 ? parse_ip_addr(args[2]) : 0;
+        auto limit = argc == 4 ? (unsigned int) strtol(args[3], nullptr, 10) : 0;
+
+        send_show(cursor, limit);
     } else if (strcmp(args[1], "ttl") == 0 && argc == 3) {
         auto ttl = (unsigned int) strtol(args[2], nullptr, 10);
 
@@ -75,93 +94,632 @@ int main(int argc, char **args) {
         send_del(ip);
     } else if (strcmp(args[1], "add") == 0 && argc == 5) {
         unsigned int ip = parse_ip_addr(args[2]);
-        unsigned char *eth = parse_eth_addr(args[3]);
+        unsigned char eth[HW_ADDR_LEN];
         auto ttl = (unsigned int) strtol(args[4], nullptr, 10);
 
-        send_add(ip, eth, ttl);
-    } else if (strcmp(args[1], "res") == 0 && argc == 3./xarp) {
-        unsigned int ip = parse_ip_addr(args[2]);
+        if (parse_eth_addr(args[3], eth)) {
+            send_add(ip, eth, ttl);
+        } else {
+            printf("Invalid MAC address: %s\n", args[3]);
+        }
+    } else if (strcmp(args[1], "res") == 0 && argc >= 3) {
+        // Every dotted argument is an IP, a trailing plain number is the timeout
+        int count = argc - 2;
+        unsigned int timeout = 0;
+        if (strchr(args[argc - 1], '.') == nullptr) {
+            timeout = (unsigned int) strtol(args[argc - 1], nullptr, 10);
+            count--;
+        }
+
+        unsigned int ips[count > 0 ? count : 1];
+        for (int i = 0; i < count; ++i) {
+            ips[i] = parse_ip_addr(args[2 + i]);
+        }
+
+        send_res(ips, count, timeout);
+    } else if (strcmp(args[1], "scan") == 0 && argc >= 3) {
+        // Same trailing timeout convention as res
+        int count = argc - 2;
+        unsigned int timeout = 0;
+        if (strchr(args[argc - 1], '.') == nullptr) {
+            timeout = (unsigned int) strtol(args[argc - 1], nullptr, 10);
+            count--;
+        }
 
-        send_res(ip);
+        send_scan(args + 2, count, timeout);
+    } else if (strcmp(args[1], "import") == 0 && argc == 3) {
+        send_import(args[2], false);
+    } else if (strcmp(args[1], "import") == 0 && argc == 4 && strcmp(args[2], "-d") == 0) {
+        send_import(args[3], true);
+    } else if (strcmp(args[1], "export") == 0 && argc == 3) {
+        send_export(args[2]);
+    } else if (strcmp(args[1], "stats") == 0 && argc == 2) {
+        send_stats();
+    } else if (strcmp(args[1], "latency") == 0 && argc == 2) {
+        send_latency();
+    } else if (strcmp(args[1], "capture") == 0 && argc == 3 && strcmp(args[2], "on") == 0) {
+        send_capture(CAPTURE_OP_START);
+    } else if (strcmp(args[1], "capture") == 0 && argc == 3 && strcmp(args[2], "off") == 0) {
+        send_capture(CAPTURE_OP_STOP);
+    } else if (strcmp(args[1], "capture") == 0 && argc == 2) {
+        send_capture(CAPTURE_OP_STATUS);
+    } else if (strcmp(args[1], "capture") == 0 && argc == 4 && strcmp(args[2], "dump") == 0) {
+        send_capture_dump(args[3]);
+    } else if (strcmp(args[1], "watch") == 0 && argc == 2) {
+        send_watch();
+    } else if (strcmp(args[1], "query") == 0) {
+        command_hdr cmd{};
+
+        if (parse_query(argc - 2, args + 2, &cmd)) {
+            send_query(&cmd);
+        } else {
+            print_usage();
+        }
     } else {
         printf("Unrecognized command: %s\n", args[1]);
         print_usage();
     }
+
+    delete client;
 }
 
 void print_usage() {
     printf("Commands:\n"
-           "1. xarp show\n"
+           "1. xarp show [<from_ip> [count]]\n"
            "2. xarp ttl <ttl>\n"
            "3. xarp del <ip>\n"
            "4. xarp add <ip> <mac> <ttl>\n"
-           "5. xarp res <ip>\n");
+           "5. xarp res <ip>... [timeout_ms]\n"
+           "6. xarp query [net <ip>/<len>] [mac <prefix>[/bits]] [ttl <min>-<max>] [static|dynamic]\n"
+           "7. xarp watch\n"
+           "8. xarp scan <ip>[/<len>]... [timeout_ms]\n"
+           "9. xarp import [-d] <file>\n"
+           "10. xarp export <file>\n"
+           "11. xarp lookup <ip>...\n"
+           "12. xarp stats\n"
+           "13. xarp latency\n"
+           "14. xarp capture [on|off|dump <file.pcap>]\n");
 }
 
 /**
- * Send show command
+ * Send show command, entries are printed as each chunk arrives
+ *
+ * @param cursor - first IP to list
+ * @param limit - max entries, 0 for whole table
  */
-void send_if_show() {
-    // Get new command
-    auto cmd = get_fresh_cmd();
+void send_show(unsigned int cursor, unsigned int limit) {
+    command_hdr cmd{};
+    frame_hdr hdr{};
+    string payload;
+    unsigned long entry_count = 0;
+    unsigned int next = 0;
+    bool end = true;
 
     // Set command to show
-    cmd->type = COMMAND_SHOW;
+    cmd.type = COMMAND_SHOW;
+    cmd.cursor = cursor;
+    cmd.limit = limit;
+
+    unsigned int id = client->request(&cmd);
 
-    // Send command
-    send_command(cmd);
-//    printf("Sent\n");
+    // Receive chunks until last frame
+    while (client->receive(&hdr, payload)) {
+        if (hdr.request_id != id) continue;
+        if (hdr.type != COMMAND_SHOW || payload.size() < WIRE_SHOW_HDR_LEN) break;
 
-    // Receive response
-    if ((received_bytes = (unsigned int) recv(listenFd, buffer, buffer_size, 0)) > 0) {
-        auto *res = (response_hdr *) buffer;
-        unsigned int entry_count = res->len / sizeof(arp_table_entry);
-//        printf("Response received: %d with %d bytes (raw: %d)\n", res->type, res->len, received_bytes);
-//        printf("Received %d table entries\n", entry_count);
+        auto *data = (const unsigned char *) payload.data();
+        decode_show_hdr(data, &next, &end);
 
         // Print each ARP entry
-        for (int i = 0; i < entry_count; ++i) {
-            auto *ent = (arp_table_entry *) (buffer + sizeof(response_hdr) + (sizeof(arp_table_entry) * i));
+        size_t count = (payload.size() - WIRE_SHOW_HDR_LEN) / WIRE_ENTRY_LEN;
+        for (size_t i = 0; i < count; ++i) {
+            arp_table_entry ent{};
+            decode_entry(data + WIRE_SHOW_HDR_LEN + WIRE_ENTRY_LEN * i, &ent);
+
+            print_arp_table_entry(&ent);
+        }
+        entry_count += count;
+
+        if (!(hdr.flags & FRAME_FLAG_MORE)) break;
+    }
+
+    if(entry_count == 0 && cursor == 0) {
+        printf("ARP table is empty\n");
+    }
+
+    // Page ended before table did
+    if (!end) {
+        print_ip_addr((char *) "Next page starts at: ", next);
+        printf("\n");
+    }
+}
+
+/**
+ * Build QUERY command from filter arguments, omitted filters match everything
+ *
+ * @param argc - argument count
+ * @param args - filter arguments
+ * @param cmd - command to fill
+ *
+ * @return - false if an argument is malformed
+ */
+bool parse_query(int argc, char **args, command_hdr *cmd) {
+    cmd->type = COMMAND_QUERY;
+    cmd->ttl = 0;
+    cmd->ttl_max = UINT32_MAX;
+
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(args[i], "static") == 0) {
+            cmd->kinds |= ARP_ENTRY_STATIC;
+        } else if (strcmp(args[i], "dynamic") == 0) {
+            cmd->kinds |= ARP_ENTRY_DYNAMIC;
+        } else if (strcmp(args[i], "net") == 0 && i + 1 < argc) {
+            // <ip>/<len>, plain IP matches that host only
+            char *arg = args[++i];
+            char *slash = strchr(arg, '/');
+            long len = slash != nullptr ? strtol(slash + 1, nullptr, 10) : 32;
+            if (slash != nullptr) *slash = '\0';
+            if (strchr(arg, '.') == nullptr || len < 0 || len > 32) return false;
+
+            cmd->ip = parse_ip_addr(arg);
+            cmd->ip_prefix = (unsigned char) len;
+        } else if (strcmp(args[i], "mac") == 0 && i + 1 < argc) {
+            // Leading octets, prefix length defaults to octets given so an OUI is AA:BB:CC
+            char *p = args[++i];
+            int octets = 0;
+            while (octets < HW_ADDR_LEN && isxdigit(*p)) {
+                cmd->eth[octets++] = (unsigned char) strtol(p, &p, 16);
+                if (*p == ':') p++;
+            }
+
+            long bits = *p == '/' ? strtol(p + 1, nullptr, 10) : octets * 8;
+            if (octets == 0 || bits < 0 || bits > octets * 8) return false;
+
+            cmd->eth_prefix = (unsigned char) bits;
+        } else if (strcmp(args[i], "ttl") == 0 && i + 1 < argc) {
+            // <min>-<max>, either side may be left out
+            char *arg = args[++i];
+            char *dash = strchr(arg, '-');
+            if (dash == nullptr) return false;
+
+            if (dash != arg) cmd->ttl = (unsigned int) strtoul(arg, nullptr, 10);
+            if (*(dash + 1) != '\0') cmd->ttl_max = (unsigned int) strtoul(dash + 1, nullptr, 10);
+        } else {
+            printf("Unrecognized filter: %s\n", args[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Send query command, matching entries are printed as each chunk arrives
+ *
+ * @param cmd - query command
+ */
+void send_query(command_hdr *cmd) {
+    frame_hdr hdr{};
+    string payload;
+    unsigned long entry_count = 0;
+
+    unsigned int id = client->request(cmd);
+
+    while (client->receive(&hdr, payload)) {
+        if (hdr.request_id != id) continue;
+        if (hdr.type != COMMAND_QUERY) break;
+
+        // Frames hold matches only, some may be empty
+        auto *data = (const unsigned char *) payload.data();
+        size_t count = payload.size() / WIRE_ENTRY_LEN;
+        for (size_t i = 0; i < count; ++i) {
+            arp_table_entry ent{};
+            decode_entry(data + WIRE_ENTRY_LEN * i, &ent);
 
-            print_arp_table_entry(ent);
+            print_arp_table_entry(&ent);
         }
+        entry_count += count;
 
-        if(entry_count == 0) {
-            printf("ARP table is empty\n");
+        if (!(hdr.flags & FRAME_FLAG_MORE)) break;
+    }
+
+    printf("%lu matching entries\n", entry_count);
+}
+
+/**
+ * Send scan command for hosts and networks, answers are printed as hosts reply
+ *
+ * @param targets - IPs or networks in <ip>/<len> form
+ * @param count - amount of targets
+ * @param timeout - how long daemon waits for each host in ms, 0 for default
+ */
+void send_scan(char **targets, int count, unsigned int timeout) {
+    unsigned char ranges[WIRE_SCAN_RANGE_LEN * SCAN_MAX_RANGES];
+    command_hdr cmd{};
+    frame_hdr hdr{};
+    string payload;
+
+    if (count < 1 || count > SCAN_MAX_RANGES) {
+        printf("Scan takes 1 to %d targets\n", SCAN_MAX_RANGES);
+        return;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        char *slash = strchr(targets[i], '/');
+        long len = slash != nullptr ? strtol(slash + 1, nullptr, 10) : 32;
+        if (slash != nullptr) *slash = '\0';
+        if (len < 0 || len > 32) {
+            printf("Invalid prefix length: %ld\n", len);
+            return;
         }
 
+        encode_scan_range(ranges + WIRE_SCAN_RANGE_LEN * i, parse_ip_addr(targets[i]), (unsigned char) len);
+    }
+
+    cmd.type = COMMAND_SCAN;
+    cmd.timeout = timeout;
+    cmd.items = ranges;
+    cmd.item_count = (unsigned int) count;
+
+    unsigned int id = client->request(&cmd);
+
+    while (client->receive(&hdr, payload)) {
+        if (hdr.request_id != id) continue;
+
+        if (hdr.type == COMMAND_DENIED) {
+            printf("Permission denied\n");
+            return;
+        }
+        if (hdr.type != COMMAND_SCAN) {
+            printf("ERROR scanning, at most %d hosts per scan\n", SCAN_MAX_HOSTS);
+            return;
+        }
+
+        auto *data = (const unsigned char *) payload.data();
+
+        // Last frame carries totals
+        if (!(hdr.flags & FRAME_FLAG_MORE)) {
+            unsigned int probed = 0, answered = 0;
+            if (payload.size() == WIRE_SCAN_DONE_LEN) decode_scan_done(data, &probed, &answered);
+
+            printf("%u of %u hosts answered\n", answered, probed);
+            return;
+        }
+
+        arp_table_entry ent{};
+        decode_entry(data, &ent);
+        print_arp_table_entry(&ent);
+        fflush(stdout);
     }
 }
 
 /**
- * Send TTL update command
+ * Send entries of file as pipelined batches, each line is "<ip> <mac> [ttl]" and a missing
+ * TTL makes the entry permanent. With remove only the IP column is used and entries are deleted.
  *
- * @param ttl - update ttl
+ * @param path - file to read, - for stdin
+ * @param remove - delete listed IPs instead of adding them
  */
-void send_set_ttl(int ttl) {
-    // Get new command
-    auto cmd = get_fresh_cmd();
+void send_import(const char *path, bool remove) {
+    unsigned char batch[WIRE_COMMAND_MAX];
+    char line[256];
+    command_hdr cmd{};
+    frame_hdr hdr{};
+    string payload;
+    unsigned long lines = 0, parsed = 0, applied = 0, pending = 0;
+    bool denied = false;
+
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (in == nullptr) {
+        perror("fopen()");
+        return;
+    }
 
-    // Set command to TTL
-    cmd->type = COMMAND_TTL;
-    cmd->ttl = (unsigned short) ttl;
+    cmd.type = remove ? COMMAND_DEL_BATCH : COMMAND_ADD_BATCH;
+    cmd.items = batch;
+    cmd.item_count = 0;
+
+    while (true) {
+        bool eof = fgets(line, sizeof(line), in) == nullptr;
+
+        if (!eof) {
+            unsigned int a, b, c, d, m[6], ttl = ARP_TTL_PERMANENT;
+            lines++;
+
+            // Comments and blank lines are skipped
+            char *p = line + strspn(line, " \t");
+            if (*p == '#' || *p == '\n' || *p == '\0') continue;
+
+            int fields = sscanf(p, "%u.%u.%u.%u %x:%x:%x:%x:%x:%x %u", &a, &b, &c, &d, &m[0], &m[1], &m[2],
+                                &m[3], &m[4], &m[5], &ttl);
+            if (fields < (remove ? 4 : 10) || a > 255 || b > 255 || c > 255 || d > 255) {
+                fprintf(stderr, "Skipping malformed line %lu\n", lines);
+                continue;
+            }
+            parsed++;
+
+            unsigned int ip = (a << 24) | (b << 16) | (c << 8) | d;
+            if (remove) {
+                encode_batch_ip(batch + WIRE_BATCH_IP_LEN * cmd.item_count, ip);
+            } else {
+                arp_table_entry ent{};
+                ent.ipAddress = ip;
+                ent.ttl = ttl;
+                for (int i = 0; i < HW_ADDR_LEN; ++i) ent.ethAddress[i] = (unsigned char) m[i];
+                encode_entry(batch + WIRE_ENTRY_LEN * cmd.item_count, &ent);
+            }
+            cmd.item_count++;
+        }
 
-    // Send command
-    send_command(cmd);
-//    printf("Sent\n");
+        // Batches are pipelined, responses are collected after the last one
+        if (cmd.item_count == BATCH_MAX_ENTRIES || (eof && cmd.item_count > 0)) {
+            client->request(&cmd);
+            cmd.item_count = 0;
+            pending++;
+        }
 
-    // Receive response
-    if ((received_bytes = (unsigned int) recv(listenFd, buffer, buffer_size, 0)) > 0) {
-        auto *res = (response_hdr *) buffer;
-//        printf("Response received: %d with %d bytes (raw: %d)\n", res->type, res->len, received_bytes);
+        if (eof) break;
+    }
 
-        // Feedback user
-        if (res->type == COMMAND_TTL) {
-            printf("TTL set successfully!\n");
-        } else {
-            printf("ERROR setting new TTL\n");
+    if (in != stdin) fclose(in);
+
+    while (pending > 0 && client->receive(&hdr, payload)) {
+        pending--;
+
+        if (hdr.type == cmd.type && payload.size() == WIRE_BATCH_DONE_LEN) {
+            applied += decode_batch_done((const unsigned char *) payload.data());
+        } else if (hdr.type == COMMAND_DENIED) {
+            denied = true;
         }
     }
+
+    if (denied) {
+        printf("Permission denied\n");
+    }
+    printf("%lu of %lu entries %s\n", applied, parsed, remove ? "removed" : "imported");
+}
+
+/**
+ * Write whole table to file in the format read by import
+ *
+ * @param path - file to write, - for stdout
+ */
+void send_export(const char *path) {
+    command_hdr cmd{};
+    frame_hdr hdr{};
+    string payload;
+    unsigned long count = 0;
+
+    FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (out == nullptr) {
+        perror("fopen()");
+        return;
+    }
+
+    cmd.type = COMMAND_SHOW;
+    unsigned int id = client->request(&cmd);
+
+    while (client->receive(&hdr, payload)) {
+        if (hdr.request_id != id) continue;
+        if (hdr.type != COMMAND_SHOW || payload.size() < WIRE_SHOW_HDR_LEN) break;
+
+        auto *data = (const unsigned char *) payload.data();
+        size_t entries = (payload.size() - WIRE_SHOW_HDR_LEN) / WIRE_ENTRY_LEN;
+        for (size_t i = 0; i < entries; ++i) {
+            arp_table_entry ent{};
+            decode_entry(data + WIRE_SHOW_HDR_LEN + WIRE_ENTRY_LEN * i, &ent);
+
+            unsigned int ip = ent.ipAddress;
+            unsigned char *m = ent.ethAddress;
+            fprintf(out, "%u.%u.%u.%u %02X:%02X:%02X:%02X:%02X:%02X", ip >> 24, (ip >> 16) & 0xFF,
+                    (ip >> 8) & 0xFF, ip & 0xFF, m[0], m[1], m[2], m[3], m[4], m[5]);
+
+            // Permanent entries are written without TTL
+            if (ent.ttl != ARP_TTL_PERMANENT) fprintf(out, " %u", ent.ttl);
+            fputc('\n', out);
+        }
+        count += entries;
+
+        if (!(hdr.flags & FRAME_FLAG_MORE)) break;
+    }
+
+    if (out != stdout) {
+        fclose(out);
+        printf("%lu entries exported\n", count);
+    }
+}
+
+/**
+ * Print counters of every interface served by daemon
+ */
+void send_stats() {
+    static const char *names[STAT_COUNT] = {"rx_frames", "rx_bytes", "tx_frames", "tx_bytes", "arp_requests",
+                                            "arp_replies", "parse_errors", "table_hits", "table_misses",
+                                            "replies_sent", "kernel_packets", "kernel_drops"};
+    command_hdr cmd{};
+    string payload;
+
+    cmd.type = COMMAND_STATS;
+    if (await_response(&cmd, payload) != COMMAND_STATS) {
+        printf("Could not read statistics\n");
+        return;
+    }
+
+    size_t count = payload.size() / WIRE_STATS_LEN;
+    for (size_t i = 0; i < count; ++i) {
+        char ifname[WIRE_IFNAME_LEN];
+        unsigned long long values[STAT_COUNT];
+        decode_stats((const unsigned char *) payload.data() + WIRE_STATS_LEN * i, ifname, values);
+
+        printf("%s\n", ifname);
+        for (int s = 0; s < STAT_COUNT; ++s) {
+            printf("  %-16s %llu\n", names[s], values[s]);
+        }
+    }
+}
+
+/**
+ * Changes or prints frame capture state
+ *
+ * @param op - CAPTURE_OP_START, CAPTURE_OP_STOP or CAPTURE_OP_STATUS
+ */
+void send_capture(unsigned int op) {
+    command_hdr cmd{};
+    string payload;
+    bool active;
+    unsigned long long written;
+
+    cmd.type = COMMAND_CAPTURE;
+    cmd.op = op;
+    unsigned short type = await_response(&cmd, payload);
+    if (type == COMMAND_DENIED) {
+        printf("Permission denied\n");
+        return;
+    }
+    if (type != COMMAND_CAPTURE || payload.size() != WIRE_CAPTURE_STATUS_LEN) {
+        printf("Could not reach capture\n");
+        return;
+    }
+
+    decode_capture_status((const unsigned char *) payload.data(), &active, &written);
+    printf("Capture %s, %llu frames captured, last %d kept\n", active ? "on" : "off", written, CAPTURE_SLOTS);
+}
+
+/**
+ * Writes frames held by capture ring to pcap file, interfaces are not told apart
+ *
+ * @param path - pcap file
+ */
+void send_capture_dump(const char *path) {
+    command_hdr cmd{};
+    frame_hdr hdr{};
+    string payload;
+    pcap_writer writer;
+    unsigned long count = 0;
+
+    if (!writer.open(path)) return;
+
+    cmd.type = COMMAND_CAPTURE;
+    cmd.op = CAPTURE_OP_DUMP;
+    unsigned int id = client->request(&cmd);
+
+    while (client->receive(&hdr, payload)) {
+        if (hdr.request_id != id) continue;
+        if (hdr.type == COMMAND_DENIED) {
+            printf("Permission denied\n");
+            writer.close();
+            unlink(path);
+            return;
+        }
+        if (hdr.type != COMMAND_CAPTURE) break;
+
+        size_t records = payload.size() / WIRE_CAPTURE_LEN;
+        for (size_t i = 0; i < records; ++i) {
+            capture_record rec{};
+            decode_capture((const unsigned char *) payload.data() + WIRE_CAPTURE_LEN * i, &rec);
+            writer.write((const char *) rec.data, rec.caplen, rec.ts_ns);
+            count++;
+        }
+
+        if (!(hdr.flags & FRAME_FLAG_MORE)) break;
+    }
+    writer.close();
+
+    printf("%lu frames written to %s\n", count, path);
+}
+
+/**
+ * Print latency percentiles of every interface served by daemon, in microseconds
+ */
+void send_latency() {
+    static const char *names[LATENCY_COUNT] = {"reply", "resolve"};
+    command_hdr cmd{};
+    string payload;
+
+    cmd.type = COMMAND_LATENCY;
+    if (await_response(&cmd, payload) != COMMAND_LATENCY) {
+        printf("Could not read latency\n");
+        return;
+    }
+
+    size_t count = payload.size() / WIRE_LATENCY_LEN;
+    for (size_t i = 0; i < count; ++i) {
+        char ifname[WIRE_IFNAME_LEN];
+        latency_summary summaries[LATENCY_COUNT];
+        decode_latency((const unsigned char *) payload.data() + WIRE_LATENCY_LEN * i, ifname, summaries);
+
+        printf("%s%*s%10s %10s %10s %10s %10s %10s %10s %10s\n", ifname, (int) (10 - strlen(ifname)), "", "count",
+               "min", "mean", "p50", "p90", "p99", "p99.9", "max");
+        for (int h = 0; h < LATENCY_COUNT; ++h) {
+            const latency_summary *s = &summaries[h];
+            printf("  %-8s%10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", names[h], s->count,
+                   s->min / 1e3, s->mean / 1e3, s->p50 / 1e3, s->p90 / 1e3, s->p99 / 1e3, s->p999 / 1e3,
+                   s->max / 1e3);
+        }
+    }
+}
+
+/**
+ * Subscribe to table changes and print them until daemon goes away
+ */
+void send_watch() {
+    static const char *names[] = {"?", "ADD", "UPDATE", "DELETE", "EXPIRE"};
+    command_hdr cmd{};
+    frame_hdr hdr{};
+    string payload;
+
+    cmd.type = COMMAND_WATCH;
+    unsigned int id = client->request(&cmd);
+
+    while (client->receive(&hdr, payload)) {
+        if (hdr.request_id != id) continue;
+        if (hdr.type != COMMAND_WATCH || payload.size() < WIRE_WATCH_HDR_LEN) {
+            printf("ERROR subscribing to table changes\n");
+            return;
+        }
+
+        auto *data = (const unsigned char *) payload.data();
+
+        size_t count = (payload.size() - WIRE_WATCH_HDR_LEN) / WIRE_EVENT_LEN;
+        for (size_t i = 0; i < count; ++i) {
+            arp_table_entry ent{};
+            unsigned char event = decode_event(data + WIRE_WATCH_HDR_LEN + WIRE_EVENT_LEN * i, &ent);
+
+            printf("%s ", names[event <= ARP_EVENT_EXPIRE ? event : 0]);
+            print_arp_table_entry(&ent);
+        }
+
+        // Daemon could not keep up with this subscriber past these events, table should be listed again
+        unsigned int dropped = decode_watch_hdr(data);
+        if (dropped > 0) {
+            printf("!! %u events dropped\n", dropped);
+        }
+        fflush(stdout);
+    }
+}
+
+/**
+ * Send TTL update command
+ *
+ * @param ttl - update ttl
+ */
+void send_set_ttl(int ttl) {
+    command_hdr cmd{};
+    string payload;
+
+    // Set command to TTL
+    cmd.type = COMMAND_TTL;
+    cmd.ttl = (unsigned int) ttl;
+
+    // Feedback user
+    unsigned short type = await_response(&cmd, payload);
+    if (type == COMMAND_TTL) {
+        printf("TTL set successfully!\n");
+    } else if (type == COMMAND_DENIED) {
+        printf("Permission denied\n");
+    } else {
+        printf("ERROR setting new TTL\n");
+    }
 }
 
 /**
@@ -170,30 +728,23 @@ void send_set_ttl(int ttl) {
  * @param ip - ip to delete
  */
 void send_del(unsigned int ip) {
-    // Get new command
-    auto cmd = get_fresh_cmd();
+    command_hdr cmd{};
+    string payload;
 
     // Set command to delete
-    cmd->type = COMMAND_DEL;
-    cmd->ip = ip;
-
-    // Send command
-    send_command(cmd);
-//    printf("Sent\n");
-
-    // Receive response
-    if ((received_bytes = (unsigned int) recv(listenFd, buffer, buffer_size, 0)) > 0) {
-        auto *res = (response_hdr *) buffer;
-//        printf("Response received: %d with %d bytes (raw: %d)\n", res->type, res->len, received_bytes);
-
-        // Feedback user
-        if (res->type == COMMAND_DEL) {
-            printf("IP deleted successfully!\n");
-        } else if (res->type == COMMAND_DEL_NOT_FOUND) {
-            printf("IP could not be found\n");
-        } else {
-            printf("ERROR deleting IP from ARP table\n");
-        }
+    cmd.type = COMMAND_DEL;
+    cmd.ip = ip;
+
+    // Feedback user
+    unsigned short type = await_response(&cmd, payload);
+    if (type == COMMAND_DEL) {
+        printf("IP deleted successfully!\n");
+    } else if (type == COMMAND_DEL_NOT_FOUND) {
+        printf("IP could not be found\n");
+    } else if (type == COMMAND_DENIED) {
+        printf("Permission denied\n");
+    } else {
+        printf("ERROR deleting IP from ARP table\n");
     }
 }
 
@@ -205,110 +756,115 @@ void send_del(unsigned int ip) {
  * @param ttl - ttl of ARP entry
  */
 void send_add(unsigned int ip, unsigned char mac[], unsigned int ttl) {
-    // Get new command header
-    auto cmd = get_fresh_cmd();
+    command_hdr cmd{};
+    string payload;
 
     // Set command to add
-    cmd->type = COMMAND_ADD;
-    cmd->ip = ip;
-    memcpy(cmd->eth, mac, sizeof(char) * 6);
-    cmd->ttl = ttl;
-
-    // Send to daemon
-    send_command(cmd);
-//    printf("Sent\n");
-
-    // Wait for response
-    if ((received_bytes = (unsigned int) recv(listenFd, buffer, buffer_size, 0)) > 0) {
-        auto *res = (response_hdr *) buffer;
-//        printf("Response received: %d with %d bytes (raw: %d)\n", res->type, res->len, received_bytes);
-
-        // Print feedback to user
-        if (res->type == COMMAND_ADD) {
-            printf("Table entry added successfully!\n");
-        }
+    cmd.type = COMMAND_ADD;
+    cmd.ip = ip;
+    memcpy(cmd.eth, mac, sizeof(char) * 6);
+    cmd.ttl = ttl;
+
+    // Print feedback to user
+    unsigned short type = await_response(&cmd, payload);
+    if (type == COMMAND_ADD) {
+        printf("Table entry added successfully!\n");
+    } else if (type == COMMAND_DENIED) {
+        printf("Permission denied\n");
     }
 }
 
-/*
- * Send resolve command
+/**
+ * Send resolve commands pipelined on one connection, results are printed as they complete
+ *
+ * @param ips - ips to resolve
+ * @param count - amount of ips
+ * @param timeout - how long daemon should wait for reply in ms, 0 for default
  */
-void send_res(unsigned int ip) {
-    // Get new command header
-    auto cmd = get_fresh_cmd();
+void send_res(unsigned int ips[], int count, unsigned int timeout) {
+    unordered_map<unsigned int, unsigned int> pending;
+    command_hdr cmd{};
+    frame_hdr hdr{};
+    string payload;
 
     // Set to resolve
-    cmd->type = COMMAND_RES;
-    cmd->ip = ip;
+    cmd.type = COMMAND_RES;
+    cmd.timeout = timeout;
+
+    // Send every request before waiting for any response
+    for (int i = 0; i < count; ++i) {
+        cmd.ip = ips[i];
+        pending[client->request(&cmd)] = ips[i];
+    }
+    client->finish();
 
-    // Send to daemon
-    send_command(cmd);
-//    printf("Sent\n");
+    while (!pending.empty() && client->receive(&hdr, payload)) {
+        auto it = pending.find(hdr.request_id);
+        if (it == pending.end()) continue;
 
-    // Wait response
-    if ((received_bytes = (unsigned int) recv(listenFd, buffer, buffer_size, 0)) > 0) {
-        auto *res = (response_hdr *) buffer;
-//        printf("Response received: %d with %d bytes (raw: %d)\n", res->type, res->len, received_bytes);
+        // Non-empty payload carries resolved entry
+        if (hdr.type == COMMAND_RES && payload.size() == WIRE_ENTRY_LEN) {
+            arp_table_entry ent{};
+            decode_entry((const unsigned char *) payload.data(), &ent);
 
-        // If IP was resolved successfully, add new entry to ARP table
-        if (res->len == sizeof(arp_table_entry)) {
             printf("Sucessfully resolved IP:\n");
-            print_arp_table_entry((arp_table_entry *) (buffer + sizeof(response_hdr)));
+            print_arp_table_entry(&ent);
         } else {
-            printf("Could not resolve IP\n");
+            print_ip_addr((char *) "Could not resolve IP: ", it->second);
+            printf("\n");
         }
+
+        pending.erase(it);
     }
 }
 
 /**
- * Send command header to daemon
+ * Send single command and wait for its response
  *
- * @param cmd - command header to send
- */
-void send_command(command_hdr *cmd) {
-    // Send command header to daemon
-    sendto(listenFd, cmd, sizeof(command_hdr), 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in));
-}
-
-/**
- * Build a new command header
+ * @param cmd - command to send
+ * @param payload - response payload
  *
- * @return - zero filled command header
+ * @return - response type, 0 if daemon closed connection
  */
-command_hdr *get_fresh_cmd() {
-    auto *cmd = new command_hdr;
+unsigned short await_response(const command_hdr *cmd, string &payload) {
+    frame_hdr hdr{};
+    unsigned int id = client->request(cmd);
 
-    // Reset structure
-    memset(cmd, '\0', sizeof(command_hdr));
+    while (client->receive(&hdr, payload)) {
+        if (hdr.request_id == id) return hdr.type;
+    }
 
-    return cmd;
+    return 0;
 }
 
 /**
- * Connect to daemon
+ * Looks IPs up in the table exported to shared memory by xarpd
+ *
+ * @param targets - IP arguments
+ * @param count - amount of IPs
+ *
+ * @return - exit status, failure if segment could not be mapped
  */
-void connect() {
-//    printf("Connecting...\n");
+int shm_lookup(char **targets, int count) {
+    shm_table_reader reader;
 
-    // Connect socket
-    if (connect(listenFd, (struct sockaddr *) &addr, sizeof(struct sockaddr_in)) < 0) {
-        perror("ERROR connecting to socket");
-        exit(errno);
+    if (!reader.open()) {
+        printf("Shared table %s is not available\n", SHM_TABLE_NAME);
+        return EXIT_FAILURE;
     }
 
-//    printf("Connected.\n");
-}
-
-/**
- * Build socket to daemon
- */
-void build_socket() {
-    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    for (int i = 0; i < count; ++i) {
+        arp_table_entry ent{};
+        unsigned int ip = parse_ip_addr(targets[i]);
 
-//    printf("Socket: %d\n", listenFd);
+        int found = reader.lookup(ip, &ent);
+        if (found == SHM_LOOKUP_FOUND) {
+            print_arp_table_entry(&ent);
+        } else {
+            print_ip_addr((char *) "", ip);
+            printf(found == SHM_LOOKUP_MISSING ? " not in table\n" : " unknown, ask daemon with res\n");
+        }
+    }
 
-    // Set address configurations
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    return EXIT_SUCCESS;
 }
@@ -0,0 +1,213 @@
+//
+// Created by root on 18/10/26.
+//
+
+#include <stdio.h>
+#include <memory>
+#include "../inc/xarp_core.h"
+#include "../inc/stats.h"
+#ifdef XARPD_IO_URING
+#include "../inc/uring_engine.h"
+#endif
+
+/**
+ * Fills options with daemon defaults
+ *
+ * @param opts - options to fill
+ */
+void core_default_options(core_options *opts) {
+    opts->retry_ms = RESOLVE_RETRY_MS;
+    opts->retry_max_ms = RESOLVE_RETRY_MAX_MS;
+    opts->backoff = RESOLVE_BACKOFF;
+    opts->probe_rate = RESOLVE_PROBE_RATE;
+    opts->use_uring = false;
+    opts->io_factory = nullptr;
+    opts->io_ctx = nullptr;
+}
+
+/**
+ * Creates empty table, it may be filled and observed before start
+ */
+xarp_core::xarp_core() {
+    this->table = new arp_table();
+    this->workers = nullptr;
+    this->worker_count = 0;
+    this->resolv = nullptr;
+    this->engine = nullptr;
+}
+
+arp_table *xarp_core::get_table() {
+    return this->table;
+}
+
+resolver *xarp_core::get_resolver() {
+    return this->resolv;
+}
+
+interface_worker **xarp_core::get_workers() {
+    return this->workers;
+}
+
+int xarp_core::get_worker_count() {
+    return this->worker_count;
+}
+
+/**
+ * If packet I/O goes through io_uring
+ *
+ * @return - true once started with a working ring
+ */
+bool xarp_core::uses_uring() {
+    return this->engine != nullptr;
+}
+
+/**
+ * Opens one worker per interface, then creates resolver and starts receiving. Nothing is started
+ * when an interface cannot be used.
+ *
+ * @param ifnames - interfaces to serve
+ * @param settings - overrides of kernel interface values, last one per interface wins
+ * @param opts - tunables
+ *
+ * @return - false if core was already started or an interface could not be opened
+ */
+bool xarp_core::start(const vector<string> &ifnames, const vector<iface_settings> &settings, const core_options *opts) {
+    bool use_uring = opts->use_uring;
+
+    if (this->resolv != nullptr) {
+        fprintf(stderr, "Core is already started\n");
+        return false;
+    }
+
+    // Every interface keeps its own counters
+    if (ifnames.size() > STATS_MAX_IFACES) {
+        fprintf(stderr, "More than %d interfaces\n", STATS_MAX_IFACES);
+        return false;
+    }
+
+#ifdef XARPD_IO_URING
+    if (use_uring && !uring::supported()) {
+        printf("io_uring is not available, falling back to blocking I/O\n");
+        use_uring = false;
+    }
+#else
+    if (use_uring) {
+        printf("Built without io_uring support, falling back to blocking I/O\n");
+        use_uring = false;
+    }
+#endif
+
+    // Ring only services packet sockets
+    if (use_uring && opts->io_factory != nullptr) {
+        printf("io_uring needs raw sockets, using blocking I/O with given backend\n");
+        use_uring = false;
+    }
+
+    // Workers point at settings for their lifetime
+    this->settings = settings;
+    auto count = (int) ifnames.size();
+    auto **created = new interface_worker *[count]();
+
+    // Open every interface before any thread sees the workers
+    for (int i = 0; i < count; ++i) {
+        printf("Creating worker for %s\n", ifnames[i].c_str());
+        created[i] = new interface_worker(new string(ifnames[i]), this->table, created, count);
+        if (opts->io_factory != nullptr) created[i]->set_io(opts->io_factory(ifnames[i], opts->io_ctx));
+
+        for (auto &ifs : this->settings) {
+            if (ifnames[i] == ifs.ifname) created[i]->set_settings(&ifs);
+        }
+
+        if (!created[i]->open()) {
+            // Caller may retry, give back sockets and stats slots newest first
+            for (int j = i; j >= 0; --j) delete created[j];
+            delete[] created;
+            return false;
+        }
+    }
+
+    this->workers = created;
+    this->worker_count = count;
+
+    // Create resolver shared by every resolution
+    this->resolv = new resolver(this->table, this->workers, this->worker_count);
+    this->resolv->set_backoff(opts->retry_ms, opts->retry_max_ms, opts->backoff);
+    this->resolv->set_probe_rate(opts->probe_rate);
+
+#ifdef XARPD_IO_URING
+    // Single ring services every packet socket
+    if (use_uring) this->engine = new uring_engine(this->workers, this->worker_count);
+#endif
+
+    // Start receiving
+    for (int i = 0; i < this->worker_count; ++i) {
+        this->workers[i]->set_resolver(this->resolv);
+#ifdef XARPD_IO_URING
+        this->workers[i]->set_engine(this->engine);
+#endif
+        this->workers[i]->start();
+    }
+
+#ifdef XARPD_IO_URING
+    if (this->engine != nullptr) {
+        this->engine->start();
+    }
+#endif
+
+    return true;
+}
+
+/**
+ * Copies entry without sending anything
+ *
+ * @param ip - ip
+ * @param out - entry
+ *
+ * @return - true if IP is in table
+ */
+bool xarp_core::lookup(unsigned int ip, arp_table_entry *out) {
+    return this->table->copy_by_ip(ip, out);
+}
+
+/**
+ * Resolves IP, callback runs once on resolver or worker thread, or right away when IP is known or
+ * core is not started
+ *
+ * @param ip - ip
+ * @param timeout_ms - how long caller is willing to wait
+ * @param callback - completion callback
+ * @param paced - send first request at the interface probe rate
+ */
+void xarp_core::resolve(unsigned int ip, unsigned int timeout_ms, resolve_callback callback, bool paced) {
+    // Nothing can be sent before start, only table entries are known
+    if (this->resolv == nullptr) {
+        arp_table_entry known{};
+        bool found = this->table->copy_by_ip(ip, &known);
+        callback(found, found ? &known : nullptr);
+        return;
+    }
+
+    this->resolv->resolve_async(ip, timeout_ms, move(callback), paced);
+}
+
+/**
+ * Resolves IP, result is delivered through future
+ *
+ * @param ip - ip
+ * @param timeout_ms - how long caller is willing to wait
+ *
+ * @return - future ready once IP is resolved or timed out
+ */
+future<resolve_result> xarp_core::resolve(unsigned int ip, unsigned int timeout_ms) {
+    auto done = make_shared<promise<resolve_result>>();
+    future<resolve_result> result = done->get_future();
+
+    this->resolve(ip, timeout_ms, [done](bool found, arp_table_entry *entry) {
+        resolve_result res{};
+        res.found = found;
+        if (found) res.entry = *entry;
+        done->set_value(res);
+    });
+
+    return result;
+}
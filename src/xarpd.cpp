@@ -1,16 +1,36 @@
 #include <iostream>
+#include <memory>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <getopt.h>
+#include "../inc/xarp_core.h"
 #include "../inc/interface_worker.h"
 #include "../inc/utils.h"
-
-/*
- * Constants
- */
-static const int RESOLVE_TIMEOUT_MS = 300;
+#include "../inc/resolver.h"
+#include "../inc/control_server.h"
+#include "../inc/watch_hub.h"
+#include "../inc/config.h"
+#include "../inc/shm_table.h"
+#include "../inc/protocol.h"
+#include "../inc/logger.h"
+#include "../inc/metrics_server.h"
+#include "../inc/probes.h"
+#include "../inc/pcap_io.h"
+#include "../inc/capture.h"
+#include "../inc/stats.h"
+#ifdef XARPD_IO_URING
+#include "../inc/uring_engine.h"
+#endif
 
 /*
  * Socket functions
@@ -19,25 +39,91 @@ void boot();
 void build_socket();
 void bind();
 void listen();
-int accept_con();
+void listen_unix();
+#ifdef XARPD_IO_URING
+void serve_uring();
+#endif
 
 /*
  * Daemon communication functions
  */
-command_hdr *read_request(int conFd);
-response_hdr *respond_request(command_hdr *cmd);
-response_hdr *respond_show(command_hdr *cmd);
-response_hdr *respond_res(command_hdr *cmd);
-response_hdr *respond_add(command_hdr *cmd);
-response_hdr *respond_del(command_hdr *cmd);
-response_hdr *respond_ttl(command_hdr *cmd);
+void handle_request(control_server *server, unsigned long long con, const control_peer *peer, request_msg *req);
+bool authorized(const control_peer *peer, command_hdr *cmd);
+size_t response_room(command_hdr *cmd);
+unsigned short respond_request(request_msg *req, unsigned char *payload, size_t *length);
+void respond_show(control_server *server, unsigned long long con, request_msg *req);
+void encode_show_entry(const arp_table_entry *entry, void *ctx);
+void respond_query(control_server *server, unsigned long long con, request_msg *req);
+void respond_watch(control_server *server, unsigned long long con, request_msg *req);
+void respond_res(control_server *server, unsigned long long con, request_msg *req);
+void respond_scan(control_server *server, unsigned long long con, request_msg *req);
+unsigned short respond_add(command_hdr *cmd, unsigned char *payload, size_t *length);
+unsigned short respond_del(command_hdr *cmd, unsigned char *payload, size_t *length);
+unsigned short respond_ttl(command_hdr *cmd, unsigned char *payload, size_t *length);
+unsigned short respond_add_batch(command_hdr *cmd, unsigned char *payload, size_t *length);
+unsigned short respond_del_batch(command_hdr *cmd, unsigned char *payload, size_t *length);
+unsigned short respond_stats(unsigned char *payload, size_t *length);
+unsigned short respond_latency(unsigned char *payload, size_t *length);
+unsigned short respond_capture(command_hdr *cmd, unsigned char *payload, size_t *length);
+void respond_capture_dump(control_server *server, unsigned long long con, request_msg *req);
+
+/*
+ * Metrics functions
+ */
+void render_metrics(string &out, bool openmetrics, void *ctx);
+void render_histogram(string &out, const char *name, const string &labels, histogram *h);
 
 /*
  * xifconfig functions
  */
-response_hdr *respond_if_show(command_hdr *pHdr);
-response_hdr *respond_if_config(command_hdr *pHdr);
-response_hdr *respond_if_mtu(command_hdr *pHdr);
+unsigned short respond_if_show(config_hdr *cfg, unsigned char *payload, size_t *length);
+unsigned short respond_if_config(config_hdr *cfg, unsigned char *payload, size_t *length);
+unsigned short respond_if_mtu(config_hdr *cfg, unsigned char *payload, size_t *length);
+
+/*
+ * Replay functions
+ */
+packet_io *replay_io(const string &ifname, void *ctx);
+/*
+ * Types
+ */
+
+// Table lookups per QUERY frame before an empty frame is sent to keep other connections served
+#define QUERY_SCANS_PER_FRAME 16
+
+// Progress of a SCAN shared by its resolution callbacks
+typedef struct _scan_state {
+    atomic<unsigned int> remaining;
+    atomic<unsigned int> answered;
+    unsigned int probed;
+} scan_state;
+
+// Latency histogram buckets exported to scrapers, powers of two from about 1us to 8.6s
+#define METRICS_FIRST_BITS 10
+#define METRICS_BUCKETS 24
+
+// Request types counted, one past COMMAND_CAPTURE
+#define METRICS_COMMANDS 20
+
+// Per interface responses go out as one frame, more interfaces than stats slots are refused at startup
+static_assert(WIRE_IFACE_LEN * STATS_MAX_IFACES <= CONTROL_PAYLOAD_MAX, "IF_SHOW must fit one frame");
+static_assert(WIRE_STATS_LEN * STATS_MAX_IFACES <= CONTROL_PAYLOAD_MAX, "STATS must fit one frame");
+static_assert(WIRE_LATENCY_LEN * STATS_MAX_IFACES <= CONTROL_PAYLOAD_MAX, "LATENCY must fit one frame");
+
+// Pcap files given with -X, sent frames of several interfaces go to one output file each
+typedef struct _replay_spec {
+    string in_path;
+    string out_path;
+    size_t interfaces;
+    unsigned char created;
+} replay_spec;
+
+// SHOW chunk being encoded
+typedef struct _show_chunk {
+    unsigned char *out;
+    unsigned int last_ip;
+} show_chunk;
+
 /*
  * Variables
  */
@@ -45,11 +131,29 @@ response_hdr *respond_if_mtu(command_hdr *pHdr);
 // Address structure to receive commands
 struct sockaddr_in *daemonAddress;
 
-// Daemon communication file descriptor
-int listenFd;
+// Daemon communication file descriptor (TCP)
+int listenFd = -1;
+
+// Daemon communication file descriptor (Unix socket)
+int unixFd = -1;
+
+// If TCP control port should be opened
+bool use_tcp = false;
 
 // What port daemon should listen
-unsigned short port = 5050;
+unsigned short port = XARPD_TCP_PORT;
+
+// Address TCP control port binds to, other hosts reach it only when given explicitly
+in_addr tcp_address = {htonl(INADDR_LOOPBACK)};
+
+// If TCP peers, which have no credentials to check, may change table and interfaces
+bool tcp_writes = false;
+
+// Where Unix control socket is created
+const char *socket_path = XARPD_SOCKET_PATH;
+
+// ARP engine: table, interface workers and resolver
+xarp_core *core;
 
 // Main arp entry table
 arp_table *table;
@@ -60,49 +164,341 @@ interface_worker** workers;
 // Amount of workers listed
 int worker_count;
 
+// Coalesces and retransmits resolutions
+resolver *resolv;
+
+// Event loop serving control connections
+control_server *server;
+
+// Fans table changes out to WATCH subscribers
+watch_hub *hub;
+
+// Mirrors table into shared memory for local readers
+shm_table_writer *shm_export = nullptr;
+
+// If packet and control I/O should go through io_uring
+bool use_uring = false;
+
+// Serves metrics over HTTP when an address is given
+metrics_server *metrics = nullptr;
+
+// Control requests by command type, and refused ones
+atomic<unsigned long long> control_requests[METRICS_COMMANDS];
+atomic<unsigned long long> control_denied(0);
+
 /*
  * Main
  */
 int main(int argc, char **args) {
-    // Create main ARP table
-    table = new arp_table();
+    // Parse options, remaining arguments are interface names
+    int opt;
+    core_options opts{};
+    core_default_options(&opts);
+    unsigned int shm_bits = SHM_TABLE_BITS;
+    const char *config_path = nullptr;
+    const char *metrics_address = nullptr;
+    const char *replay = nullptr;
+    while ((opt = getopt(argc, args, "ur:R:b:P:s:tp:a:wc:S:L:m:X:C")) != -1) {
+        if (opt == 'u') {
+            opts.use_uring = true;
+        } else if (opt == 'c') {
+            config_path = optarg;
+        } else if (opt == 's') {
+            socket_path = optarg;
+        } else if (opt == 't') {
+            use_tcp = true;
+        } else if (opt == 'p') {
+            use_tcp = true;
+            port = (unsigned short) strtol(optarg, nullptr, 10);
+        } else if (opt == 'a' && inet_pton(AF_INET, optarg, &tcp_address) == 1) {
+            use_tcp = true;
+        } else if (opt == 'w') {
+            tcp_writes = true;
+        } else if (opt == 'r') {
+            opts.retry_ms = (unsigned int) strtol(optarg, nullptr, 10);
+        } else if (opt == 'R') {
+            opts.retry_max_ms = (unsigned int) strtol(optarg, nullptr, 10);
+        } else if (opt == 'b') {
+            opts.backoff = (unsigned int) strtol(optarg, nullptr, 10);
+        } else if (opt == 'P') {
+            opts.probe_rate = (unsigned int) strtol(optarg, nullptr, 10);
+        } else if (opt == 'S') {
+            shm_bits = (unsigned int) strtol(optarg, nullptr, 10);
+        } else if (opt == 'm') {
+            metrics_address = optarg;
+        } else if (opt == 'X') {
+            replay = optarg;
+        } else if (opt == 'C') {
+            capture_start();
+        } else if (opt == 'L' && log_parse_level(optarg) >= 0) {
+            log_set_level(log_parse_level(optarg));
+        } else {
+            fprintf(stderr, "Usage: %s [-c config] [-u] [-s socket] [-t] [-p port] [-a tcp_address] [-w] [-r retry_ms] "
+                            "[-R retry_max_ms] [-b backoff] [-P probes_per_sec] [-S shm_slot_bits] "
+                            "[-L error|warn|info|debug] [-m [ip:]metrics_port] [-X in.pcap[,out.pcap]] [-C] "
+                            "<interface>...\n", args[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Startup config is read before anything is served
+    daemon_config config{};
+    if (config_path != nullptr && !load_config(config_path, &config)) {
+        exit(EXIT_FAILURE);
+    }
 
-    // Allocates workers for each interface in arguments
-    worker_count = argc - 1;
-    workers = new interface_worker *[worker_count];
+    // Create main ARP table, static entries are in place before any reader starts
+    core = new xarp_core();
+    table = core->get_table();
+    if (config.has_ttl) {
+        table->setTtl(config.ttl);
+    }
+    if (!config.statics.empty()) {
+        size_t loaded = table->add_batch(config.statics.data(), config.statics.size());
+        printf("Loaded %zu static entries from %s\n", loaded, config_path);
 
-    // Create and bind workers
-    for (int i = 0; i < worker_count; ++i) {
-        printf("Creating worker for %s\n", args[i+1]);
-        workers[i] = new interface_worker(new string(args[i + 1]), table, workers, worker_count);
-        workers[i]->bind();
+        // Table holds its own copies
+        vector<arp_table_entry>().swap(config.statics);
+    }
+
+    // Shared memory export is seeded with loaded entries, 0 slot bits disable it
+    if (shm_bits > 0) {
+        shm_export = new shm_table_writer(SHM_TABLE_NAME, shm_bits);
+        table->add_listener(shm_table_changed, shm_export, true);
+    }
+
+    // Interfaces in arguments followed by configured ones not listed there
+    vector<string> names(args + optind, args + argc);
+    for (auto &ifs : config.interfaces) {
+        if (find(names.begin(), names.end(), string(ifs.ifname)) == names.end()) names.emplace_back(ifs.ifname);
+    }
+
+    // Replayed interfaces need no privileges, addresses come from config
+    replay_spec spec{};
+    if (replay != nullptr) {
+        const char *comma = strchr(replay, ',');
+        spec.in_path = comma != nullptr ? string(replay, comma - replay) : string(replay);
+        spec.out_path = comma != nullptr ? string(comma + 1) : string();
+        spec.interfaces = names.size();
+        opts.io_factory = replay_io;
+        opts.io_ctx = &spec;
     }
 
+    // Bind workers, daemon handles requests through the same objects embedders get
+    if (!core->start(names, config.interfaces, &opts)) {
+        exit(EXIT_FAILURE);
+    }
+    workers = core->get_workers();
+    worker_count = core->get_worker_count();
+    resolv = core->get_resolver();
+    use_uring = core->uses_uring();
+
     /*
      * Daemon startup
      */
     printf("Created interface workers for %d interfaces\n", worker_count);
-    boot();
-    build_socket();
-    bind();
-    listen();
+    listen_unix();
+
+    // TCP control port is opt-in
+    if (use_tcp) {
+        boot();
+        build_socket();
+        bind();
+        listen();
+    }
+
+    server = new control_server(handle_request);
+
+    // Metrics are rendered from counters the packet path never locks
+    if (metrics_address != nullptr) {
+        metrics = new metrics_server(render_metrics, nullptr);
+        if (!metrics->listen(metrics_address)) exit(EXIT_FAILURE);
+        metrics->start();
+    }
+
+    // Table changes are pushed to WATCH subscribers
+    hub = new watch_hub(server);
+    table->add_listener(watch_table_changed, hub, false, watch_table_flushed);
+
+#ifdef XARPD_IO_URING
+    if (use_uring) {
+        // Connections are accepted by the ring and handed to the event loop
+        server->start();
+        serve_uring();
+    }
+#endif
+
+    // Serve control connections forever
+    server->add_listener(unixFd);
+    if (use_tcp) {
+        server->add_listener(listenFd);
+    }
+    server->run();
+}
+
+/**
+ * Dispatches request, RES completes asynchronously once resolver is done and SHOW is streamed
+ *
+ * @param server - control server
+ * @param con - connection id
+ * @param peer - peer credentials
+ * @param req - decoded request
+ */
+void handle_request(control_server *server, unsigned long long con, const control_peer *peer, request_msg *req) {
+    if (req->cmd.type < METRICS_COMMANDS) control_requests[req->cmd.type].fetch_add(1, memory_order_relaxed);
+    XARPD_PROBE3(command__dispatched, req->cmd.type, req->id, peer->has_creds ? (long) peer->uid : -1L);
+
+    if (!authorized(peer, &req->cmd)) {
+        control_denied.fetch_add(1, memory_order_relaxed);
+        log_warn("Denied command %d from uid %d", req->cmd.type, peer->uid);
+        server->respond(con, req->id, COMMAND_DENIED, nullptr, 0);
+        return;
+    }
+
+    if (req->cmd.type == COMMAND_RES) {
+        respond_res(server, con, req);
+        return;
+    }
+
+    if (req->cmd.type == COMMAND_SHOW) {
+        respond_show(server, con, req);
+        return;
+    }
+
+    if (req->cmd.type == COMMAND_QUERY) {
+        respond_query(server, con, req);
+        return;
+    }
+
+    if (req->cmd.type == COMMAND_WATCH) {
+        respond_watch(server, con, req);
+        return;
+    }
+
+    if (req->cmd.type == COMMAND_SCAN) {
+        respond_scan(server, con, req);
+        return;
+    }
+
+    if (req->cmd.type == COMMAND_CAPTURE && req->cmd.op == CAPTURE_OP_DUMP) {
+        respond_capture_dump(server, con, req);
+        return;
+    }
+
+    // Responders encode straight into connection output block
+    size_t length = 0;
+    unsigned char *payload = server->reserve(con, response_room(&req->cmd));
+    unsigned short type = respond_request(req, payload, &length);
+
+    server->commit(con, req->id, type, length);
+}
+
+/**
+ * Payload room responder needs, so small responses share output blocks
+ *
+ * @param cmd - command header
+ *
+ * @return - max payload length of response
+ */
+size_t response_room(command_hdr *cmd) {
+    if (cmd->type == COMMAND_IF_SHOW) {
+        return WIRE_IFACE_LEN * (size_t) worker_count;
+    }
+
+    if (cmd->type == COMMAND_STATS) {
+        return WIRE_STATS_LEN * (size_t) worker_count;
+    }
+
+    if (cmd->type == COMMAND_LATENCY) {
+        return WIRE_LATENCY_LEN * (size_t) worker_count;
+    }
+
+    if (cmd->type == COMMAND_ADD_BATCH || cmd->type == COMMAND_DEL_BATCH) {
+        return WIRE_BATCH_DONE_LEN;
+    }
+
+    if (cmd->type == COMMAND_CAPTURE) {
+        return WIRE_CAPTURE_STATUS_LEN;
+    }
+
+    // Everything else answers with type only
+    return 0;
+}
+
+/**
+ * Checks if peer may run command, table and interface changes need root or the daemon user
+ *
+ * @param peer - peer credentials
+ * @param cmd - command header
+ *
+ * @return - true if command is allowed
+ */
+bool authorized(const control_peer *peer, command_hdr *cmd) {
+    // Read-only commands are open to anyone who can reach the socket
+    if (cmd->type == COMMAND_SHOW || cmd->type == COMMAND_QUERY || cmd->type == COMMAND_WATCH ||
+        cmd->type == COMMAND_RES || cmd->type == COMMAND_IF_SHOW || cmd->type == COMMAND_STATS ||
+        cmd->type == COMMAND_LATENCY) {
+        return true;
+    }
+
+    // Opt-in TCP port has no credentials to check, changes need -w
+    if (!peer->has_creds) {
+        return tcp_writes;
+    }
+
+    return peer->uid == 0 || peer->uid == geteuid();
+}
+
+#ifdef XARPD_IO_URING
+/**
+ * Accepts connections with a multishot accept instead of one accept() per client
+ */
+void serve_uring() {
+    uring ring(URING_ENTRIES);
+    vector<int> unarmed;
+
+    printf("Accepting connections through io_uring\n");
+    unarmed.push_back(unixFd);
+    if (use_tcp) unarmed.push_back(listenFd);
 
-    // Listen forever
     while (true) {
-        int con = accept_con();
+        // Arm listeners, those finding submission queue full are retried next loop
+        vector<int> pending;
+        pending.swap(unarmed);
+        for (int listener : pending) {
+            if (!ring.prep_accept_multishot(listener, URING_USER_DATA(URING_TAG_ACCEPT, listener))) {
+                unarmed.push_back(listener);
+            }
+        }
 
-        command_hdr *cmd = read_request(con);
+        int ret = ring.submit(1);
+        if (ret < 0 && ret != -EBUSY) {
+            fprintf(stderr, "io_uring_enter(): %s\n", strerror(-ret));
+            exit(EXIT_FAILURE);
+        }
 
-        response_hdr* res = respond_request(cmd);
+        // Serve every accepted connection
+        io_uring_cqe *cqe;
+        while ((cqe = ring.peek_cqe()) != nullptr) {
+            int con = cqe->res;
+            unsigned int flags = cqe->flags;
+            int listener = (int) URING_VALUE(cqe->user_data);
+            ring.cqe_seen();
+
+            if (con < 0) {
+                log_error("Accept(): %s", log_errno(-con));
+            } else {
+                server->adopt(con);
+            }
 
-        if(res != nullptr) {
-            send(con, res, sizeof(response_hdr) + res->len, 0);
-        } else {
-            fprintf(stderr, "Request response is 'nullptr', aborting...\n");
-            exit(1);
+            // Kernel stopped the multishot, re-arm it
+            if (!(flags & IORING_CQE_F_MORE)) {
+                unarmed.push_back(listener);
+            }
         }
     }
 }
+#endif
 
 /**
  * Create and setup address structure
@@ -113,7 +509,7 @@ void boot() {
     // Fill struct and set fields
     memset(daemonAddress, '\0', sizeof(sockaddr_in));
     daemonAddress->sin_family = AF_INET;
-    daemonAddress->sin_addr.s_addr = INADDR_ANY;
+    daemonAddress->sin_addr = tcp_address;
     daemonAddress->sin_port = htons(port);
 }
 
@@ -140,380 +536,760 @@ void bind() {
  * Start socket listening
  */
 void listen() {
-    if (listen(listenFd, 3)) {
+    if (listen(listenFd, SOMAXCONN)) {
         perror("listen()");
         exit(EXIT_FAILURE);
     }
 
-    printf("Listening on port %d\n", port);
+    printf("Listening on %s:%d\n", inet_ntoa(tcp_address), port);
+    if (tcp_writes) {
+        printf("TCP peers may change table and interfaces\n");
+    }
 }
 
 /**
- * Waits and returns connection descriptor
- *
- * @return - connection descriptor
+ * Create, bind and listen on Unix control socket
  */
-int accept_con() {
-    // Wait for connection
-    printf("Waiting new connections... ");
-    int connectionFd = accept(listenFd, nullptr, nullptr);
-
-    printf("ACCEPTED!\n");
+void listen_unix() {
+    sockaddr_un address{};
 
-    // Check for errors
-    if (connectionFd == -1) {
-        perror("Accept()");
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
         exit(EXIT_FAILURE);
     }
 
-    return connectionFd;
-}
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
 
-/**
- * Reads entire incoming request from 'conFd'
- *
- * @param conFd - what connection to read request
- *
- * @return - command header structure
- */
-command_hdr *read_request(int conFd) {
-
-    // TODO: rewrite
-    auto request_data_size = 64 * 1024;
-    auto bufferSize = 1024;
-
-    char* request_data = new char[request_data_size];
-    char buffer[bufferSize + 1];
+    // Sequenced packets keep message boundaries
+    unixFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (unixFd < 0) {
+        perror("socket()");
+        exit(EXIT_FAILURE);
+    }
 
-    auto request_total_size = 0;
-    auto request_partial_size = bufferSize;
-    memset(buffer, '\0', bufferSize);
+    // Remove socket left by a previous run
+    unlink(socket_path);
 
-    // Keeps reading while read returns data
-    while (request_partial_size == bufferSize && request_total_size < request_data_size) {
-        // Reads partial request
-        printf("Reading request... ");
-        request_partial_size = (unsigned long) read(conFd, buffer, bufferSize);
+    if (bind(unixFd, (struct sockaddr *) &address, sizeof(sockaddr_un)) == -1) {
+        perror("bind()");
+        exit(EXIT_FAILURE);
+    }
 
-        // Check for error and append data
-        if (request_partial_size < 0) {
-            printf("ERROR: %s\n", strerror(errno));
+    // Anyone may connect, changes are checked against peer credentials
+    chmod(socket_path, 0666);
 
-            exit(errno);
-        } else if (request_partial_size > bufferSize) {
-            fprintf(stderr, "Request buffer overflow\n");
-            exit(1);
-        } else {
-            printf("Read %d bytes\n", (int) request_partial_size);
-            memcpy(request_data + request_total_size, buffer, request_partial_size);
-            request_total_size += request_partial_size;
-        }
+    if (listen(unixFd, SOMAXCONN)) {
+        perror("listen()");
+        exit(EXIT_FAILURE);
     }
 
-    printf("Request total size: %d bytes.\n", (int) request_total_size);
-
-    return (command_hdr*) request_data;
+    printf("Listening on %s\n", socket_path);
 }
 
 /**
  * Handles request according to type
  *
- * @param cmd - command header to respond
+ * @param req - request to respond
+ * @param payload - where response payload is encoded
+ * @param length - response payload length
  *
- * @return - response header
+ * @return - response type
  */
-response_hdr *respond_request(command_hdr *cmd) {
-    printf("Receiving: %d\n", cmd->type);
+unsigned short respond_request(request_msg *req, unsigned char *payload, size_t *length) {
+    command_hdr *cmd = &req->cmd;
+
+    log_debug("Receiving: %d", cmd->type);
     // Calls responder according to command type
-    if (cmd->type == COMMAND_SHOW) {
-        return respond_show(cmd);
-    } else if (cmd->type == COMMAND_RES) {
-        return respond_res(cmd);
-    } else if (cmd->type == COMMAND_ADD) {
-        return respond_add(cmd);
+    if (cmd->type == COMMAND_ADD) {
+        return respond_add(cmd, payload, length);
     } else if (cmd->type == COMMAND_DEL) {
-        return respond_del(cmd);
+        return respond_del(cmd, payload, length);
     } else if (cmd->type == COMMAND_TTL) {
-        return respond_ttl(cmd);
+        return respond_ttl(cmd, payload, length);
+    } else if (cmd->type == COMMAND_ADD_BATCH) {
+        return respond_add_batch(cmd, payload, length);
+    } else if (cmd->type == COMMAND_DEL_BATCH) {
+        return respond_del_batch(cmd, payload, length);
+    } else if (cmd->type == COMMAND_STATS) {
+        return respond_stats(payload, length);
+    } else if (cmd->type == COMMAND_LATENCY) {
+        return respond_latency(payload, length);
+    } else if (cmd->type == COMMAND_CAPTURE) {
+        return respond_capture(cmd, payload, length);
     } else if (cmd->type == COMMAND_IF_SHOW) {
-        return respond_if_show(cmd);
+        return respond_if_show(&req->config, payload, length);
     } else if (cmd->type == COMMAND_IF_CONFIG) {
-        return respond_if_config(cmd);
+        return respond_if_config(&req->config, payload, length);
     } else if (cmd->type == COMMAND_IF_MTU) {
-        return respond_if_mtu(cmd);
+        return respond_if_mtu(&req->config, payload, length);
     } else {
-        printf("Could not respond request of type %d\n", cmd->type);
-        return nullptr;
+        log_warn("Could not respond request of type %d", cmd->type);
+        return COMMAND_BAD_REQUEST;
     }
 }
 
 /**
  * Configures interface
  *
- * @param pHdr - command header
+ * @param cfg - interface config
+ * @param payload - where response payload is encoded
+ * @param length - response payload length
  *
- * @return - response header
+ * @return - response type
  */
-response_hdr *respond_if_config(command_hdr *pHdr) {
-    printf("=== RESPONDING CONFIG INTERFACES COMMAND ===\n");
-
-    size_t cmd_size = sizeof(command_hdr);
-    auto *cfg = (config_hdr*) (pHdr + 1);
-    auto *res = new response_hdr();
+unsigned short respond_if_config(config_hdr *cfg, unsigned char *payload, size_t *length) {
+    log_debug("=== RESPONDING CONFIG INTERFACES COMMAND ===");
 
     // Find and update iface
     interface_worker *w = find_interface_worker_by_name(cfg->eth, workers, worker_count);
     if(w != nullptr) {
         w->iface_data->ip_addr = cfg->ip;
         w->iface_data->netmask = cfg->mask;
-        res->type = COMMAND_IF_CONFIG;
-    } else {
-        res->type = 0;
+        return COMMAND_IF_CONFIG;
     }
 
-    // Fill header
-    res->len = 0;
-
-    return res;
+    return 0;
 }
 
 /**
- * Builds response header with list of iface entries in table
+ * Builds response with list of iface entries
  *
- * @param cmd - command header
+ * @param cfg - interface config
+ * @param payload - where iface entries are encoded
+ * @param length - response payload length
  *
- * @return - response header with iface entries appended
+ * @return - response type
  */
-response_hdr *respond_if_show(command_hdr *pHdr) {
-    printf("=== RESPONDING SHOW INTERFACES COMMAND ===\n");
+unsigned short respond_if_show(config_hdr *cfg, unsigned char *payload, size_t *length) {
+    log_debug("=== RESPONDING SHOW INTERFACES COMMAND ===");
 
-    // Calculates count and size of entries
+    // Calculates count and size of entries, every interface fits one frame
     auto entry_count = (unsigned int) worker_count;
-    unsigned short entries_size = sizeof(iface) * entry_count;
-    printf("Responding %d entries (%d bytes)\n", entry_count, entries_size);
+    *length = WIRE_IFACE_LEN * entry_count;
+    log_debug("Responding %d entries (%zu bytes)", entry_count, *length);
 
-    // Allocate and populate iface entries
-    iface entries[entry_count];
+    // Encode iface entries in place with current counters
     for (int i = 0; i < entry_count; ++i) {
-        memcpy(&entries[i], workers[i]->iface_data, sizeof(iface));
+        iface ifc = *workers[i]->iface_data;
+        unsigned long long stats[STAT_COUNT];
+        workers[i]->read_stats(stats);
+
+        ifc.rx_pkts = stats[STAT_RX_FRAMES];
+        ifc.rx_bytes = stats[STAT_RX_BYTES];
+        ifc.tx_pkts = stats[STAT_TX_FRAMES];
+        ifc.tx_bytes = stats[STAT_TX_BYTES];
+        ifc.rx_dropped = stats[STAT_KERNEL_DROPS];
+        payload += encode_iface(payload, &ifc);
     }
 
-    // Prepare response data
-    auto *data = new unsigned char[sizeof(response_hdr) + entries_size];
-    auto *res = (response_hdr *) data;
+    return COMMAND_IF_SHOW;
+}
 
-    // Fill header
-    res->type = COMMAND_IF_SHOW;
-    res->len = entries_size;
+/**
+ * Responds counters of every interface
+ *
+ * @param payload - where response payload is encoded
+ * @param length - response payload length
+ *
+ * @return - response type
+ */
+unsigned short respond_stats(unsigned char *payload, size_t *length) {
+    log_debug("=== RESPONDING STATS COMMAND ===");
+
+    auto entry_count = (unsigned int) worker_count;
+    *length = WIRE_STATS_LEN * entry_count;
 
-    // Copy header data
-    memcpy(data + sizeof(response_hdr), entries, entries_size);
+    for (unsigned int i = 0; i < entry_count; ++i) {
+        unsigned long long stats[STAT_COUNT];
+        workers[i]->read_stats(stats);
+
+        payload += encode_stats(payload, workers[i]->iface_data->ifname, stats);
+    }
 
-    return res;
+    return COMMAND_STATS;
 }
 
 /**
- * Updates MTU and responds request
+ * Responds latency percentiles of every interface
  *
- * @param cmd - command header
+ * @param payload - where response payload is encoded
+ * @param length - response payload length
  *
- * @return - response header with iface entries appended
+ * @return - response type
  */
-response_hdr *respond_if_mtu(command_hdr *pHdr) {
-    printf("=== RESPONDING UPDATE MTU COMMAND ===\n");
+unsigned short respond_latency(unsigned char *payload, size_t *length) {
+    log_debug("=== RESPONDING LATENCY COMMAND ===");
+
+    auto entry_count = (unsigned int) worker_count;
+    *length = WIRE_LATENCY_LEN * entry_count;
 
-    size_t cmd_size = sizeof(command_hdr);
-    auto *cfg = (config_hdr*) (pHdr + 1);
-    auto *res = new response_hdr();
+    for (unsigned int i = 0; i < entry_count; ++i) {
+        latency_summary summaries[LATENCY_COUNT];
+        for (int h = 0; h < LATENCY_COUNT; ++h) {
+            workers[i]->latency[h].summarize(&summaries[h]);
+        }
+
+        payload += encode_latency(payload, workers[i]->iface_data->ifname, summaries);
+    }
+
+    return COMMAND_LATENCY;
+}
+
+/**
+ * Starts, stops or reports frame capture
+ *
+ * @param cmd - command with CAPTURE_OP_*
+ * @param payload - where response payload is encoded
+ * @param length - response payload length
+ *
+ * @return - response type
+ */
+unsigned short respond_capture(command_hdr *cmd, unsigned char *payload, size_t *length) {
+    if (cmd->op == CAPTURE_OP_START) {
+        capture_start();
+        log_info("Frame capture started");
+    } else if (cmd->op == CAPTURE_OP_STOP) {
+        capture_stop();
+        log_info("Frame capture stopped");
+    }
+
+    *length = encode_capture_status(payload, capture_active(), capture_written());
+
+    return COMMAND_CAPTURE;
+}
+
+/**
+ * Streams frames ring holds when request arrives, oldest first. Capture keeps running, so
+ * frames overwritten before their chunk is encoded are left out.
+ *
+ * @param server - control server
+ * @param con - connection id
+ * @param req - request
+ */
+void respond_capture_dump(control_server *server, unsigned long long con, request_msg *req) {
+    unsigned int request_id = req->id;
+    unsigned long long cursor = capture_oldest();
+    unsigned long long end = capture_written();
+
+    server->stream(con, [request_id, cursor, end](control_server *srv, unsigned long long id) mutable {
+        unsigned char *data = srv->reserve(id, WIRE_CAPTURE_LEN * CAPTURE_CHUNK_RECORDS);
+        if (data == nullptr) return false;
+
+        capture_record records[CAPTURE_CHUNK_RECORDS];
+        size_t count = capture_read(&cursor, end, records, CAPTURE_CHUNK_RECORDS);
+        for (size_t i = 0; i < count; ++i) encode_capture(data + WIRE_CAPTURE_LEN * i, &records[i]);
+
+        bool more = cursor < end;
+        srv->commit(id, request_id, COMMAND_CAPTURE, WIRE_CAPTURE_LEN * count, more ? FRAME_FLAG_MORE : 0);
+
+        return more;
+    });
+}
+
+/**
+ * Updates MTU and responds request
+ *
+ * @param cfg - interface config, ip field carries MTU
+ * @param payload - where response payload is encoded
+ * @param length - response payload length
+ *
+ * @return - response type
+ */
+unsigned short respond_if_mtu(config_hdr *cfg, unsigned char *payload, size_t *length) {
+    log_debug("=== RESPONDING UPDATE MTU COMMAND ===");
 
     // Find and update iface
     interface_worker *w = find_interface_worker_by_name(cfg->eth, workers, worker_count);
     if(w != nullptr) {
         w->iface_data->mtu = (int) cfg->ip;
-        res->type = COMMAND_IF_MTU;
-    } else {
-        res->type = 0;
+        return COMMAND_IF_MTU;
     }
 
-    // Fill header
-    res->len = 0;
+    return 0;
+}
 
-    return res;
+/**
+ * Streams ARP entries in IP order, one bounded chunk per frame, starting at request cursor.
+ * Chunks are produced only as fast as the connection drains them.
+ *
+ * @param server - control server
+ * @param con - connection id
+ * @param req - request with cursor and limit
+ */
+void respond_show(control_server *server, unsigned long long con, request_msg *req) {
+    log_debug("=== RESPONDING SHOW COMMAND ===");
+
+    unsigned int request_id = req->id;
+    unsigned int cursor = req->cmd.cursor;
+    unsigned int remaining = req->cmd.limit > 0 ? req->cmd.limit : UINT32_MAX;
+
+    server->stream(con, [request_id, cursor, remaining](control_server *srv, unsigned long long id) mutable {
+        // Encode next chunk straight from table into output block
+        size_t want = remaining < SHOW_CHUNK_ENTRIES ? remaining : SHOW_CHUNK_ENTRIES;
+        unsigned char *data = srv->reserve(id, WIRE_SHOW_HDR_LEN + WIRE_ENTRY_LEN * want);
+        if (data == nullptr) return false;
+
+        show_chunk chunk{};
+        bool end;
+        chunk.out = data + WIRE_SHOW_HDR_LEN;
+        size_t count = table->visit_page(cursor, want, encode_show_entry, &chunk, &end);
+        remaining -= count;
+
+        // Table decided under its lock if entries follow, a page ending on the last one is the end
+        end = end || (count > 0 && chunk.last_ip == UINT32_MAX);
+        if (count > 0) cursor = chunk.last_ip + 1;
+        bool more = !end && remaining > 0;
+
+        encode_show_hdr(data, cursor, end);
+        srv->commit(id, request_id, COMMAND_SHOW, WIRE_SHOW_HDR_LEN + WIRE_ENTRY_LEN * count,
+                    more ? FRAME_FLAG_MORE : 0);
+
+        return more;
+    });
 }
 
 /**
- * Builds response header with list of ARP entries in table
+ * Encodes entry into SHOW chunk, runs under table read lock
  *
- * @param cmd - command header
+ * @param entry - table entry
+ * @param ctx - show chunk
+ */
+void encode_show_entry(const arp_table_entry *entry, void *ctx) {
+    auto *chunk = (show_chunk *) ctx;
+
+    chunk->out += encode_entry(chunk->out, entry);
+    chunk->last_ip = entry->ipAddress;
+}
+
+/**
+ * Streams ARP entries matching request predicates, filtering happens under the table lock
+ * so only matches are copied. Walks the IP index for IP prefixes and the MAC index when
+ * the MAC prefix is the narrower one.
  *
- * @return - response header with ARP entries appended
+ * @param server - control server
+ * @param con - connection id
+ * @param req - request with query predicates
  */
-response_hdr *respond_show(command_hdr *cmd) {
-    printf("=== RESPONDING SHOW COMMAND ===\n");
+void respond_query(control_server *server, unsigned long long con, request_msg *req) {
+    log_debug("=== RESPONDING QUERY COMMAND ===");
 
-    // Calculates count and size of entries
-    auto entry_count = (unsigned int) table->count();
-    unsigned short entries_size = sizeof(arp_table_entry) * entry_count;
-    printf("Responding %d entries (%d bytes)\n", entry_count, entries_size);
+    unsigned int request_id = req->id;
+    command_hdr *cmd = &req->cmd;
+    arp_query q{};
 
-    // Allocate and populate ARP entries
-    arp_table_entry entries[entry_count];
-    for (int i = 0; i < entry_count; ++i) {
-        entries[i] = (*table->get((unsigned int) i));
+    // Prefixes to inclusive ranges
+    unsigned int ip_mask = cmd->ip_prefix == 0 ? 0 : UINT32_MAX << (32 - cmd->ip_prefix);
+    q.ip_lo = cmd->ip & ip_mask;
+    q.ip_hi = q.ip_lo | ~ip_mask;
+
+    unsigned long long eth_all = (1ULL << (HW_ADDR_LEN * 8)) - 1;
+    unsigned long long eth_mask = cmd->eth_prefix == 0 ? 0 : (eth_all << (HW_ADDR_LEN * 8 - cmd->eth_prefix)) & eth_all;
+    q.eth_lo = arp_table::eth_key(cmd->eth) & eth_mask;
+    q.eth_hi = q.eth_lo | (~eth_mask & eth_all);
+
+    q.ttl_min = cmd->ttl;
+    q.ttl_max = cmd->ttl_max;
+    q.kinds = cmd->kinds;
+    q.by_eth = cmd->eth_prefix > cmd->ip_prefix;
+
+    arp_query_cursor cursor{};
+
+    server->stream(con, [request_id, q, cursor](control_server *srv, unsigned long long id) mutable {
+        unsigned char *data = srv->reserve(id, WIRE_ENTRY_LEN * SHOW_CHUNK_ENTRIES);
+        if (data == nullptr) return false;
+
+        show_chunk chunk{};
+        chunk.out = data;
+        size_t count = 0;
+
+        // Sparse matches take several bounded lookups to fill a frame
+        for (int i = 0; i < QUERY_SCANS_PER_FRAME && count < SHOW_CHUNK_ENTRIES && !cursor.done; ++i) {
+            count += table->query(&q, &cursor, SHOW_CHUNK_ENTRIES - count, encode_show_entry, &chunk);
+        }
+
+        srv->commit(id, request_id, COMMAND_QUERY, WIRE_ENTRY_LEN * count, cursor.done ? 0 : FRAME_FLAG_MORE);
+
+        return !cursor.done;
+    });
+}
+
+/**
+ * Subscribes connection to table changes. Events are queued by the hub and sent whenever the
+ * connection has drained the previous frame, the stream parks while nothing is queued and
+ * lasts until the connection closes.
+ *
+ * @param server - control server
+ * @param con - connection id
+ * @param req - request
+ */
+void respond_watch(control_server *server, unsigned long long con, request_msg *req) {
+    log_debug("=== RESPONDING WATCH COMMAND ===");
+
+    unsigned int request_id = req->id;
+
+    // Every subscriber holds a ring, their number is bounded
+    watch_subscriber *subscriber = hub->subscribe(con);
+    if (subscriber == nullptr) {
+        log_warn("Refusing WATCH, %d connections are watching", WATCH_SUBSCRIBERS_MAX);
+        server->respond(con, request_id, COMMAND_DENIED, nullptr, 0);
+        return;
     }
 
-    // Prepare response data
-    auto *data = new unsigned char[sizeof(response_hdr) + entries_size];
-    auto *res = (response_hdr *) data;
+    // Subscription ends when connection drops its producer
+    shared_ptr<watch_subscriber> sub(subscriber, [](watch_subscriber *s) { hub->unsubscribe(s); });
+    bool acked = false;
 
-    // Fill header
-    res->type = COMMAND_SHOW;
-    res->len = entries_size;
+    server->stream(con, [request_id, sub, acked](control_server *srv, unsigned long long id) mutable {
+        unsigned char *data = srv->reserve(id, WIRE_WATCH_HDR_LEN + WIRE_EVENT_LEN * WATCH_CHUNK_EVENTS);
+        if (data == nullptr) return false;
 
-    // Copy header data
-    memcpy(data + sizeof(response_hdr), entries, entries_size);
+        unsigned int dropped = 0;
+        size_t count = hub->drain(sub.get(), data + WIRE_WATCH_HDR_LEN, WATCH_CHUNK_EVENTS, &dropped);
 
-    return res;
+        // First frame acknowledges subscription even without events
+        if (count == 0 && dropped == 0 && acked) {
+            srv->idle(id);
+            return true;
+        }
+        acked = true;
+
+        encode_watch_hdr(data, dropped);
+        srv->commit(id, request_id, COMMAND_WATCH, WIRE_WATCH_HDR_LEN + WIRE_EVENT_LEN * count, FRAME_FLAG_MORE);
+
+        return true;
+    });
 }
 
 /**
- * Resolves IP and creates response header with ARP entry appened
+ * Resolves IP and responds with ARP entry once resolution completes
  *
- * @param cmd - command header
+ * @param server - control server
+ * @param con - connection id
+ * @param req - request
+ */
+void respond_res(control_server *server, unsigned long long con, request_msg *req) {
+    log_debug("=== RESPONDING RESOLVE ===");
+
+    // Attach to resolution of this IP, sending a request only if none is in flight
+    unsigned int request_id = req->id;
+    unsigned int timeout = req->cmd.timeout > 0 ? req->cmd.timeout : RESOLVE_TIMEOUT_MS;
+    resolv->resolve_async(req->cmd.ip, timeout, [server, con, request_id](bool found, arp_table_entry *ent) {
+        unsigned char data[WIRE_ENTRY_LEN];
+
+        // Empty payload means IP could not be resolved
+        if(found) {
+            log_debug("Found ARP table entry, responding...");
+            server->respond(con, request_id, COMMAND_RES, data, encode_entry(data, ent));
+        } else {
+            log_info("ARP table entry could not be found");
+            server->respond(con, request_id, COMMAND_RES, nullptr, 0);
+        }
+    });
+}
+
+/**
+ * Resolves every host of request ranges through paced resolutions, each answer is streamed as
+ * it arrives and a final frame reports totals once every host answered or timed out.
+ * Network and broadcast addresses of ranges wider than /31 are skipped.
  *
- * @return - response header with ARP entry appended
- */
-response_hdr *respond_res(command_hdr *cmd) {
-    printf("=== RESPONDING RESOLVE ===\n");
-
-    // Allocate response header
-    auto *data = new char[sizeof(response_hdr) + sizeof(arp_table_entry)];
-    auto *res = (response_hdr*) data;
-    arp_table_entry *ent = nullptr;
-
-    // Find worker that should handle requested IP
-    interface_worker *ifw = find_interface_worker(cmd->ip, workers, worker_count);
-
-    // Check if worker exists
-    if(ifw != nullptr) {
-        // Send resolve request
-        ifw->resolve_ip(cmd->ip);
-
-        // Sleeps x times waiting for resolution
-        // TODO: interruption instead of polling
-        unsigned int sleeps = 0;
-        while (sleeps < RESOLVE_TIMEOUT_MS) {
-            // Check if requested entry is present on table
-            ent = table->find_by_ip(cmd->ip);
-            if (ent != nullptr) {
-                printf("Found entry: ");
-                print_arp_table_entry(ent);
-                break;
-            }
+ * @param server - control server
+ * @param con - connection id
+ * @param req - request with ranges
+ */
+void respond_scan(control_server *server, unsigned long long con, request_msg *req) {
+    log_debug("=== RESPONDING SCAN ===");
+
+    unsigned int request_id = req->id;
+    unsigned int timeout = req->cmd.timeout > 0 ? req->cmd.timeout : RESOLVE_TIMEOUT_MS;
+
+    // Hosts are counted first so no callback can see the sweep finished early
+    vector<unsigned int> hosts;
+    for (unsigned int i = 0; i < req->cmd.item_count; ++i) {
+        unsigned int network;
+        unsigned char prefix;
+        decode_scan_range(req->cmd.items + WIRE_SCAN_RANGE_LEN * i, &network, &prefix);
+
+        unsigned int mask = prefix == 0 ? 0 : UINT32_MAX << (32 - prefix);
+        unsigned int first = network & mask;
+        unsigned int last = first | ~mask;
+        if (prefix < 31) {
+            first++;
+            last--;
+        }
 
-            // Sleep for 10ms
-            usleep(10000);
-            sleeps++;
+        for (unsigned long long ip = first; ip <= last; ++ip) {
+            hosts.push_back((unsigned int) ip);
         }
-    } else {
-        printf("Could not find interface for IP\n");
     }
 
-    // Fill header
-    res->type = COMMAND_RES;
+    auto state = make_shared<scan_state>();
+    state->remaining = (unsigned int) hosts.size();
+    state->answered = 0;
+    state->probed = (unsigned int) hosts.size();
 
-    // Check if response was filled
-    if(ent != nullptr) {
-        printf("Found ARP table entry, responding...\n");
-        res->len = sizeof(arp_table_entry);
-        memcpy(data + sizeof(response_hdr), ent, sizeof(arp_table_entry));
-    } else {
-        printf("ARP table entry could not be found\n");
-        res->len = 0;
+    if (hosts.empty()) {
+        unsigned char data[WIRE_SCAN_DONE_LEN];
+        server->respond(con, request_id, COMMAND_SCAN, data, encode_scan_done(data, 0, 0));
+        return;
     }
-    
-    return res;
-}
 
+    for (unsigned int ip : hosts) {
+        resolv->resolve_async(ip, timeout, [server, con, request_id, state](bool found, arp_table_entry *ent) {
+            unsigned char data[WIRE_ENTRY_LEN];
+
+            // Answer is queued before countdown so it always precedes final frame
+            if (found) {
+                state->answered++;
+                server->respond(con, request_id, COMMAND_SCAN, data, encode_entry(data, ent), FRAME_FLAG_MORE);
+            }
+
+            if (--state->remaining == 0) {
+                server->respond(con, request_id, COMMAND_SCAN, data,
+                                encode_scan_done(data, state->probed, state->answered));
+            }
+        }, true);
+    }
+}
 
 /**
  * Adds new IP to ARP table
  *
  * @param cmd - command header containing IP
+ * @param payload - where response payload is encoded
+ * @param length - response payload length
  *
- * @return - response header
+ * @return - response type
  */
-response_hdr *respond_add(command_hdr *cmd) {
-    printf("=== RESPONDING ADD COMMAND ===\n");
-    auto *res = new response_hdr;
-    auto *ent = new arp_table_entry;
+unsigned short respond_add(command_hdr *cmd, unsigned char *payload, size_t *length) {
+    log_debug("=== RESPONDING ADD COMMAND ===");
+    arp_table_entry ent{};
 
     // Fill ARP entry
-    ent->ipAddress = cmd->ip;
-    memcpy(&ent->ethAddress, &cmd->eth, sizeof(char) * 6);
-    ent->ttl = cmd->ttl;
+    ent.ipAddress = cmd->ip;
+    memcpy(&ent.ethAddress, &cmd->eth, sizeof(char) * 6);
+    ent.ttl = cmd->ttl;
 
     // Debug
-    printf("Added entry: ");
-    print_arp_table_entry(ent);
-    printf("\n");
+    log_info("Added entry: (%s, %s, %u)", log_ip(ent.ipAddress), log_mac(ent.ethAddress), ent.ttl);
 
     // Push to table
     table->add(cmd->ip, cmd->eth, cmd->ttl);
 
-    // Fill response
-    res->type = COMMAND_ADD;
-    res->len = 0;
-
-    return res;
+    return COMMAND_ADD;
 }
 
 /**
  * Removes IP from table
  *
  * @param cmd - command header containing IP to be removed
+ * @param payload - where response payload is encoded
+ * @param length - response payload length
  *
- * @return - response header
+ * @return - response type
  */
-response_hdr *respond_del(command_hdr *cmd) {
-    printf("=== RESPONDING DEL COMMAND ===\n");
-    printf("Deleting IP: %d\n", cmd->ip);
+unsigned short respond_del(command_hdr *cmd, unsigned char *payload, size_t *length) {
+    log_debug("=== RESPONDING DEL COMMAND ===");
+    log_info("Deleting IP: %s", log_ip(cmd->ip));
 
-    // Allocate response header
-    auto *res = new response_hdr;
+    // Try to delete given IP and report if something was modified
+    if(table->remove(cmd->ip)) {
+        return COMMAND_DEL;
+    }
 
-    // Try to delete given IP and store if something was modified
-    bool deleted = table->remove(cmd->ip);
+    return COMMAND_DEL_NOT_FOUND;
+}
 
-    // Set type correctly
-    if(deleted) {
-        res->type = COMMAND_DEL;
-    } else {
-        res->type = COMMAND_DEL_NOT_FOUND;
+/**
+ * Adds or refreshes every entry of batch in one table pass
+ *
+ * @param cmd - command header with encoded entries
+ * @param payload - where response payload is encoded
+ * @param length - response payload length
+ *
+ * @return - response type
+ */
+unsigned short respond_add_batch(command_hdr *cmd, unsigned char *payload, size_t *length) {
+    // Only loop thread decodes batches, scratch keeps its capacity between them
+    static vector<arp_table_entry> entries;
+
+    entries.resize(cmd->item_count);
+    for (unsigned int i = 0; i < cmd->item_count; ++i) {
+        decode_entry(cmd->items + WIRE_ENTRY_LEN * i, &entries[i]);
     }
-    res->len = 0;
 
-    return res;
+    size_t applied = table->add_batch(entries.data(), entries.size());
+    log_info("Batch added %zu of %u entries", applied, cmd->item_count);
+
+    *length = encode_batch_done(payload, (unsigned int) applied);
+    return COMMAND_ADD_BATCH;
+}
+
+/**
+ * Removes every IP of batch in one table pass
+ *
+ * @param cmd - command header with encoded IPs
+ * @param payload - where response payload is encoded
+ * @param length - response payload length
+ *
+ * @return - response type
+ */
+unsigned short respond_del_batch(command_hdr *cmd, unsigned char *payload, size_t *length) {
+    static vector<unsigned int> ips;
+
+    ips.resize(cmd->item_count);
+    for (unsigned int i = 0; i < cmd->item_count; ++i) {
+        ips[i] = decode_batch_ip(cmd->items + WIRE_BATCH_IP_LEN * i);
+    }
+
+    size_t removed = table->remove_batch(ips.data(), ips.size());
+    log_info("Batch removed %zu of %u entries", removed, cmd->item_count);
+
+    *length = encode_batch_done(payload, (unsigned int) removed);
+    return COMMAND_DEL_BATCH;
 }
 
 /**
  * Sets a new TTL
  *
  * @param cmd - command header containing new TTL
+ * @param payload - where response payload is encoded
+ * @param length - response payload length
  *
- * @return - response header
+ * @return - response type
  */
-response_hdr *respond_ttl(command_hdr *cmd) {
-    printf("=== RESPONDING TTL COMMAND ===\n");
-    auto *res = new response_hdr;
+unsigned short respond_ttl(command_hdr *cmd, unsigned char *payload, size_t *length) {
+    log_debug("=== RESPONDING TTL COMMAND ===");
 
     // Update TTL
-    printf("Setting TTL to: %d\n", cmd->ttl);
+    log_info("Setting TTL to: %u", cmd->ttl);
     table->setTtl(cmd->ttl);
 
-    // Set response
-    res->type = COMMAND_TTL;
-    res->len = 0;
+    return COMMAND_TTL;
+}
+
+/**
+ * Writes daemon metrics, every value comes from relaxed atomics or per-thread counters
+ *
+ * @param out - exposition
+ * @param openmetrics - OpenMetrics instead of Prometheus text
+ * @param ctx - unused
+ */
+void render_metrics(string &out, bool openmetrics, void *ctx) {
+    static const char *stat_names[STAT_COUNT] = {
+            "xarpd_rx_frames", "xarpd_rx_bytes", "xarpd_tx_frames", "xarpd_tx_bytes", "xarpd_arp_requests",
+            "xarpd_arp_replies", "xarpd_parse_errors", "xarpd_table_hits", "xarpd_table_misses",
+            "xarpd_replies_sent", "xarpd_kernel_packets", "xarpd_kernel_drops"};
+    static const char *stat_help[STAT_COUNT] = {
+            "Frames received", "Bytes received", "Frames sent", "Bytes sent", "ARP requests received",
+            "ARP replies received", "Frames that failed to parse", "Requests answered from table",
+            "Requests for addresses not in table", "ARP replies sent", "Packets seen by kernel socket",
+            "Packets dropped by kernel before being read"};
+    static const char *command_names[METRICS_COMMANDS] = {
+            "unknown", "show", "res", "add", "del", "ttl", "unknown", "if_show", "if_config", "if_mtu", "unknown",
+            "unknown", "query", "watch", "scan", "add_batch", "del_batch", "stats", "latency", "capture"};
+    const string none;
+    char name[64];
+
+    // Table size and changes
+    table_counters tc{};
+    table->read_counters(&tc);
+    metrics_family(out, openmetrics, "xarpd_table_entries", "gauge", "Entries in ARP table");
+    metrics_sample(out, "xarpd_table_entries", none, tc.entries);
+    metrics_family(out, openmetrics, "xarpd_table_insertions", "counter", "Entries added to table");
+    metrics_sample(out, "xarpd_table_insertions_total", none, tc.added);
+    metrics_family(out, openmetrics, "xarpd_table_updates", "counter", "Entries whose address or TTL changed");
+    metrics_sample(out, "xarpd_table_updates_total", none, tc.updated);
+    metrics_family(out, openmetrics, "xarpd_table_expirations", "counter", "Entries removed when TTL ran out");
+    metrics_sample(out, "xarpd_table_expirations_total", none, tc.expired);
+    metrics_family(out, openmetrics, "xarpd_table_evictions", "counter", "Entries removed by DEL or DEL_BATCH");
+    metrics_sample(out, "xarpd_table_evictions_total", none, tc.deleted);
+
+    // Interface counters, one family per counter
+    vector<string> labels((size_t) worker_count);
+    vector<array<unsigned long long, STAT_COUNT>> stats((size_t) worker_count);
+    for (int i = 0; i < worker_count; ++i) {
+        metrics_label(labels[i], "interface", workers[i]->iface_data->ifname);
+        workers[i]->read_stats(stats[i].data());
+    }
+    for (int s = 0; s < STAT_COUNT; ++s) {
+        metrics_family(out, openmetrics, stat_names[s], "counter", stat_help[s]);
+        snprintf(name, sizeof(name), "%s_total", stat_names[s]);
+        for (int i = 0; i < worker_count; ++i) metrics_sample(out, name, labels[i], stats[i][s]);
+    }
+
+    // Latency histograms
+    metrics_family(out, openmetrics, "xarpd_reply_latency_seconds", "histogram",
+                   "Time from request received to reply sent");
+    for (int i = 0; i < worker_count; ++i) {
+        render_histogram(out, "xarpd_reply_latency_seconds", labels[i], &workers[i]->latency[LATENCY_REPLY]);
+    }
+    metrics_family(out, openmetrics, "xarpd_resolve_latency_seconds", "histogram",
+                   "Time from first request sent to address learned");
+    for (int i = 0; i < worker_count; ++i) {
+        render_histogram(out, "xarpd_resolve_latency_seconds", labels[i], &workers[i]->latency[LATENCY_RESOLVE]);
+    }
+
+    // Control plane
+    metrics_family(out, openmetrics, "xarpd_control_requests", "counter", "Control requests by command");
+    for (int t = 1; t < METRICS_COMMANDS; ++t) {
+        // Response-only types are never requested
+        if (strcmp(command_names[t], "unknown") == 0) continue;
 
-    return res;
-}
\ No newline at end of file
+        string command;
+        metrics_label(command, "command", command_names[t]);
+        metrics_sample(out, "xarpd_control_requests_total", command, control_requests[t].load(memory_order_relaxed));
+    }
+    metrics_family(out, openmetrics, "xarpd_control_denied", "counter", "Control requests refused to peer");
+    metrics_sample(out, "xarpd_control_denied_total", none, control_denied.load(memory_order_relaxed));
+}
+
+/**
+ * Writes cumulative buckets, sum and count of one histogram in seconds
+ *
+ * @param out - exposition
+ * @param name - family name
+ * @param labels - labels of histogram
+ * @param h - histogram
+ */
+void render_histogram(string &out, const char *name, const string &labels, histogram *h) {
+    unsigned long long below[METRICS_BUCKETS];
+    unsigned long long sum;
+    unsigned long long count = h->below_powers(METRICS_FIRST_BITS, METRICS_BUCKETS, below, &sum);
+    string sample = string(name) + "_bucket";
+    char le[32];
+
+    for (int b = 0; b < METRICS_BUCKETS; ++b) {
+        snprintf(le, sizeof(le), "%.9g", (double) (1ull << (METRICS_FIRST_BITS + b)) / 1e9);
+
+        string bucket_labels = labels;
+        metrics_label(bucket_labels, "le", le);
+        metrics_sample(out, sample.c_str(), bucket_labels, below[b]);
+    }
+
+    string inf_labels = labels;
+    metrics_label(inf_labels, "le", "+Inf");
+    metrics_sample(out, sample.c_str(), inf_labels, count);
+    metrics_sample(out, (string(name) + "_sum").c_str(), labels, (double) sum / 1e9);
+    metrics_sample(out, (string(name) + "_count").c_str(), labels, count);
+}
+
+/**
+ * Creates pcap replay backend of an interface
+ *
+ * @param ifname - interface name
+ * @param ctx - replay_spec
+ *
+ * @return - backend with a locally administered MAC, address 0 unless configured
+ */
+packet_io *replay_io(const string &ifname, void *ctx) {
+    auto *spec = (replay_spec *) ctx;
+    unsigned char mac[HW_ADDR_LEN] = {0x02, 0, 0, 0, 0, ++spec->created};
+
+    // Interfaces do not share an output file
+    string out_path = spec->out_path;
+    if (!out_path.empty() && spec->interfaces > 1) out_path += "." + ifname;
+
+    printf("Replaying %s on %s\n", spec->in_path.c_str(), ifname.c_str());
+    return new pcap_replay_io(spec->in_path, mac, 0, 0, out_path);
+}
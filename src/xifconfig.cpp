@@ -1,26 +1,16 @@
 #include <iostream>
 #include <sys/socket.h>
 #include <sys/types.h>
-#include <netinet/in.h>
 #include <string.h>
 #include <unistd.h>
-#include <arpa/inet.h>
 #include "../inc/types.h"
 #include "../inc/utils.h"
-
-/*
- * Socket
- */
-void build_socket();
-
-void connect();
+#include "../inc/control_client.h"
 
 /*
  * Commands
  */
 
-void send_command(command_hdr *cmd);
-
 void send_if_show();
 
 void send_if_config(char ifn[MAX_IFNAME_LEN], unsigned int ip, unsigned int mask);
@@ -30,17 +20,12 @@ void send_if_mtu(char ifn[MAX_IFNAME_LEN], int mtu);
 /*
  * Utils
  */
-command_hdr *get_fresh_cmd();
+unsigned short await_response(const command_hdr *cmd, const config_hdr *config, string &payload);
 
 /*
  * Variables
  */
-int listenFd;
-sockaddr_in addr{};
-unsigned short port = 5050;
-unsigned int buffer_size = 1024 * 64;
-unsigned int received_bytes;
-unsigned char *buffer;
+control_client *client;
 
 int main(int argc, char **args) {
     printf("Commands:\n"
@@ -49,15 +34,9 @@ int main(int argc, char **args) {
            "3. xifconfig <interface> <mtu>\n\n\n");
 
     /*
-     * Prepare socket
+     * Connect to daemon
      */
-    build_socket();
-    connect();
-
-    /*
-     * Boot
-     */
-    buffer = new unsigned char[buffer_size];
+    client = new control_client();
 
     /**
      * Call function according to arguments
@@ -76,161 +55,110 @@ int main(int argc, char **args) {
 
         send_if_mtu(name, mtu);
     }
+
+    delete client;
 }
 
 /**
  * Send show command
  */
 void send_if_show() {
-    // Get new command
-    auto cmd = get_fresh_cmd();
+    command_hdr cmd{};
+    string payload;
 
     // Set command to show
-    cmd->type = COMMAND_IF_SHOW;
-
-    // Send command
-    send_command(cmd);
+    cmd.type = COMMAND_IF_SHOW;
 
     // Receive response
-    if ((received_bytes = (unsigned int) recv(listenFd, buffer, buffer_size, 0)) > 0) {
-        auto *res = (response_hdr *) buffer;
-        unsigned int entry_count = res->len / sizeof(iface);
-//        printf("Response received: %d with %d bytes (raw: %d)\n", res->type, res->len, received_bytes);
-//        printf("Received %d interface entries\n", entry_count);
+    if (await_response(&cmd, nullptr, payload) == COMMAND_IF_SHOW) {
+        size_t entry_count = payload.size() / WIRE_IFACE_LEN;
 
-        // Print each ARP entry
-        for (int i = 0; i < entry_count; ++i) {
-            auto *ent = (iface *) (buffer + sizeof(response_hdr) + (sizeof(iface) * i));
+        // Print each interface
+        for (size_t i = 0; i < entry_count; ++i) {
+            iface ent{};
+            decode_iface((const unsigned char *) payload.data() + WIRE_IFACE_LEN * i, &ent);
 
-            print_iface(ent);
+            print_iface(&ent);
         }
-
     }
 }
 
 /**
- * Send TTL update command
+ * Send interface address update command
  *
- * @param ttl - update ttl
+ * @param ifn - interface name
+ * @param ip - new address
+ * @param mask - new netmask
  */
 void send_if_config(char ifn[MAX_IFNAME_LEN], unsigned int ip, unsigned int mask) {
-    // Allocate memory
-    auto cmd = get_fresh_cmd();
-    auto config = new config_hdr;
-    unsigned char data[sizeof(command_hdr) + sizeof(config_hdr)];
+    command_hdr cmd{};
+    config_hdr config{};
+    string payload;
 
     // Set config
-    memcpy(&config->eth, ifn, strlen(ifn) + 1);
-    config->ip = ip;
-    config->mask = mask;
-    config->length = 0;
-
-    // Set command to TTL
-    cmd->type = COMMAND_IF_CONFIG;
-
-    memcpy(data, cmd, sizeof(command_hdr));
-    memcpy(data + sizeof(command_hdr), config, sizeof(config_hdr));
-
-    // Send data
-    sendto(listenFd, data, sizeof(command_hdr) + sizeof(config_hdr), 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in));
-
-    // Receive response
-    if ((received_bytes = (unsigned int) recv(listenFd, buffer, buffer_size, 0)) > 0) {
-        auto *res = (response_hdr *) buffer;
-//        printf("Response received: %d with %d bytes (raw: %d)\n", res->type, res->len, received_bytes);
-
-        // Feedback user
-        if (res->type == COMMAND_IF_CONFIG) {
-            printf("Interface configured successfully!\n");
-        } else {
-            printf("ERROR setting updating interface\n");
-        }
+    strncpy(config.eth, ifn, MAX_IFNAME_LEN);
+    config.ip = ip;
+    config.mask = mask;
+
+    // Set command to config
+    cmd.type = COMMAND_IF_CONFIG;
+
+    // Feedback user
+    unsigned short type = await_response(&cmd, &config, payload);
+    if (type == COMMAND_IF_CONFIG) {
+        printf("Interface configured successfully!\n");
+    } else if (type == COMMAND_DENIED) {
+        printf("Permission denied\n");
+    } else {
+        printf("ERROR setting updating interface\n");
     }
 }
 
 /**
- * Send delete command
+ * Send MTU update command
  *
- * @param ip - ip to delete
+ * @param ifn - interface name
+ * @param mtu - new MTU
  */
 void send_if_mtu(char ifn[MAX_IFNAME_LEN], int mtu) {
-    // Allocate memory
-    auto cmd = get_fresh_cmd();
-    auto config = new config_hdr;
-    unsigned char data[sizeof(command_hdr) + sizeof(config_hdr)];
-
-    // Set config
-    memcpy(&config->eth, ifn, strlen(ifn) + 1);
-    config->ip = (unsigned int) mtu;
-    config->mask = 0;
-    config->length = 0;
-
-    // Set command to TTL
-    cmd->type = COMMAND_IF_MTU;
-
-    memcpy(data, cmd, sizeof(command_hdr));
-    memcpy(data + sizeof(command_hdr), config, sizeof(config_hdr));
-
-    // Send data
-    sendto(listenFd, data, sizeof(command_hdr) + sizeof(config_hdr), 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in));
-
-    // Receive response
-    if ((received_bytes = (unsigned int) recv(listenFd, buffer, buffer_size, 0)) > 0) {
-        auto *res = (response_hdr *) buffer;
-//        printf("Response received: %d with %d bytes (raw: %d)\n", res->type, res->len, received_bytes);
-
-        // Feedback user
-        if (res->type == COMMAND_IF_MTU) {
-            printf("MTU updated successfully!\n");
-        } else {
-            printf("ERROR setting new MTU\n");
-        }
+    command_hdr cmd{};
+    config_hdr config{};
+    string payload;
+
+    // Set config, MTU travels in ip field
+    strncpy(config.eth, ifn, MAX_IFNAME_LEN);
+    config.ip = (unsigned int) mtu;
+
+    // Set command to MTU
+    cmd.type = COMMAND_IF_MTU;
+
+    // Feedback user
+    unsigned short type = await_response(&cmd, &config, payload);
+    if (type == COMMAND_IF_MTU) {
+        printf("MTU updated successfully!\n");
+    } else if (type == COMMAND_DENIED) {
+        printf("Permission denied\n");
+    } else {
+        printf("ERROR setting new MTU\n");
     }
 }
 
 /**
- * Send command header to daemon
+ * Send single command and wait for its response
  *
- * @param cmd - command header to send
- */
-void send_command(command_hdr *cmd) {
-    // Send command header to daemon
-    sendto(listenFd, cmd, sizeof(command_hdr), 0, (struct sockaddr *) &addr, sizeof(struct sockaddr_in));
-}
-
-/**
- * Build a new command header
+ * @param cmd - command to send
+ * @param config - interface config, nullptr when command has none
+ * @param payload - response payload
  *
- * @return - zero filled command header
+ * @return - response type, 0 if daemon closed connection
  */
-command_hdr *get_fresh_cmd() {
-    auto *cmd = new command_hdr;
+unsigned short await_response(const command_hdr *cmd, const config_hdr *config, string &payload) {
+    frame_hdr hdr{};
+    unsigned int id = client->request(cmd, config);
 
-    // Reset structure
-    memset(cmd, '\0', sizeof(command_hdr));
-
-    return cmd;
-}
-
-/**
- * Connect to daemon
- */
-void connect() {
-    // Connect socket
-    if (connect(listenFd, (struct sockaddr *) &addr, sizeof(struct sockaddr_in)) < 0) {
-        perror("ERROR connecting to socket");
-        exit(errno);
+    while (client->receive(&hdr, payload)) {
+        if (hdr.request_id == id) return hdr.type;
     }
-}
 
-/**
- * Build socket to daemon
- */
-void build_socket() {
-    listenFd = socket(AF_INET, SOCK_STREAM, 0);
-
-    // Set address configurations
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-}
\ No newline at end of file
+    return 0;
+}